@@ -0,0 +1,1116 @@
+/*!*******************************************************************
+ * bench.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * Benchmarks for the Monte-Carlo kernels.
+ *
+ * This is the reference for judging performance changes. It times
+ * each kernel on its own (`cyl_dist`, `u_cc`, `move_cyl`, `u_i` with
+ * every pair potential, `du`,
+ * `cyl_list_move`, `state_uniform_initialize` and their batched,
+ * tabulated, cell sorted and neighbor list variants), and then runs
+ * whole sweeps across system size, packing fraction and aspect ratio
+ * (also with the incremental observables attached),
+ * across the subdivision of the buckets, and with the cylinders
+ * scattered over memory or sorted by bucket. It times the
+ * initializers from 10^4 cylinders up to `n_max`. Finally it compares
+ * how fast Metropolis sweeps and event chains decorrelate the total
+ * energy in a periodic box, checks a `CYL_FLOAT` build against a
+ * `double` one, and times a mixture of short and long rods with one
+ * grid and with a grid per size class.
+ *
+ * Build and run with
+ *
+ *     gcc -std=gnu99 -O2 -march=native -pthread -o bench bench.c \
+ *         montecarlo.c manybody.c sweep.c cellstore.c cylbatch.c \
+ *         nlist.c ljtable.c ecmc.c lennardjones.c cylinders.c \
+ *         distributions.c observe.c rsa.c movebatch.c mixture.c rng.c -lm
+ *     ./bench [kernels|scale|sub|order|init|ecmc|prec|mix|all] [n_max] [nthreads] [ref]
+ *
+ * Adding `-DCYL_FLOAT` stores the coordinates in single precision
+ * (see vecs.h). To validate it, run `prec` with the same `ref` file
+ * name first from the `double` build, which writes the reference, and
+ * then from the `float` build, which compares against it (see
+ * `bench_precision`).
+ *
+ * Adding `-DU_CC_COUNT` to the compile line also prints how the pairs
+ * were settled by the broad phase of `u_cc` to stderr at the end.
+ *
+ * The default is `all` with `n_max` = 100000 and 1 thread. The scaling
+ * runs go through n = 10^3, 10^4, ... up to `n_max` (10^7 needs
+ * several GB of memory), and the ordering runs use `n_max` cylinders.
+ *
+ * The output is one comma separated line per measurement, after a
+ * header line, with the columns
+ * + `name` the kernel or run
+ * + `n`, `phi`, `aspect` the number of cylinders, the packing
+ *   fraction and the length to diameter ratio
+ * + `threads` number of threads
+ * + `ops` number of calls (or trial moves for sweeps, or effectively
+ *   independent samples for the decorrelation runs)
+ * + `seconds` total time
+ * + `ns_per_op` time per call (or per trial move, or per independent
+ *   sample)
+ * + `pairs_per_s` pair energies evaluated per second, estimated from
+ *   the mean number of cylinders in the bucket stencil (0 when
+ *   it does not apply)
+ * + `bytes` memory used by the state (and extra structures)
+ * + `max_rss_kb` peak resident memory of the process so far
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "math_const.h"
+#include "vecs.h"
+#include "rng.h"
+#include "distributions.h"
+#include "lennardjones.h"
+#include "ljtable.h"
+#include "cylinders.h"
+#include "manybody.h"
+#include "cellstore.h"
+#include "cylbatch.h"
+#include "nlist.h"
+#include "montecarlo.h"
+#include "sweep.h"
+#include "ecmc.h"
+#include "observe.h"
+#include "rsa.h"
+#include "movebatch.h"
+#include "mixture.h"
+
+#define NPAIR 1024
+
+/*!
+ * Result sink, so the compiler can not drop the timed loops.
+ */
+static volatile double bench_sink;
+
+/*!
+ * Wall clock time in seconds.
+ */
+static double bench_time(){
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1.0e-9*ts.tv_nsec;
+}
+
+/*!
+ * Peak resident memory in kB.
+ */
+static long bench_rss(){
+	struct rusage ru;
+	getrusage( RUSAGE_SELF, &ru);
+	return ru.ru_maxrss;
+}
+
+/*!
+ * Print one line of results.
+ */
+static void bench_print( const char *name, state *s, int nthreads, long ops,
+						 double sec, double pairs, size_t bytes){
+	double phi = 0., aspect = 0.;
+	int n = 0;
+	if( s != NULL ){
+		n = s->n;
+		phi = n*PI*s->cp.r*s->cp.r*s->cp.l/(s->box.x*s->box.y*s->box.z);
+		aspect = s->cp.l/(2.*s->cp.r);
+	}
+	fprintf( stdout, "%s,%d,%.4f,%.2f,%d,%ld,%.6e,%.3f,%.6e,%zu,%ld\n",
+			 name, n, phi, aspect, nthreads, ops, sec, 1.0e9*sec/ops,
+			 pairs/sec, bytes, bench_rss());
+	fflush( stdout);
+}
+
+/*!
+ * Memory used by a state.
+ */
+static size_t bench_state_bytes( state *s){
+	size_t nb = s->nbx * s->nby * s->nbz;
+	return sizeof(state) + s->n*(sizeof(cyl_ll) + sizeof(double)) + nb*sizeof(cyl_ll *) +
+		(2*s->sub+1)*(s->nbx + s->nby + s->nbz)*sizeof(int) + 3*NBR_MAX*sizeof(int);
+}
+
+/*!
+ * Mean number of cylinders in the bucket stencil.
+ *
+ * This is the number of pair energies in one call to `u_i`.
+ */
+static double bench_neighborhood( state *s){
+	int t, l, cnt, nn, nbr[NBR_MAX];
+	long tot = 0;
+	cyl_ll *cur;
+	int step = (s->n > 1000)?s->n/1000:1;
+	cnt = 0;
+	for( l=0; l<s->n; l+=step){
+		nn = state_neighbors( s, s->a[l].bucket, nbr);
+		for( t=0; t<nn; t++){
+			for( cur = s->heads[nbr[t]]; cur != NULL; cur = cur->next){
+				tot++;
+			}
+		}
+		cnt++;
+	}
+	return ((double) tot)/cnt - 1.;
+}
+
+/*!
+ * Allocate a state without placing the cylinders.
+ *
+ * The cylinders have length 1 and radius `0.5/aspect`, and the cubic
+ * box is sized to give packing fraction `phi`, but is never smaller
+ * than two buckets across.
+ */
+static state* bench_state_malloc( int n, double phi, double aspect){
+	cyl_params cp;
+	vec3 box;
+	double side, bucket;
+	cp.l = 1.;
+	cp.r = 0.5/aspect;
+	side = cbrt( n*PI*cp.r*cp.r*cp.l/phi);
+	bucket = 2.*(LJ_RMAX*cp.r + cp.l);
+	side = max( side, 2.*bucket);
+	box.x = side; box.y = side; box.z = side;
+	return state_malloc( cp, box, n);
+}
+
+/*!
+ * Set up a state.
+ *
+ * The box is as for `bench_state_malloc`. It is periodic if `periodic`
+ * is set, and the buckets are `1/sub` of the interaction range.
+ * Returns `NULL` if the cylinders do not fit on the starting lattice.
+ */
+static state* bench_state( int n, double phi, double aspect, int periodic, int sub){
+	state *s;
+	s = bench_state_malloc( n, phi, aspect);
+	if( s == NULL ){
+		return NULL;
+	}
+	if( (periodic && !state_set_periodic( s, 1)) || !state_set_subdivision( s, sub) ||
+		!state_uniform_initialize( s) ){
+		state_free( s);
+		return NULL;
+	}
+	return s;
+}
+
+/*!
+ * Random pairs of nearby cylinders for the pair kernels.
+ */
+static void bench_pairs( cyl *c0, cyl *c1, double r, rng *g){
+	int i;
+	for( i=0; i<NPAIR; i++){
+		c0[i].p = vec3_smul( rand_ball( g), 1.5);
+		c0[i].d = rand_ball( g);
+		vec3_smulto( &(c0[i].d), 1./vec3_mag( c0[i].d));
+		c0[i].r = r;
+		c1[i].p = vec3_smul( rand_ball( g), 1.5);
+		c1[i].d = rand_ball( g);
+		vec3_smulto( &(c1[i].d), 1./vec3_mag( c1[i].d));
+		c1[i].r = r;
+	}
+}
+
+/*!
+ * Time the pair kernels.
+ */
+static void bench_pair_kernels( int reps){
+	cyl c0[NPAIR], c1[NPAIR];
+	coord px[NPAIR], py[NPAIR], pz[NPAIR], dx[NPAIR], dy[NPAIR], dz[NPAIR];
+	double dist2[NPAIR], sep2[NPAIR];
+	cyl_batch b = { px, py, pz, dx, dy, dz};
+	pair_tables *pt;
+	double t0, u;
+	int i, k;
+	rng g;
+
+	rng_seed( &g, 1);
+	bench_pairs( c0, c1, 0.1, &g);
+	for( i=0; i<NPAIR; i++){
+		px[i] = c1[i].p.x; py[i] = c1[i].p.y; pz[i] = c1[i].p.z;
+		dx[i] = c1[i].d.x; dy[i] = c1[i].d.y; dz[i] = c1[i].d.z;
+	}
+
+	u = 0.;
+	t0 = bench_time();
+	for( k=0; k<reps; k++){
+		for( i=0; i<NPAIR; i++){
+			u += cyl_dist( c0[i], c1[i]);
+		}
+	}
+	t0 = bench_time() - t0;
+	bench_sink = u;
+	bench_print( "cyl_dist", NULL, 1, (long) reps*NPAIR, t0, (double) reps*NPAIR, 0);
+
+	u = 0.;
+	t0 = bench_time();
+	for( k=0; k<reps; k++){
+		cyl_dist2_batch( c0[k%NPAIR], b, NPAIR, dist2, sep2);
+		u += dist2[k%NPAIR];
+	}
+	t0 = bench_time() - t0;
+	bench_sink = u;
+	bench_print( "cyl_dist2_batch", NULL, 1, (long) reps*NPAIR, t0, (double) reps*NPAIR, 0);
+
+	u = 0.;
+	t0 = bench_time();
+	for( k=0; k<reps; k++){
+		for( i=0; i<NPAIR; i++){
+			u += u_cc( c0[i], c1[i]);
+		}
+	}
+	t0 = bench_time() - t0;
+	bench_sink = u;
+	bench_print( "u_cc", NULL, 1, (long) reps*NPAIR, t0, (double) reps*NPAIR, 0);
+
+	pt = pair_tables_malloc( 0.1, 4096);
+	if( pt != NULL ){
+		u = 0.;
+		t0 = bench_time();
+		for( k=0; k<reps; k++){
+			for( i=0; i<NPAIR; i++){
+				u += u_cc_tab( pt, c0[i], c1[i]);
+			}
+		}
+		t0 = bench_time() - t0;
+		bench_sink = u;
+		bench_print( "u_cc_tab", NULL, 1, (long) reps*NPAIR, t0, (double) reps*NPAIR,
+					 2*4*4096*sizeof(double));
+		pair_tables_free( pt);
+	}
+}
+
+/*!
+ * Time making trial moves, one at a time with `move_cyl` and from a
+ * batch with `move_batch_next`.
+ */
+static void bench_move_kernels( int reps){
+	cyl c[NPAIR], c1[NPAIR];
+	move_batch *mb;
+	double t0, u;
+	int i, k;
+	rng g;
+
+	rng_seed( &g, 3);
+	bench_pairs( c, c1, 0.1, &g);
+
+	u = 0.;
+	t0 = bench_time();
+	for( k=0; k<reps; k++){
+		for( i=0; i<NPAIR; i++){
+			u += move_cyl( c[i], &g).d.z;
+		}
+	}
+	t0 = bench_time() - t0;
+	bench_sink = u;
+	bench_print( "move_cyl", NULL, 1, (long) reps*NPAIR, t0, 0., 0);
+
+	mb = move_batch_malloc( 2048, PI_6);
+	if( mb == NULL ){
+		return;
+	}
+	u = 0.;
+	t0 = bench_time();
+	for( k=0; k<reps; k++){
+		for( i=0; i<NPAIR; i++){
+			u += move_batch_next( mb, c[i], &g).d.z;
+		}
+	}
+	t0 = bench_time() - t0;
+	bench_sink = u;
+	bench_print( "move_batch_next", NULL, 1, (long) reps*NPAIR, t0, 0., 6*2048*sizeof(double));
+	move_batch_free( mb);
+}
+
+/*!
+ * Time the many body kernels on a state.
+ */
+static void bench_state_kernels( int n, double phi, double aspect){
+	const char *pot_names[POT_COUNT] = { "u_i_default", "u_i_centre", "u_i_closest",
+										 "u_i_kihara", "u_i_hard"};
+	state *s;
+	cell_store *cs;
+	pair_tables *pt;
+	nlist *nl;
+	double t0, u, nbr;
+	long ops;
+	int i, l, k, ls[2];
+	cyl c;
+	vec3 p_old, ps[2];
+	rng g;
+
+	t0 = bench_time();
+	s = bench_state( n, phi, aspect, 0, 1);
+	t0 = bench_time() - t0;
+	if( s == NULL ){
+		fprintf( stderr, "bench: could not set up n=%d phi=%g aspect=%g\n", n, phi, aspect);
+		return;
+	}
+	bench_print( "state_uniform_initialize", s, 1, 1, t0, 0., bench_state_bytes( s));
+
+	rng_seed( &g, 2);
+	nbr = bench_neighborhood( s);
+	ops = max( 10000, 1000000/(long) (nbr+1.));
+
+	u = 0.;
+	t0 = bench_time();
+	for( i=0; i<ops; i++){
+		l = rng_below( &g, s->n);
+		u += u_i( s, l, s->a[l].c);
+	}
+	t0 = bench_time() - t0;
+	bench_sink = u;
+	bench_print( "u_i", s, 1, ops, t0, ops*nbr, bench_state_bytes( s));
+
+	/* the same for every pair potential the build allows */
+	for( k=0; k<POT_COUNT; k++){
+		if( !mc_set_potential( s, k) ){
+			continue;
+		}
+		u = 0.;
+		t0 = bench_time();
+		for( i=0; i<ops; i++){
+			l = rng_below( &g, s->n);
+			u += u_i( s, l, s->a[l].c);
+		}
+		t0 = bench_time() - t0;
+		bench_sink = u;
+		bench_print( pot_names[k], s, 1, ops, t0, ops*nbr, bench_state_bytes( s));
+	}
+	mc_set_potential( s, POT_DEFAULT);
+
+	t0 = bench_time();
+	state_energy( s);
+	t0 = bench_time() - t0;
+	bench_print( "state_energy", s, 1, s->n, t0, s->n*nbr, bench_state_bytes( s));
+
+	u = 0.;
+	t0 = bench_time();
+	for( i=0; i<ops; i++){
+		l = rng_below( &g, s->n);
+		c = move_cyl( s->a[l].c, &g);
+		if( cyl_box_overlap( c, s->box) ){
+			u += du( s, l, c);
+		}
+	}
+	t0 = bench_time() - t0;
+	bench_sink = u;
+	bench_print( "du", s, 1, ops, t0, ops*nbr, bench_state_bytes( s));
+
+	/* same trial moves, decided with early rejection at beta = 1 */
+	k = 0;
+	t0 = bench_time();
+	for( i=0; i<ops; i++){
+		l = rng_below( &g, s->n);
+		c = move_cyl( s->a[l].c, &g);
+		if( cyl_box_overlap( c, s->box) ){
+			k += mc_try( s, NULL, l, c, 1., &g);
+		}
+	}
+	t0 = bench_time() - t0;
+	bench_sink = k;
+	bench_print( "mc_try", s, 1, ops, t0, ops*nbr, bench_state_bytes( s));
+
+	/* move a cylinder one bucket over and back */
+	t0 = bench_time();
+	for( i=0; i<ops; i++){
+		l = rng_below( &g, s->n);
+		p_old = s->a[l].c.p;
+		c = s->a[l].c;
+		c.p.x += (c.p.x < 0.5*s->box.x)?s->bucket.x:-s->bucket.x;
+		cyl_list_move( s, l, c.p);
+		cyl_list_move( s, l, p_old);
+	}
+	t0 = bench_time() - t0;
+	bench_print( "cyl_list_move", s, 1, 2*ops, t0, 0., bench_state_bytes( s));
+
+	/* the same moves, 2 at a time through the batch interface */
+	t0 = bench_time();
+	for( i=0; i<ops; i++){
+		ls[0] = rng_below( &g, s->n);
+		ls[1] = ls[0];
+		ps[1] = s->a[ls[0]].c.p;
+		ps[0] = ps[1];
+		ps[0].x += (ps[0].x < 0.5*s->box.x)?s->bucket.x:-s->bucket.x;
+		cyl_list_move_batch( s, 2, ls, ps);
+	}
+	t0 = bench_time() - t0;
+	bench_print( "cyl_list_move_batch", s, 1, 2*ops, t0, 0., bench_state_bytes( s));
+
+	cs = cell_store_malloc( s->cp, s->box, s->n);
+	pt = pair_tables_malloc( s->cp.r, 4096);
+	if( cs != NULL && pt != NULL && cell_store_load( cs, s) ){
+		u = 0.;
+		t0 = bench_time();
+		for( i=0; i<ops; i++){
+			l = rng_below( &g, s->n);
+			u += cs_u_i( cs, pt, l, s->a[l].c);
+		}
+		t0 = bench_time() - t0;
+		bench_sink = u;
+		bench_print( "cs_u_i", s, 1, ops, t0, ops*nbr,
+					 cs->size*(7*sizeof(double) + sizeof(int)) + s->n*sizeof(int));
+	}
+	if( pt != NULL ){
+		pair_tables_free( pt);
+	}
+	if( cs != NULL ){
+		cell_store_free( cs);
+	}
+
+	nl = nlist_malloc( s, min( 0.3*s->cp.l, nlist_max_skin( s)));
+	if( nl != NULL ){
+		t0 = bench_time();
+		nlist_build( nl, s);
+		t0 = bench_time() - t0;
+		bench_print( "nlist_build", s, 1, s->n, t0, s->n*nbr,
+					 nl->size*sizeof(int) + s->n*(sizeof(int) + 2*sizeof(vec3)));
+		u = 0.;
+		t0 = bench_time();
+		for( i=0; i<ops; i++){
+			l = rng_below( &g, s->n);
+			u += u_i_nlist( s, nl, l, s->a[l].c);
+		}
+		t0 = bench_time() - t0;
+		bench_sink = u;
+		bench_print( "u_i_nlist", s, 1, ops, t0, ops*nlist_mean( nl),
+					 nl->size*sizeof(int) + s->n*(sizeof(int) + 2*sizeof(vec3)));
+		nlist_free( nl);
+	}
+
+	state_free( s);
+}
+
+/*!
+ * Time whole sweeps.
+ *
+ * Runs enough sweeps for about 2x10^7 pair energies (at least 1),
+ * with and without neighbor lists, and with the observables of
+ * observe.c attached and sampled after every sweep. For the last the
+ * full recomputation of the observables is timed as well.
+ */
+static void bench_sweeps( int n, double phi, double aspect, int nthreads){
+	sweep_params sp = { 1., 1, 0, 3, 0., 0, 0};
+	observe_params op = { 0., 100, 0};
+	const char *names[3] = { "sweep", "sweep_nlist", "sweep_observe"};
+	sweep_stats st0, st;
+	sweeper *sw;
+	observables *o;
+	state *s;
+	double t0, nbr;
+	int k, nsweeps, v;
+
+	sp.nthreads = nthreads;
+	sp.serial_moves = n/100;
+	for( v=0; v<3; v++){
+		s = bench_state( n, phi, aspect, 0, 1);
+		if( s == NULL ){
+			fprintf( stderr, "bench: could not set up n=%d phi=%g aspect=%g\n", n, phi, aspect);
+			return;
+		}
+		nbr = bench_neighborhood( s);
+		nsweeps = max( 1, (int) (2.0e7/(n*(nbr+1.))));
+		sp.skin = (v == 1)?0.3*s->cp.l:0.;
+		o = NULL;
+		if( v == 2 ){
+			o = observables_malloc( s, op);
+			if( o == NULL ){
+				state_free( s);
+				return;
+			}
+		}
+		sw = sweeper_malloc( s, sp);
+		if( sw == NULL ){
+			if( o != NULL ){
+				observables_free( o);
+			}
+			state_free( s);
+			return;
+		}
+		/* one warm up sweep, which also fills the energy cache */
+		sweeper_run( sw, 1);
+		st0 = sweeper_stats( sw);
+		t0 = bench_time();
+		for( k=0; k<nsweeps; k++){
+			sweeper_run( sw, 1);
+			if( o != NULL ){
+				observables_sample( o);
+			}
+		}
+		t0 = bench_time() - t0;
+		st = sweeper_stats( sw);
+		st.tried -= st0.tried;
+		bench_print( names[v], s, nthreads, st.tried, t0, st.tried*nbr, bench_state_bytes( s));
+		if( o != NULL ){
+			t0 = bench_time();
+			observables_check( o);
+			t0 = bench_time() - t0;
+			bench_print( "observables_check", s, 1, 1, t0, s->n*nbr, 0);
+			observables_free( o);
+		}
+		sweeper_free( sw);
+		state_free( s);
+	}
+}
+
+/*!
+ * Time `u_i` and whole sweeps for every bucket subdivision.
+ *
+ * The number of cylinders in the stencil (the `pairs_per_s` estimate)
+ * drops with finer buckets, while the number of buckets to step over
+ * grows.
+ */
+static void bench_subdivision( int n, double phi, double aspect, int nthreads){
+	sweep_params sp = { 1., 1, 0, 3, 0., 0, 0};
+	sweep_stats st0, st;
+	sweeper *sw;
+	state *s;
+	double t0, u, nbr;
+	long i, ops;
+	int l, sub;
+	char name[64];
+	rng g;
+
+	sp.nthreads = nthreads;
+	sp.serial_moves = n/100;
+	for( sub=1; sub<=SUB_MAX; sub++){
+		s = bench_state( n, phi, aspect, 0, sub);
+		if( s == NULL ){
+			fprintf( stderr, "bench: could not set up n=%d phi=%g aspect=%g sub=%d\n",
+					 n, phi, aspect, sub);
+			return;
+		}
+		nbr = bench_neighborhood( s);
+
+		rng_seed( &g, 2);
+		ops = max( 10000, 1000000/(long) (nbr+1.));
+		u = 0.;
+		t0 = bench_time();
+		for( i=0; i<ops; i++){
+			l = rng_below( &g, s->n);
+			u += u_i( s, l, s->a[l].c);
+		}
+		t0 = bench_time() - t0;
+		bench_sink = u;
+		snprintf( name, sizeof(name), "u_i_sub%d", sub);
+		bench_print( name, s, 1, ops, t0, ops*nbr, bench_state_bytes( s));
+
+		sw = sweeper_malloc( s, sp);
+		if( sw == NULL ){
+			state_free( s);
+			return;
+		}
+		sweeper_run( sw, 1);
+		st0 = sweeper_stats( sw);
+		t0 = bench_time();
+		sweeper_run( sw, max( 1, (int) (2.0e7/(n*(nbr+1.)))));
+		t0 = bench_time() - t0;
+		st = sweeper_stats( sw);
+		st.tried -= st0.tried;
+		snprintf( name, sizeof(name), "sweep_sub%d", sub);
+		bench_print( name, s, nthreads, st.tried, t0, st.tried*nbr, bench_state_bytes( s));
+		sweeper_free( sw);
+		state_free( s);
+	}
+}
+
+/*!
+ * Put the cylinders of a state back in their buckets in a random
+ * order of the array, as they end up after a long run.
+ */
+static void bench_shuffle( state *s, rng *g){
+	int l, k;
+	cyl c;
+	for( l=s->n-1; l>0; l--){
+		k = rng_below( g, l+1);
+		c = s->a[l].c;
+		s->a[l].c = s->a[k].c;
+		s->a[k].c = c;
+	}
+	state_empty_buckets( s);
+	for( l=0; l<s->n; l++){
+		cyl_list_add( s, l);
+	}
+	s->u_valid = 0;
+}
+
+/*!
+ * Time sweeps with the cylinders scattered over the array, sorted
+ * by bucket in row major order, and sorted by bucket along a Morton
+ * curve.
+ */
+static void bench_ordering( int n, double phi, double aspect, int nthreads){
+	const char *names[3] = { "sweep_shuffled", "sweep_reordered", "sweep_morton"};
+	sweep_params sp = { 1., 1, 0, 3, 0., 0, 0};
+	sweep_stats st0, st;
+	sweeper *sw;
+	state *s;
+	double t0, nbr;
+	int order, nsweeps;
+	rng g;
+
+	sp.nthreads = nthreads;
+	sp.serial_moves = n/100;
+	for( order=0; order<3; order++){
+		s = bench_state( n, phi, aspect, 1, 1);
+		if( s == NULL ){
+			fprintf( stderr, "bench: could not set up n=%d phi=%g aspect=%g\n", n, phi, aspect);
+			return;
+		}
+		if( order == 2 && !state_set_morton( s, 1) ){
+			state_free( s);
+			return;
+		}
+		rng_seed( &g, 4);
+		bench_shuffle( s, &g);
+		if( order > 0 && !state_reorder( s, NULL) ){
+			state_free( s);
+			return;
+		}
+		nbr = bench_neighborhood( s);
+		nsweeps = max( 1, (int) (2.0e7/(n*(nbr+1.))));
+		sw = sweeper_malloc( s, sp);
+		if( sw == NULL ){
+			state_free( s);
+			return;
+		}
+		/* fill the energy cache first, it is not part of the sweeps */
+		state_energy( s);
+		st0 = sweeper_stats( sw);
+		t0 = bench_time();
+		sweeper_run( sw, nsweeps);
+		t0 = bench_time() - t0;
+		st = sweeper_stats( sw);
+		st.tried -= st0.tried;
+		bench_print( names[order], s, nthreads, st.tried, t0, st.tried*nbr, bench_state_bytes( s));
+		sweeper_free( sw);
+		state_free( s);
+	}
+}
+
+/*!
+ * Time the initializers.
+ *
+ * The lattice search of `state_uniform_initialize`, the closed form
+ * lattice of `state_lattice_initialize`, and random sequential
+ * addition with `nthreads` threads, in a periodic box. For random
+ * sequential addition `ops` is the number of cylinders placed at
+ * random (0 if it fell back on the lattice).
+ */
+static void bench_initializers( int n, double phi, double aspect, int nthreads){
+	rsa_params rp = { 5, 1, 0, 0, 0.};
+	state *s;
+	double t0;
+	int init, ret;
+
+	rp.nthreads = nthreads;
+	for( init=0; init<3; init++){
+		s = bench_state_malloc( n, phi, aspect);
+		if( s == NULL || !state_set_periodic( s, 1) ){
+			fprintf( stderr, "bench: could not set up n=%d phi=%g aspect=%g\n", n, phi, aspect);
+			if( s != NULL ){
+				state_free( s);
+			}
+			return;
+		}
+		t0 = bench_time();
+		if( init == 0 ){
+			ret = state_uniform_initialize( s);
+		}else if( init == 1 ){
+			ret = state_lattice_initialize( s);
+		}else{
+			ret = rsa_initialize( s, rp);
+		}
+		t0 = bench_time() - t0;
+		if( init < 2 ){
+			bench_print( init?"state_lattice_initialize":"state_uniform_initialize",
+						 s, 1, ret, t0, 0., bench_state_bytes( s));
+		}else{
+			bench_print( "rsa_initialize", s, nthreads, (ret == 1)?n:0, t0, 0.,
+						 bench_state_bytes( s));
+		}
+		state_free( s);
+	}
+}
+
+/*!
+ * Integrated autocorrelation time of a time series, in samples.
+ *
+ * Sums the normalized autocorrelation function up to the window `w`,
+ * which is grown until it is at least 5 times the estimate (Sokal's
+ * automatic windowing).
+ */
+static double bench_tau( double *x, int n){
+	double mean, c0, c, tau;
+	int i, w;
+	mean = 0.;
+	for( i=0; i<n; i++){
+		mean += x[i];
+	}
+	mean /= n;
+	c0 = 0.;
+	for( i=0; i<n; i++){
+		c0 += (x[i]-mean)*(x[i]-mean);
+	}
+	if( c0 == 0. ){
+		return 0.5;
+	}
+	tau = 0.5;
+	for( w=1; w<n/2 && w < 5.*tau; w++){
+		c = 0.;
+		for( i=0; i+w<n; i++){
+			c += (x[i]-mean)*(x[i+w]-mean);
+		}
+		tau += c/c0;
+	}
+	return max( tau, 0.5);
+}
+
+/*!
+ * Compare how fast Metropolis sweeps and event chains decorrelate.
+ *
+ * Both start from the same periodic state, run `nsamples/5` samples
+ * to warm up, and then record the total energy `nsamples` times. A
+ * Metropolis sample is one sweep, an event chain sample is `n/50`
+ * translational and `n/50` rotational chains with `chain_length` the
+ * cylinder length and `chain_angle` 1. The number of independent
+ * samples is `nsamples/(2 tau)`, with `tau` the integrated
+ * autocorrelation time.
+ */
+static void bench_decorrelation( int n, double phi, double aspect, int nsamples){
+	sweep_params sp = { 1., 1, 0, 5, 0., 0, 0};
+	ecmc_params ep = { 1., 0., 0., 0., 1., 0, 5};
+	sweeper *sw;
+	ecmc *e;
+	state *s;
+	double *x, t0, tau, n_eff;
+	int i, k, ok;
+
+	x = (double *) malloc( nsamples*sizeof(double));
+	if( x == NULL ){
+		return;
+	}
+	for( k=0; k<2; k++){
+		s = bench_state( n, phi, aspect, 1, 1);
+		if( s == NULL ){
+			fprintf( stderr, "bench: could not set up n=%d phi=%g aspect=%g\n", n, phi, aspect);
+			break;
+		}
+		sw = NULL;
+		e = NULL;
+		if( k == 0 ){
+			sp.serial_moves = n/100;
+			sw = sweeper_malloc( s, sp);
+		}else{
+			ep.step = 0.1*s->cp.r;
+			ep.rot_step = ep.step/s->cp.l;
+			ep.chain_length = s->cp.l;
+			e = ecmc_malloc( s, ep);
+		}
+		if( sw == NULL && e == NULL ){
+			state_free( s);
+			break;
+		}
+		ok = 1;
+		t0 = 0.;
+		for( i=-nsamples/5; ok && i<nsamples; i++){
+			if( i == 0 ){
+				t0 = bench_time();
+			}
+			if( sw != NULL ){
+				ok = sweeper_run( sw, 1);
+			}else{
+				ok = ecmc_run( e, max( 1, n/50), max( 1, n/50));
+			}
+			if( i >= 0 ){
+				x[i] = s->u_tot;
+			}
+		}
+		t0 = bench_time() - t0;
+		if( ok ){
+			tau = bench_tau( x, nsamples);
+			n_eff = nsamples/(2.*tau);
+			bench_print( sw != NULL?"decorrelate_metropolis":"decorrelate_ecmc", s, 1,
+						 max( 1, (long) n_eff), t0, 0., bench_state_bytes( s));
+		}
+		if( sw != NULL ){
+			sweeper_free( sw);
+		}
+		if( e != NULL ){
+			ecmc_free( e);
+		}
+		state_free( s);
+	}
+	free( x);
+}
+
+/*!
+ * Mean of `x` and its error, from the integrated autocorrelation time.
+ */
+static void bench_mean( double *x, int n, double *mean, double *err){
+	double var = 0.;
+	int i;
+	*mean = 0.;
+	for( i=0; i<n; i++){
+		*mean += x[i];
+	}
+	*mean /= n;
+	for( i=0; i<n; i++){
+		var += (x[i] - *mean)*(x[i] - *mean);
+	}
+	var /= max( 1, n-1);
+	*err = sqrt( 2.*bench_tau( x, n)*var/n);
+}
+
+/*!
+ * Validate the coordinate precision against a reference run.
+ *
+ * Runs `nsweeps` Metropolis sweeps (after `nsweeps/5` to warm up) of
+ * a periodic state with a fixed seed, and records the acceptance
+ * ratio and the energy per cylinder after every sweep. The summary
+ * (the precision, the energy of the starting state, and the two means
+ * with their errors) goes to stderr. If `ref` names a file that does
+ * not exist yet, the summary is written to it. If it does exist, the
+ * summary in it (normally from the `double` build) is compared with
+ * this run: the starting energies, which are for the same lattice,
+ * should agree to about `COORD_EPSILON`, and the means to within a
+ * few times their combined error.
+ */
+static void bench_precision( int n, double phi, double aspect, int nthreads,
+							 int nsweeps, const char *ref){
+	sweep_params sp = { 1., 1, 0, 7, 0., 0, 0};
+	const char *name = (sizeof(coord) == sizeof(float))?"float":"double";
+	sweep_stats st0, st;
+	sweeper *sw;
+	state *s;
+	FILE *file;
+	char ref_name[16];
+	double *acc, *u, u0, t0, a_mean, a_err, u_mean, u_err;
+	double r_u0, r_a_mean, r_a_err, r_u_mean, r_u_err;
+	long tried;
+	int i, ok, r_n;
+
+	s = bench_state( n, phi, aspect, 1, 1);
+	if( s == NULL ){
+		fprintf( stderr, "bench: could not set up n=%d phi=%g aspect=%g\n", n, phi, aspect);
+		return;
+	}
+	sp.nthreads = nthreads;
+	sp.serial_moves = n/100;
+	sw = sweeper_malloc( s, sp);
+	acc = (double *) malloc( 2*nsweeps*sizeof(double));
+	if( sw == NULL || acc == NULL ){
+		if( sw != NULL ){
+			sweeper_free( sw);
+		}
+		free( acc);
+		state_free( s);
+		return;
+	}
+	u = acc + nsweeps;
+	u0 = state_energy( s)/n;
+	ok = 1;
+	t0 = 0.;
+	tried = 0;
+	st0 = sweeper_stats( sw);
+	for( i=-nsweeps/5; ok && i<nsweeps; i++){
+		if( i == 0 ){
+			t0 = bench_time();
+			tried = st0.tried;
+		}
+		ok = sweeper_run( sw, 1);
+		st = sweeper_stats( sw);
+		if( i >= 0 ){
+			acc[i] = ((double) (st.accepted - st0.accepted))/max( 1, st.tried - st0.tried);
+			u[i] = s->u_tot/n;
+		}
+		st0 = st;
+	}
+	t0 = bench_time() - t0;
+	if( ok ){
+		bench_print( (sizeof(coord) == sizeof(float))?"precision_float":"precision_double",
+					 s, nthreads, st.tried - tried, t0, 0., bench_state_bytes( s));
+		bench_mean( acc, nsweeps, &a_mean, &a_err);
+		bench_mean( u, nsweeps, &u_mean, &u_err);
+		fprintf( stderr, "precision %s n %d sweeps %d u0 %.17g acceptance %.17g %.17g u %.17g %.17g\n",
+				 name, n, nsweeps, u0, a_mean, a_err, u_mean, u_err);
+		file = (ref != NULL)?fopen( ref, "r"):NULL;
+		if( file != NULL ){
+			if( fscanf( file, "precision %15s n %d sweeps %*d u0 %lf acceptance %lf %lf u %lf %lf",
+						ref_name, &r_n, &r_u0, &r_a_mean, &r_a_err, &r_u_mean, &r_u_err) == 7 &&
+				r_n == n ){
+				fprintf( stderr, "%s against %s: u0 relative difference %.3e, "
+						 "acceptance %.2f sigma, u %.2f sigma\n", name, ref_name,
+						 fabs( u0 - r_u0)/max( fabs( r_u0), 1.0e-300),
+						 fabs( a_mean - r_a_mean)/sqrt( a_err*a_err + r_a_err*r_a_err),
+						 fabs( u_mean - r_u_mean)/sqrt( u_err*u_err + r_u_err*r_u_err));
+			}else{
+				fprintf( stderr, "bench: %s is not a reference for n=%d\n", ref, n);
+			}
+			fclose( file);
+		}else if( ref != NULL && (file = fopen( ref, "w")) != NULL ){
+			fprintf( file, "precision %s n %d sweeps %d u0 %.17g acceptance %.17g %.17g u %.17g %.17g\n",
+					 name, n, nsweeps, u0, a_mean, a_err, u_mean, u_err);
+			fclose( file);
+		}
+	}
+	sweeper_free( sw);
+	free( acc);
+	state_free( s);
+}
+
+/*!
+ * Time a mixture of short and long rods.
+ *
+ * `n` cylinders at packing fraction `phi` in a periodic box, all of
+ * radius `0.5/aspect`, with a fraction `frac` of them `stretch` long
+ * and the rest of length 1. Times `mixture_u_i` for every cylinder and
+ * Metropolis sweeps, first with all the species on one level (the
+ * buckets sized for the long rods, as they would be in a `state`) and
+ * then with a level per size class. The `aspect` column is the one of
+ * the short rods, and `pairs_per_s` is left at 0.
+ */
+static void bench_mixture( int n, double phi, double aspect, double frac, double stretch){
+	const char *names[2][2] = {{ "mixture_u_i_flat", "mixture_sweep_flat"},
+							   { "mixture_u_i_levels", "mixture_sweep_levels"}};
+	cyl_params sp[2];
+	int count[2];
+	vec3 box;
+	double side, t0, u;
+	size_t bytes;
+	int h, i, k, L, nsweeps;
+	long tried;
+	mixture *m;
+	rng g;
+
+	sp[0].r = 0.5/aspect;
+	sp[0].l = 1.;
+	sp[1].r = sp[0].r;
+	sp[1].l = stretch;
+	count[1] = (int) (frac*n);
+	count[0] = n - count[1];
+	side = cbrt( PI*sp[0].r*sp[0].r*(count[0]*sp[0].l + count[1]*sp[1].l)/phi);
+	side = max( side, 2.*(stretch + 2.*sp[0].r));
+	box.x = side; box.y = side; box.z = side;
+	for( h=0; h<2; h++){
+		m = mixture_malloc( sp, 2, box, 1, n, h);
+		rng_seed( &g, 11u);
+		if( m == NULL || !mixture_random_initialize( m, count, &g, 1000) ){
+			fprintf( stderr, "bench: could not set up a mixture of n=%d phi=%g\n", n, phi);
+			if( m != NULL ){
+				mixture_free( m);
+			}
+			return;
+		}
+		bytes = sizeof(mixture) + n*(sizeof(cyl_ll) + sizeof(int) + sizeof(double));
+		for( L=0; L<m->nlevels; L++){
+			bytes += m->lv[L].nbx*m->lv[L].nby*m->lv[L].nbz*sizeof(cyl_ll *);
+		}
+
+		t0 = bench_time();
+		u = 0.;
+		for( i=0; i<n; i++){
+			u += mixture_u_i( m, i, m->a[i].c);
+		}
+		t0 = bench_time() - t0;
+		bench_sink = u;
+		fprintf( stdout, "%s,%d,%.4f,%.2f,%d,%ld,%.6e,%.3f,%.6e,%zu,%ld\n",
+				 names[h][0], n, phi, aspect, 1, (long) n, t0, 1.0e9*t0/n, 0., bytes, bench_rss());
+
+		/* one warm up sweep, which also fills the energy cache */
+		mixture_sweep( m, 1., &g);
+		nsweeps = max( 1, 20000/n);
+		tried = (long) nsweeps*n;
+		t0 = bench_time();
+		for( k=0; k<nsweeps; k++){
+			mixture_sweep( m, 1., &g);
+		}
+		t0 = bench_time() - t0;
+		fprintf( stdout, "%s,%d,%.4f,%.2f,%d,%ld,%.6e,%.3f,%.6e,%zu,%ld\n",
+				 names[h][1], n, phi, aspect, 1, tried, t0, 1.0e9*t0/tried, 0., bytes, bench_rss());
+		fflush( stdout);
+		mixture_free( m);
+	}
+}
+
+int main( int argc, char **argv){
+	const char *mode = (argc > 1)?argv[1]:"all";
+	int n_max = (argc > 2)?atoi( argv[2]):100000;
+	int nthreads = (argc > 3)?atoi( argv[3]):1;
+	const char *ref = (argc > 4)?argv[4]:NULL;
+	double phis[] = { 0.02, 0.1, 0.2};
+	double aspects[] = { 2.5, 5., 10.};
+	int i, n, kernels, scale, subdivide, order, init, decorrelate, precision, mix;
+
+	kernels = (strcmp( mode, "kernels") == 0 || strcmp( mode, "all") == 0);
+	scale = (strcmp( mode, "scale") == 0 || strcmp( mode, "all") == 0);
+	subdivide = (strcmp( mode, "sub") == 0 || strcmp( mode, "all") == 0);
+	order = (strcmp( mode, "order") == 0 || strcmp( mode, "all") == 0);
+	init = (strcmp( mode, "init") == 0 || strcmp( mode, "all") == 0);
+	decorrelate = (strcmp( mode, "ecmc") == 0 || strcmp( mode, "all") == 0);
+	precision = (strcmp( mode, "prec") == 0 || strcmp( mode, "all") == 0);
+	mix = (strcmp( mode, "mix") == 0 || strcmp( mode, "all") == 0);
+	if( !kernels && !scale && !subdivide && !order && !init && !decorrelate && !precision && !mix ){
+		fprintf( stderr, "usage: %s [kernels|scale|sub|order|init|ecmc|prec|mix|all] [n_max] [nthreads] [ref]\n", argv[0]);
+		return 1;
+	}
+
+	fprintf( stdout, "name,n,phi,aspect,threads,ops,seconds,ns_per_op,pairs_per_s,bytes,max_rss_kb\n");
+	if( kernels ){
+		bench_pair_kernels( 2000);
+		bench_move_kernels( 2000);
+		bench_state_kernels( min( 10000, n_max), 0.1, 5.);
+	}
+	if( scale ){
+		for( n=1000; n<=n_max; n*=10){
+			bench_sweeps( n, 0.1, 5., nthreads);
+		}
+		n = min( 10000, n_max);
+		for( i=0; i<3; i++){
+			bench_sweeps( n, phis[i], 5., nthreads);
+		}
+		for( i=0; i<3; i++){
+			bench_sweeps( n, 0.1, aspects[i], nthreads);
+		}
+	}
+	if( subdivide ){
+		for( i=0; i<3; i++){
+			bench_subdivision( min( 10000, n_max), 0.1, aspects[i], nthreads);
+		}
+	}
+	if( order ){
+		bench_ordering( n_max, 0.1, 5., nthreads);
+	}
+	if( init ){
+		for( n=10000; n<=n_max; n*=10){
+			bench_initializers( n, 0.1, 5., nthreads);
+		}
+	}
+	if( decorrelate ){
+		bench_decorrelation( min( 500, n_max), 0.1, 5., 200);
+	}
+	if( precision ){
+		bench_precision( min( 2000, n_max), 0.02, 5., nthreads, 500, ref);
+	}
+	if( mix ){
+		bench_mixture( min( 10000, n_max), 0.05, 5., 0.02, 8.);
+	}
+	if( u_cc_count.calls > 0 ){
+		fprintf( stderr, "u_cc broad phase: %ld pairs, %.4f settled by centers, "
+				 "%.4f by boxes, %.4f exact\n", u_cc_count.calls,
+				 ((double) u_cc_count.centre)/u_cc_count.calls,
+				 ((double) u_cc_count.box)/u_cc_count.calls,
+				 ((double) u_cc_count.exact)/u_cc_count.calls);
+	}
+	return 0;
+}
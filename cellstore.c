@@ -0,0 +1,345 @@
+/*!*******************************************************************
+ * cellstore.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * This file contains an alternative storage for the manybody state
+ * in `manybody.c`. Instead of an array of `cyl` structs chained
+ * together per bucket, the positions, directions and radii are kept
+ * in separate arrays (one per component) and sorted by bucket. Every
+ * bucket owns a contiguous range of slots, given by an offset and a
+ * count, so walking the cylinders of a bucket is a sequential read of
+ * a few arrays rather than following `next` pointers around memory.
+ *
+ * Each bucket range has some spare room at the end, so moving a
+ * cylinder between buckets is a swap with the last member of the old
+ * bucket and an append to the new one. When a bucket runs out of
+ * room, all the arrays are repacked with new spare room.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "vecs.h"
+#include "cylinders.h"
+#include "lennardjones.h"
+#include "manybody.h"
+#include "math_const.h"
+
+/*!
+ * Cell sorted storage.
+ *
+ * The grid parameters are the same as in `state`:
+ * + `cp` object parameters
+ * + `box` full enclosing box size
+ * + `n` number of objects
+ * + `nbx`, `nby`, `nbz` The number of buckets in x, y, and z axis
+ * + `bucket` the size of a bucket
+ * The storage is:
+ * + `px`, `py`, `pz`, `dx`, `dy`, `dz`, `r` the cylinder data, one
+ *   array per component, `size` slots long
+ * + `id` the cylinder index stored in each slot
+ * + `slot` the slot holding each cylinder index
+ * + `start` the first slot of each bucket, with one extra entry so
+ *   that the room in bucket `m` is `start[m+1]-start[m]`
+ * + `count` the number of cylinders in each bucket
+ */
+typedef struct{
+	cyl_params cp;
+	vec3 box;
+	int n;
+	int nbx, nby, nbz;
+	vec3 bucket;
+	int size;
+	coord *px, *py, *pz;
+	coord *dx, *dy, *dz;
+	coord *r;
+	int *id;
+	int *slot;
+	int *start;
+	int *count;
+} cell_store;
+
+/*!
+ * Allocate the slot arrays with `size` slots.
+ */
+static int cell_store_arrays( cell_store *cs, int size){
+	cs->size = size;
+	cs->px = (coord *) malloc( 7*size*sizeof(coord));
+	cs->id = (int *) malloc( size*sizeof(int));
+	if( cs->px == NULL || cs->id == NULL ){
+		free( cs->px);
+		free( cs->id);
+		return 0;
+	}
+	cs->py = cs->px + size;
+	cs->pz = cs->py + size;
+	cs->dx = cs->pz + size;
+	cs->dy = cs->dx + size;
+	cs->dz = cs->dy + size;
+	cs->r = cs->dz + size;
+	return 1;
+}
+
+/*!
+ * Room given to a bucket holding `count` cylinders when repacking.
+ */
+static int cell_store_room( int count){
+	return count + count/2 + 4;
+}
+
+/*!
+ * Constructor for the cell sorted storage.
+ *
+ * Takes the same parameters as `state_malloc`, and sets up the same
+ * bucket grid. Every bucket starts out with room for a bit more than
+ * the average number of cylinders per bucket. Returns `NULL` if any
+ * allocation fails.
+ */
+cell_store* cell_store_malloc( cyl_params cp, vec3 box, int n){
+	double min_bucket_size;
+	int i, nb, room;
+
+	cell_store *cs = (cell_store *) malloc( sizeof(cell_store));
+	if( cs == NULL ){
+		return NULL;
+	}
+	cs->cp = cp;
+	cs->box = box;
+	cs->n = n;
+
+	min_bucket_size = 2.*(LJ_RMAX*cp.r+cp.l);
+	cs->nbx = (int) (box.x/min_bucket_size);
+	cs->nby = (int) (box.y/min_bucket_size);
+	cs->nbz = (int) (box.z/min_bucket_size);
+	cs->bucket.x = box.x/cs->nbx;
+	cs->bucket.y = box.y/cs->nby;
+	cs->bucket.z = box.z/cs->nbz;
+
+	nb = cs->nbx * cs->nby * cs->nbz;
+	room = cell_store_room( n/nb + 1);
+	cs->slot = (int *) malloc( n*sizeof(int));
+	cs->start = (int *) malloc( (nb+1)*sizeof(int));
+	cs->count = (int *) malloc( nb*sizeof(int));
+	if( cs->slot == NULL || cs->start == NULL || cs->count == NULL ||
+		!cell_store_arrays( cs, nb*room) ){
+		free( cs->slot);
+		free( cs->start);
+		free( cs->count);
+		free( cs);
+		return NULL;
+	}
+	for( i=0; i<=nb; i++){
+		cs->start[i] = i*room;
+	}
+	for( i=0; i<nb; i++){
+		cs->count[i] = 0;
+	}
+	for( i=0; i<n; i++){
+		cs->slot[i] = -1;
+	}
+	return cs;
+}
+
+/*!
+ * Destructor for the cell sorted storage.
+ */
+void cell_store_free( cell_store *cs){
+	free( cs->px);
+	free( cs->id);
+	free( cs->slot);
+	free( cs->start);
+	free( cs->count);
+	free( cs);
+}
+
+/*!
+ * Index of the bucket containing a point.
+ */
+int cell_store_bucket( cell_store *cs, vec3 p){
+	int i = (int) (p.x/cs->bucket.x);
+	int j = (int) (p.y/cs->bucket.y);
+	int k = (int) (p.z/cs->bucket.z);
+	return (cs->nbx)*( (cs->nby)*k + j) + i;
+}
+
+/*!
+ * Get the cylinder stored in slot `q`.
+ */
+cyl cell_store_get( cell_store *cs, int q){
+	cyl c;
+	c.p.x = cs->px[q]; c.p.y = cs->py[q]; c.p.z = cs->pz[q];
+	c.d.x = cs->dx[q]; c.d.y = cs->dy[q]; c.d.z = cs->dz[q];
+	c.r = cs->r[q];
+	return c;
+}
+
+/*!
+ * Copy slot `q0` into slot `q1`, and update the index tables.
+ */
+static void cell_store_copy( cell_store *cs, int q0, int q1){
+	cs->px[q1] = cs->px[q0]; cs->py[q1] = cs->py[q0]; cs->pz[q1] = cs->pz[q0];
+	cs->dx[q1] = cs->dx[q0]; cs->dy[q1] = cs->dy[q0]; cs->dz[q1] = cs->dz[q0];
+	cs->r[q1] = cs->r[q0];
+	cs->id[q1] = cs->id[q0];
+	cs->slot[cs->id[q1]] = q1;
+}
+
+/*!
+ * Repack the slot arrays.
+ *
+ * Every bucket gets new spare room based on its current count, and
+ * the cylinders are copied over bucket by bucket. Returns 0 if the
+ * new arrays could not be allocated, leaving the storage unchanged.
+ */
+int cell_store_repack( cell_store *cs){
+	cell_store old = *cs;
+	int nb = cs->nbx * cs->nby * cs->nbz;
+	int m, q, size;
+
+	size = 0;
+	for( m=0; m<nb; m++){
+		size += cell_store_room( cs->count[m]);
+	}
+	if( !cell_store_arrays( cs, size) ){
+		*cs = old;
+		return 0;
+	}
+	q = 0;
+	for( m=0; m<nb; m++){
+		int c = cs->count[m];
+		int q0 = old.start[m];
+		memcpy( cs->px+q, old.px+q0, c*sizeof(coord));
+		memcpy( cs->py+q, old.py+q0, c*sizeof(coord));
+		memcpy( cs->pz+q, old.pz+q0, c*sizeof(coord));
+		memcpy( cs->dx+q, old.dx+q0, c*sizeof(coord));
+		memcpy( cs->dy+q, old.dy+q0, c*sizeof(coord));
+		memcpy( cs->dz+q, old.dz+q0, c*sizeof(coord));
+		memcpy( cs->r+q, old.r+q0, c*sizeof(coord));
+		memcpy( cs->id+q, old.id+q0, c*sizeof(int));
+		cs->start[m] = q;
+		q += cell_store_room( c);
+	}
+	cs->start[nb] = q;
+	for( m=0; m<nb; m++){
+		for( q=cs->start[m]; q<cs->start[m]+cs->count[m]; q++){
+			cs->slot[cs->id[q]] = q;
+		}
+	}
+	free( old.px);
+	free( old.id);
+	return 1;
+}
+
+/*!
+ * Append cylinder `l` with data `c` to the end of bucket `m`.
+ */
+static int cell_store_append( cell_store *cs, int l, cyl c, int m){
+	int q;
+	if( cs->start[m] + cs->count[m] == cs->start[m+1] ){
+		if( !cell_store_repack( cs) ){
+			return 0;
+		}
+	}
+	q = cs->start[m] + cs->count[m];
+	cs->px[q] = c.p.x; cs->py[q] = c.p.y; cs->pz[q] = c.p.z;
+	cs->dx[q] = c.d.x; cs->dy[q] = c.d.y; cs->dz[q] = c.d.z;
+	cs->r[q] = c.r;
+	cs->id[q] = l;
+	cs->slot[l] = q;
+	cs->count[m]++;
+	return 1;
+}
+
+/*!
+ * Add cylinder `l` with data `c` to the appropriate bucket.
+ */
+int cs_list_add( cell_store *cs, int l, cyl c){
+	return cell_store_append( cs, l, c, cell_store_bucket( cs, c.p));
+}
+
+/*!
+ * Move a cylinder to a new bucket.
+ *
+ * Move cylinder `l` to a new point `pnew`. If the bucket changes, the
+ * last member of the old bucket is moved into the vacated slot, and
+ * the cylinder is appended to the new bucket. If the new bucket is
+ * full the arrays are repacked first, and if that fails 0 is returned
+ * with the storage unchanged.
+ */
+int cs_list_move( cell_store *cs, int l, vec3 pnew){
+	cyl c;
+	int q = cs->slot[l];
+	int m = cell_store_bucket( cs, cell_store_get( cs, q).p);
+	int mm = cell_store_bucket( cs, pnew);
+	if( m == mm ){
+		cs->px[q] = pnew.x; cs->py[q] = pnew.y; cs->pz[q] = pnew.z;
+		return 1;
+	}
+	/* make room in bucket `mm` before taking the cyl out of `m` */
+	if( cs->start[mm] + cs->count[mm] == cs->start[mm+1] ){
+		if( !cell_store_repack( cs) ){
+			return 0;
+		}
+		q = cs->slot[l];
+	}
+	c = cell_store_get( cs, q);
+	c.p = pnew;
+	/* remove the cyl from bucket `m` */
+	cs->count[m]--;
+	if( q != cs->start[m] + cs->count[m] ){
+		cell_store_copy( cs, cs->start[m] + cs->count[m], q);
+	}
+	/* add the cyl to bucket `mm` */
+	return cell_store_append( cs, l, c, mm);
+}
+
+/*!
+ * Set the direction of cylinder `l`.
+ */
+void cs_set_dir( cell_store *cs, int l, vec3 d){
+	int q = cs->slot[l];
+	cs->dx[q] = d.x; cs->dy[q] = d.y; cs->dz[q] = d.z;
+}
+
+/*!
+ * Fill the storage from a state.
+ */
+int cell_store_load( cell_store *cs, state *s){
+	int l, n;
+	n = 1;
+	for( l=0; l<s->n; l++){
+		n = n && cs_list_add( cs, l, s->a[l].c);
+	}
+	return n;
+}
+
+/*!
+ * Print the storage (list of cylinders)
+ *
+ * Same format as `state_print`, with the cylinders in index order.
+ */
+int cell_store_print( FILE *file, cell_store *cs){
+	int i, n, m;
+	m = fprintf( file, "Box \n");
+	n = (m >= 0);
+	m = fprintf( file, " x         y         z\n");
+	n = n && (m >= 0);
+	m = fprintf( file, "%1.3e %1.3e %1.3e\n", cs->box.x, cs->box.y, cs->box.z);
+	n = n && (m >= 0);
+	m = fprintf( file, "State: \n");
+	n = n && (m >= 0);
+	m = fprintf( file, "Number %d \n", cs->n);
+	n = n && (m >= 0);
+	m = fprintf( file, "pos.x     pos.y     pos.z");
+	n = n && (m >= 0);
+	m = fprintf( file, "     dir.x     dir.y     dir.z     r \n");
+	n = n && (m >= 0);
+	for( i=0; i<cs->n; i++){
+		m = cyl_print_ln( file, cell_store_get( cs, cs->slot[i]));
+		n = n && (m >= 0);
+	}
+	return n;
+}
@@ -0,0 +1,37 @@
+/*!*******************************************************************
+ * cellstore.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#ifndef JW_CELLSTORE
+#define JW_CELLSTORE
+
+typedef struct{
+	cyl_params cp;
+	vec3 box;
+	int n;
+	int nbx, nby, nbz;
+	vec3 bucket;
+	int size;
+	coord *px, *py, *pz;
+	coord *dx, *dy, *dz;
+	coord *r;
+	int *id;
+	int *slot;
+	int *start;
+	int *count;
+} cell_store;
+
+cell_store* cell_store_malloc( cyl_params cp, vec3 box, int n);
+void cell_store_free( cell_store *cs);
+int cell_store_bucket( cell_store *cs, vec3 p);
+cyl cell_store_get( cell_store *cs, int q);
+int cell_store_repack( cell_store *cs);
+int cs_list_add( cell_store *cs, int l, cyl c);
+int cs_list_move( cell_store *cs, int l, vec3 pnew);
+void cs_set_dir( cell_store *cs, int l, vec3 d);
+int cell_store_load( cell_store *cs, state *s);
+int cell_store_print( FILE *file, cell_store *cs);
+
+#endif /* JW_CELLSTORE */
@@ -0,0 +1,162 @@
+/*!*******************************************************************
+ * cellstore_test.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+/* the allocations in cellstore.c go through here, so that the test
+ * can make them fail */
+static int fail_alloc = 0;
+static void* test_malloc( size_t size){
+	return fail_alloc?NULL:malloc( size);
+}
+#define malloc test_malloc
+#include "cellstore.c"
+#undef malloc
+#include "distributions.h"
+#include "nlist.h"
+#include "ljtable.h"
+#include "montecarlo.h"
+
+void cell_store_test(){
+	FILE *file;
+	int i, l, m, q, result;
+	double a, b;
+	vec3 p;
+	cyl c;
+	rng g;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {20., 20., 20.};
+	state *s = state_malloc( cp, box, 500);
+	cell_store *cs;
+	pair_tables *pt;
+
+	rng_seed( &g, 2014);
+	state_uniform_initialize( s);
+
+	fprintf( stdout, "Testing cell_store_malloc: ");
+	cs = cell_store_malloc( cp, box, 500);
+	result = (cs != NULL);
+	if( !result ){
+		fprintf( stdout, "failed!\n");
+		return;
+	}
+	result = result && ( cs->nbx == s->nbx && cs->nby == s->nby && cs->nbz == s->nbz );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing cs_list_add: ");
+	result = cell_store_load( cs, s);
+	for( l=0; l<s->n; l++){
+		c = cell_store_get( cs, cs->slot[l]);
+		result = result && ( cs->id[cs->slot[l]] == l );
+		result = result && ( c.p.x == s->a[l].c.p.x && c.d.z == s->a[l].c.d.z );
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing cs_list_move: ");
+	result = 1;
+	for( i=0; i<5000; i++){
+		l = rng_below( &g, s->n);
+		c = move_cyl( s->a[l].c, &g);
+		c.p = vec3_add( c.p, vec3_smul( rand_ball( &g), 2.));
+		if( !cyl_box_overlap( c, box) ){
+			continue;
+		}
+		result = result && cyl_list_move( s, l, c.p);
+		result = result && cs_list_move( cs, l, c.p);
+		s->a[l].c.d = c.d;
+		cs_set_dir( cs, l, c.d);
+	}
+	for( l=0; l<s->n; l++){
+		c = cell_store_get( cs, cs->slot[l]);
+		result = result && ( cs->id[cs->slot[l]] == l );
+		result = result && ( c.p.y == s->a[l].c.p.y && c.d.x == s->a[l].c.d.x );
+		result = result && ( cell_store_bucket( cs, c.p) == bucket_index( s, c.p) );
+		result = result && ( cs->slot[l] >= cs->start[bucket_index( s, c.p)] );
+		result = result && ( cs->slot[l] < cs->start[bucket_index( s, c.p)+1] );
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing cs_u_i: ");
+	pt = pair_tables_malloc( cp.r, 4096);
+	result = ( pt != NULL );
+	for( l=0; l<s->n; l++){
+		a = u_i( s, l, s->a[l].c);
+		b = cs_u_i( cs, pt, l, s->a[l].c);
+		result = result && ( fabs(a-b) < max( 1.0e-6, 100.*COORD_EPSILON)*(1.+fabs(a)) );
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing cs_list_move when a repack fails: ");
+	/* fill the spare room of the bucket of cylinder 0 with the
+	 * others, so the next move into it needs a repack */
+	result = 1;
+	m = cell_store_bucket( cs, cell_store_get( cs, cs->slot[0]).p);
+	p = cell_store_get( cs, cs->slot[0]).p;
+	for( l=1; l<s->n && cs->start[m] + cs->count[m] < cs->start[m+1]; l++){
+		if( cell_store_bucket( cs, cell_store_get( cs, cs->slot[l]).p) != m ){
+			result = result && cs_list_move( cs, l, p);
+			result = result && cyl_list_move( s, l, p);
+		}
+	}
+	for( l=1; l<s->n && cell_store_bucket( cs, cell_store_get( cs, cs->slot[l]).p) == m; l++);
+	result = result && ( l < s->n );
+	q = cs->slot[l];
+	fail_alloc = 1;
+	result = result && !cs_list_move( cs, l, p);
+	fail_alloc = 0;
+	/* nothing moved */
+	result = result && ( cs->slot[l] == q && cs->id[q] == l );
+	for( i=0; i<s->n; i++){
+		result = result && ( cs->id[cs->slot[i]] == i );
+		result = result && ( cell_store_get( cs, cs->slot[i]).p.x == s->a[i].c.p.x );
+	}
+	result = result && cs_list_move( cs, l, p) && cyl_list_move( s, l, p);
+	result = result && ( cs->id[cs->slot[l]] == l );
+	result = result && ( cell_store_bucket( cs, cell_store_get( cs, cs->slot[l]).p) == m );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing cell_store_print: ");
+	file = fopen( "test_cellstore.dat", "w");
+	result = cell_store_print( file, cs);
+	fclose( file);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	fprintf( stdout, " printed to file \"test_cellstore.dat\"\n");
+
+	pair_tables_free( pt);
+	cell_store_free( cs);
+	state_free( s);
+}
+
+int main(){
+	cell_store_test();
+	return 0;
+}
@@ -0,0 +1,476 @@
+/*!*******************************************************************
+ * cylbatch.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * This file contains a batched version of `cyl_dist2`, which computes
+ * the squared distance between one cylinder and a whole block of
+ * neighbors stored as separate component arrays (as in
+ * `cellstore.c`). Along with the distance of closest approach it also
+ * gives the squared separation between the centers, which is the
+ * other distance used by `u_cc`. The squares go straight into the
+ * tabulated potentials in `ljtable.c`, so there is no square root.
+ *
+ * There are three versions of the kernel: a plain C version, an AVX2
+ * version doing 4 neighbors at a time, and an AVX-512 version doing 8
+ * at a time. The vector versions do the clamping in `cyl_dist2` with
+ * min, max and blends, so there are no branches in the loop. The
+ * version is picked the first time `cyl_dist2_batch` is called, based
+ * on what the CPU supports.
+ *
+ * When compiled with `CYL_FLOAT` (see vecs.h) the component arrays
+ * hold `float`, and the vector kernels work in single precision, 8
+ * (AVX2) or 16 (AVX-512) neighbors at a time. The squares they give
+ * back are still `double`, so the energies are summed in double
+ * precision.
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "vecs.h"
+#include "cylinders.h"
+#include "math_const.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define CYL_BATCH_X86
+#endif
+
+/*!
+ * A block of cylinders
+ *
+ * Pointers to the component arrays of the endpoints `p` and the
+ * lengths `d` of a block of cylinders.
+ */
+typedef struct{
+	const coord *px, *py, *pz;
+	const coord *dx, *dy, *dz;
+} cyl_batch;
+
+/*!
+ * Kernel versions
+ */
+#define CYL_BATCH_AUTO -1
+#define CYL_BATCH_SCALAR 0
+#define CYL_BATCH_AVX2 1
+#define CYL_BATCH_AVX512 2
+
+/*!
+ * Plain C kernel
+ *
+ * Squared distance of closest approach `dist2` and center separation
+ * `sep2` between `c` and the neighbors `i0` up to `n` in the block
+ * `b`.
+ */
+static void cyl_dist_batch_scalar( cyl c, cyl_batch b, int i0, int n,
+								   double *dist2, double *sep2){
+	double a = vec3_dot( c.d, c.d);
+	int i;
+	for( i=i0; i<n; i++){
+		double rx = c.p.x - b.px[i];
+		double ry = c.p.y - b.py[i];
+		double rz = c.p.z - b.pz[i];
+		double bb = c.d.x*b.dx[i] + c.d.y*b.dy[i] + c.d.z*b.dz[i];
+		double dd = b.dx[i]*b.dx[i] + b.dy[i]*b.dy[i] + b.dz[i]*b.dz[i];
+		double t0 = rx*c.d.x + ry*c.d.y + rz*c.d.z;
+		double t1 = rx*b.dx[i] + ry*b.dy[i] + rz*b.dz[i];
+		double det = a*dd - bb*bb;
+		double l0, l1, l1c, x, y, z;
+
+		l0 = (det > 1.e-12*a*dd)?(bb*t1 - dd*t0)/det:0.;
+		l0 = min( max( l0, 0.), 1.);
+		l1 = (bb*l0 + t1)/dd;
+		l1c = min( max( l1, 0.), 1.);
+		l0 = (l1 != l1c)?min( max( (bb*l1c - t0)/a, 0.), 1.):l0;
+
+		x = rx + l0*c.d.x - l1c*b.dx[i];
+		y = ry + l0*c.d.y - l1c*b.dy[i];
+		z = rz + l0*c.d.z - l1c*b.dz[i];
+		dist2[i] = x*x + y*y + z*z;
+		x = rx + 0.5*(c.d.x - b.dx[i]);
+		y = ry + 0.5*(c.d.y - b.dy[i]);
+		z = rz + 0.5*(c.d.z - b.dz[i]);
+		sep2[i] = x*x + y*y + z*z;
+	}
+}
+
+#ifdef CYL_BATCH_X86
+
+#ifdef CYL_FLOAT
+
+/*!
+ * AVX2 kernel, single precision
+ *
+ * Same steps as the plain C kernel, eight neighbors at a time on the
+ * `float` coordinates. The squares are widened to `double` when they
+ * are stored. The remaining `n%8` neighbors go through the plain C
+ * kernel.
+ */
+__attribute__((target("avx2,fma")))
+static void cyl_dist_batch_avx2( cyl c, cyl_batch b, int n,
+								 double *dist2, double *sep2){
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps( 1.f);
+	const __m256 half = _mm256_set1_ps( 0.5f);
+	const __m256 eps = _mm256_set1_ps( 1.e-12f);
+	const __m256 p0x = _mm256_set1_ps( c.p.x);
+	const __m256 p0y = _mm256_set1_ps( c.p.y);
+	const __m256 p0z = _mm256_set1_ps( c.p.z);
+	const __m256 d0x = _mm256_set1_ps( c.d.x);
+	const __m256 d0y = _mm256_set1_ps( c.d.y);
+	const __m256 d0z = _mm256_set1_ps( c.d.z);
+	const __m256 a = _mm256_set1_ps( vec3_dot( c.d, c.d));
+	int i;
+
+	for( i=0; i+8<=n; i+=8){
+		__m256 d1x = _mm256_loadu_ps( b.dx+i);
+		__m256 d1y = _mm256_loadu_ps( b.dy+i);
+		__m256 d1z = _mm256_loadu_ps( b.dz+i);
+		__m256 rx = _mm256_sub_ps( p0x, _mm256_loadu_ps( b.px+i));
+		__m256 ry = _mm256_sub_ps( p0y, _mm256_loadu_ps( b.py+i));
+		__m256 rz = _mm256_sub_ps( p0z, _mm256_loadu_ps( b.pz+i));
+		__m256 bb, dd, t0, t1, det, l0, l0b, l1, l1c, x, y, z, mask;
+
+		bb = _mm256_mul_ps( d0x, d1x);
+		bb = _mm256_fmadd_ps( d0y, d1y, bb);
+		bb = _mm256_fmadd_ps( d0z, d1z, bb);
+		dd = _mm256_mul_ps( d1x, d1x);
+		dd = _mm256_fmadd_ps( d1y, d1y, dd);
+		dd = _mm256_fmadd_ps( d1z, d1z, dd);
+		t0 = _mm256_mul_ps( rx, d0x);
+		t0 = _mm256_fmadd_ps( ry, d0y, t0);
+		t0 = _mm256_fmadd_ps( rz, d0z, t0);
+		t1 = _mm256_mul_ps( rx, d1x);
+		t1 = _mm256_fmadd_ps( ry, d1y, t1);
+		t1 = _mm256_fmadd_ps( rz, d1z, t1);
+		det = _mm256_fmsub_ps( a, dd, _mm256_mul_ps( bb, bb));
+
+		mask = _mm256_cmp_ps( det, _mm256_mul_ps( eps, _mm256_mul_ps( a, dd)), _CMP_GT_OQ);
+		l0 = _mm256_div_ps( _mm256_fmsub_ps( bb, t1, _mm256_mul_ps( dd, t0)), det);
+		l0 = _mm256_blendv_ps( zero, l0, mask);
+		l0 = _mm256_min_ps( _mm256_max_ps( l0, zero), one);
+		l1 = _mm256_div_ps( _mm256_fmadd_ps( bb, l0, t1), dd);
+		l1c = _mm256_min_ps( _mm256_max_ps( l1, zero), one);
+		l0b = _mm256_div_ps( _mm256_fmsub_ps( bb, l1c, t0), a);
+		l0b = _mm256_min_ps( _mm256_max_ps( l0b, zero), one);
+		mask = _mm256_cmp_ps( l1, l1c, _CMP_NEQ_UQ);
+		l0 = _mm256_blendv_ps( l0, l0b, mask);
+
+		x = _mm256_fnmadd_ps( l1c, d1x, _mm256_fmadd_ps( l0, d0x, rx));
+		y = _mm256_fnmadd_ps( l1c, d1y, _mm256_fmadd_ps( l0, d0y, ry));
+		z = _mm256_fnmadd_ps( l1c, d1z, _mm256_fmadd_ps( l0, d0z, rz));
+		x = _mm256_mul_ps( x, x);
+		x = _mm256_fmadd_ps( y, y, x);
+		x = _mm256_fmadd_ps( z, z, x);
+		_mm256_storeu_pd( dist2+i, _mm256_cvtps_pd( _mm256_castps256_ps128( x)));
+		_mm256_storeu_pd( dist2+i+4, _mm256_cvtps_pd( _mm256_extractf128_ps( x, 1)));
+
+		x = _mm256_fmadd_ps( half, _mm256_sub_ps( d0x, d1x), rx);
+		y = _mm256_fmadd_ps( half, _mm256_sub_ps( d0y, d1y), ry);
+		z = _mm256_fmadd_ps( half, _mm256_sub_ps( d0z, d1z), rz);
+		x = _mm256_mul_ps( x, x);
+		x = _mm256_fmadd_ps( y, y, x);
+		x = _mm256_fmadd_ps( z, z, x);
+		_mm256_storeu_pd( sep2+i, _mm256_cvtps_pd( _mm256_castps256_ps128( x)));
+		_mm256_storeu_pd( sep2+i+4, _mm256_cvtps_pd( _mm256_extractf128_ps( x, 1)));
+	}
+	cyl_dist_batch_scalar( c, b, i, n, dist2, sep2);
+}
+
+/*!
+ * AVX-512 kernel, single precision
+ *
+ * Same steps as the plain C kernel, sixteen neighbors at a time on
+ * the `float` coordinates. The remaining `n%16` neighbors go through
+ * the plain C kernel.
+ */
+__attribute__((target("avx512f")))
+static void cyl_dist_batch_avx512( cyl c, cyl_batch b, int n,
+								   double *dist2, double *sep2){
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512 one = _mm512_set1_ps( 1.f);
+	const __m512 half = _mm512_set1_ps( 0.5f);
+	const __m512 eps = _mm512_set1_ps( 1.e-12f);
+	const __m512 p0x = _mm512_set1_ps( c.p.x);
+	const __m512 p0y = _mm512_set1_ps( c.p.y);
+	const __m512 p0z = _mm512_set1_ps( c.p.z);
+	const __m512 d0x = _mm512_set1_ps( c.d.x);
+	const __m512 d0y = _mm512_set1_ps( c.d.y);
+	const __m512 d0z = _mm512_set1_ps( c.d.z);
+	const __m512 a = _mm512_set1_ps( vec3_dot( c.d, c.d));
+	int i;
+
+	for( i=0; i+16<=n; i+=16){
+		__m512 d1x = _mm512_loadu_ps( b.dx+i);
+		__m512 d1y = _mm512_loadu_ps( b.dy+i);
+		__m512 d1z = _mm512_loadu_ps( b.dz+i);
+		__m512 rx = _mm512_sub_ps( p0x, _mm512_loadu_ps( b.px+i));
+		__m512 ry = _mm512_sub_ps( p0y, _mm512_loadu_ps( b.py+i));
+		__m512 rz = _mm512_sub_ps( p0z, _mm512_loadu_ps( b.pz+i));
+		__m512 bb, dd, t0, t1, det, l0, l0b, l1, l1c, x, y, z;
+		__mmask16 mask;
+
+		bb = _mm512_mul_ps( d0x, d1x);
+		bb = _mm512_fmadd_ps( d0y, d1y, bb);
+		bb = _mm512_fmadd_ps( d0z, d1z, bb);
+		dd = _mm512_mul_ps( d1x, d1x);
+		dd = _mm512_fmadd_ps( d1y, d1y, dd);
+		dd = _mm512_fmadd_ps( d1z, d1z, dd);
+		t0 = _mm512_mul_ps( rx, d0x);
+		t0 = _mm512_fmadd_ps( ry, d0y, t0);
+		t0 = _mm512_fmadd_ps( rz, d0z, t0);
+		t1 = _mm512_mul_ps( rx, d1x);
+		t1 = _mm512_fmadd_ps( ry, d1y, t1);
+		t1 = _mm512_fmadd_ps( rz, d1z, t1);
+		det = _mm512_fmsub_ps( a, dd, _mm512_mul_ps( bb, bb));
+
+		mask = _mm512_cmp_ps_mask( det, _mm512_mul_ps( eps, _mm512_mul_ps( a, dd)), _CMP_GT_OQ);
+		l0 = _mm512_div_ps( _mm512_fmsub_ps( bb, t1, _mm512_mul_ps( dd, t0)), det);
+		l0 = _mm512_mask_blend_ps( mask, zero, l0);
+		l0 = _mm512_min_ps( _mm512_max_ps( l0, zero), one);
+		l1 = _mm512_div_ps( _mm512_fmadd_ps( bb, l0, t1), dd);
+		l1c = _mm512_min_ps( _mm512_max_ps( l1, zero), one);
+		l0b = _mm512_div_ps( _mm512_fmsub_ps( bb, l1c, t0), a);
+		l0b = _mm512_min_ps( _mm512_max_ps( l0b, zero), one);
+		mask = _mm512_cmp_ps_mask( l1, l1c, _CMP_NEQ_UQ);
+		l0 = _mm512_mask_blend_ps( mask, l0, l0b);
+
+		x = _mm512_fnmadd_ps( l1c, d1x, _mm512_fmadd_ps( l0, d0x, rx));
+		y = _mm512_fnmadd_ps( l1c, d1y, _mm512_fmadd_ps( l0, d0y, ry));
+		z = _mm512_fnmadd_ps( l1c, d1z, _mm512_fmadd_ps( l0, d0z, rz));
+		x = _mm512_mul_ps( x, x);
+		x = _mm512_fmadd_ps( y, y, x);
+		x = _mm512_fmadd_ps( z, z, x);
+		_mm512_storeu_pd( dist2+i, _mm512_cvtps_pd( _mm512_castps512_ps256( x)));
+		_mm512_storeu_pd( dist2+i+8, _mm512_cvtps_pd(
+			_mm256_castpd_ps( _mm512_extractf64x4_pd( _mm512_castps_pd( x), 1))));
+
+		x = _mm512_fmadd_ps( half, _mm512_sub_ps( d0x, d1x), rx);
+		y = _mm512_fmadd_ps( half, _mm512_sub_ps( d0y, d1y), ry);
+		z = _mm512_fmadd_ps( half, _mm512_sub_ps( d0z, d1z), rz);
+		x = _mm512_mul_ps( x, x);
+		x = _mm512_fmadd_ps( y, y, x);
+		x = _mm512_fmadd_ps( z, z, x);
+		_mm512_storeu_pd( sep2+i, _mm512_cvtps_pd( _mm512_castps512_ps256( x)));
+		_mm512_storeu_pd( sep2+i+8, _mm512_cvtps_pd(
+			_mm256_castpd_ps( _mm512_extractf64x4_pd( _mm512_castps_pd( x), 1))));
+	}
+	cyl_dist_batch_scalar( c, b, i, n, dist2, sep2);
+}
+
+#else
+
+/*!
+ * AVX2 kernel
+ *
+ * Same steps as the plain C kernel, four neighbors at a time. The
+ * remaining `n%4` neighbors go through the plain C kernel.
+ */
+__attribute__((target("avx2,fma")))
+static void cyl_dist_batch_avx2( cyl c, cyl_batch b, int n,
+								 double *dist2, double *sep2){
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d one = _mm256_set1_pd( 1.);
+	const __m256d half = _mm256_set1_pd( 0.5);
+	const __m256d eps = _mm256_set1_pd( 1.e-12);
+	const __m256d p0x = _mm256_set1_pd( c.p.x);
+	const __m256d p0y = _mm256_set1_pd( c.p.y);
+	const __m256d p0z = _mm256_set1_pd( c.p.z);
+	const __m256d d0x = _mm256_set1_pd( c.d.x);
+	const __m256d d0y = _mm256_set1_pd( c.d.y);
+	const __m256d d0z = _mm256_set1_pd( c.d.z);
+	const __m256d a = _mm256_set1_pd( vec3_dot( c.d, c.d));
+	int i;
+
+	for( i=0; i+4<=n; i+=4){
+		__m256d d1x = _mm256_loadu_pd( b.dx+i);
+		__m256d d1y = _mm256_loadu_pd( b.dy+i);
+		__m256d d1z = _mm256_loadu_pd( b.dz+i);
+		__m256d rx = _mm256_sub_pd( p0x, _mm256_loadu_pd( b.px+i));
+		__m256d ry = _mm256_sub_pd( p0y, _mm256_loadu_pd( b.py+i));
+		__m256d rz = _mm256_sub_pd( p0z, _mm256_loadu_pd( b.pz+i));
+		__m256d bb, dd, t0, t1, det, l0, l0b, l1, l1c, x, y, z, mask;
+
+		bb = _mm256_mul_pd( d0x, d1x);
+		bb = _mm256_fmadd_pd( d0y, d1y, bb);
+		bb = _mm256_fmadd_pd( d0z, d1z, bb);
+		dd = _mm256_mul_pd( d1x, d1x);
+		dd = _mm256_fmadd_pd( d1y, d1y, dd);
+		dd = _mm256_fmadd_pd( d1z, d1z, dd);
+		t0 = _mm256_mul_pd( rx, d0x);
+		t0 = _mm256_fmadd_pd( ry, d0y, t0);
+		t0 = _mm256_fmadd_pd( rz, d0z, t0);
+		t1 = _mm256_mul_pd( rx, d1x);
+		t1 = _mm256_fmadd_pd( ry, d1y, t1);
+		t1 = _mm256_fmadd_pd( rz, d1z, t1);
+		det = _mm256_fmsub_pd( a, dd, _mm256_mul_pd( bb, bb));
+
+		mask = _mm256_cmp_pd( det, _mm256_mul_pd( eps, _mm256_mul_pd( a, dd)), _CMP_GT_OQ);
+		l0 = _mm256_div_pd( _mm256_fmsub_pd( bb, t1, _mm256_mul_pd( dd, t0)), det);
+		l0 = _mm256_blendv_pd( zero, l0, mask);
+		l0 = _mm256_min_pd( _mm256_max_pd( l0, zero), one);
+		l1 = _mm256_div_pd( _mm256_fmadd_pd( bb, l0, t1), dd);
+		l1c = _mm256_min_pd( _mm256_max_pd( l1, zero), one);
+		l0b = _mm256_div_pd( _mm256_fmsub_pd( bb, l1c, t0), a);
+		l0b = _mm256_min_pd( _mm256_max_pd( l0b, zero), one);
+		mask = _mm256_cmp_pd( l1, l1c, _CMP_NEQ_UQ);
+		l0 = _mm256_blendv_pd( l0, l0b, mask);
+
+		x = _mm256_fnmadd_pd( l1c, d1x, _mm256_fmadd_pd( l0, d0x, rx));
+		y = _mm256_fnmadd_pd( l1c, d1y, _mm256_fmadd_pd( l0, d0y, ry));
+		z = _mm256_fnmadd_pd( l1c, d1z, _mm256_fmadd_pd( l0, d0z, rz));
+		x = _mm256_mul_pd( x, x);
+		x = _mm256_fmadd_pd( y, y, x);
+		x = _mm256_fmadd_pd( z, z, x);
+		_mm256_storeu_pd( dist2+i, x);
+
+		x = _mm256_fmadd_pd( half, _mm256_sub_pd( d0x, d1x), rx);
+		y = _mm256_fmadd_pd( half, _mm256_sub_pd( d0y, d1y), ry);
+		z = _mm256_fmadd_pd( half, _mm256_sub_pd( d0z, d1z), rz);
+		x = _mm256_mul_pd( x, x);
+		x = _mm256_fmadd_pd( y, y, x);
+		x = _mm256_fmadd_pd( z, z, x);
+		_mm256_storeu_pd( sep2+i, x);
+	}
+	cyl_dist_batch_scalar( c, b, i, n, dist2, sep2);
+}
+
+/*!
+ * AVX-512 kernel
+ *
+ * Same steps as the plain C kernel, eight neighbors at a time. The
+ * remaining `n%8` neighbors go through the plain C kernel.
+ */
+__attribute__((target("avx512f")))
+static void cyl_dist_batch_avx512( cyl c, cyl_batch b, int n,
+								   double *dist2, double *sep2){
+	const __m512d zero = _mm512_setzero_pd();
+	const __m512d one = _mm512_set1_pd( 1.);
+	const __m512d half = _mm512_set1_pd( 0.5);
+	const __m512d eps = _mm512_set1_pd( 1.e-12);
+	const __m512d p0x = _mm512_set1_pd( c.p.x);
+	const __m512d p0y = _mm512_set1_pd( c.p.y);
+	const __m512d p0z = _mm512_set1_pd( c.p.z);
+	const __m512d d0x = _mm512_set1_pd( c.d.x);
+	const __m512d d0y = _mm512_set1_pd( c.d.y);
+	const __m512d d0z = _mm512_set1_pd( c.d.z);
+	const __m512d a = _mm512_set1_pd( vec3_dot( c.d, c.d));
+	int i;
+
+	for( i=0; i+8<=n; i+=8){
+		__m512d d1x = _mm512_loadu_pd( b.dx+i);
+		__m512d d1y = _mm512_loadu_pd( b.dy+i);
+		__m512d d1z = _mm512_loadu_pd( b.dz+i);
+		__m512d rx = _mm512_sub_pd( p0x, _mm512_loadu_pd( b.px+i));
+		__m512d ry = _mm512_sub_pd( p0y, _mm512_loadu_pd( b.py+i));
+		__m512d rz = _mm512_sub_pd( p0z, _mm512_loadu_pd( b.pz+i));
+		__m512d bb, dd, t0, t1, det, l0, l0b, l1, l1c, x, y, z;
+		__mmask8 mask;
+
+		bb = _mm512_mul_pd( d0x, d1x);
+		bb = _mm512_fmadd_pd( d0y, d1y, bb);
+		bb = _mm512_fmadd_pd( d0z, d1z, bb);
+		dd = _mm512_mul_pd( d1x, d1x);
+		dd = _mm512_fmadd_pd( d1y, d1y, dd);
+		dd = _mm512_fmadd_pd( d1z, d1z, dd);
+		t0 = _mm512_mul_pd( rx, d0x);
+		t0 = _mm512_fmadd_pd( ry, d0y, t0);
+		t0 = _mm512_fmadd_pd( rz, d0z, t0);
+		t1 = _mm512_mul_pd( rx, d1x);
+		t1 = _mm512_fmadd_pd( ry, d1y, t1);
+		t1 = _mm512_fmadd_pd( rz, d1z, t1);
+		det = _mm512_fmsub_pd( a, dd, _mm512_mul_pd( bb, bb));
+
+		mask = _mm512_cmp_pd_mask( det, _mm512_mul_pd( eps, _mm512_mul_pd( a, dd)), _CMP_GT_OQ);
+		l0 = _mm512_div_pd( _mm512_fmsub_pd( bb, t1, _mm512_mul_pd( dd, t0)), det);
+		l0 = _mm512_mask_blend_pd( mask, zero, l0);
+		l0 = _mm512_min_pd( _mm512_max_pd( l0, zero), one);
+		l1 = _mm512_div_pd( _mm512_fmadd_pd( bb, l0, t1), dd);
+		l1c = _mm512_min_pd( _mm512_max_pd( l1, zero), one);
+		l0b = _mm512_div_pd( _mm512_fmsub_pd( bb, l1c, t0), a);
+		l0b = _mm512_min_pd( _mm512_max_pd( l0b, zero), one);
+		mask = _mm512_cmp_pd_mask( l1, l1c, _CMP_NEQ_UQ);
+		l0 = _mm512_mask_blend_pd( mask, l0, l0b);
+
+		x = _mm512_fnmadd_pd( l1c, d1x, _mm512_fmadd_pd( l0, d0x, rx));
+		y = _mm512_fnmadd_pd( l1c, d1y, _mm512_fmadd_pd( l0, d0y, ry));
+		z = _mm512_fnmadd_pd( l1c, d1z, _mm512_fmadd_pd( l0, d0z, rz));
+		x = _mm512_mul_pd( x, x);
+		x = _mm512_fmadd_pd( y, y, x);
+		x = _mm512_fmadd_pd( z, z, x);
+		_mm512_storeu_pd( dist2+i, x);
+
+		x = _mm512_fmadd_pd( half, _mm512_sub_pd( d0x, d1x), rx);
+		y = _mm512_fmadd_pd( half, _mm512_sub_pd( d0y, d1y), ry);
+		z = _mm512_fmadd_pd( half, _mm512_sub_pd( d0z, d1z), rz);
+		x = _mm512_mul_pd( x, x);
+		x = _mm512_fmadd_pd( y, y, x);
+		x = _mm512_fmadd_pd( z, z, x);
+		_mm512_storeu_pd( sep2+i, x);
+	}
+	cyl_dist_batch_scalar( c, b, i, n, dist2, sep2);
+}
+
+#endif /* CYL_FLOAT */
+
+#endif /* CYL_BATCH_X86 */
+
+/*!
+ * The kernel in use, `CYL_BATCH_AUTO` until the first call.
+ */
+static int cyl_batch_kernel = CYL_BATCH_AUTO;
+
+/*!
+ * Select the kernel.
+ *
+ * With `CYL_BATCH_AUTO` the widest kernel the CPU supports is used.
+ * Asking for a kernel the CPU does not support falls back to the
+ * next narrower one. Returns the kernel selected.
+ */
+int cyl_batch_select( int kernel){
+#ifdef CYL_BATCH_X86
+	__builtin_cpu_init();
+	if( kernel == CYL_BATCH_AUTO ){
+		kernel = CYL_BATCH_AVX512;
+	}
+	if( kernel == CYL_BATCH_AVX512 && !__builtin_cpu_supports( "avx512f") ){
+		kernel = CYL_BATCH_AVX2;
+	}
+	if( kernel == CYL_BATCH_AVX2 &&
+		!(__builtin_cpu_supports( "avx2") && __builtin_cpu_supports( "fma")) ){
+		kernel = CYL_BATCH_SCALAR;
+	}
+#else
+	kernel = CYL_BATCH_SCALAR;
+#endif
+	cyl_batch_kernel = kernel;
+	return kernel;
+}
+
+/*!
+ * Squared distance between a cylinder and a block of cylinders
+ *
+ * For each of the `n` cylinders in the block `b`, find the squared
+ * distance of closest approach to `c` (as in `cyl_dist2`) and store
+ * it in `dist2`, and the squared separation between the centers and
+ * store it in `sep2`.
+ */
+void cyl_dist2_batch( cyl c, cyl_batch b, int n, double *dist2, double *sep2){
+	if( cyl_batch_kernel == CYL_BATCH_AUTO ){
+		cyl_batch_select( CYL_BATCH_AUTO);
+	}
+	switch( cyl_batch_kernel ){
+#ifdef CYL_BATCH_X86
+	case CYL_BATCH_AVX512:
+		cyl_dist_batch_avx512( c, b, n, dist2, sep2);
+		break;
+	case CYL_BATCH_AVX2:
+		cyl_dist_batch_avx2( c, b, n, dist2, sep2);
+		break;
+#endif
+	default:
+		cyl_dist_batch_scalar( c, b, 0, n, dist2, sep2);
+	}
+}
@@ -0,0 +1,23 @@
+/*!*******************************************************************
+ * cylbatch.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#ifndef JW_CYLBATCH
+#define JW_CYLBATCH
+
+typedef struct{
+	const coord *px, *py, *pz;
+	const coord *dx, *dy, *dz;
+} cyl_batch;
+
+#define CYL_BATCH_AUTO -1
+#define CYL_BATCH_SCALAR 0
+#define CYL_BATCH_AVX2 1
+#define CYL_BATCH_AVX512 2
+
+int cyl_batch_select( int kernel);
+void cyl_dist2_batch( cyl c, cyl_batch b, int n, double *dist2, double *sep2);
+
+#endif /* JW_CYLBATCH */
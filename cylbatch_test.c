@@ -0,0 +1,114 @@
+/*!*******************************************************************
+ * cylbatch_test.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cylbatch.c"
+
+#define NB 37
+
+/*!
+ * Compare a batched kernel against `cyl_dist` for random cylinders.
+ */
+int cyl_batch_check( int kernel){
+	coord px[NB], py[NB], pz[NB], dx[NB], dy[NB], dz[NB];
+	double dist2[NB], sep2[NB];
+	cyl_batch b = { px, py, pz, dx, dy, dz};
+	cyl c0, c1;
+	int i, t, result;
+
+	if( cyl_batch_select( kernel) != kernel ){
+		/* not supported on this CPU, nothing to test */
+		return 1;
+	}
+	srand( 1);
+	result = 1;
+	for( t=0; t<100; t++){
+		c0.p.x = 4.*rand()/RAND_MAX; c0.p.y = 4.*rand()/RAND_MAX; c0.p.z = 4.*rand()/RAND_MAX;
+		c0.d.x = 2.*rand()/RAND_MAX-1.; c0.d.y = 2.*rand()/RAND_MAX-1.; c0.d.z = 2.*rand()/RAND_MAX-1.;
+		c0.r = 0.2;
+		for( i=0; i<NB; i++){
+			px[i] = 4.*rand()/RAND_MAX; py[i] = 4.*rand()/RAND_MAX; pz[i] = 4.*rand()/RAND_MAX;
+			dx[i] = 2.*rand()/RAND_MAX-1.; dy[i] = 2.*rand()/RAND_MAX-1.; dz[i] = 2.*rand()/RAND_MAX-1.;
+		}
+		/* a few parallel and anti-parallel neighbors */
+		dx[3] = c0.d.x; dy[3] = c0.d.y; dz[3] = c0.d.z;
+		dx[9] = -c0.d.x; dy[9] = -c0.d.y; dz[9] = -c0.d.z;
+		cyl_dist2_batch( c0, b, NB, dist2, sep2);
+		for( i=0; i<NB; i++){
+			c1.p.x = px[i]; c1.p.y = py[i]; c1.p.z = pz[i];
+			c1.d.x = dx[i]; c1.d.y = dy[i]; c1.d.z = dz[i];
+			c1.r = 0.2;
+			result = result && ( fabs( sqrt( dist2[i]) - cyl_dist( c0, c1)) < max( 1.0e-10, 100.*COORD_EPSILON) );
+			result = result && ( fabs( sqrt( sep2[i]) - vec3_dist( cyl_point( c0, 0.5), cyl_point( c1, 0.5))) < max( 1.0e-10, 100.*COORD_EPSILON) );
+		}
+	}
+	return result;
+}
+
+/*!
+ * Brute force distance between two cylinders by sampling points.
+ */
+double cyl_dist_brute( cyl c0, cyl c1){
+	double l0, l1, a, dmin = 1.e10;
+	for( l0=0.; l0<=1.; l0+=0.005){
+		for( l1=0.; l1<=1.; l1+=0.005){
+			a = vec3_dist( cyl_point( c0, l0), cyl_point( c1, l1));
+			dmin = (a<dmin)?a:dmin;
+		}
+	}
+	return dmin;
+}
+
+void cyl_batch_test(){
+	int t, result;
+	cyl c0, c1;
+
+	fprintf( stdout, "Testing cyl_dist against brute force: ");
+	srand( 2);
+	result = 1;
+	for( t=0; t<50; t++){
+		c0.p.x = 2.*rand()/RAND_MAX; c0.p.y = 2.*rand()/RAND_MAX; c0.p.z = 2.*rand()/RAND_MAX;
+		c0.d.x = 2.*rand()/RAND_MAX-1.; c0.d.y = 2.*rand()/RAND_MAX-1.; c0.d.z = 2.*rand()/RAND_MAX-1.;
+		c1.p.x = 2.*rand()/RAND_MAX; c1.p.y = 2.*rand()/RAND_MAX; c1.p.z = 2.*rand()/RAND_MAX;
+		c1.d.x = 2.*rand()/RAND_MAX-1.; c1.d.y = 2.*rand()/RAND_MAX-1.; c1.d.z = 2.*rand()/RAND_MAX-1.;
+		c0.r = c1.r = 0.2;
+		result = result && ( cyl_dist( c0, c1) <= cyl_dist_brute( c0, c1) + max( 1.0e-12, 100.*COORD_EPSILON) );
+		result = result && ( cyl_dist_brute( c0, c1) - cyl_dist( c0, c1) < 1.0e-2 );
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing cyl_dist2_batch (scalar): ");
+	if( cyl_batch_check( CYL_BATCH_SCALAR) ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing cyl_dist2_batch (avx2): ");
+	if( cyl_batch_check( CYL_BATCH_AVX2) ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing cyl_dist2_batch (avx512): ");
+	if( cyl_batch_check( CYL_BATCH_AVX512) ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+}
+
+int main(){
+	cyl_batch_test();
+	return 0;
+}
@@ -19,7 +19,7 @@
  */
 typedef struct{ 
 	vec3 p, d;
-	double r;
+	coord r;
 } cyl;
 
 /*!
@@ -64,45 +64,48 @@ int cyl_box_overlap( cyl c, vec3 box){
  *
  * This is accomplished by treating the cylinders mathematically as
  * two lines (\[\vec{L}(l)=\vec{p}+\vec{d}l\]), and finding the value
- * of \[l\] where the lines are closest. If the value of \[l\] is
- * between 0 and 1, then the point of closest approach is along the
- * cylinder, otherwise the point of closest approach should be one of
- * the endpoints.
+ * of \[l\] where the lines are closest. The value for the first
+ * cylinder \[l_0\] is clamped to \[[0,1]\], then the closest point
+ * on the second cylinder to that point gives \[l_1\]. If \[l_1\] had
+ * to be clamped as well, \[l_0\] is recomputed from the clamped
+ * \[l_1\]. For parallel cylinders any \[l_0\] works, and we start
+ * from the endpoint \[l_0=0\]. All the clamping is done with `min`
+ * and `max` so the batched version in `cylbatch.c` can do the same
+ * steps without branches. The closest points are only ever formed
+ * relative to each other, never as absolute positions, so nothing is
+ * lost to rounding far from the origin (see `CYL_FLOAT` in vecs.h).
+ *
+ * `cyl_dist2` gives the square of the distance, which is all that is
+ * needed with the tabulated potentials in `ljtable.c`.
  */
-double cyl_dist( cyl c0, cyl c1){
-	vec3 p0, p1;
+double cyl_dist2( cyl c0, cyl c1){
 	vec3 pm = vec3_sub( c0.p, c1.p);
 	double a = vec3_dot( c0.d, c0.d);
 	double b = vec3_dot( c0.d, c1.d);
 	double d = vec3_dot( c1.d, c1.d);
-	double t0 = -vec3_dot( pm, c0.d);
+	double t0 = vec3_dot( pm, c0.d);
 	double t1 = vec3_dot( pm, c1.d);
 	double det = a*d - b*b;
-	if( det != 0. ){
-		double l0 = (d*t0 + b*t1)/det;
-		double l1 = (b*t0 + a*t1)/det;
-	}else{
-		
-	}
-	if( l0 < 0. ){
-		p0 = c0.p;
-	}else if( l0 <= 1. ){
-		p0 = vec3_add( c0.p, vec3_smul( c0.d, l0));
-	}else{
-		p0 = vec3_add( c0.p, c0.d);
-	}
-	if( l1 < 0. ){
-		p1 = c1.p;
-	}else if( l1 <= 1. ){
-		p1 = vec3_add( c1.p, vec3_smul( c1.d, l1));
-	}else{
-		p1 = vec3_add( c0.p, c0.d);
-	}
-	return vec3_dist( p0, p1); 
+	double l0, l1, l1c;
+
+	l0 = (det > 1.e-12*a*d)?(b*t1 - d*t0)/det:0.;
+	l0 = min( max( l0, 0.), 1.);
+	l1 = (b*l0 + t1)/d;
+	l1c = min( max( l1, 0.), 1.);
+	l0 = (l1 != l1c)?min( max( (b*l1c - t0)/a, 0.), 1.):l0;
+
+	/* c0 relative to the endpoint of c1 */
+	c0.p = pm;
+	pm = vec3_sub( cyl_point( c0, l0), vec3_smul( c1.d, l1c));
+	return vec3_dot( pm, pm);
+}
+
+double cyl_dist( cyl c0, cyl c1){
+	return sqrt( cyl_dist2( c0, c1));
 }
 
 int cyl_cyl_overlap( cyl c0, cyl c1){
-	return( cyl_dist( c0, c1) < c0.r+c1.r );	
+	return( cyl_dist2( c0, c1) < (c0.r+c1.r)*(c0.r+c1.r) );
 }
 
 /*!
@@ -11,7 +11,7 @@
 
 typedef struct{ 
 	vec3 p, d;
-	double r;
+	coord r;
 } cyl;
 
 inline static vec3 cyl_point( cyl c, double l){
@@ -19,6 +19,7 @@ inline static vec3 cyl_point( cyl c, double l){
 }
 
 int cyl_box_overlap( cyl c, vec3 box);
+double cyl_dist2( cyl c0, cyl c1);
 double cyl_dist( cyl c0, cyl c1);
 int cyl_cyl_overlap( cyl c0, cyl c1);
 int cyl_print_ln( FILE *file, cyl c);
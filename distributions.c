@@ -7,6 +7,7 @@
 #include <stdlib.h>
 
 #include "vecs.h"
+#include "rng.h"
 #include "math_const.h"
 
  /*!
@@ -14,11 +15,11 @@
  *
  * Uniformly generate a random 2-vector in a disk of radius 1.
  */
-vec2 rand_disk(){
+vec2 rand_disk( rng *g){
 	vec2 p;
 	do{
-		p.x = 2.*rand()/RAND_MAX-1.;
-		p.y = 2.*rand()/RAND_MAX-1.;
+		p.x = 2.*rng_uniform( g)-1.;
+		p.y = 2.*rng_uniform( g)-1.;
 	}while( vec2_mag(p) > 1 );
 	return p;
 }
@@ -28,12 +29,12 @@ vec2 rand_disk(){
  *
  * Uniformly generate a random 3-vector in a disk of radius 1.
  */
-vec3 rand_ball(){
+vec3 rand_ball( rng *g){
 	vec3 p;
 	do{
-		p.x = 2.*rand()/RAND_MAX-1.;
-		p.y = 2.*rand()/RAND_MAX-1.;
-		p.z = 2.*rand()/RAND_MAX-1.;
+		p.x = 2.*rng_uniform( g)-1.;
+		p.y = 2.*rng_uniform( g)-1.;
+		p.z = 2.*rng_uniform( g)-1.;
 	}while( vec3_mag(p) > 1 );
 	return p;	
 }
@@ -45,12 +46,12 @@ vec3 rand_ball(){
  * 3-vector is uniformly distributed over a spherical cap centered on
  * `v` with a half- angle of `th_max`.
  */ 
-vec3 rand_rot( vec3 v, double th_max ){
+vec3 rand_rot( vec3 v, double th_max, rng *g){
 	vec3 u;
 	/* azimuthal angle */
-    double ph = 2.*PI*rand()/RAND_MAX;
+    double ph = 2.*PI*rng_uniform( g);
     /* polar angle, properly weighted using the inverse of the CDF. */
-    double x = 1.*rand()/RAND_MAX;
+    double x = rng_uniform( g);
     double th = acos(1.-(1.-cos(th_max))*x);
     /* generate a vector `u` normal to `v` */
     double r = sqrt( v.x*v.x + v.y*v.y);
@@ -69,4 +70,4 @@ vec3 rand_rot( vec3 v, double th_max ){
     vec3_rotAAto( &u, v, ph);
     /* rotate the vector `v` around `u` by angle `th` */
     return vec3_rotAA( v, u, th);
-}
\ No newline at end of file
+}
@@ -5,12 +5,13 @@
  */
 
 #include "vecs.h"
+#include "rng.h"
 
 #ifndef JW_DIST
 #define JW_DIST
 
-vec2 rand_disk();
-vec3 rand_ball();
-vec3 rand_rot( vec3 v, double th_max );
+vec2 rand_disk( rng *g);
+vec3 rand_ball( rng *g);
+vec3 rand_rot( vec3 v, double th_max, rng *g);
 
 #endif
\ No newline at end of file
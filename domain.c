@@ -0,0 +1,443 @@
+/*!*******************************************************************
+ * domain.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * This file contains a spatial domain decomposition of a periodic
+ * box over several processes. The box is cut along x at bucket
+ * boundaries into `size` slabs of whole bucket columns, one for each
+ * rank of a `transport`, and every process only keeps the cylinders
+ * in its own slab (plus a ghost layer). The processes talk to each
+ * other only through the transport.
+ *
+ * Every process has a local `state` on the same (periodic) bucket
+ * grid as the whole box. It holds the cylinders the process owns, and
+ * as ghosts copies of the cylinders in the last bucket column of the
+ * slab on the left, so the ghost layer is one bucket deep.
+ *
+ * A sweep is a set of Metropolis moves in every slab at once. Only
+ * the cylinders in the slab minus its last column are moved, and a
+ * move has to stay in that region. The regions of two neighboring
+ * slabs are then two columns apart, so no two processes move
+ * cylinders that interact, and a cylinder in the region only sees
+ * owned cylinders and ghosts. Picking the cylinders uniformly from
+ * the region (whose population does not change during the sweep)
+ * keeps each sweep in detailed balance.
+ *
+ * A cylinder in the last column of a slab would never move, so the
+ * cuts between the slabs are shifted after every sweep, back and
+ * forth by half a slab. That changes which process owns the
+ * cylinders near a cut, and they are migrated to their new owners,
+ * just like `cyl_list_move` carries a cylinder to a new bucket. Then
+ * the ghost layer is refreshed and the local state is rebuilt.
+ *
+ * The box must be periodic with at least 2 bucket columns per slab.
+ * The cylinders keep a global id, so the whole state can be put back
+ * together with `domain_gather`.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "vecs.h"
+#include "rng.h"
+#include "lennardjones.h"
+#include "ljtable.h"
+#include "cylinders.h"
+#include "manybody.h"
+#include "cellstore.h"
+#include "nlist.h"
+#include "montecarlo.h"
+#include "transport.h"
+
+/*!
+ * One cylinder in a message, `id` is its global index.
+ */
+typedef struct{
+	int64_t id;
+	double px, py, pz, dx, dy, dz;
+} domain_rec;
+
+/*!
+ * One process of a domain decomposition
+ *
+ * + `t` the transport, with the rank and the number of slabs
+ * + `s` the local state, its `n` is the number of local cylinders
+ * + `cap` the number of cylinders the local state has room for
+ * + `id` global index of each local cylinder
+ * + `n_own` the first `n_own` local cylinders are owned, the rest are
+ *   ghosts
+ * + `shift` the cuts are shifted by this many columns on odd sweeps
+ * + `sweeps` the number of sweeps done
+ * + `g` random number generator
+ * + `tried`, `accepted`, `migrated` number of trial moves, accepted
+ *   moves and cylinders handed to another process
+ * + `out`, `out_max` scratch message buffer
+ * + `pick` scratch array of the cylinders in the region
+ */
+typedef struct{
+	transport *t;
+	state *s;
+	int cap;
+	int64_t *id;
+	int n_own;
+	int shift;
+	long sweeps;
+	rng g;
+	long tried, accepted, migrated;
+	domain_rec *out;
+	int out_max;
+	int *pick;
+} domain;
+
+/*!
+ * First bucket column of slab `k` in the current decomposition.
+ */
+static int domain_start( domain *d, int k){
+	int off = (d->sweeps%2)?d->shift:0;
+	return( (off + (k*d->s->nbx)/d->t->size) % d->s->nbx );
+}
+
+/*!
+ * Number of bucket columns in slab `k`.
+ */
+static int domain_width( domain *d, int k){
+	int nbx = d->s->nbx, size = d->t->size;
+	return( ((k+1)*nbx)/size - (k*nbx)/size );
+}
+
+/*!
+ * Bucket column of a point.
+ */
+static int domain_column( domain *d, vec3 p){
+	int i = (int) (p.x/d->s->bucket.x);
+	return( (i < d->s->nbx)?i:d->s->nbx-1 );
+}
+
+/*!
+ * Position of column `i` in slab `k`, counting from its first column
+ * (a number outside [0, width) if the column is not in the slab).
+ */
+static int domain_offset( domain *d, int k, int i){
+	return( (i - domain_start( d, k) + d->s->nbx) % d->s->nbx );
+}
+
+/*!
+ * The slab that holds column `i`.
+ */
+static int domain_owner( domain *d, int i){
+	int k;
+	for( k=0; k<d->t->size; k++){
+		if( domain_offset( d, k, i) < domain_width( d, k) ){
+			return k;
+		}
+	}
+	return -1;
+}
+
+/*!
+ * Add a cylinder to the end of the local arrays.
+ */
+static int domain_push( domain *d, int64_t id, cyl c){
+	if( d->s->n == d->cap ){
+		return 0;
+	}
+	d->id[d->s->n] = id;
+	d->s->a[d->s->n].c = c;
+	d->s->n++;
+	return 1;
+}
+
+/*!
+ * Pack a cylinder into a message record.
+ */
+static domain_rec domain_pack( int64_t id, cyl c){
+	domain_rec rec;
+	rec.id = id;
+	rec.px = c.p.x; rec.py = c.p.y; rec.pz = c.p.z;
+	rec.dx = c.d.x; rec.dy = c.d.y; rec.dz = c.d.z;
+	return rec;
+}
+
+/*!
+ * Unpack a message record into a cylinder of radius `r`.
+ */
+static cyl domain_unpack( domain_rec *rec, double r){
+	cyl c;
+	c.p.x = rec->px; c.p.y = rec->py; c.p.z = rec->pz;
+	c.d.x = rec->dx; c.d.y = rec->dy; c.d.z = rec->dz;
+	c.r = r;
+	return c;
+}
+
+/*!
+ * Make sure the scratch message buffer holds `n` records.
+ */
+static int domain_reserve( domain *d, int n){
+	domain_rec *tmp;
+	if( n <= d->out_max ){
+		return 1;
+	}
+	tmp = (domain_rec *) realloc( d->out, n*sizeof(domain_rec));
+	if( tmp == NULL ){
+		return 0;
+	}
+	d->out = tmp;
+	d->out_max = n;
+	return 1;
+}
+
+/*!
+ * Send `n` records from the scratch buffer to rank `to`, and append
+ * the cylinders received from rank `from` to the local arrays.
+ */
+static int domain_swap( domain *d, int n, int to, int from){
+	void *rbuf;
+	size_t rlen;
+	domain_rec *rec;
+	int k, m;
+	if( !transport_exchange( d->t, to, d->out, n*sizeof(domain_rec), from, &rbuf, &rlen) ){
+		return 0;
+	}
+	rec = (domain_rec *) rbuf;
+	m = (int) (rlen/sizeof(domain_rec));
+	for( k=0; k<m; k++){
+		if( !domain_push( d, rec[k].id, domain_unpack( &rec[k], d->s->cp.r)) ){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*!
+ * Hand the owned cylinders that have left the slab to their new
+ * owners, refresh the ghosts, and rebuild the local state.
+ *
+ * With the cuts moving by at most half a slab, a cylinder can only
+ * go to a neighboring slab. Returns 0 on failure.
+ */
+static int domain_exchange( domain *d){
+	state *s = d->s;
+	int rank = d->t->rank, size = d->t->size;
+	int right = (rank+1)%size, left = (rank+size-1)%size;
+	int k, n, dir, owner, last;
+
+	/* drop the ghosts, and send the cylinders that left to the right
+	 * and then the ones that left to the left */
+	s->n = d->n_own;
+	for( dir=0; dir<2; dir++){
+		if( !domain_reserve( d, s->n) ){
+			return 0;
+		}
+		n = 0;
+		for( k=0; k<s->n; ){
+			owner = domain_owner( d, domain_column( d, s->a[k].c.p));
+			if( owner != rank && owner == (dir?left:right) ){
+				d->out[n++] = domain_pack( d->id[k], s->a[k].c);
+				/* fill the hole with the last cylinder */
+				s->n--;
+				d->id[k] = d->id[s->n];
+				s->a[k].c = s->a[s->n].c;
+			}else{
+				k++;
+			}
+		}
+		d->migrated += n;
+		if( !domain_swap( d, n, dir?left:right, dir?right:left) ){
+			return 0;
+		}
+	}
+	d->n_own = s->n;
+
+	/* the ghosts are the last column of the slab on the left, with a
+	 * single slab that is our own and already here */
+	if( size > 1 ){
+		if( !domain_reserve( d, d->n_own) ){
+			return 0;
+		}
+		last = (domain_start( d, rank) + domain_width( d, rank) - 1) % s->nbx;
+		n = 0;
+		for( k=0; k<d->n_own; k++){
+			if( domain_column( d, s->a[k].c.p) == last ){
+				d->out[n++] = domain_pack( d->id[k], s->a[k].c);
+			}
+		}
+		if( !domain_swap( d, n, right, left) ){
+			return 0;
+		}
+	}
+
+	state_empty_buckets( s);
+	for( k=0; k<s->n; k++){
+		cyl_list_add( s, k);
+	}
+	s->u_valid = 0;
+	return 1;
+}
+
+/*!
+ * Constructor for one process of a domain decomposition.
+ *
+ * The local state is set up for a periodic `box` of cylinders with
+ * parameters `cp`, with room for `cap` local cylinders (owned and
+ * ghosts). The random number stream is stream `rank` of `seed`.
+ * Returns `NULL` if an allocation fails, or if there are fewer than 2
+ * bucket columns per slab.
+ */
+domain* domain_malloc( transport *t, cyl_params cp, vec3 box, int cap, uint64_t seed){
+	domain *d;
+	d = (domain *) malloc( sizeof(domain));
+	if( d == NULL ){
+		return NULL;
+	}
+	d->s = state_malloc( cp, box, cap);
+	if( d->s == NULL ){
+		free( d);
+		return NULL;
+	}
+	d->id = (int64_t *) malloc( cap*sizeof(int64_t));
+	d->pick = (int *) malloc( cap*sizeof(int));
+	if( d->id == NULL || d->pick == NULL || !state_set_periodic( d->s, 1) ||
+		d->s->nbx < 2*t->size ){
+		free( d->id);
+		free( d->pick);
+		state_free( d->s);
+		free( d);
+		return NULL;
+	}
+	d->t = t;
+	d->cap = cap;
+	d->s->n = 0;
+	d->n_own = 0;
+	d->shift = (d->s->nbx/t->size)/2;
+	d->sweeps = 0;
+	rng_stream( &(d->g), seed, t->rank);
+	d->tried = 0;
+	d->accepted = 0;
+	d->migrated = 0;
+	d->out = NULL;
+	d->out_max = 0;
+	return d;
+}
+
+/*!
+ * Destructor for one process of a domain decomposition.
+ */
+void domain_free( domain *d){
+	free( d->out);
+	free( d->pick);
+	free( d->id);
+	state_free( d->s);
+	free( d);
+}
+
+/*!
+ * Take the cylinders of this slab from a whole state `g`.
+ *
+ * Every process needs to call this with the same state. Returns 0 if
+ * the cylinders do not fit in the local state or the exchange of the
+ * ghosts fails.
+ */
+int domain_scatter( domain *d, state *g){
+	int k;
+	cyl c;
+	d->s->n = 0;
+	for( k=0; k<g->n; k++){
+		c = g->a[k].c;
+		c.p = state_wrap( d->s, c.p);
+		if( domain_owner( d, domain_column( d, c.p)) == d->t->rank ){
+			if( !domain_push( d, k, c) ){
+				return 0;
+			}
+		}
+	}
+	d->n_own = d->s->n;
+	return domain_exchange( d);
+}
+
+/*!
+ * Run one sweep of Metropolis moves at inverse temperature `beta`.
+ *
+ * Every cylinder in the region gets one trial move on average. Then
+ * the cuts are shifted and the cylinders are migrated. All processes
+ * have to call this together. Returns 0 on failure.
+ */
+int domain_sweep( domain *d, double beta){
+	state *s = d->s;
+	int rank = d->t->rank;
+	int w = domain_width( d, rank);
+	int k, n, l;
+	cyl c_new;
+
+	n = 0;
+	for( k=0; k<d->n_own; k++){
+		if( domain_offset( d, rank, domain_column( d, s->a[k].c.p)) < w-1 ){
+			d->pick[n++] = k;
+		}
+	}
+	for( k=0; k<n; k++){
+		l = d->pick[rng_below( &(d->g), n)];
+		c_new = move_cyl( s->a[l].c, &(d->g));
+		c_new.p = state_wrap( s, c_new.p);
+		d->tried++;
+		if( domain_offset( d, rank, domain_column( d, c_new.p)) >= w-1 ){
+			continue;
+		}
+		if( mc_try( s, NULL, l, c_new, beta, &(d->g)) ){
+			mc_accept( s, l, c_new);
+			d->accepted++;
+		}
+	}
+	d->sweeps++;
+	return domain_exchange( d);
+}
+
+/*!
+ * Put the whole state back together on rank 0.
+ *
+ * Every process has to call this together. On rank 0 the cylinders
+ * are copied into `g` by their global index, the other ranks can pass
+ * `NULL`. Returns 0 on failure.
+ */
+int domain_gather( domain *d, state *g){
+	int rank = d->t->rank, size = d->t->size;
+	int k, m, i;
+	void *rbuf;
+	size_t rlen;
+	domain_rec *rec;
+
+	if( rank != 0 ){
+		if( !domain_reserve( d, d->n_own) ){
+			return 0;
+		}
+		for( k=0; k<d->n_own; k++){
+			d->out[k] = domain_pack( d->id[k], d->s->a[k].c);
+		}
+		return transport_exchange( d->t, 0, d->out, d->n_own*sizeof(domain_rec), 0, &rbuf, &rlen);
+	}
+
+	state_empty_buckets( g);
+	for( k=0; k<d->n_own; k++){
+		g->a[d->id[k]].c = d->s->a[k].c;
+	}
+	for( m=1; m<size; m++){
+		if( !transport_exchange( d->t, m, NULL, 0, m, &rbuf, &rlen) ){
+			return 0;
+		}
+		rec = (domain_rec *) rbuf;
+		for( k=0; k<(int) (rlen/sizeof(domain_rec)); k++){
+			if( rec[k].id < 0 || rec[k].id >= g->n ){
+				return 0;
+			}
+			g->a[rec[k].id].c = domain_unpack( &rec[k], g->cp.r);
+		}
+	}
+	for( i=0; i<g->n; i++){
+		cyl_list_add( g, i);
+	}
+	g->u_valid = 0;
+	return 1;
+}
@@ -0,0 +1,38 @@
+/*!*******************************************************************
+ * domain.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdint.h>
+
+#ifndef JW_DOMAIN
+#define JW_DOMAIN
+
+typedef struct{
+	int64_t id;
+	double px, py, pz, dx, dy, dz;
+} domain_rec;
+
+typedef struct{
+	transport *t;
+	state *s;
+	int cap;
+	int64_t *id;
+	int n_own;
+	int shift;
+	long sweeps;
+	rng g;
+	long tried, accepted, migrated;
+	domain_rec *out;
+	int out_max;
+	int *pick;
+} domain;
+
+domain* domain_malloc( transport *t, cyl_params cp, vec3 box, int cap, uint64_t seed);
+void domain_free( domain *d);
+int domain_scatter( domain *d, state *g);
+int domain_sweep( domain *d, double beta);
+int domain_gather( domain *d, state *g);
+
+#endif /* JW_DOMAIN */
@@ -0,0 +1,179 @@
+/*!*******************************************************************
+ * domain_test.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "math_const.h"
+#include "domain.c"
+
+#define NPROC 3
+
+/*!
+ * Check that every cylinder that can be moved sees the same energy in
+ * the local state as in the whole state `g`.
+ */
+int domain_ghosts_ok( domain *d, state *g){
+	int k, w = domain_width( d, d->t->rank);
+	double u_loc, u_all;
+	for( k=0; k<d->n_own; k++){
+		if( domain_offset( d, d->t->rank, domain_column( d, d->s->a[k].c.p)) < w-1 ){
+			u_loc = u_i( d->s, k, d->s->a[k].c);
+			u_all = u_i( g, d->id[k], g->a[d->id[k]].c);
+			if( fabs( u_loc - u_all) > max( 1.0e-9, 100.*COORD_EPSILON)*(1.+fabs( u_all)) ){
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+/*!
+ * Check that every cylinder is on the list of the bucket that
+ * contains it, exactly once.
+ */
+int domain_consistent( state *s){
+	int m, nb, count;
+	cyl_ll *cur;
+
+	nb = s->nbx * s->nby * s->nbz;
+	count = 0;
+	for( m=0; m<nb; m++){
+		for( cur = s->heads[m]; cur != NULL; cur = cur->next){
+			if( bucket_index( s, cur->c.p) != m ){
+				return 0;
+			}
+			count++;
+		}
+	}
+	return( count == s->n );
+}
+
+/*!
+ * Put the cylinders of `s` on a lattice in one layer, all pointing
+ * along z. The spacing along x is close enough for neighbors to
+ * interact across the cuts between the slabs.
+ */
+void domain_lattice( state *s){
+	int k, m = (int) (s->box.x/0.75);
+	for( k=0; k<s->n; k++){
+		s->a[k].c.p.x = 0.75*(k%m) + 0.1;
+		s->a[k].c.p.y = 1.5*(k/m) + 0.5;
+		s->a[k].c.p.z = 0.5;
+		s->a[k].c.d.x = 0.;
+		s->a[k].c.d.y = 0.;
+		s->a[k].c.d.z = s->cp.l;
+		s->a[k].c.r = s->cp.r;
+		cyl_list_add( s, k);
+	}
+}
+
+/*!
+ * The part of the test every rank runs. Returns 1 on success.
+ */
+int domain_rank( transport *t, int rank, state *g, state *all, long *migrated){
+	domain *d;
+	int k, ok;
+	ok = transport_local_attach( t, rank);
+	d = ok?domain_malloc( t, g->cp, g->box, g->n, 31u):NULL;
+	if( d == NULL ){
+		return 0;
+	}
+	ok = domain_scatter( d, g) && domain_ghosts_ok( d, g);
+	for( k=0; ok && k<20; k++){
+		ok = domain_sweep( d, 1.);
+	}
+	ok = ok && ( d->accepted > 0 );
+	ok = ok && domain_gather( d, all);
+	*migrated = d->migrated;
+	domain_free( d);
+	return ok;
+}
+
+void domain_test(){
+	int k, result, status;
+	long migrated;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {18., 18., 18.};
+	pid_t pid[NPROC];
+	transport *t;
+	state *g, *all;
+
+	g = state_malloc( cp, box, 288);
+	state_set_periodic( g, 1);
+	domain_lattice( g);
+	all = state_malloc( cp, box, 288);
+	state_set_periodic( all, 1);
+
+	fprintf( stdout, "Testing domain_malloc: ");
+	t = transport_local_malloc( 4);
+	result = ( t != NULL ) && transport_local_attach( t, 0);
+	/* 6 bucket columns can not make 4 slabs */
+	result = result && ( domain_malloc( t, cp, box, 288, 1u) == NULL );
+	if( t != NULL ){
+		transport_free( t);
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing domain_sweep: ");
+	fflush( stdout);
+	t = transport_local_malloc( NPROC);
+	if( t == NULL ){
+		fprintf( stdout, "failed!\n");
+		return;
+	}
+	for( k=1; k<NPROC; k++){
+		pid[k] = fork();
+		if( pid[k] == 0 ){
+			result = domain_rank( t, k, g, NULL, &migrated);
+			transport_free( t);
+			_exit( result?0:1);
+		}
+	}
+	for( k=0; k<all->n; k++){
+		all->a[k].c.r = -1.;
+	}
+	result = domain_rank( t, 0, g, all, &migrated);
+	/* closing the sockets first stops the other ranks if we failed */
+	transport_free( t);
+	for( k=1; k<NPROC; k++){
+		result = ( waitpid( pid[k], &status, 0) == pid[k] ) && result;
+		result = result && WIFEXITED( status) && ( WEXITSTATUS( status) == 0 );
+	}
+	result = result && ( migrated > 0 );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing domain_gather: ");
+	/* every cylinder came back once, in the right bucket */
+	for( k=0; k<all->n; k++){
+		result = result && ( all->a[k].c.r == (coord) cp.r );
+	}
+	result = result && domain_consistent( all);
+	result = result && isfinite( state_energy( all));
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	state_free( all);
+	state_free( g);
+}
+
+int main(){
+	domain_test();
+	return 0;
+}
@@ -0,0 +1,632 @@
+/*!*******************************************************************
+ * ecmc.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * This file contains an event-chain Monte-Carlo engine for the
+ * cylinders in a periodic `state`. Instead of proposing a move and
+ * accepting or rejecting it, a cylinder is moved continuously until
+ * an event, and no move is ever rejected.
+ *
+ * Translational chains move one cylinder along +x, +y or +z. The
+ * energy with each neighbor `j` is a separate factor, and each factor
+ * gets an energy budget drawn from an exponential distribution (mean
+ * 1/beta). As the cylinder moves, every increase of a pair energy is
+ * taken out of that pair's budget, and the first pair to run out
+ * causes an event. The moving cylinder stops where it is, and `j`
+ * carries on in the same direction with fresh budgets (a lift). The
+ * chain ends once the total displacement reaches `chain_length`.
+ *
+ * Rotational chains turn one cylinder about its center, around a
+ * random axis perpendicular to it. There is no lift for rotations
+ * (turning `j` is not the reverse of turning `i`), so an event flips
+ * the sense of the rotation instead, which is the zig-zag process.
+ * The chain ends once the total angle turned reaches `chain_angle`.
+ *
+ * Either the whole of `u_cc` can be used as a soft factor, or the
+ * repulsive core can be made hard. Then cylinders whose closest
+ * approach reaches the range of the repulsive potential (`2r/2^1/6`)
+ * collide, which is always an event, and only the attractive part is
+ * a soft factor. A collision is only seen when the closest approach
+ * crosses that range, so a hard core chain should be started from a
+ * state with no overlapping cores.
+ *
+ * No point of the moving cylinder moves further than the parameter
+ * of a translation, or half the length times the angle of a rotation,
+ * so the distance between the centers and a lower bound on the closest
+ * approach (the same bounds `u_cc` uses to skip pairs) tell how far a
+ * leg can go before a pair can come into range. A leg goes straight to
+ * the first point where that can happen, and only the pairs that are
+ * in range are followed, in small steps (`step` in length, `rot_step`
+ * in angle). Within a step every pair energy (or distance) is taken
+ * to change monotonically, and the point of an event is found by
+ * bisection. The steps should be small compared to the width of the
+ * repulsive core. The neighbors are gathered from the stencil of buckets
+ * around the moving cylinder, and gathered again whenever it changes
+ * bucket. The cached energies in the state are kept up to date by
+ * making every finished piece of a chain through `mc_accept`.
+ *
+ * Chains only make sense in a periodic box, where there are no walls
+ * to stop them.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "math_const.h"
+#include "vecs.h"
+#include "rng.h"
+#include "distributions.h"
+#include "lennardjones.h"
+#include "ljtable.h"
+#include "cylinders.h"
+#include "manybody.h"
+#include "cellstore.h"
+#include "nlist.h"
+#include "montecarlo.h"
+
+/*!
+ * A neighbor is looked at on every step of a leg once it can come into
+ * range within this many steps.
+ */
+#define ECMC_AHEAD 16
+
+/*!
+ * Event-chain parameters
+ *
+ * + `beta` the inverse temperature
+ * + `step` step length for translations
+ * + `rot_step` step angle for rotations
+ * + `chain_length` total displacement of a translational chain
+ * + `chain_angle` total angle of a rotational chain
+ * + `hard` treat the repulsive core as hard
+ * + `seed` seed for the random number generator
+ */
+typedef struct{
+	double beta;
+	double step, rot_step;
+	double chain_length, chain_angle;
+	int hard;
+	uint64_t seed;
+} ecmc_params;
+
+/*!
+ * Event-chain statistics
+ *
+ * + `chains`, `rot_chains` number of translational and rotational
+ *   chains
+ * + `events` number of events (lifts or flips)
+ * + `steps` number of steps
+ */
+typedef struct{
+	long chains, rot_chains, events, steps;
+} ecmc_stats;
+
+/*!
+ * The event-chain engine
+ *
+ * + `s` the state being sampled
+ * + `ep` the parameters
+ * + `g` the random number generator
+ * + `stats` statistics
+ * + `dir` direction of the next translational chain (0, 1 or 2)
+ * + `idx`, `u`, `budget`, `dist` for each neighbor of the moving
+ *   cylinder, the index, the soft pair energy at the current point,
+ *   the remaining budget (negative until it is drawn), and the closest
+ *   approach or a lower bound on it (only used for the hard core), `nn`
+ *   of them in arrays of length `nmax`
+ * + `u_new`, `dist_new` the same at the end of the current step
+ * + `wake`, `near` for each neighbor, the leg parameter up to which
+ *   its soft pair energy cannot change, and up to which its closest
+ *   approach cannot reach the range of the repulsive potential
+ * + `awake` the list positions of the neighbors that are looked at on
+ *   every step
+ */
+typedef struct{
+	state *s;
+	ecmc_params ep;
+	rng g;
+	ecmc_stats stats;
+	int dir;
+	int *idx;
+	double *u, *budget, *dist;
+	double *u_new, *dist_new;
+	double *wake, *near;
+	int *awake;
+	int nn, nmax;
+} ecmc;
+
+/*!
+ * One piece of a chain.
+ *
+ * The cylinder is at `c0` at the parameter `t0`, and at the parameter
+ * `t` it is at `ecmc_path( lg, t)`. A translation is along `e` and a
+ * rotation is around the axis `a` through the center, in the sense
+ * `v`.
+ */
+typedef struct{
+	cyl c0;
+	double t0;
+	int rot;
+	vec3 e, a;
+	double v;
+} ecmc_leg;
+
+/*!
+ * Position of the moving cylinder at the parameter `t` along a leg.
+ */
+static cyl ecmc_path( ecmc_leg *lg, double t){
+	cyl c = lg->c0;
+	vec3 ctr, ad;
+	double th;
+	if( !lg->rot ){
+		c.p = vec3_add( c.p, vec3_smul( lg->e, t - lg->t0));
+	}else{
+		ctr = cyl_point( c, 0.5);
+		ad = vec3_cross( lg->a, c.d);
+		th = lg->v*(t - lg->t0);
+		c.d = vec3_add( vec3_smul( c.d, cos( th)), vec3_smul( ad, sin( th)));
+		c.p = vec3_sub( ctr, vec3_smul( c.d, 0.5));
+	}
+	return c;
+}
+
+/*!
+ * The soft pair energy between the moving cylinder `c` and `cj`.
+ */
+static double ecmc_pair( ecmc *e, cyl c, cyl cj){
+	lj_params p_attractive = { 1., 2.*c.r};
+	vec3 ctr = cyl_point( c, 0.5);
+	cj = state_image( e->s, cj, ctr);
+	if( e->ep.hard ){
+		return lj_truncated( vec3_dist( ctr, cyl_point( cj, 0.5)), p_attractive);
+	}
+	return u_cc( cj, c);
+}
+
+/*!
+ * Closest approach between the moving cylinder `c` and `cj`.
+ */
+static double ecmc_dist( ecmc *e, cyl c, cyl cj){
+	return cyl_dist( c, state_image( e->s, cj, cyl_point( c, 0.5)));
+}
+
+/*!
+ * Look at neighbor `q` with the moving cylinder at `c`, a parameter
+ * `t` along the leg.
+ *
+ * Sets `u_new` and `dist_new` to the soft pair energy and the closest
+ * approach, and `wake` and `near` to how far the leg can go before
+ * either can change. A translation moves the center and every point
+ * of the cylinder as far as the parameter, and a rotation leaves the
+ * center in place and moves no point further than half the length
+ * times the angle. The attractive energy cannot change until the
+ * centers come within its range, and the repulsive energy (or the
+ * hard core) until the closest approach comes within `2r/2^1/6`. The
+ * closest approach is bounded by the distance between the centers
+ * less the half lengths (as in `u_cc`), and only worked out exactly
+ * once that bound is less than a step away, so `dist_new` may be the
+ * bound.
+ */
+static void ecmc_quiet( ecmc *e, ecmc_leg *lg, int q, double t, cyl c){
+	lj_params p_attractive = { 1., 2.*c.r};
+	lj_params p_repulsive = { 1., 2.*c.r/TWO_1_6};
+	double r_att = LJ_RMAX*p_attractive.r0, r_rep = p_repulsive.r0;
+	double h = lg->rot?e->ep.rot_step:e->ep.step;
+	double speed, sep, gap, att;
+	vec3 ctr = cyl_point( c, 0.5), dc;
+	cyl cj = e->s->a[e->idx[q]].c;
+
+	/* the image of `cj` is only needed for the closest approach */
+	dc = min_image( vec3_sub( cyl_point( cj, 0.5), ctr), e->s->box);
+	speed = lg->rot?0.5*vec3_mag( c.d):1.;
+	sep = vec3_mag( dc);
+	att = lg->rot?HUGE_VAL:max( sep - r_att, 0.);
+	gap = sep - sqrt( 0.5*(vec3_dot( c.d, c.d) + vec3_dot( cj.d, cj.d)));
+	if( gap - r_rep < speed*h ){
+		cj.p = vec3_sub( vec3_add( ctr, dc), vec3_smul( cj.d, 0.5));
+		gap = cyl_dist( c, cj);
+	}
+	e->u_new[q] = lj_truncated( sep, p_attractive);
+	if( !e->ep.hard && gap < r_rep ){
+		e->u_new[q] += lj_shifted( gap, p_repulsive);
+	}
+	e->dist_new[q] = gap;
+	e->near[q] = t + max( gap - r_rep, 0.)/speed;
+	e->wake[q] = e->ep.hard?t + att:min( t + att, e->near[q]);
+}
+
+/*!
+ * How far the leg can go from `c` before the cylinder can leave its
+ * bucket.
+ */
+static double ecmc_exit( ecmc *e, ecmc_leg *lg, cyl c){
+	state *s = e->s;
+	vec3 p = state_wrap( s, c.p);
+	p.x -= s->bucket.x*floor( p.x/s->bucket.x);
+	p.y -= s->bucket.y*floor( p.y/s->bucket.y);
+	p.z -= s->bucket.z*floor( p.z/s->bucket.z);
+	if( !lg->rot ){
+		/* the face ahead, the direction is along one of the axes */
+		return vec3_dot( lg->e, vec3_sub( s->bucket, p));
+	}
+	return min( min( min( p.x, s->bucket.x - p.x), min( p.y, s->bucket.y - p.y)),
+				min( p.z, s->bucket.z - p.z))/(0.5*vec3_mag( c.d));
+}
+
+/*!
+ * Exponential energy budget for a factor.
+ */
+static double ecmc_budget( ecmc *e){
+	return -log( 1. - rng_uniform( &(e->g)))/e->ep.beta;
+}
+
+/*!
+ * Grow an array to `size` bytes, keeping its contents.
+ */
+static int ecmc_grow( void **a, size_t size){
+	void *tmp = realloc( *a, size);
+	if( tmp == NULL ){
+		return 0;
+	}
+	*a = tmp;
+	return 1;
+}
+
+/*!
+ * Gather the neighbors of cylinder `i` at `c`, a parameter `t` along
+ * the leg.
+ *
+ * No neighbor has a budget yet, it is drawn once the neighbor comes
+ * close enough to be looked at (see `ecmc_leg_run`). The budgets are
+ * exponential, so the part of a budget that is left over is again an
+ * exponential with the same mean, and drawing it afresh whenever the
+ * list is gathered again is the same as keeping it. Returns 0 if the
+ * arrays could not be grown.
+ */
+static int ecmc_gather( ecmc *e, int i, ecmc_leg *lg, double t, cyl c){
+	state *s = e->s;
+	int k, q, n, nn, nbr[NBR_MAX];
+	cyl_ll *cur;
+
+	n = 0;
+	nn = state_neighbors( s, bucket_index( s, state_wrap( s, c.p)), nbr);
+	for( k=0; k<nn; k++){
+		for( cur = s->heads[nbr[k]]; cur != NULL; cur = cur->next){
+			n++;
+		}
+	}
+	if( n > e->nmax ){
+		n = 2*n;
+		if( !ecmc_grow( (void **) &(e->idx), n*sizeof(int)) ||
+			!ecmc_grow( (void **) &(e->u), n*sizeof(double)) ||
+			!ecmc_grow( (void **) &(e->budget), n*sizeof(double)) ||
+			!ecmc_grow( (void **) &(e->dist), n*sizeof(double)) ||
+			!ecmc_grow( (void **) &(e->u_new), n*sizeof(double)) ||
+			!ecmc_grow( (void **) &(e->dist_new), n*sizeof(double)) ||
+			!ecmc_grow( (void **) &(e->wake), n*sizeof(double)) ||
+			!ecmc_grow( (void **) &(e->near), n*sizeof(double)) ||
+			!ecmc_grow( (void **) &(e->awake), n*sizeof(int)) ){
+			return 0;
+		}
+		e->nmax = n;
+	}
+
+	q = 0;
+	for( k=0; k<nn; k++){
+		for( cur = s->heads[nbr[k]]; cur != NULL; cur = cur->next){
+			if( cur == s->a + i ){
+				continue;
+			}
+			e->idx[q] = (int) (cur - s->a);
+			ecmc_quiet( e, lg, q, t, c);
+			e->u[q] = e->u_new[q];
+			e->dist[q] = e->dist_new[q];
+			e->budget[q] = -1.;
+			q++;
+		}
+	}
+	e->nn = q;
+	return 1;
+}
+
+/*!
+ * Run a leg for cylinder `i` until the first event, or until the
+ * parameter reaches `t_max`. A rotation does not stop at an event, it
+ * turns back where it is and goes on, with fresh budgets.
+ *
+ * Only the neighbors that can come into range within `ECMC_AHEAD`
+ * steps are kept on the `awake` list and looked at as the leg goes,
+ * the whole list is only gone through again once the leg gets that
+ * far. Returns the parameter where the leg stopped, and sets `who` to
+ * the list position of the neighbor that caused the event, or -1 if
+ * there was none. Sets `who` to -2 if the neighbor list could not be
+ * grown.
+ */
+static double ecmc_leg_run( ecmc *e, int i, ecmc_leg *lg, double t_max, int *who){
+	state *s = e->s;
+	double sigma = 2.*lg->c0.r/TWO_1_6;
+	double h = lg->rot?e->ep.rot_step:e->ep.step;
+	double t, dt, t_ev, t_scan, lo, hi, mid;
+	int k, q, q_ev, m, na, it;
+	cyl c, cj;
+
+	*who = -1;
+	if( !ecmc_gather( e, i, lg, lg->t0, lg->c0) ){
+		*who = -2;
+		return lg->t0;
+	}
+	c = lg->c0;
+	m = bucket_index( s, state_wrap( s, c.p));
+	t = lg->t0;
+	t_scan = t;
+	na = 0;
+	while( t < t_max ){
+		if( t + h >= t_scan ){
+			na = 0;
+			t_scan = HUGE_VAL;
+			for( q=0; q<e->nn; q++){
+				if( min( e->wake[q], e->near[q]) < t + ECMC_AHEAD*h ){
+					e->awake[na++] = q;
+					if( e->budget[q] < 0. ){
+						e->budget[q] = ecmc_budget( e);
+					}
+				}else{
+					t_scan = min( t_scan, min( e->wake[q], e->near[q]));
+				}
+			}
+		}
+		/* go straight to where the first pair can come into range, but
+		 * not more than a step past the face of the bucket */
+		dt = min( max( h, ecmc_exit( e, lg, c)), t_scan - t);
+		for( k=0; k<na; k++){
+			q = e->awake[k];
+			dt = min( dt, max( h, min( e->wake[q], e->near[q]) - t));
+		}
+		dt = min( dt, t_max - t);
+		c = ecmc_path( lg, t+dt);
+		e->stats.steps++;
+		t_ev = dt;
+		q_ev = -1;
+		for( k=0; k<na; k++){
+			q = e->awake[k];
+			if( min( e->wake[q], e->near[q]) >= t+dt ){
+				continue;
+			}
+			ecmc_quiet( e, lg, q, t+dt, c);
+			cj = s->a[e->idx[q]].c;
+			if( e->ep.hard && e->dist_new[q] < sigma && e->dist[q] >= sigma ){
+				/* find where the cores touch, stopping just short */
+				lo = 0.; hi = dt;
+				for( it=0; it<40; it++){
+					mid = 0.5*(lo+hi);
+					if( ecmc_dist( e, ecmc_path( lg, t+mid), cj) < sigma ){
+						hi = mid;
+					}else{
+						lo = mid;
+					}
+				}
+				if( lo < t_ev ){
+					t_ev = lo;
+					q_ev = q;
+				}
+			}
+			if( e->u_new[q] - e->u[q] > e->budget[q] ){
+				/* find where the budget runs out */
+				lo = 0.; hi = dt;
+				for( it=0; it<40; it++){
+					mid = 0.5*(lo+hi);
+					if( ecmc_pair( e, ecmc_path( lg, t+mid), cj) - e->u[q] > e->budget[q] ){
+						hi = mid;
+					}else{
+						lo = mid;
+					}
+				}
+				if( hi < t_ev ){
+					t_ev = hi;
+					q_ev = q;
+				}
+			}
+		}
+		if( q_ev >= 0 && !lg->rot ){
+			e->stats.events++;
+			*who = q_ev;
+			return t + t_ev;
+		}
+		if( q_ev >= 0 ){
+			/* the bounds hold whichever way the cylinder turns, only the
+			 * pairs that are looked at need their energies again */
+			e->stats.events++;
+			t += t_ev;
+			lg->c0 = ecmc_path( lg, t);
+			/* keep the length exact over many small rotations */
+			lg->c0.d = vec3_smul( vec3_unit( lg->c0.d), s->cp.l);
+			lg->t0 = t;
+			lg->v = -lg->v;
+			c = lg->c0;
+			for( k=0; k<na; k++){
+				q = e->awake[k];
+				ecmc_quiet( e, lg, q, t, c);
+				e->u[q] = e->u_new[q];
+				e->dist[q] = e->dist_new[q];
+			}
+			for( q=0; q<e->nn; q++){
+				e->budget[q] = -1.;
+			}
+			t_scan = t;
+			continue;
+		}
+		/* the pairs that were not looked at have not changed */
+		for( k=0; k<na; k++){
+			q = e->awake[k];
+			if( e->u_new[q] > e->u[q] ){
+				e->budget[q] -= e->u_new[q] - e->u[q];
+			}
+			e->u[q] = e->u_new[q];
+			e->dist[q] = e->dist_new[q];
+		}
+		t += dt;
+		if( bucket_index( s, state_wrap( s, c.p)) != m ){
+			m = bucket_index( s, state_wrap( s, c.p));
+			if( !ecmc_gather( e, i, lg, t, c) ){
+				*who = -2;
+				return t;
+			}
+			t_scan = t;
+		}
+	}
+	return t_max;
+}
+
+/*!
+ * Constructor for the event-chain engine.
+ *
+ * Returns `NULL` if the state is not periodic, does not use the
+ * default pair potential `u_cc`, or an allocation fails.
+ */
+ecmc* ecmc_malloc( state *s, ecmc_params ep){
+	ecmc *e;
+	if( !s->periodic || mc_potential( s) != POT_DEFAULT ){
+		return NULL;
+	}
+	e = (ecmc *) malloc( sizeof(ecmc));
+	if( e == NULL ){
+		return NULL;
+	}
+	e->s = s;
+	e->ep = ep;
+	rng_seed( &(e->g), ep.seed);
+	e->stats.chains = 0;
+	e->stats.rot_chains = 0;
+	e->stats.events = 0;
+	e->stats.steps = 0;
+	e->dir = 0;
+	e->idx = NULL;
+	e->u = NULL;
+	e->budget = NULL;
+	e->dist = NULL;
+	e->u_new = NULL;
+	e->dist_new = NULL;
+	e->wake = NULL;
+	e->near = NULL;
+	e->awake = NULL;
+	e->nn = 0;
+	e->nmax = 0;
+	return e;
+}
+
+/*!
+ * Destructor for the event-chain engine.
+ */
+void ecmc_free( ecmc *e){
+	free( e->idx);
+	free( e->u);
+	free( e->budget);
+	free( e->dist);
+	free( e->u_new);
+	free( e->dist_new);
+	free( e->wake);
+	free( e->near);
+	free( e->awake);
+	free( e);
+}
+
+/*!
+ * Run one translational chain.
+ *
+ * Starts from a random cylinder, and moves along +x, +y and +z in
+ * turn from one chain to the next. Returns 0 if the neighbor list
+ * could not be grown.
+ */
+int ecmc_chain( ecmc *e){
+	state *s = e->s;
+	ecmc_leg lg;
+	double left, t;
+	int i, who;
+
+	if( !s->u_valid ){
+		state_energy( s);
+	}
+	lg.rot = 0;
+	lg.e.x = (e->dir == 0)?1.:0.;
+	lg.e.y = (e->dir == 1)?1.:0.;
+	lg.e.z = (e->dir == 2)?1.:0.;
+	e->dir = (e->dir+1)%3;
+	i = rng_below( &(e->g), s->n);
+	left = e->ep.chain_length;
+	while( left > 0. ){
+		lg.c0 = s->a[i].c;
+		lg.t0 = 0.;
+		t = ecmc_leg_run( e, i, &lg, left, &who);
+		if( who == -2 ){
+			return 0;
+		}
+		mc_accept( s, i, ecmc_path( &lg, t));
+		left -= t;
+		if( who >= 0 ){
+			i = e->idx[who];
+		}
+	}
+	e->stats.chains++;
+	return 1;
+}
+
+/*!
+ * Run one rotational chain.
+ *
+ * Turns a random cylinder about its center, around a random axis
+ * perpendicular to it, flipping the sense at every event. Returns 0
+ * if the neighbor list could not be grown.
+ */
+int ecmc_rot_chain( ecmc *e){
+	state *s = e->s;
+	ecmc_leg lg;
+	double t;
+	int i, who;
+	vec3 a;
+
+	if( !s->u_valid ){
+		state_energy( s);
+	}
+	i = rng_below( &(e->g), s->n);
+	/* random axis perpendicular to the cylinder */
+	do{
+		a = rand_ball( &(e->g));
+		a = vec3_cross( a, s->a[i].c.d);
+	}while( vec3_mag( a) < 1.0e-3*vec3_mag( s->a[i].c.d) );
+	lg.rot = 1;
+	lg.a = vec3_unit( a);
+	lg.v = 1.;
+	lg.c0 = s->a[i].c;
+	lg.t0 = 0.;
+	t = ecmc_leg_run( e, i, &lg, e->ep.chain_angle, &who);
+	if( who == -2 ){
+		return 0;
+	}
+	lg.c0 = ecmc_path( &lg, t);
+	lg.c0.d = vec3_smul( vec3_unit( lg.c0.d), s->cp.l);
+	mc_accept( s, i, lg.c0);
+	e->stats.rot_chains++;
+	return 1;
+}
+
+/*!
+ * Run `nchains` translational and `nrot` rotational chains, mixed in
+ * a random order. Returns 0 if a chain fails.
+ */
+int ecmc_run( ecmc *e, int nchains, int nrot){
+	int ok = 1;
+	while( ok && (nchains > 0 || nrot > 0) ){
+		if( rng_below( &(e->g), nchains+nrot) < nchains ){
+			ok = ecmc_chain( e);
+			nchains--;
+		}else{
+			ok = ecmc_rot_chain( e);
+			nrot--;
+		}
+	}
+	return ok;
+}
@@ -0,0 +1,46 @@
+/*!*******************************************************************
+ * ecmc.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#ifndef JW_ECMC
+#define JW_ECMC
+
+#include <stdint.h>
+
+#include "rng.h"
+
+typedef struct{
+	double beta;
+	double step, rot_step;
+	double chain_length, chain_angle;
+	int hard;
+	uint64_t seed;
+} ecmc_params;
+
+typedef struct{
+	long chains, rot_chains, events, steps;
+} ecmc_stats;
+
+typedef struct{
+	state *s;
+	ecmc_params ep;
+	rng g;
+	ecmc_stats stats;
+	int dir;
+	int *idx;
+	double *u, *budget, *dist;
+	double *u_new, *dist_new;
+	double *wake, *near;
+	int *awake;
+	int nn, nmax;
+} ecmc;
+
+ecmc* ecmc_malloc( state *s, ecmc_params ep);
+void ecmc_free( ecmc *e);
+int ecmc_chain( ecmc *e);
+int ecmc_rot_chain( ecmc *e);
+int ecmc_run( ecmc *e, int nchains, int nrot);
+
+#endif /* JW_ECMC */
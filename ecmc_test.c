@@ -0,0 +1,144 @@
+/*!*******************************************************************
+ * ecmc_test.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "ecmc.c"
+
+/*!
+ * Check that every cylinder is on the list of the bucket that
+ * contains it, exactly once, and inside the box.
+ */
+int ecmc_consistent( state *s){
+	int m, nb, count;
+	cyl_ll *cur;
+
+	nb = s->nbx * s->nby * s->nbz;
+	count = 0;
+	for( m=0; m<nb; m++){
+		for( cur = s->heads[m]; cur != NULL; cur = cur->next){
+			if( bucket_index( s, cur->c.p) != m || cur->c.p.x < 0. ||
+				cur->c.p.x >= s->box.x ){
+				return 0;
+			}
+			count++;
+		}
+	}
+	return( count == s->n );
+}
+
+/*!
+ * Smallest closest approach between any two cylinders.
+ */
+double ecmc_min_dist( state *s){
+	int i, j;
+	double d, d_min = 1.0e10;
+	for( i=0; i<s->n; i++){
+		for( j=i+1; j<s->n; j++){
+			d = cyl_dist( s->a[i].c, state_image( s, s->a[j].c, cyl_point( s->a[i].c, 0.5)));
+			d_min = min( d, d_min);
+		}
+	}
+	return d_min;
+}
+
+void ecmc_test(){
+	int i, result;
+	double drift, max_drift, l;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {12., 12., 12.};
+	ecmc_params ep = { 1., 0.01, 0.01, 2., 1., 0, 99u};
+	vec3 c0[100];
+	state *s;
+	ecmc *e;
+
+	fprintf( stdout, "Testing ecmc_malloc: ");
+	s = state_malloc( cp, box, 100);
+	state_uniform_initialize( s);
+	result = ( ecmc_malloc( s, ep) == NULL );
+	state_free( s);
+	s = state_malloc( cp, box, 100);
+	state_set_periodic( s, 1);
+	state_uniform_initialize( s);
+	e = ecmc_malloc( s, ep);
+	result = result && ( e != NULL );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+		return;
+	}
+
+	fprintf( stdout, "Testing ecmc_chain: ");
+	for( i=0; i<s->n; i++){
+		c0[i] = cyl_point( s->a[i].c, 0.5);
+	}
+	result = 1;
+	for( i=0; i<30; i++){
+		result = result && ecmc_chain( e);
+	}
+	/* every chain moves the cylinders a total of chain_length */
+	l = 0.;
+	for( i=0; i<s->n; i++){
+		l += vec3_mag( min_image( vec3_sub( cyl_point( s->a[i].c, 0.5), c0[i]), box));
+	}
+	result = result && ( e->stats.chains == 30 ) && ( l > 0. ) && ( l < 30*ep.chain_length + 1.0e-6 );
+	drift = state_energy_check( s, &max_drift);
+	result = result && ( fabs( drift) < max( 1.0e-7, 100.*COORD_EPSILON)*(1.+fabs( s->u_tot)) );
+	result = result && ecmc_consistent( s);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing ecmc_rot_chain: ");
+	result = 1;
+	for( i=0; i<30; i++){
+		result = result && ecmc_rot_chain( e);
+	}
+	for( i=0; i<s->n; i++){
+		result = result && ( fabs( vec3_mag( s->a[i].c.d) - cp.l) < max( 1.0e-9, 100.*COORD_EPSILON)*cp.l );
+	}
+	drift = state_energy_check( s, &max_drift);
+	result = result && ( fabs( drift) < max( 1.0e-7, 100.*COORD_EPSILON)*(1.+fabs( s->u_tot)) );
+	result = result && ecmc_consistent( s);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	ecmc_free( e);
+
+	fprintf( stdout, "Testing ecmc_run with a hard core: ");
+	/* start again without overlapping cores */
+	state_free( s);
+	s = state_malloc( cp, box, 100);
+	state_set_periodic( s, 1);
+	state_uniform_initialize( s);
+	ep.hard = 1;
+	e = ecmc_malloc( s, ep);
+	l = ecmc_min_dist( s);
+	result = ecmc_run( e, 30, 30);
+	result = result && ( e->stats.chains == 30 && e->stats.rot_chains == 30 );
+	/* no cores that were apart can have been pushed together */
+	result = result && ( ecmc_min_dist( s) >= min( l, 2.*cp.r/TWO_1_6) - 1.0e-6 );
+	result = result && ecmc_consistent( s);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	ecmc_free( e);
+
+	state_free( s);
+}
+
+int main(){
+	ecmc_test();
+	return 0;
+}
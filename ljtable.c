@@ -0,0 +1,129 @@
+/*!*******************************************************************
+ * ljtable.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * This file builds the tabulated pair potentials in `ljtable.h`. Any
+ * of the Lennard-Jones forms in `lennardjones.c` can be tabulated
+ * along with its `lj_params`. The table is indexed by the squared
+ * distance, so the energy of a pair can be found straight from the
+ * squared distances in `cyl_dist2` and `cyl_dist2_batch`.
+ *
+ * The number of intervals `n` sets both the size and the accuracy of
+ * the table. The error of a cubic Hermite spline falls off as the
+ * fourth power of the grid spacing, and `lj_table_report` measures it
+ * against the analytic form.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "lennardjones.h"
+#include "ljtable.h"
+
+/*!
+ * Derivative of `f` with respect to r^2 at `r2`.
+ *
+ * Central differences are used in the interior. At the ends of the
+ * table one sided differences are used, so that the cutoff of the
+ * truncated and shifted forms (where the derivative jumps) is never
+ * straddled.
+ */
+static double lj_table_deriv( lj_table *t, double r2, int side){
+	double h = 1.0e-4*(t->r2_max - t->r2_min)/t->n;
+	double f0, f1, f2;
+	if( side == 0 ){
+		f1 = t->f( sqrt( r2+h), t->p);
+		f0 = t->f( sqrt( r2-h), t->p);
+		return( (f1-f0)/(2.*h) );
+	}
+	h = side*h;
+	f0 = t->f( sqrt( r2), t->p);
+	f1 = t->f( sqrt( r2+h), t->p);
+	f2 = t->f( sqrt( r2+2.*h), t->p);
+	return( (4.*f1 - 3.*f0 - f2)/(2.*h) );
+}
+
+/*!
+ * Constructor for a tabulated potential.
+ *
+ * Tabulates `f` with parameters `p` for distances between `r_min` and
+ * `r_max` using `n` intervals in r^2. The potential is taken to be
+ * zero past `r_max`, so for the truncated and shifted forms `r_max`
+ * should be the cutoff (`LJ_RMAX*p.r0` and `p.r0`). Returns `NULL` if
+ * any allocation fails.
+ */
+lj_table* lj_table_malloc( double (*f)( double r, lj_params p), lj_params p,
+						   double r_min, double r_max, int n){
+	int i;
+	double dr2, r2, f0, f1, m0, m1;
+	lj_table *t = (lj_table *) malloc( sizeof(lj_table));
+	if( t == NULL ){
+		return NULL;
+	}
+	t->c = (double *) malloc( 4*n*sizeof(double));
+	if( t->c == NULL ){
+		free( t);
+		return NULL;
+	}
+	t->f = f;
+	t->p = p;
+	t->n = n;
+	t->r2_min = r_min*r_min;
+	t->r2_max = r_max*r_max;
+	dr2 = (t->r2_max - t->r2_min)/n;
+	t->inv_dr2 = 1./dr2;
+
+	r2 = t->r2_min;
+	f1 = f( r_min, p);
+	m1 = dr2*lj_table_deriv( t, r2, 1);
+	for( i=0; i<n; i++){
+		f0 = f1;
+		m0 = m1;
+		r2 = t->r2_min + (i+1)*dr2;
+		f1 = f( sqrt( r2), p);
+		m1 = dr2*lj_table_deriv( t, r2, (i==n-1)?-1:0);
+		t->c[4*i] = f0;
+		t->c[4*i+1] = m0;
+		t->c[4*i+2] = 3.*(f1-f0) - 2.*m0 - m1;
+		t->c[4*i+3] = 2.*(f0-f1) + m0 + m1;
+	}
+	return t;
+}
+
+/*!
+ * Destructor for a tabulated potential.
+ */
+void lj_table_free( lj_table *t){
+	free( t->c);
+	free( t);
+}
+
+/*!
+ * Accuracy report for a tabulated potential.
+ *
+ * Compares the table with the analytic form at `samples` evenly spaced
+ * distances across the table. Prints the size of the table and the
+ * largest error, both absolute and in units of the well depth `u0`,
+ * and returns the largest absolute error.
+ */
+double lj_table_report( FILE *file, lj_table *t, int samples){
+	int i;
+	double r, r_min, r_max, err, max_err;
+	r_min = sqrt( t->r2_min);
+	r_max = sqrt( t->r2_max);
+	max_err = 0.;
+	for( i=0; i<samples; i++){
+		r = r_min + (r_max - r_min)*(i + 0.5)/samples;
+		err = fabs( t->f( r, t->p) - lj_table_eval( t, r*r));
+		if( err > max_err ){
+			max_err = err;
+		}
+	}
+	fprintf( file, "table %d intervals (%zu bytes), r in [%1.3e,%1.3e]:",
+			 t->n, 4*t->n*sizeof(double), r_min, r_max);
+	fprintf( file, " max error %1.3e (%1.3e u0)\n", max_err, max_err/fabs( t->p.u0));
+	return max_err;
+}
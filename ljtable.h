@@ -0,0 +1,62 @@
+/*!*******************************************************************
+ * ljtable.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#ifndef JW_LJTABLE
+#define JW_LJTABLE
+
+/*!
+ * Tabulated pair potential
+ * ----------------------------
+ * lj_table_eval : potential at squared distance `r2`
+ *
+ * The potential is stored as a cubic Hermite spline on a uniform grid
+ * in r^2, so a lookup is an index computation and a cubic polynomial,
+ * with no `sqrt` or division. The `n` intervals run from `r2_min` to
+ * `r2_max`, and interval `i` has the 4 polynomial coefficients
+ * `c[4*i]` to `c[4*i+3]`. Past `r2_max` the potential is zero, and
+ * below `r2_min` (deep inside the core, where the table would need a
+ * very fine grid) the analytic form `f` is called instead.
+ */
+typedef struct{
+	double r2_min, r2_max, inv_dr2;
+	int n;
+	double *c;
+	double (*f)( double r, lj_params p);
+	lj_params p;
+} lj_table;
+
+static inline double lj_table_eval( const lj_table *t, double r2){
+	double x;
+	const double *c;
+	int i;
+	if( r2 >= t->r2_max ){
+		return 0.;
+	}
+	if( r2 < t->r2_min ){
+		return t->f( sqrt( r2), t->p);
+	}
+	x = (r2 - t->r2_min)*t->inv_dr2;
+	i = (int) x;
+	/* just below r2_max the rounding can land on the end of the table */
+	if( i >= t->n ){
+		i = t->n-1;
+		x = 1.;
+	}else{
+		x -= i;
+	}
+	c = t->c + 4*i;
+	return c[0] + x*(c[1] + x*(c[2] + x*c[3]));
+}
+
+lj_table* lj_table_malloc( double (*f)( double r, lj_params p), lj_params p,
+						   double r_min, double r_max, int n);
+void lj_table_free( lj_table *t);
+double lj_table_report( FILE *file, lj_table *t, int samples);
+
+#endif /* JW_LJTABLE */
@@ -0,0 +1,89 @@
+/*!*******************************************************************
+ * ljtable_test.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "lennardjones.h"
+#include "ljtable.c"
+
+void test_ljtable(){
+	int i, j, hits, status;
+	lj_params p = { .u0 = 1., .r0 = 2.};
+	lj_table *t, *tt;
+	double r, r2, e0, e1, *guard;
+
+	fprintf( stdout, "Testing lj_table_eval: ");
+	t = lj_table_malloc( lj_truncated, p, 0.8*p.r0, LJ_RMAX*p.r0, 4096);
+	status = ( t != NULL );
+	for( i=0; i<1000 && status; i++){
+		r = 0.8*p.r0 + i*(LJ_RMAX-0.8)*p.r0/1000.;
+		status = ( fabs( lj_table_eval( t, r*r) - lj_truncated( r, p)) < 1.0e-6 );
+	}
+	r = 1.01*LJ_RMAX*p.r0;
+	status = status && ( lj_table_eval( t, r*r) == 0. );
+	r = 0.7*p.r0;
+	status = status && ( lj_table_eval( t, r*r) == lj_truncated( r, p) );
+	/* for some ranges the index of the last r2 below r2_max rounds up
+	 * to n, which has to be clamped to the last interval */
+	hits = 0;
+	for( i=1; i<=500 && status; i++){
+		p.r0 = 0.002*i;
+		tt = lj_table_malloc( lj_truncated, p, 0.8*p.r0, LJ_RMAX*p.r0, 1024);
+		status = ( tt != NULL );
+		/* a guard interval of NaNs after the table, so reading past
+		 * the end shows */
+		guard = (double *) realloc( tt->c, 4*(tt->n+1)*sizeof(double));
+		status = status && ( guard != NULL );
+		tt->c = guard;
+		for( j=4*tt->n; j<4*(tt->n+1); j++){
+			tt->c[j] = NAN;
+		}
+		r2 = nextafter( tt->r2_max, 0.);
+		hits += ( (int) ((r2 - tt->r2_min)*tt->inv_dr2) == tt->n );
+		status = status && ( fabs( lj_table_eval( tt, r2) - lj_truncated( sqrt( r2), p)) < 1.0e-9 );
+		lj_table_free( tt);
+	}
+	status = status && ( hits > 0 );
+	p.r0 = 2.;
+	if( status){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing lj_table_report: ");
+	tt = lj_table_malloc( lj_truncated, p, 0.8*p.r0, LJ_RMAX*p.r0, 1024);
+	e0 = lj_table_report( stdout, tt, 10000);
+	e1 = lj_table_report( stdout, t, 10000);
+	/* 4x the intervals should be about 256x more accurate */
+	status = ( e1 < e0/64. );
+	if( status){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	lj_table_free( tt);
+	lj_table_free( t);
+
+	fprintf( stdout, "Testing lj_table shifted: ");
+	p.r0 = 2./TWO_1_6;
+	t = lj_table_malloc( lj_shifted, p, 0.8*p.r0, p.r0, 2048);
+	e0 = lj_table_report( stdout, t, 10000);
+	status = ( e0 < 1.0e-6 );
+	if( status){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	lj_table_free( t);
+}
+
+int main(){
+	test_ljtable();
+	return 0;
+}
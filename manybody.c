@@ -37,10 +37,15 @@ typedef struct{
 
 /*!
  * A linked list structure
+ *
+ * The lists are doubly linked, and each cylinder keeps the index of
+ * the bucket whose list it is on (`bucket`, or -1 if it is not on a
+ * list), so taking it off a list does not need a walk.
  */
 typedef struct cyl_ll_struct{
 	cyl c;
-	struct cyl_ll_struct *next;
+	struct cyl_ll_struct *next, *prev;
+	int bucket;
 } cyl_ll;
 
 /*!
@@ -53,9 +58,41 @@ typedef struct cyl_ll_struct{
  * + `n` number of objects
  * + `a` array of linked_list objects
  * + `nbx`, `nby`, `nbz` The number of buckets in x, y, and z axis
- * + `heads` array of pointers to the heads of the list for each bucket
+ * + `heads` array of pointers to the heads of the list for each bucket,
+ *   with one extra bucket at the end that is always empty
+ * + `periodic` whether the box is periodic (otherwise it has hard walls)
+ * + `sub` the number of buckets the interaction range is divided into
+ *   along each axis (see `state_set_subdivision`)
+ * + `nnbr` the number of buckets in the stencil
+ * + `stencil` the offsets `(di, dj, dk)` of the buckets that can hold
+ *   a neighbor, `stencil[3*t]` up to `stencil[3*t+2]`, closest first
+ * + `wrap` for every axis a table of the code (see `code`) of the
+ *   bucket `d` over from bucket `i`, at `wrap[(2*sub+1)*i + d+sub]`
+ *   with the y and z tables following the x table. Past a wall, and
+ *   for repeats when the box is only a few buckets across, the entry
+ *   is -1.
+ * + `morton` whether the buckets are numbered along a Morton curve
+ *   (see `state_set_morton`)
+ * + `code` the part of the code of bucket `(i, j, k)` that comes from
+ *   each axis, `code[i] + code[nbx+j] + code[nbx+nby+k]`. In row
+ *   major order this is `i + nbx*j + nbx*nby*k`, for a Morton curve
+ *   the bits of `i`, `j` and `k` are interleaved.
+ * + `rank` the bucket index for each code, -1 for codes that are not
+ *   a bucket
+ * + `cell` the `(i, j, k)` of each bucket, `cell[3*m]` up to
+ *   `cell[3*m+2]`
+ * + `hook`, `hook_ctx` if `hook` is not `NULL`, `mc_accept` calls
+ *   `hook( hook_ctx, s, i, c_new)` just before cylinder `i` is moved
+ *   to `c_new`, so the state still has the old position. It can be
+ *   called from several threads at once for cylinders that do not
+ *   interact (see `sweep.c`).
+ * + `potential` the pair potential of the energy functions in
+ *   montecarlo.c, 0 for `u_cc` (see `mc_set_potential`)
+ * + `u` cached energy of each cylinder with all its neighbors
+ * + `u_tot` cached total energy
+ * + `u_valid` whether the cached energies are up to date
  */
-typedef struct{
+typedef struct state_struct{
 	cyl_params cp;
 	vec3 box;
 	int n; 
@@ -63,8 +100,287 @@ typedef struct{
 	int nbx, nby, nbz;
 	vec3 bucket;
 	cyl_ll **heads;
+	int periodic;
+	int sub, nnbr;
+	int *stencil, *wrap;
+	int morton;
+	int *code, *rank, *cell;
+	void (*hook)( void *ctx, struct state_struct *s, int i, cyl c_new);
+	void *hook_ctx;
+	int potential;
+	double *u;
+	double u_tot;
+	int u_valid;
 } state;
 
+/*!
+ * Bucket subdivision
+ *
+ * The buckets can be a fraction `1/sub` of the interaction range, up
+ * to `SUB_MAX`, so the stencil has at most `NBR_MAX` buckets.
+ */
+#define SUB_MAX 4
+#define NBR_MAX ((2*SUB_MAX+1)*(2*SUB_MAX+1)*(2*SUB_MAX+1))
+
+/*!
+ * Fill in the wrap table of one axis with `nb` buckets and codes
+ * `code`.
+ *
+ * The offsets count as closer in the order 0, -1, 1, -2, 2, ... and
+ * in a periodic box an offset that lands on the same bucket as a
+ * closer one is a repeat.
+ */
+static void state_wrap_axis( int *wrap, int nb, int *code, int sub, int periodic){
+	int i, d, e, ii, w = 2*sub+1;
+	for( i=0; i<nb; i++){
+		for( d=-sub; d<=sub; d++){
+			ii = i+d;
+			if( periodic ){
+				ii = ((ii%nb)+nb)%nb;
+				for( e=-sub; e<=sub; e++){
+					if( (abs(e) < abs(d) || (abs(e) == abs(d) && e < d)) &&
+						(((i+e)%nb)+nb)%nb == ii ){
+						ii = -1;
+						break;
+					}
+				}
+			}
+			wrap[w*i + d+sub] = ( ii >= 0 && ii < nb )?code[ii]:-1;
+		}
+	}
+}
+
+/*!
+ * Fill in the codes of the three axes, and return the number of
+ * codes.
+ *
+ * For a Morton curve the bits of the three indices are interleaved,
+ * lowest first. Once an axis runs out of bits the others carry on
+ * without it, so a long thin box does not leave most of the codes
+ * unused.
+ */
+static int state_codes( state *s){
+	int n[3], bits[3], pos[3][31], *code[3];
+	int a, b, i, np;
+	n[0] = s->nbx; n[1] = s->nby; n[2] = s->nbz;
+	code[0] = s->code;
+	code[1] = s->code + s->nbx;
+	code[2] = s->code + s->nbx + s->nby;
+	if( !s->morton ){
+		for( i=0; i<n[0]; i++){ code[0][i] = i; }
+		for( i=0; i<n[1]; i++){ code[1][i] = n[0]*i; }
+		for( i=0; i<n[2]; i++){ code[2][i] = n[0]*n[1]*i; }
+		return n[0]*n[1]*n[2];
+	}
+	for( a=0; a<3; a++){
+		for( bits[a]=0; (1<<bits[a]) < n[a]; bits[a]++);
+	}
+	np = 0;
+	for( b=0; b<31; b++){
+		for( a=0; a<3; a++){
+			if( b < bits[a] ){
+				pos[a][b] = np++;
+			}
+		}
+	}
+	for( a=0; a<3; a++){
+		for( i=0; i<n[a]; i++){
+			code[a][i] = 0;
+			for( b=0; b<bits[a]; b++){
+				code[a][i] |= ((i>>b)&1)<<pos[a][b];
+			}
+		}
+	}
+	return 1<<np;
+}
+
+/*!
+ * Index of bucket `(i, j, k)`.
+ */
+int state_bucket( state *s, int i, int j, int k){
+	return s->rank[s->code[i] + s->code[s->nbx+j] + s->code[s->nbx+s->nby+k]];
+}
+
+/*!
+ * Empty every bucket.
+ *
+ * Afterwards none of the first `n` cylinders is on a list.
+ */
+void state_empty_buckets( state *s){
+	int i, nb = s->nbx * s->nby * s->nbz;
+	for( i=0; i<=nb; i++){
+		s->heads[i] = NULL;
+	}
+	for( i=0; i<s->n; i++){
+		s->a[i].bucket = -1;
+	}
+}
+
+/*!
+ * Set up the buckets.
+ *
+ * Sizes the bucket grid for the box, and (re)allocates the heads, the
+ * stencil and the wrap tables. The buckets are at least `1/sub` of
+ * the interaction range `2*(LJ_RMAX*r+l)` across, and the stencil
+ * holds every offset whose closest point is within the range of the
+ * bucket, sorted by the distance between the bucket centers. In a
+ * periodic box the number of buckets along an axis is rounded down to
+ * a multiple of `sub+1` (if more than `sub+1`), so that the colouring
+ * of the buckets in `sweep.c` still holds across the periodic
+ * boundary. The buckets are numbered in the order of their codes. All
+ * the buckets are left empty, and no cylinder is on a list. Returns 0
+ * if an allocation fails.
+ */
+static int state_buckets( state *s){
+	double min_bucket_size, range2, d2, key[NBR_MAX];
+	int di, dj, dk, i, j, k, t, m, nb, nw, nc, sub = s->sub, *stencil, *wrap, *tmp;
+	vec3 gap;
+	cyl_ll **heads;
+
+	min_bucket_size = 2.*(LJ_RMAX*s->cp.r+s->cp.l);
+	s->nbx = (int) (sub*s->box.x/min_bucket_size);
+	s->nby = (int) (sub*s->box.y/min_bucket_size);
+	s->nbz = (int) (sub*s->box.z/min_bucket_size);
+	if( s->periodic ){
+		s->nbx -= (s->nbx > sub+1)?(s->nbx%(sub+1)):0;
+		s->nby -= (s->nby > sub+1)?(s->nby%(sub+1)):0;
+		s->nbz -= (s->nbz > sub+1)?(s->nbz%(sub+1)):0;
+	}
+	s->bucket.x = s->box.x/s->nbx;
+	s->bucket.y = s->box.y/s->nby;
+	s->bucket.z = s->box.z/s->nbz;
+
+	nb = s->nbx * s->nby * s->nbz;
+	nw = (2*sub+1)*(s->nbx + s->nby + s->nbz);
+	heads = (cyl_ll **) realloc( s->heads, (nb+1)*sizeof(cyl_ll *));
+	if( heads == NULL ){
+		return 0;
+	}
+	s->heads = heads;
+	stencil = (int *) realloc( s->stencil, 3*NBR_MAX*sizeof(int));
+	if( stencil == NULL ){
+		return 0;
+	}
+	s->stencil = stencil;
+	wrap = (int *) realloc( s->wrap, nw*sizeof(int));
+	if( wrap == NULL ){
+		return 0;
+	}
+	s->wrap = wrap;
+	tmp = (int *) realloc( s->code, (s->nbx + s->nby + s->nbz)*sizeof(int));
+	if( tmp == NULL ){
+		return 0;
+	}
+	s->code = tmp;
+	tmp = (int *) realloc( s->cell, 3*nb*sizeof(int));
+	if( tmp == NULL ){
+		return 0;
+	}
+	s->cell = tmp;
+	nc = state_codes( s);
+	tmp = (int *) realloc( s->rank, nc*sizeof(int));
+	if( tmp == NULL ){
+		return 0;
+	}
+	s->rank = tmp;
+	state_empty_buckets( s);
+
+	/* number the buckets in the order of their codes */
+	for( i=0; i<nc; i++){
+		s->rank[i] = -1;
+	}
+	for( k=0; k<s->nbz; k++){
+		for( j=0; j<s->nby; j++){
+			for( i=0; i<s->nbx; i++){
+				s->rank[s->code[i] + s->code[s->nbx+j] + s->code[s->nbx+s->nby+k]] = 0;
+			}
+		}
+	}
+	m = 0;
+	for( i=0; i<nc; i++){
+		if( s->rank[i] == 0 ){
+			s->rank[i] = m++;
+		}
+	}
+	for( k=0; k<s->nbz; k++){
+		for( j=0; j<s->nby; j++){
+			for( i=0; i<s->nbx; i++){
+				m = state_bucket( s, i, j, k);
+				s->cell[3*m] = i;
+				s->cell[3*m+1] = j;
+				s->cell[3*m+2] = k;
+			}
+		}
+	}
+
+	/* the offsets within range, sorted by an insertion sort */
+	range2 = min_bucket_size*min_bucket_size;
+	s->nnbr = 0;
+	for( di=-sub; di<=sub; di++){
+		for( dj=-sub; dj<=sub; dj++){
+			for( dk=-sub; dk<=sub; dk++){
+				/* closest approach of the two buckets */
+				gap.x = max( abs(di)-1, 0)*s->bucket.x;
+				gap.y = max( abs(dj)-1, 0)*s->bucket.y;
+				gap.z = max( abs(dk)-1, 0)*s->bucket.z;
+				if( vec3_dot( gap, gap) >= range2 ){
+					continue;
+				}
+				gap.x = di*s->bucket.x;
+				gap.y = dj*s->bucket.y;
+				gap.z = dk*s->bucket.z;
+				d2 = vec3_dot( gap, gap);
+				for( t=s->nnbr; t>0 && key[t-1] > d2; t--){
+					key[t] = key[t-1];
+					s->stencil[3*t] = s->stencil[3*t-3];
+					s->stencil[3*t+1] = s->stencil[3*t-2];
+					s->stencil[3*t+2] = s->stencil[3*t-1];
+				}
+				key[t] = d2;
+				s->stencil[3*t] = di;
+				s->stencil[3*t+1] = dj;
+				s->stencil[3*t+2] = dk;
+				s->nnbr++;
+			}
+		}
+	}
+
+	state_wrap_axis( s->wrap, s->nbx, s->code, sub, s->periodic);
+	state_wrap_axis( s->wrap + (2*sub+1)*s->nbx, s->nby, s->code + s->nbx, sub, s->periodic);
+	state_wrap_axis( s->wrap + (2*sub+1)*(s->nbx+s->nby), s->nbz, s->code + s->nbx + s->nby,
+					 sub, s->periodic);
+	return 1;
+}
+
+/*!
+ * The neighboring buckets of bucket `m`.
+ *
+ * Writes the `s->nnbr` buckets of the stencil around bucket `m` into
+ * `nbr` (which must have room for `NBR_MAX`), closest first, and
+ * returns how many there are. Neighbors past a wall, and repeats when
+ * the box is only a few buckets across, are replaced by the empty
+ * bucket, so a scan over the neighbors never needs to check for the
+ * edges.
+ */
+int state_neighbors( state *s, int m, int *nbr){
+	int i, j, k, t, a, b, c, w, nb, *wx, *wy, *wz;
+	w = 2*s->sub+1;
+	nb = s->nbx * s->nby * s->nbz;
+	i = s->cell[3*m];
+	j = s->cell[3*m+1];
+	k = s->cell[3*m+2];
+	wx = s->wrap + w*i + s->sub;
+	wy = s->wrap + w*(s->nbx + j) + s->sub;
+	wz = s->wrap + w*(s->nbx + s->nby + k) + s->sub;
+	for( t=0; t<s->nnbr; t++){
+		a = wx[s->stencil[3*t]];
+		b = wy[s->stencil[3*t+1]];
+		c = wz[s->stencil[3*t+2]];
+		nbr[t] = ( (a|b|c) < 0 )?nb:s->rank[a+b+c];
+	}
+	return s->nnbr;
+}
+
 /*!
  * Constructor for the state.
  *
@@ -80,8 +396,7 @@ typedef struct{
  * returns `NULL`.
  */
 state* state_malloc( cyl_params cp, vec3 box, int n){
-	double min_bucket_size;
-	int i, nb;
+	int i;
 
 	state *s = (state *) malloc( sizeof(state));
 	if( s == NULL ){
@@ -90,14 +405,18 @@ state* state_malloc( cyl_params cp, vec3 box, int n){
 	s->cp = cp;
 	s->box = box;
 	s->n = n;
-
-	min_bucket_size = 2.*(LJ_RMAX*cp.r+cp.l);
-	s->nbx = (int) (box.x/min_bucket_size);
-	s->nby = (int) (box.y/min_bucket_size);
-	s->nbz = (int) (box.z/min_bucket_size);
-	s->bucket.x = box.x/s->nbx;
-	s->bucket.y = box.y/s->nby;
-	s->bucket.z = box.z/s->nbz;
+	s->periodic = 0;
+	s->sub = 1;
+	s->morton = 0;
+	s->heads = NULL;
+	s->stencil = NULL;
+	s->wrap = NULL;
+	s->code = NULL;
+	s->rank = NULL;
+	s->cell = NULL;
+	s->hook = NULL;
+	s->hook_ctx = NULL;
+	s->potential = 0;
 
 	s->a = (cyl_ll *) malloc( n*sizeof(cyl_ll));
 	if( s->a == NULL ){
@@ -106,17 +425,34 @@ state* state_malloc( cyl_params cp, vec3 box, int n){
 	}
 	for( i=0; i<n; i++){
 		s->a[i].next = NULL;
+		s->a[i].prev = NULL;
+		s->a[i].bucket = -1;
 	}
-	nb = s->nbx * s->nby * s->nbz;
-	s->heads = (cyl_ll **) malloc( nb*sizeof(cyl_ll *));
-	if( s->heads == NULL ){
+	if( !state_buckets( s) ){
+		free( s->heads);
+		free( s->stencil);
+		free( s->wrap);
+		free( s->code);
+		free( s->rank);
+		free( s->cell);
 		free( s->a);
 		free( s);
 		return NULL;
 	}
-	for( i=0; i<nb; i++){
-		s->heads[i] = NULL;
+	s->u = (double *) malloc( n*sizeof(double));
+	if( s->u == NULL ){
+		free( s->stencil);
+		free( s->wrap);
+		free( s->code);
+		free( s->rank);
+		free( s->cell);
+		free( s->heads);
+		free( s->a);
+		free( s);
+		return NULL;
 	}
+	s->u_tot = 0.;
+	s->u_valid = 0;
 	return s;
 }
 
@@ -124,66 +460,293 @@ state* state_malloc( cyl_params cp, vec3 box, int n){
  * Destructor for the state.
  */
 void state_free( state* s){
+	free( s->u);
+	free( s->stencil);
+	free( s->wrap);
+	free( s->code);
+	free( s->rank);
+	free( s->cell);
 	free( s->heads);
 	free( s->a);
 	free( s);
 }
 
+/*!
+ * Index of the bucket containing a point.
+ *
+ * The point `p` is assumed to lie inside the box. Note the division
+ * must happen before the cast, otherwise the coordinate is truncated
+ * to an integer first and points near the upper edge of a bucket end
+ * up in the bucket below.
+ */
+int bucket_index( state *s, vec3 p){
+	int i = (int) (p.x/s->bucket.x);
+	int j = (int) (p.y/s->bucket.y);
+	int k = (int) (p.z/s->bucket.z);
+	return state_bucket( s, i, j, k);
+}
+
+/*!
+ * Switch between a box with hard walls and a periodic box.
+ *
+ * The bucket grid is set up again for the new boundary conditions,
+ * and every bucket is emptied, so this should be called before the
+ * cylinders are placed. Returns 0 if an allocation fails.
+ */
+int state_set_periodic( state *s, int periodic){
+	s->periodic = periodic;
+	s->u_valid = 0;
+	return state_buckets( s);
+}
+
+/*!
+ * Divide the interaction range into `sub` buckets along each axis.
+ *
+ * With the default `sub` = 1 a bucket is a whole interaction range
+ * across and the stencil is the 27 buckets around it, which covers a
+ * volume many times that of the interaction sphere, especially for
+ * long cylinders. Smaller buckets give a stencil that follows the
+ * sphere more closely (125 buckets of 1/8 the volume for `sub` = 2,
+ * 311 to 335 buckets of 1/27 the volume for `sub` = 3), so fewer
+ * cylinders out of range are looked at, at the cost of more empty
+ * buckets to step over. The bucket grid is set up again and every
+ * bucket is emptied, so this should be called before the cylinders
+ * are placed. Returns 0 if `sub` is not between 1 and `SUB_MAX` or an
+ * allocation fails.
+ */
+int state_set_subdivision( state *s, int sub){
+	if( sub < 1 || sub > SUB_MAX ){
+		return 0;
+	}
+	s->sub = sub;
+	s->u_valid = 0;
+	return state_buckets( s);
+}
+
+/*!
+ * Number the buckets along a Morton (Z order) curve.
+ *
+ * By default the buckets are numbered in row major order, so the
+ * buckets in a stencil are spread all over the heads. Along a Morton
+ * curve buckets that are close in space mostly have close indices, and
+ * with `state_reorder` so do the cylinders in them. The bucket grid is
+ * set up again and every bucket is emptied, so this should be called
+ * before the cylinders are placed. Returns 0 if an allocation fails.
+ */
+int state_set_morton( state *s, int morton){
+	s->morton = morton;
+	s->u_valid = 0;
+	return state_buckets( s);
+}
+
+/*!
+ * Put cylinder `l` at the head of the list of bucket `m`.
+ */
+static void cyl_list_push( state *s, int l, int m){
+	cyl_ll *a = &(s->a[l]);
+	a->bucket = m;
+	a->prev = NULL;
+	a->next = s->heads[m];
+	if( a->next != NULL ){
+		a->next->prev = a;
+	}
+	s->heads[m] = a;
+}
+
+/*!
+ * Take cylinder `l` off the list it is on.
+ */
+static void cyl_list_unlink( state *s, int l){
+	cyl_ll *a = &(s->a[l]);
+	if( a->prev != NULL ){
+		a->prev->next = a->next;
+	}else{
+		s->heads[a->bucket] = a->next;
+	}
+	if( a->next != NULL ){
+		a->next->prev = a->prev;
+	}
+	a->bucket = -1;
+}
+
+/*!
+ * Sort the cylinders by bucket.
+ *
+ * Over a run the cylinders drift away from where they started, and
+ * the ones in a bucket end up all over the array. This copies the
+ * cylinders into bucket order (and within a bucket in list order), so
+ * a scan over the neighboring buckets reads memory that is mostly
+ * together, and links the lists up again. The cached energies move
+ * with the cylinders. Anything else that is kept by cylinder index
+ * has to be moved along too: if `id` is not `NULL` it is permuted the
+ * same way, so passing the original indices keeps track of which
+ * cylinder is which. Returns 0 if an allocation fails, in which case
+ * the state is unchanged.
+ */
+int state_reorder( state *s, int *id){
+	int nb, m, q, *b, *tid;
+	cyl *c;
+	double *u;
+	cyl_ll *cur;
+
+	nb = s->nbx * s->nby * s->nbz;
+	c = (cyl *) malloc( s->n*sizeof(cyl));
+	u = (double *) malloc( s->n*sizeof(double));
+	b = (int *) malloc( s->n*sizeof(int));
+	tid = (int *) malloc( s->n*sizeof(int));
+	if( c == NULL || u == NULL || b == NULL || tid == NULL ){
+		free( c);
+		free( u);
+		free( b);
+		free( tid);
+		return 0;
+	}
+	q = 0;
+	for( m=0; m<nb; m++){
+		for( cur = s->heads[m]; cur != NULL; cur = cur->next){
+			c[q] = cur->c;
+			u[q] = s->u[cur - s->a];
+			tid[q] = (id != NULL)?id[cur - s->a]:0;
+			b[q] = m;
+			q++;
+		}
+	}
+	state_empty_buckets( s);
+	for( q=s->n-1; q>=0; q--){
+		s->a[q].c = c[q];
+		cyl_list_push( s, q, b[q]);
+		s->u[q] = u[q];
+		if( id != NULL ){
+			id[q] = tid[q];
+		}
+	}
+	free( c);
+	free( u);
+	free( b);
+	free( tid);
+	return 1;
+}
+
+/*!
+ * Minimum image of a separation `d` in a periodic box of size `box`.
+ */
+vec3 min_image( vec3 d, vec3 box){
+	d.x -= box.x*floor( d.x/box.x + 0.5);
+	d.y -= box.y*floor( d.y/box.y + 0.5);
+	d.z -= box.z*floor( d.z/box.z + 0.5);
+	return d;
+}
+
+/*!
+ * Wrap a point back into a periodic box.
+ *
+ * Does nothing if the box has hard walls.
+ */
+vec3 state_wrap( state *s, vec3 p){
+	if( s->periodic ){
+		p.x -= s->box.x*floor( p.x/s->box.x);
+		p.y -= s->box.y*floor( p.y/s->box.y);
+		p.z -= s->box.z*floor( p.z/s->box.z);
+		/* a tiny negative coordinate can round up to the box size */
+		p.x = (p.x < s->box.x)?p.x:0.;
+		p.y = (p.y < s->box.y)?p.y:0.;
+		p.z = (p.z < s->box.z)?p.z:0.;
+	}
+	return p;
+}
+
+/*!
+ * The periodic image of cylinder `c` closest to the point `ref`.
+ *
+ * The images are compared by the center of the cylinder. Returns `c`
+ * unchanged if the box has hard walls.
+ */
+cyl state_image( state *s, cyl c, vec3 ref){
+	vec3 d;
+	if( s->periodic ){
+		d = vec3_sub( cyl_point( c, 0.5), ref);
+		c.p = vec3_add( c.p, vec3_sub( min_image( d, s->box), d));
+	}
+	return c;
+}
+
+/*!
+ * Check if a cylinder is an allowed position.
+ *
+ * In a periodic box every position is allowed, otherwise the cylinder
+ * has to be inside the box.
+ */
+int state_inside( state *s, cyl c){
+	return( s->periodic || cyl_box_overlap( c, s->box) );
+}
+
 /*!
  * Add a cylinder the appropriate bucket.
+ *
+ * In a periodic box the position is wrapped into the box first. If
+ * the cylinder is already on a list it is taken off first.
  */
 int cyl_list_add( state *s, int l){
-	vec3 p = s->a[l].c.p;
-	int i = (int) p.x/s->bucket.x;
-	int j = (int) p.y/s->bucket.y;
-	int k = (int) p.z/s->bucket.z;
-	int m = (s->nbx)*( (s->nby)*k + j) + i;
-	s->a[l].next = s->heads[m];
-	s->heads[m] = &(s->a[l]);
+	if( s->a[l].bucket >= 0 ){
+		cyl_list_unlink( s, l);
+	}
+	s->a[l].c.p = state_wrap( s, s->a[l].c.p);
+	cyl_list_push( s, l, bucket_index( s, s->a[l].c.p));
 	return 1;
 }
 
 /*!
  * Move a cylinder to a new bucket.
  *
- * Move a cylinder to a new bucket based on a new point `pnew`.
+ * Move a cylinder to a new bucket based on a new point `pnew`. In a
+ * periodic box the new point is wrapped into the box first. The old
+ * bucket is the one stored with the cylinder, and the lists are
+ * doubly linked, so this takes the same time however full the buckets
+ * are. Returns 0 if the cylinder was not on a list (it is added to the
+ * new bucket anyway).
  */
 int cyl_list_move( state *s, int l, vec3 pnew){
-	int retval;
-	cyl_ll *cur;
-	vec3 p = s->a[l].c.p;
-	int i = (int) p.x/s->bucket.x;
-	int j = (int) p.y/s->bucket.y;
-	int k = (int) p.z/s->bucket.z;
-	int m = (s->nbx)*( (s->nby)*k + j) + i;
+	int mm;
+	pnew = state_wrap( s, pnew);
+	mm = bucket_index( s, pnew);
 	s->a[l].c.p = pnew;
-	int ii = (int) pnew.x/s->bucket.x;
-	int jj = (int) pnew.y/s->bucket.y;
-	int kk = (int) pnew.z/s->bucket.z;
-	int mm = (s->nbx)*( (s->nby)*kk + jj) + ii;
-	if( m == mm ){
+	if( s->a[l].bucket == mm ){
 		return 1;
 	}
-	/* remove the cyl from list `m` */
-	cur = s->heads[m];
-	if( cur == &(s->a[l])){
-		s->heads[m] = cur->next;
-		retval = 1;
-	}else{
-		while( cur->next != &(s->a[l]) && cur->next != NULL ){
-			cur = cur->next;
-		}
-		if( cur->next != NULL ){
-			cur->next = cur->next->next;
-			retval = 1;
-		}else{
-			retval = 0;
+	if( s->a[l].bucket < 0 ){
+		cyl_list_push( s, l, mm);
+		return 0;
+	}
+	cyl_list_unlink( s, l);
+	cyl_list_push( s, l, mm);
+	return 1;
+}
+
+/*!
+ * Move many cylinders at once.
+ *
+ * Moves cylinder `l[q]` to `pnew[q]` for each of the `nmoves` moves,
+ * as `cyl_list_move` would, and returns how many of them changed
+ * bucket. The lists are only touched for the cylinders that actually
+ * change bucket. A cylinder can appear more than once, the moves are
+ * applied in order.
+ */
+int cyl_list_move_batch( state *s, int nmoves, const int *l, const vec3 *pnew){
+	int q, mm, changed = 0;
+	vec3 p;
+	for( q=0; q<nmoves; q++){
+		p = state_wrap( s, pnew[q]);
+		mm = bucket_index( s, p);
+		s->a[l[q]].c.p = p;
+		if( s->a[l[q]].bucket != mm ){
+			if( s->a[l[q]].bucket >= 0 ){
+				cyl_list_unlink( s, l[q]);
+			}
+			cyl_list_push( s, l[q], mm);
+			changed++;
 		}
 	}
-	/* add the cyl to the list `mm` */
-	s->a[l].next = s->heads[mm];
-	s->heads[mm] = &(s->a[l]);
-	return retval;
+	return changed;
 }
 
 /*!
@@ -198,7 +761,7 @@ int cyl_list_move( state *s, int l, vec3 pnew){
  * going through all possible permutations and minimizing a weighted
  * sum that compares the relative difference in total number, and
  * rations x:y, x:z, and y:z. Finally it fills in the state with the
- * cylinders.
+ * cylinders. The cached energies are marked out of date.
  */
 int state_uniform_initialize( state *s){
 	vec3 bbox, d;
@@ -278,6 +841,7 @@ int state_uniform_initialize( state *s){
 	bbox.y = s->box.y/ny;
 	bbox.z = s->box.z/nz;
 
+	s->u_valid = 0;
 	l = 0;
 	for( i=0; i<nx; i++){
 		for( j=0; j<ny; j++){
@@ -7,16 +7,20 @@
 #ifndef JW_MANYBODY
 #define JW_MANYBODY
 
+#define SUB_MAX 4
+#define NBR_MAX ((2*SUB_MAX+1)*(2*SUB_MAX+1)*(2*SUB_MAX+1))
+
 typedef struct{
 	double r, l;
 } cyl_params;
 
 typedef struct cyl_ll_struct{
 	cyl c;
-	struct cyl_ll_struct *next;
+	struct cyl_ll_struct *next, *prev;
+	int bucket;
 } cyl_ll;
 
-typedef struct{
+typedef struct state_struct{
 	cyl_params cp;
 	vec3 box;
 	int n; 
@@ -24,12 +28,36 @@ typedef struct{
 	int nbx, nby, nbz;
 	vec3 bucket;
 	cyl_ll **heads;
+	int periodic;
+	int sub, nnbr;
+	int *stencil, *wrap;
+	int morton;
+	int *code, *rank, *cell;
+	void (*hook)( void *ctx, struct state_struct *s, int i, cyl c_new);
+	void *hook_ctx;
+	int potential;
+	double *u;
+	double u_tot;
+	int u_valid;
 } state;
 
 state* state_malloc( cyl_params cp, vec3 box, int n);
 void state_free( state* s);
+void state_empty_buckets( state *s);
+int state_bucket( state *s, int i, int j, int k);
+int bucket_index( state *s, vec3 p);
+int state_neighbors( state *s, int m, int *nbr);
+int state_set_periodic( state *s, int periodic);
+int state_set_subdivision( state *s, int sub);
+int state_set_morton( state *s, int morton);
+int state_reorder( state *s, int *id);
+vec3 min_image( vec3 d, vec3 box);
+vec3 state_wrap( state *s, vec3 p);
+cyl state_image( state *s, cyl c, vec3 ref);
+int state_inside( state *s, cyl c);
 int cyl_list_add( state *s, int l);
 int cyl_list_move( state *s, int l, vec3 pnew);
+int cyl_list_move_batch( state *s, int nmoves, const int *l, const vec3 *pnew);
 int state_uniform_initialize( state *s);
 int state_print( FILE *file, state *s);
 
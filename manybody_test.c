@@ -7,6 +7,12 @@ int cyl_print_ln( FILE *file, cyl c){
 		            c.p.x, c.p.y, c.p.z, c.d.x, c.d.y, c.d.z, c.r);
 }
 
+int cyl_box_overlap( cyl c, vec3 box){
+	(void) c;
+	(void) box;
+	return 1;
+}
+
 void state_test(){
 	FILE *file;
 	int result = 0;
@@ -91,7 +97,305 @@ void state_test(){
 	state_free( s);
 }
 
+void periodic_test(){
+	int result, t, m, n, nbr[NBR_MAX];
+	cyl_params cp = {0.2, 1};
+	vec3 box = {20., 20.5, 11.};
+	vec3 p = {-0.5, 21., 5.};
+	vec3 ref = {19.5, 0.5, 5.};
+	cyl c = { {0.5, 0.5, 0.5}, {0., 0., 1.}, 0.2};
+	state *s = state_malloc( cp, box, 500);
+
+	fprintf( stdout, "Testing state_set_periodic: ");
+	result = state_set_periodic( s, 1);
+	/* 7 buckets in y is rounded down to 6, 3 in z down to 2 */
+	result = result && ( s->nbx == 6 && s->nby == 6 && s->nbz == 2 );
+	/* bucket 0 wraps around to the far side in x and y */
+	result = result && ( state_neighbors( s, 0, nbr) == 27 );
+	n = 0;
+	for( t=0; t<27; t++){
+		m = nbr[t];
+		n += ( m%36 == 5 || m%36 == 6*5 || m%36 == 6*5+5 );
+		result = result && ( m >= 0 && m <= 6*6*2 );
+	}
+	result = result && ( n == 6 );
+	/* only 2 buckets in z, so 9 of the neighbors are repeats */
+	n = 0;
+	for( t=0; t<27; t++){
+		n += ( nbr[t] == 6*6*2 );
+	}
+	result = result && ( n == 9 );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing state_wrap: ");
+	p = state_wrap( s, p);
+	result = ( fabs( p.x - 19.5) < 1.0e-12 && fabs( p.y - 0.5) < 1.0e-12 && p.z == 5. );
+	p = state_wrap( s, (vec3) {-1.0e-18, 0., 0.});
+	result = result && ( p.x >= 0. && p.x < box.x );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing state_image: ");
+	c = state_image( s, c, ref);
+	result = ( fabs( c.p.x - 20.5) < 1.0e-12 && fabs( c.p.y - 0.5) < 1.0e-12 );
+	result = result && ( c.p.z == 0.5 );
+	s->periodic = 0;
+	c = state_image( s, c, (vec3) {0., 0., 0.});
+	result = result && ( fabs( c.p.x - 20.5) < 1.0e-12 );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	state_free( s);
+}
+
+/*!
+ * Check that the stencil of the bucket of `p` holds the bucket of `q`.
+ */
+int stencil_has( state *s, vec3 p, vec3 q){
+	int t, n, m, nbr[NBR_MAX];
+	n = state_neighbors( s, bucket_index( s, p), nbr);
+	m = bucket_index( s, q);
+	for( t=0; t<n; t++){
+		if( nbr[t] == m ){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void subdivision_test(){
+	int result, i, sub, periodic;
+	unsigned int seed = 12345u;
+	cyl_params cp = {0.2, 1};
+	vec3 box = {20., 20.5, 11.};
+	vec3 p, q, d;
+	double range = 2.*(LJ_RMAX*cp.r+cp.l);
+	state *s = state_malloc( cp, box, 10);
+
+	fprintf( stdout, "Testing state_set_subdivision: ");
+	result = !state_set_subdivision( s, 0) && !state_set_subdivision( s, SUB_MAX+1);
+	result = result && state_set_subdivision( s, 2);
+	result = result && ( s->nbx == 13 && s->nby == 14 && s->nbz == 7 );
+	result = result && ( s->nnbr == 125 );
+	result = result && state_set_subdivision( s, 3);
+	result = result && ( s->nnbr > 27 && s->nnbr < 343 );
+	/* closest first, starting with the own bucket */
+	result = result && ( s->stencil[0] == 0 && s->stencil[1] == 0 && s->stencil[2] == 0 );
+	/* every pair within range is in the stencil, with walls and periodic,
+	 * and with the buckets in row major and Morton order */
+	for( periodic=0; periodic<4; periodic++){
+		for( sub=1; sub<=3; sub++){
+			result = result && state_set_periodic( s, periodic&1);
+			result = result && state_set_morton( s, periodic>>1);
+			result = result && state_set_subdivision( s, sub);
+			for( i=0; i<20000; i++){
+				p.x = box.x*rand_r( &seed)/(RAND_MAX+1.);
+				p.y = box.y*rand_r( &seed)/(RAND_MAX+1.);
+				p.z = box.z*rand_r( &seed)/(RAND_MAX+1.);
+				d.x = range*(2.*rand_r( &seed)/(RAND_MAX+1.) - 1.);
+				d.y = range*(2.*rand_r( &seed)/(RAND_MAX+1.) - 1.);
+				d.z = range*(2.*rand_r( &seed)/(RAND_MAX+1.) - 1.);
+				if( vec3_dot( d, d) >= range*range ){
+					continue;
+				}
+				q = vec3_add( p, d);
+				if( !(periodic&1) && ( q.x < 0. || q.x >= box.x || q.y < 0. || q.y >= box.y ||
+								   q.z < 0. || q.z >= box.z ) ){
+					continue;
+				}
+				q = state_wrap( s, q);
+				result = result && stencil_has( s, p, q);
+			}
+		}
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	state_free( s);
+}
+
+void morton_test(){
+	int result, i, j, k, m, nb, l, *seen, id[500];
+	double x0[500];
+	unsigned int seed = 54321u;
+	cyl_params cp = {0.2, 1};
+	vec3 box = {20., 20.5, 11.};
+	vec3 d = {0., 0., 1.};
+	cyl_ll *cur;
+	state *s = state_malloc( cp, box, 500);
+
+	fprintf( stdout, "Testing state_set_morton: ");
+	result = state_set_subdivision( s, 2) && state_set_morton( s, 1);
+	nb = s->nbx * s->nby * s->nbz;
+	seen = (int *) calloc( nb, sizeof(int));
+	for( k=0; k<s->nbz; k++){
+		for( j=0; j<s->nby; j++){
+			for( i=0; i<s->nbx; i++){
+				m = state_bucket( s, i, j, k);
+				result = result && ( m >= 0 && m < nb && !seen[m] );
+				result = result && ( s->cell[3*m] == i && s->cell[3*m+1] == j &&
+									 s->cell[3*m+2] == k );
+				if( m >= 0 && m < nb ){
+					seen[m] = 1;
+				}
+			}
+		}
+	}
+	/* the first 8 buckets are a 2x2x2 block */
+	for( m=0; m<8; m++){
+		result = result && ( s->cell[3*m] == (m&1) && s->cell[3*m+1] == ((m>>1)&1) &&
+							 s->cell[3*m+2] == ((m>>2)&1) );
+	}
+	free( seen);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing state_reorder: ");
+	for( l=0; l<s->n; l++){
+		s->a[l].c.p.x = box.x*rand_r( &seed)/(RAND_MAX+1.);
+		s->a[l].c.p.y = box.y*rand_r( &seed)/(RAND_MAX+1.);
+		s->a[l].c.p.z = (box.z-1.)*rand_r( &seed)/(RAND_MAX+1.);
+		s->a[l].c.d = d;
+		s->a[l].c.r = cp.r;
+		s->u[l] = s->a[l].c.p.x;
+		cyl_list_add( s, l);
+		id[l] = l;
+		x0[l] = s->a[l].c.p.x;
+	}
+	result = state_reorder( s, id);
+	for( l=0; l<s->n; l++){
+		result = result && ( s->u[l] == s->a[l].c.p.x );
+		result = result && ( l == 0 || bucket_index( s, s->a[l-1].c.p) <= bucket_index( s, s->a[l].c.p) );
+	}
+	/* the lists hold every cylinder, in array order */
+	l = 0;
+	for( m=0; m<nb; m++){
+		for( cur = s->heads[m]; cur != NULL; cur = cur->next){
+			result = result && ( cur == &(s->a[l]) && bucket_index( s, cur->c.p) == m );
+			l++;
+		}
+	}
+	result = result && ( l == s->n );
+	/* the ids follow the cylinders */
+	for( l=0; l<s->n; l++){
+		result = result && ( id[l] >= 0 && id[l] < s->n && x0[id[l]] == s->a[l].c.p.x );
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	state_free( s);
+}
+
+/*!
+ * Check that every cylinder is on the list of its bucket exactly
+ * once, and that the back links and stored buckets match.
+ */
+int lists_consistent( state *s){
+	int m, nb, count;
+	cyl_ll *cur, *prev;
+	nb = s->nbx * s->nby * s->nbz;
+	count = 0;
+	for( m=0; m<nb; m++){
+		prev = NULL;
+		for( cur = s->heads[m]; cur != NULL; cur = cur->next){
+			if( cur->prev != prev || cur->bucket != m || bucket_index( s, cur->c.p) != m ||
+				count > s->n ){
+				return 0;
+			}
+			prev = cur;
+			count++;
+		}
+	}
+	return( count == s->n && s->heads[nb] == NULL );
+}
+
+void list_test(){
+	int result, i, l, q, ls[50];
+	unsigned int seed = 999u;
+	cyl_params cp = {0.2, 1};
+	vec3 box = {10., 10., 10.};
+	vec3 d = {0., 0., 1.};
+	vec3 ps[50];
+	state *s = state_malloc( cp, box, 2000);
+
+	state_set_periodic( s, 1);
+	for( l=0; l<s->n; l++){
+		s->a[l].c.p.x = box.x*rand_r( &seed)/(RAND_MAX+1.);
+		s->a[l].c.p.y = box.y*rand_r( &seed)/(RAND_MAX+1.);
+		s->a[l].c.p.z = box.z*rand_r( &seed)/(RAND_MAX+1.);
+		s->a[l].c.d = d;
+		s->a[l].c.r = cp.r;
+		cyl_list_add( s, l);
+	}
+
+	fprintf( stdout, "Testing cyl_list_move with dense buckets: ");
+	result = lists_consistent( s);
+	for( i=0; i<20000; i++){
+		l = rand_r( &seed)%s->n;
+		ps[0].x = s->a[l].c.p.x + 4.*rand_r( &seed)/(RAND_MAX+1.) - 2.;
+		ps[0].y = s->a[l].c.p.y + 4.*rand_r( &seed)/(RAND_MAX+1.) - 2.;
+		ps[0].z = s->a[l].c.p.z + 4.*rand_r( &seed)/(RAND_MAX+1.) - 2.;
+		result = result && cyl_list_move( s, l, ps[0]);
+	}
+	result = result && lists_consistent( s);
+	/* adding a cylinder again moves it */
+	result = result && cyl_list_add( s, 7) && lists_consistent( s);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing cyl_list_move_batch: ");
+	result = 1;
+	for( i=0; i<400; i++){
+		for( q=0; q<50; q++){
+			ls[q] = rand_r( &seed)%s->n;
+			ps[q].x = box.x*rand_r( &seed)/(RAND_MAX+1.);
+			ps[q].y = box.y*rand_r( &seed)/(RAND_MAX+1.);
+			ps[q].z = box.z*rand_r( &seed)/(RAND_MAX+1.);
+		}
+		result = result && ( cyl_list_move_batch( s, 50, ls, ps) <= 50 );
+		result = result && ( s->a[ls[49]].c.p.x == ps[49].x );
+	}
+	result = result && lists_consistent( s);
+	/* moving to the bucket it is already in changes nothing */
+	ls[0] = 3;
+	ps[0] = s->a[3].c.p;
+	result = result && ( cyl_list_move_batch( s, 1, ls, ps) == 0 );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	state_free( s);
+}
+
 int main(){
 	state_test();
+	periodic_test();
+	subdivision_test();
+	morton_test();
+	list_test();
 	return 0;
 }
\ No newline at end of file
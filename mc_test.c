@@ -6,19 +6,238 @@
 
 #include <stdio.h>
 
+#define U_CC_COUNT
 #include "montecarlo.c"
+#include "rsa.h"
+
+/*!
+ * Check the broad phase of `u_cc` against the full calculation, for
+ * random pairs at all separations up to 3 lengths.
+ */
+void broad_phase_test(){
+	int i, result;
+	double u, u_ref, err;
+	lj_params p_attractive = { 1., 0.4};
+	lj_params p_repulsive = { 1., 0.4/TWO_1_6};
+	cyl c1, c2;
+	rng g;
+
+	rng_seed( &g, 8);
+	c1.r = 0.2;
+	c2.r = 0.2;
+	u_cc_count.calls = 0;
+	u_cc_count.centre = 0;
+	u_cc_count.box = 0;
+	u_cc_count.exact = 0;
+
+	fprintf( stdout, "Testing u_cc broad phase: ");
+	err = 0.;
+	for( i=0; i<20000; i++){
+		c1.p = vec3_smul( rand_ball( &g), 3.);
+		c1.d = vec3_unit( rand_ball( &g));
+		c2.p = vec3_smul( rand_ball( &g), 3.);
+		c2.d = vec3_unit( rand_ball( &g));
+		u = u_cc( c1, c2);
+		u_ref = lj_truncated( vec3_dist( cyl_point( c1, 0.5), cyl_point( c2, 0.5)), p_attractive);
+		u_ref += lj_shifted( cyl_dist( c1, c2), p_repulsive);
+		err = max( err, fabs( u - u_ref)/(1.+fabs( u_ref)));
+	}
+	result = ( err < max( 1.0e-12, 100.*COORD_EPSILON) );
+	result = result && ( u_cc_count.calls == 20000 );
+	result = result && ( u_cc_count.centre + u_cc_count.box + u_cc_count.exact == 20000 );
+	result = result && ( u_cc_count.centre > 0 && u_cc_count.box > 0 && u_cc_count.exact > 0 );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+}
+
+void energy_cache_test(){
+	int i, l, result;
+	double u, u_tot, drift, max_drift;
+	rng g;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {20., 20., 20.};
+	state *s = state_malloc( cp, box, 500);
+	cyl c;
+
+	rng_seed( &g, 5);
+	state_uniform_initialize( s);
+
+	fprintf( stdout, "Testing state_energy: ");
+	u_tot = state_energy( s);
+	u = 0.;
+	for( i=0; i<s->n; i++){
+		u += u_i( s, i, s->a[i].c);
+	}
+	result = s->u_valid && ( fabs( u_tot - 0.5*u) < max( 1.0e-7, 100.*COORD_EPSILON)*(1.+fabs(u)) );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing mc_accept: ");
+	for( i=0; i<5000; i++){
+		l = rng_below( &g, s->n);
+		c = move_cyl( s->a[l].c, &g);
+		if( !cyl_box_overlap( c, box) ){
+			continue;
+		}
+		u = du( s, l, c);
+		if( u <= 0. || rng_uniform( &g) < exp(-u) ){
+			mc_accept( s, l, c);
+		}
+	}
+	u_tot = s->u_tot;
+	drift = state_energy_check( s, &max_drift);
+	result = ( fabs( drift) < max( 1.0e-7, 100.*COORD_EPSILON)*(1.+fabs( u_tot)) );
+	result = result && ( max_drift < max( 1.0e-7, 100.*COORD_EPSILON) );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing u_i_budget: ");
+	result = 1;
+	for( i=0; i<5000; i++){
+		l = rng_below( &g, s->n);
+		c = move_cyl( s->a[l].c, &g);
+		if( !cyl_box_overlap( c, box) ){
+			continue;
+		}
+		u = u_i( s, l, c);
+		result = result && ( fabs( u_i_budget( s, l, c, INFINITY) - u) < 1.0e-9*(1.+fabs( u)) );
+		u_tot = s->u[l] + 4.*(rng_uniform( &g) - 0.5);
+		result = result && ( (u_i_budget( s, l, c, u_tot) < u_tot) == (u < u_tot) );
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	state_free( s);
+}
+
+/*!
+ * Energy of cylinder `i` with every other cylinder at its closest
+ * image, without the buckets.
+ */
+double u_pair_brute( state *s, int i){
+	vec3 ctr = cyl_point( s->a[i].c, 0.5);
+	double u = 0.;
+	int j;
+	for( j=0; j<s->n; j++){
+		if( j != i ){
+			u += u_pair( mc_potential( s), state_image( s, s->a[j].c, ctr), s->a[i].c);
+		}
+	}
+	return u;
+}
+
+void potential_test(){
+	int i, k, l, result;
+	double u, drift, max_drift;
+	lj_params p_attractive = { 1., 0.4};
+	rsa_params rp = { 31u, 1, 0, 0, 0.};
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {8., 8., 8.};
+	state *s;
+	cyl c1, c2;
+	rng g;
+
+	fprintf( stdout, "Testing u_pair: ");
+	c1.p.x = 0.; c1.p.y = 0.; c1.p.z = 0.;
+	c1.d.x = 0.; c1.d.y = 0.; c1.d.z = 1.;
+	c1.r = c2.r = 0.2;
+	c2 = c1;
+	c2.p.x = 0.4;
+	/* parallel cylinders with the surfaces touching */
+	result = ( fabs( u_pair( POT_DEFAULT, c1, c2) - u_cc( c1, c2)) < 1.0e-12 );
+	result = result && ( fabs( u_pair( POT_CENTRE, c1, c2) - u_cc( c1, c2)) < 1.0e-12 );
+	result = result && ( u_pair( POT_CLOSEST, c1, c2) == 0. );
+	result = result && ( fabs( u_pair( POT_KIHARA, c1, c2) - lj_truncated( 0.4, p_attractive)) < 1.0e-12 );
+	result = result && ( u_pair( POT_HARD, c1, c2) == 0. );
+	/* end to end, the centers are far apart but the ends are close */
+	c2.p.x = 0.; c2.p.z = 1.5;
+	result = result && ( u_pair( POT_CENTRE, c1, c2) == 0. );
+	result = result && ( u_pair( POT_KIHARA, c1, c2) < 0. );
+	/* parallel and overlapping */
+	c2.p.x = 0.3; c2.p.z = 0.;
+	result = result && ( u_pair( POT_HARD, c1, c2) == INFINITY );
+	result = result && ( u_pair( POT_CLOSEST, c1, c2) > 0. );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing mc_set_potential: ");
+	s = state_malloc( cp, box, 200);
+	result = ( s != NULL ) && state_set_periodic( s, 1) && state_uniform_initialize( s);
+	result = result && ( mc_potential( s) == POT_DEFAULT );
+	result = result && !mc_set_potential( s, POT_COUNT) && !mc_set_potential( s, -1);
+	state_energy( s);
+	result = result && mc_set_potential( s, POT_KIHARA) && !s->u_valid;
+	result = result && ( mc_potential( s) == POT_KIHARA );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	state_free( s);
+
+	fprintf( stdout, "Testing u_i and mc_accept for every potential: ");
+	rng_seed( &g, 11);
+	for( k=0; k<POT_COUNT && result; k++){
+		/* start afresh every time, the soft potentials let the cores
+		 * overlap (and the lattice has them touching) */
+		s = state_malloc( cp, box, 200);
+		result = ( s != NULL ) && state_set_periodic( s, 1) && ( rsa_initialize( s, rp) == 1 );
+		result = result && mc_set_potential( s, k);
+		for( l=0; l<s->n; l++){
+			u = u_i( s, l, s->a[l].c);
+			result = result && ( fabs( u - u_pair_brute( s, l)) < max( 1.0e-9, 100.*COORD_EPSILON)*(1.+fabs( u)) );
+		}
+		state_energy( s);
+		for( i=0; i<2000; i++){
+			l = rng_below( &g, s->n);
+			c1 = move_cyl( s->a[l].c, &g);
+			if( mc_try( s, NULL, l, c1, 1., &g) ){
+				mc_accept( s, l, c1);
+			}
+		}
+		drift = state_energy_check( s, &max_drift);
+		result = result && isfinite( s->u_tot);
+		result = result && ( fabs( drift) < max( 1.0e-7, 100.*COORD_EPSILON)*(1.+fabs( s->u_tot)) );
+		/* the hard core never lets an overlap in */
+		result = result && ( k != POT_HARD || s->u_tot == 0. );
+		state_free( s);
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+}
 
 void mc_test(){
 	int result;
 	double u;
 	cyl c1, c2;
+	rng g;
+	rng_seed( &g, 1);
 	c1.r = 0.2;
 	c2.r = 0.2;
 
 	fprintf( stdout, "Testing move_cyl: ");
 	c1.p.x = 0.; c1.p.y = 0.; c1.p.z = 0.;
 	c1.d.x = 0.; c1.d.y = 0.; c1.d.z = 1.;
-	c2 = move_cyl( c1);
+	c2 = move_cyl( c1, &g);
 	result = (vec3_mag( c2.p) <= 0.5);
 	result = result && ( c2.d.z >= 0 );
 	if( result ){
@@ -41,5 +260,8 @@ void mc_test(){
 
 int main(){
 	mc_test();
+	broad_phase_test();
+	energy_cache_test();
+	potential_test();
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,868 @@
+/*!*******************************************************************
+ * mixture.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * This file contains a manybody state for a mixture of cylinder
+ * species. Every species has its own radius and length, every
+ * cylinder has a species, and the pair energy of two species is
+ * scaled by a well depth from a table.
+ *
+ * The buckets of `state` are sized for the one kind of cylinder it
+ * holds. In a mixture, buckets big enough for the longest rods
+ * hold a great many of the short ones, and every short rod has to go
+ * through all of them. So here the species are sorted into size
+ * classes by their interaction range, and each size class gets a grid
+ * of its own (a level), with buckets just big enough for the range of
+ * that class. A cylinder is filed on the level of its species, by its
+ * center. To find the neighbors of a cylinder the levels are scanned
+ * one after the other: on its own level and the coarser ones that is
+ * the bucket it is in and the ones around it, on a finer level it is
+ * as many buckets as it takes to cover the range of the pair. Short
+ * rods among short rods only ever look at small buckets, and only the
+ * pairs with a long rod go through the coarse grid.
+ *
+ * The mixture keeps a scratch list of buckets for the neighbor scans,
+ * so the functions here are not safe to call from several threads on
+ * the same mixture.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "math_const.h"
+#include "vecs.h"
+#include "rng.h"
+#include "distributions.h"
+#include "lennardjones.h"
+#include "ljtable.h"
+#include "cylinders.h"
+#include "manybody.h"
+#include "cellstore.h"
+#include "nlist.h"
+#include "montecarlo.h"
+
+/*!
+ * Ratio of the largest to the smallest interaction range within a
+ * size class.
+ */
+#define MIX_CLASS_RATIO 2.
+
+/*!
+ * One level of the grid.
+ *
+ * + `nbx`, `nby`, `nbz` the number of buckets along each axis
+ * + `bucket` the size of a bucket
+ * + `reach` the largest interaction range of two species of the level
+ * + `heads` the first cylinder on the list of each bucket
+ */
+typedef struct{
+	int nbx, nby, nbz;
+	vec3 bucket;
+	double reach;
+	cyl_ll **heads;
+} mix_level;
+
+/*!
+ * Mixture of cylinder species.
+ *
+ * The species:
+ * + `ns` the number of species
+ * + `sp` the radius and length of each species
+ * + `eps` the well depth of each pair of species, `eps[a*ns+b]`
+ * + `reach` the center separation of each pair of species beyond
+ *   which they neither interact nor overlap
+ * + `u_min` the lowest pair energy of each species, for the early
+ *   exits
+ * The grid:
+ * + `nlevels` the number of levels, finest first
+ * + `level` the level of each species
+ * + `span` the number of buckets to scan on either side along x, y
+ *   and z around a cylinder of species `a` on level `L`, starting at
+ *   `span[3*(a*nlevels+L)]`
+ * + `lv` the levels
+ * + `nbr`, `nbr_max` scratch room for the buckets of a neighbor scan
+ * The cylinders, as in `state`:
+ * + `box`, `periodic` the box, and whether it is periodic
+ * + `n`, `a` the cylinders, with `bucket` the bucket on their level
+ *   (-1 until they are placed)
+ * + `species` the species of each cylinder
+ * + `u`, `u_tot`, `u_valid` the cached energies
+ */
+typedef struct{
+	int ns;
+	cyl_params *sp;
+	double *eps;
+	double *reach;
+	double *u_min;
+	int nlevels;
+	int *level;
+	int *span;
+	mix_level *lv;
+	int *nbr;
+	int nbr_max;
+	vec3 box;
+	int periodic;
+	int n;
+	cyl_ll *a;
+	int *species;
+	double *u;
+	double u_tot;
+	int u_valid;
+} mixture;
+
+/*!
+ * Center separation beyond which a cylinder of species `p` and one of
+ * species `q` neither interact nor overlap: the range of the
+ * attractive potential between the centers, or the half lengths plus
+ * the contact distance.
+ */
+static double mix_reach( cyl_params p, cyl_params q){
+	double r0 = p.r + q.r;
+	return max( LJ_RMAX*r0, 0.5*(p.l + q.l) + r0);
+}
+
+/*!
+ * Pair energy of two cylinders with well depth `eps`.
+ *
+ * The same as `u_cc`, with the lj potentials of the pair: the
+ * attractive one between the centers with the minimum at `r1+r2`, and
+ * the repulsive one between the points of closest approach. For two
+ * cylinders of the same radius and a well depth of 1 this is `u_cc`.
+ */
+static inline double pot_mix( double eps, cyl c1, cyl c2){
+	double u0, sep2, reach;
+	double r0 = c1.r + c2.r;
+	lj_params p_attractive = { eps, r0};
+	lj_params p_repulsive = { eps, r0/TWO_1_6};
+	double r_att = LJ_RMAX*p_attractive.r0;
+	vec3 dp = vec3_add( vec3_sub( c1.p, c2.p), vec3_smul( vec3_sub( c1.d, c2.d), 0.5));
+
+	sep2 = vec3_dot( dp, dp);
+	u0 = 0.;
+	if( sep2 <= r_att*r_att ){
+		u0 = lj_truncated( sqrt( sep2), p_attractive);
+	}
+	/* (|d1|+|d2|)/2 <= sqrt((|d1|^2+|d2|^2)/2) */
+	reach = p_repulsive.r0 + sqrt( 0.5*(vec3_dot( c1.d, c1.d) + vec3_dot( c2.d, c2.d)));
+	if( sep2 < reach*reach ){
+		u0 += lj_shifted( cyl_dist( c1, c2), p_repulsive);
+	}
+
+	return u0;
+}
+
+/*!
+ * Energy between cylinder `c1` of species `a` and cylinder `c2` of
+ * species `b`.
+ */
+double u_mix( mixture *m, int a, int b, cyl c1, cyl c2){
+	return pot_mix( m->eps[a*m->ns+b], c1, c2);
+}
+
+/*!
+ * Work out the lowest pair energy of every species from the well
+ * depths.
+ */
+static void mix_u_min( mixture *m){
+	int a, b;
+	for( a=0; a<m->ns; a++){
+		m->u_min[a] = 0.;
+		for( b=0; b<m->ns; b++){
+			m->u_min[a] = min( m->u_min[a], -m->eps[a*m->ns+b]);
+		}
+	}
+}
+
+/*!
+ * Destructor for a mixture.
+ */
+void mixture_free( mixture *m){
+	int L;
+	if( m->lv != NULL ){
+		for( L=0; L<m->nlevels; L++){
+			free( m->lv[L].heads);
+		}
+	}
+	free( m->lv);
+	free( m->span);
+	free( m->nbr);
+	free( m->sp);
+	free( m->eps);
+	free( m->reach);
+	free( m->u_min);
+	free( m->level);
+	free( m->a);
+	free( m->species);
+	free( m->u);
+	free( m);
+}
+
+/*!
+ * Constructor for a mixture.
+ *
+ * Makes room for `n` cylinders of the `ns` species `sp` in the box
+ * `box`, periodic if `periodic` is set. All the well depths are 1.
+ * With `hierarchical` set the species are sorted into size classes,
+ * so that the largest interaction range in a class is at most
+ * `MIX_CLASS_RATIO` times the smallest, and every class gets a level
+ * of the grid. Otherwise all species share a single level, with the
+ * buckets sized for the largest range. None of the cylinders are
+ * placed yet (see `mixture_place` and `mixture_random_initialize`).
+ * Returns `NULL` if an allocation fails, or if a periodic box is less
+ * than twice the largest interaction range across.
+ */
+mixture* mixture_malloc( const cyl_params *sp, int ns, vec3 box, int periodic, int n, int hierarchical){
+	int a, b, i, t, L, nb, count, *order;
+	double r, lo, box_min;
+	const int *w;
+	mix_level *lv;
+	mixture *m;
+
+	if( ns < 1 || n < 0 ){
+		return NULL;
+	}
+	m = (mixture *) malloc( sizeof(mixture));
+	if( m == NULL ){
+		return NULL;
+	}
+	m->ns = ns;
+	m->box = box;
+	m->periodic = periodic;
+	m->n = n;
+	m->nlevels = 0;
+	m->lv = NULL;
+	m->span = NULL;
+	m->nbr = NULL;
+	m->u_tot = 0.;
+	m->u_valid = 0;
+	m->sp = (cyl_params *) malloc( ns*sizeof(cyl_params));
+	m->eps = (double *) malloc( ns*ns*sizeof(double));
+	m->reach = (double *) malloc( ns*ns*sizeof(double));
+	m->u_min = (double *) malloc( ns*sizeof(double));
+	m->level = (int *) malloc( ns*sizeof(int));
+	m->a = (cyl_ll *) malloc( (n+1)*sizeof(cyl_ll));
+	m->species = (int *) malloc( (n+1)*sizeof(int));
+	m->u = (double *) malloc( (n+1)*sizeof(double));
+	order = (int *) malloc( ns*sizeof(int));
+	if( m->sp == NULL || m->eps == NULL || m->reach == NULL ||
+		m->u_min == NULL || m->level == NULL || m->a == NULL ||
+		m->species == NULL || m->u == NULL || order == NULL ){
+		free( order);
+		mixture_free( m);
+		return NULL;
+	}
+	for( a=0; a<ns; a++){
+		m->sp[a] = sp[a];
+	}
+	for( a=0; a<ns; a++){
+		for( b=0; b<ns; b++){
+			m->eps[a*ns+b] = 1.;
+			m->reach[a*ns+b] = mix_reach( sp[a], sp[b]);
+		}
+	}
+	mix_u_min( m);
+	for( i=0; i<n; i++){
+		m->a[i].next = NULL;
+		m->a[i].prev = NULL;
+		m->a[i].bucket = -1;
+		m->species[i] = -1;
+		m->u[i] = 0.;
+	}
+
+	/* size classes, in order of the range of each species with
+	 * itself */
+	for( a=0; a<ns; a++){
+		for( t=a; t>0 && m->reach[order[t-1]*(ns+1)] > m->reach[a*(ns+1)]; t--){
+			order[t] = order[t-1];
+		}
+		order[t] = a;
+	}
+	lo = 0.;
+	for( t=0; t<ns; t++){
+		r = m->reach[order[t]*(ns+1)];
+		if( m->nlevels == 0 || (hierarchical && r > MIX_CLASS_RATIO*lo) ){
+			lo = r;
+			m->nlevels++;
+		}
+		m->level[order[t]] = m->nlevels-1;
+	}
+	free( order);
+
+	m->lv = (mix_level *) malloc( m->nlevels*sizeof(mix_level));
+	m->span = (int *) malloc( 3*ns*m->nlevels*sizeof(int));
+	if( m->lv == NULL || m->span == NULL ){
+		mixture_free( m);
+		return NULL;
+	}
+	for( L=0; L<m->nlevels; L++){
+		m->lv[L].heads = NULL;
+	}
+	for( L=0; L<m->nlevels; L++){
+		lv = m->lv + L;
+		lv->reach = 0.;
+		for( a=0; a<ns; a++){
+			for( b=0; b<ns; b++){
+				if( m->level[a] == L && m->level[b] == L ){
+					lv->reach = max( lv->reach, m->reach[a*ns+b]);
+				}
+			}
+		}
+		lv->nbx = max( (int) (box.x/lv->reach), 1);
+		lv->nby = max( (int) (box.y/lv->reach), 1);
+		lv->nbz = max( (int) (box.z/lv->reach), 1);
+		lv->bucket.x = box.x/lv->nbx;
+		lv->bucket.y = box.y/lv->nby;
+		lv->bucket.z = box.z/lv->nbz;
+		nb = lv->nbx * lv->nby * lv->nbz;
+		lv->heads = (cyl_ll **) malloc( nb*sizeof(cyl_ll *));
+		if( lv->heads == NULL ){
+			mixture_free( m);
+			return NULL;
+		}
+		for( i=0; i<nb; i++){
+			lv->heads[i] = NULL;
+		}
+	}
+	box_min = min( min( box.x, box.y), box.z);
+	if( periodic && 2.*m->lv[m->nlevels-1].reach > box_min ){
+		mixture_free( m);
+		return NULL;
+	}
+
+	/* how far to look on every level, and the most buckets a scan of
+	 * one level can take */
+	m->nbr_max = 1;
+	for( a=0; a<ns; a++){
+		for( L=0; L<m->nlevels; L++){
+			lv = m->lv + L;
+			r = 0.;
+			for( b=0; b<ns; b++){
+				if( m->level[b] == L ){
+					r = max( r, m->reach[a*ns+b]);
+				}
+			}
+			m->span[3*(a*m->nlevels+L)] = (int) ceil( r/lv->bucket.x);
+			m->span[3*(a*m->nlevels+L)+1] = (int) ceil( r/lv->bucket.y);
+			m->span[3*(a*m->nlevels+L)+2] = (int) ceil( r/lv->bucket.z);
+			w = m->span + 3*(a*m->nlevels+L);
+			count = min( 2*w[0]+1, lv->nbx)*min( 2*w[1]+1, lv->nby)*min( 2*w[2]+1, lv->nbz);
+			m->nbr_max = max( m->nbr_max, count);
+		}
+	}
+	m->nbr = (int *) malloc( m->nbr_max*sizeof(int));
+	if( m->nbr == NULL ){
+		mixture_free( m);
+		return NULL;
+	}
+	return m;
+}
+
+/*!
+ * Set the well depth of the pair of species `a` and `b` (both ways
+ * round). The depth cannot be negative. Returns 0 for a species that
+ * does not exist or a negative depth.
+ */
+int mixture_set_pair( mixture *m, int a, int b, double eps){
+	if( a < 0 || a >= m->ns || b < 0 || b >= m->ns || !(eps >= 0.) ){
+		return 0;
+	}
+	m->eps[a*m->ns+b] = eps;
+	m->eps[b*m->ns+a] = eps;
+	mix_u_min( m);
+	m->u_valid = 0;
+	return 1;
+}
+
+/*!
+ * Move a cylinder so its center is in the box, if the box is
+ * periodic.
+ */
+static cyl mix_wrap( mixture *m, cyl c){
+	vec3 ctr, w;
+	if( m->periodic ){
+		ctr = cyl_point( c, 0.5);
+		w = ctr;
+		w.x -= m->box.x*floor( w.x/m->box.x);
+		w.y -= m->box.y*floor( w.y/m->box.y);
+		w.z -= m->box.z*floor( w.z/m->box.z);
+		/* a tiny negative coordinate can round up to the box size */
+		w.x = (w.x < m->box.x)?w.x:0.;
+		w.y = (w.y < m->box.y)?w.y:0.;
+		w.z = (w.z < m->box.z)?w.z:0.;
+		c.p = vec3_add( c.p, vec3_sub( w, ctr));
+	}
+	return c;
+}
+
+/*!
+ * The periodic image of cylinder `c` with the center closest to
+ * `ref`.
+ */
+static inline cyl mix_image( mixture *m, cyl c, vec3 ref){
+	vec3 d;
+	if( m->periodic ){
+		d = vec3_sub( cyl_point( c, 0.5), ref);
+		c.p = vec3_add( c.p, vec3_sub( min_image( d, m->box), d));
+	}
+	return c;
+}
+
+/*!
+ * Check if a cylinder is in an allowed position.
+ */
+int mixture_inside( mixture *m, cyl c){
+	return( m->periodic || cyl_box_overlap( c, m->box) );
+}
+
+/*!
+ * Bucket of level `lv` along each axis containing the center `ctr`.
+ */
+static inline void mix_cell( mix_level *lv, vec3 ctr, int *c){
+	c[0] = max( min( (int) (ctr.x/lv->bucket.x), lv->nbx-1), 0);
+	c[1] = max( min( (int) (ctr.y/lv->bucket.y), lv->nby-1), 0);
+	c[2] = max( min( (int) (ctr.z/lv->bucket.z), lv->nbz-1), 0);
+}
+
+/*!
+ * Index of the bucket of level `lv` containing the center `ctr`.
+ */
+static int mix_bucket( mix_level *lv, vec3 ctr){
+	int c[3];
+	mix_cell( lv, ctr, c);
+	return c[0] + lv->nbx*(c[1] + lv->nby*c[2]);
+}
+
+/*!
+ * The buckets of level `L` that can hold a neighbor of a cylinder of
+ * species `a` with its center at `ctr`.
+ *
+ * Along each axis these are the buckets within the span of species
+ * `a` on the level, wrapped around in a periodic box (each bucket only
+ * once, even if the span goes all the way around) and cut off at the
+ * walls otherwise. The bucket indices are stored in `nbr` and the
+ * number of them is returned.
+ */
+static int mix_neighbors( mixture *m, int L, int a, vec3 ctr, int *nbr){
+	mix_level *lv = m->lv + L;
+	const int *w = m->span + 3*(a*m->nlevels + L);
+	int c[3], nb[3], lo[3], hi[3];
+	int i, j, k, t, nn;
+
+	nb[0] = lv->nbx; nb[1] = lv->nby; nb[2] = lv->nbz;
+	mix_cell( lv, ctr, c);
+	for( t=0; t<3; t++){
+		if( m->periodic && 2*w[t]+1 >= nb[t] ){
+			lo[t] = 0;
+			hi[t] = nb[t]-1;
+		}else if( m->periodic ){
+			lo[t] = c[t] - w[t];
+			hi[t] = c[t] + w[t];
+		}else{
+			lo[t] = max( c[t] - w[t], 0);
+			hi[t] = min( c[t] + w[t], nb[t]-1);
+		}
+	}
+	nn = 0;
+	for( k=lo[2]; k<=hi[2]; k++){
+		for( j=lo[1]; j<=hi[1]; j++){
+			for( i=lo[0]; i<=hi[0]; i++){
+				nbr[nn++] = (i+nb[0])%nb[0] + nb[0]*((j+nb[1])%nb[1] + nb[1]*((k+nb[2])%nb[2]));
+			}
+		}
+	}
+	return nn;
+}
+
+/*!
+ * Put cylinder `i` at the front of the list of bucket `mm` on level
+ * `L`.
+ */
+static void mix_push( mixture *m, int i, int L, int mm){
+	cyl_ll *a = &(m->a[i]);
+	a->bucket = mm;
+	a->prev = NULL;
+	a->next = m->lv[L].heads[mm];
+	if( a->next != NULL ){
+		a->next->prev = a;
+	}
+	m->lv[L].heads[mm] = a;
+}
+
+/*!
+ * Take cylinder `i` off the list it is on.
+ */
+static void mix_unlink( mixture *m, int i){
+	cyl_ll *a = &(m->a[i]);
+	if( a->prev != NULL ){
+		a->prev->next = a->next;
+	}else{
+		m->lv[m->level[m->species[i]]].heads[a->bucket] = a->next;
+	}
+	if( a->next != NULL ){
+		a->next->prev = a->prev;
+	}
+	a->bucket = -1;
+}
+
+/*!
+ * Place a cylinder.
+ *
+ * Makes cylinder `i` a cylinder of species `species` at `c`, with
+ * the radius of the species and the direction of `c` stretched to the
+ * length of the species, and files it on its level. A cylinder that
+ * was already placed is moved. The cached energies are marked out of
+ * date. Returns 0 if the species does not exist, the direction is
+ * zero, or the cylinder is not inside a box with walls.
+ */
+int mixture_place( mixture *m, int i, int species, cyl c){
+	double len;
+	int L;
+	if( i < 0 || i >= m->n || species < 0 || species >= m->ns ){
+		return 0;
+	}
+	len = vec3_mag( c.d);
+	if( len == 0. ){
+		return 0;
+	}
+	c.d = vec3_smul( c.d, m->sp[species].l/len);
+	c.r = m->sp[species].r;
+	c = mix_wrap( m, c);
+	if( !mixture_inside( m, c) ){
+		return 0;
+	}
+	if( m->a[i].bucket >= 0 ){
+		mix_unlink( m, i);
+	}
+	L = m->level[species];
+	m->species[i] = species;
+	m->a[i].c = c;
+	mix_push( m, i, L, mix_bucket( m->lv + L, cyl_point( c, 0.5)));
+	m->u_valid = 0;
+	return 1;
+}
+
+/*!
+ * Check if cylinder `c` of species `a` would overlap any placed
+ * cylinder other than `index`.
+ */
+static int mix_overlap( mixture *m, int index, int a, cyl c){
+	int L, t, nn;
+	vec3 ctr;
+	cyl_ll *old, *cur;
+
+	ctr = cyl_point( c, 0.5);
+	old = &(m->a[index]);
+	for( L=0; L<m->nlevels; L++){
+		nn = mix_neighbors( m, L, a, ctr, m->nbr);
+		for( t=0; t<nn; t++){
+			for( cur = m->lv[L].heads[m->nbr[t]]; cur != NULL; cur = cur->next){
+				if( cur != old && cyl_cyl_overlap( mix_image( m, cur->c, ctr), c) ){
+					return 1;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+/*!
+ * Random sequential addition for a mixture.
+ *
+ * Places `count[a]` cylinders of every species `a` (the counts have
+ * to add up to the number of cylinders), the first `count[0]`
+ * cylinders of species 0, the next `count[1]` of species 1, and so
+ * on. The species with the longest range go first, since the long
+ * rods are the hardest to fit in between the others. Every cylinder
+ * gets up to `tries` random positions and orientations to find one
+ * where it is inside the box and does not overlap any cylinder placed
+ * before it. Returns 0 if the counts are wrong or a cylinder could
+ * not be placed (or an allocation fails), in which case some of the
+ * cylinders are left unplaced.
+ */
+int mixture_random_initialize( mixture *m, const int *count, rng *g, int tries){
+	int a, b, i, q, t, k, L, nb, total, base, *order;
+	double dd;
+	vec3 d, ctr;
+	cyl c;
+
+	total = 0;
+	for( a=0; a<m->ns; a++){
+		if( count[a] < 0 ){
+			return 0;
+		}
+		total += count[a];
+	}
+	if( total != m->n ){
+		return 0;
+	}
+	order = (int *) malloc( m->ns*sizeof(int));
+	if( order == NULL ){
+		return 0;
+	}
+	for( a=0; a<m->ns; a++){
+		for( k=a; k>0 && m->reach[order[k-1]*(m->ns+1)] < m->reach[a*(m->ns+1)]; k--){
+			order[k] = order[k-1];
+		}
+		order[k] = a;
+	}
+	for( L=0; L<m->nlevels; L++){
+		nb = m->lv[L].nbx * m->lv[L].nby * m->lv[L].nbz;
+		for( i=0; i<nb; i++){
+			m->lv[L].heads[i] = NULL;
+		}
+	}
+	for( i=0; i<m->n; i++){
+		m->a[i].bucket = -1;
+		m->species[i] = -1;
+	}
+	m->u_valid = 0;
+
+	for( k=0; k<m->ns; k++){
+		a = order[k];
+		base = 0;
+		for( b=0; b<a; b++){
+			base += count[b];
+		}
+		for( q=0; q<count[a]; q++){
+			i = base + q;
+			for( t=0; t<tries; t++){
+				do{
+					d = rand_ball( g);
+					dd = vec3_dot( d, d);
+				}while( dd < 1.e-4 );
+				c.d = vec3_smul( d, m->sp[a].l/sqrt( dd));
+				c.r = m->sp[a].r;
+				ctr.x = m->box.x*rng_uniform( g);
+				ctr.y = m->box.y*rng_uniform( g);
+				ctr.z = m->box.z*rng_uniform( g);
+				c.p = vec3_sub( ctr, vec3_smul( c.d, 0.5));
+				if( mixture_inside( m, c) && !mix_overlap( m, i, a, c) ){
+					break;
+				}
+			}
+			if( t == tries ){
+				free( order);
+				return 0;
+			}
+			mixture_place( m, i, a, c);
+		}
+	}
+	free( order);
+	return 1;
+}
+
+/*!
+ * Total energy involving indexed cylinder, with early exit.
+ *
+ * The energy cylinder `index` would have at `c`, summed over the
+ * neighbor buckets of every level. If `budget` is finite, the
+ * cylinders in the neighbor buckets are counted first, and the sum
+ * stops as soon as it plus the lowest pair energy of the species for
+ * every cylinder left is at or above the budget (as in `u_i_budget`).
+ */
+static double mix_u( mixture *m, int index, cyl c, double budget){
+	int a, L, t, nn, left;
+	vec3 ctr;
+	cyl_ll *old, *cur;
+	const double *eps;
+	double u, u_min;
+
+	a = m->species[index];
+	eps = m->eps + a*m->ns;
+	u_min = m->u_min[a];
+	c = mix_wrap( m, c);
+	ctr = cyl_point( c, 0.5);
+	old = &(m->a[index]);
+
+	left = 0;
+	if( budget < INFINITY ){
+		for( L=0; L<m->nlevels; L++){
+			nn = mix_neighbors( m, L, a, ctr, m->nbr);
+			for( t=0; t<nn; t++){
+				for( cur = m->lv[L].heads[m->nbr[t]]; cur != NULL; cur = cur->next){
+					left++;
+				}
+			}
+		}
+	}
+	u = 0.;
+	for( L=0; L<m->nlevels; L++){
+		nn = mix_neighbors( m, L, a, ctr, m->nbr);
+		for( t=0; t<nn; t++){
+			for( cur = m->lv[L].heads[m->nbr[t]]; cur != NULL; cur = cur->next){
+				if( cur != old ){
+					u += pot_mix( eps[m->species[cur - m->a]], mix_image( m, cur->c, ctr), c);
+				}
+				left--;
+				if( u + u_min*left >= budget ){
+					return u + u_min*left;
+				}
+			}
+		}
+	}
+	return u;
+}
+
+/*!
+ * Total energy involving indexed cylinder.
+ *
+ * The energy cylinder `index` would have at `c`, with all the placed
+ * cylinders except itself.
+ */
+double mixture_u_i( mixture *m, int index, cyl c){
+	return mix_u( m, index, c, INFINITY);
+}
+
+/*!
+ * The difference in energy.
+ */
+double mixture_du( mixture *m, int i, cyl c_new){
+	double u_old = m->u_valid?m->u[i]:mixture_u_i( m, i, m->a[i].c);
+	return( mixture_u_i( m, i, c_new) - u_old );
+}
+
+/*!
+ * Total energy of the mixture.
+ *
+ * Fills the energy cache and marks it valid.
+ */
+double mixture_energy( mixture *m){
+	int i;
+	m->u_tot = 0.;
+	for( i=0; i<m->n; i++){
+		m->u[i] = (m->a[i].bucket >= 0)?mixture_u_i( m, i, m->a[i].c):0.;
+		m->u_tot += m->u[i];
+	}
+	m->u_tot *= 0.5;
+	m->u_valid = 1;
+	return m->u_tot;
+}
+
+/*!
+ * Energy of cylinder `index` at `c`, adding `sign` times every pair
+ * energy to the cached energy of the neighbor.
+ */
+static double mix_shift( mixture *m, int index, cyl c, double sign){
+	int a, L, t, nn;
+	vec3 ctr;
+	cyl_ll *old, *cur;
+	const double *eps;
+	double u, e;
+
+	a = m->species[index];
+	eps = m->eps + a*m->ns;
+	ctr = cyl_point( c, 0.5);
+	old = &(m->a[index]);
+	u = 0.;
+	for( L=0; L<m->nlevels; L++){
+		nn = mix_neighbors( m, L, a, ctr, m->nbr);
+		for( t=0; t<nn; t++){
+			for( cur = m->lv[L].heads[m->nbr[t]]; cur != NULL; cur = cur->next){
+				if( cur != old ){
+					e = pot_mix( eps[m->species[cur - m->a]], mix_image( m, cur->c, ctr), c);
+					m->u[cur - m->a] += sign*e;
+					u += e;
+				}
+			}
+		}
+	}
+	return u;
+}
+
+/*!
+ * Accept a move.
+ *
+ * Move cylinder `i` to `c_new`, and update the cached energies of the
+ * cylinder, its old and new neighbors, and the total.
+ */
+void mixture_accept( mixture *m, int i, cyl c_new){
+	double u_old, u_new;
+	int L, mm;
+	c_new = mix_wrap( m, c_new);
+	if( m->u_valid ){
+		u_old = mix_shift( m, i, m->a[i].c, -1.);
+		u_new = mix_shift( m, i, c_new, 1.);
+		m->u[i] = u_new;
+		m->u_tot += u_new - u_old;
+	}
+	L = m->level[m->species[i]];
+	mm = mix_bucket( m->lv + L, cyl_point( c_new, 0.5));
+	if( m->a[i].bucket != mm ){
+		mix_unlink( m, i);
+		mix_push( m, i, L, mm);
+	}
+	m->a[i].c = c_new;
+}
+
+/*!
+ * Check the cached energies.
+ *
+ * Recomputes all the energies from scratch and compares them with
+ * the cached ones, as `state_energy_check` does. The largest
+ * difference for a single cylinder is stored in `max_drift` and the
+ * difference in the total energy is returned.
+ */
+double mixture_energy_check( mixture *m, double *max_drift){
+	int i;
+	double u, u_tot, drift;
+	*max_drift = 0.;
+	u_tot = 0.;
+	for( i=0; i<m->n; i++){
+		u = (m->a[i].bucket >= 0)?mixture_u_i( m, i, m->a[i].c):0.;
+		drift = fabs( u - m->u[i]);
+		*max_drift = max( *max_drift, drift);
+		m->u[i] = u;
+		u_tot += u;
+	}
+	drift = 0.5*u_tot - m->u_tot;
+	m->u_tot = 0.5*u_tot;
+	m->u_valid = 1;
+	return drift;
+}
+
+/*!
+ * Metropolis test with early rejection.
+ *
+ * Same as `mc_try`: draws the random number for moving cylinder `i`
+ * to `c_new` at inverse temperature `beta` first, and works out the
+ * new energy only as far as needed. Returns 1 if the move should be
+ * accepted.
+ */
+int mixture_try( mixture *m, int i, cyl c_new, double beta, rng *g){
+	double u_old, budget;
+	u_old = m->u_valid?m->u[i]:mixture_u_i( m, i, m->a[i].c);
+	budget = -log( 1. - rng_uniform( g));
+	budget = u_old + ((beta > 0.)?budget/beta:INFINITY);
+	return( mix_u( m, i, c_new, budget) < budget );
+}
+
+/*!
+ * A sweep of Metropolis moves.
+ *
+ * Tries `n` moves of randomly chosen cylinders with `move_cyl` at
+ * inverse temperature `beta`, and returns the number accepted. The
+ * energy cache is filled first if it is out of date.
+ */
+int mixture_sweep( mixture *m, double beta, rng *g){
+	int i, t, accepted;
+	cyl c_new;
+	if( !m->u_valid ){
+		mixture_energy( m);
+	}
+	accepted = 0;
+	for( t=0; t<m->n; t++){
+		i = rng_below( g, m->n);
+		if( m->a[i].bucket < 0 ){
+			continue;
+		}
+		c_new = move_cyl( m->a[i].c, g);
+		if( mixture_inside( m, c_new) && mixture_try( m, i, c_new, beta, g) ){
+			mixture_accept( m, i, c_new);
+			accepted++;
+		}
+	}
+	return accepted;
+}
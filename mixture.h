@@ -0,0 +1,56 @@
+/*!*******************************************************************
+ * mixture.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#ifndef JW_MIXTURE
+#define JW_MIXTURE
+
+#define MIX_CLASS_RATIO 2.
+
+typedef struct{
+	int nbx, nby, nbz;
+	vec3 bucket;
+	double reach;
+	cyl_ll **heads;
+} mix_level;
+
+typedef struct{
+	int ns;
+	cyl_params *sp;
+	double *eps;
+	double *reach;
+	double *u_min;
+	int nlevels;
+	int *level;
+	int *span;
+	mix_level *lv;
+	int *nbr;
+	int nbr_max;
+	vec3 box;
+	int periodic;
+	int n;
+	cyl_ll *a;
+	int *species;
+	double *u;
+	double u_tot;
+	int u_valid;
+} mixture;
+
+mixture* mixture_malloc( const cyl_params *sp, int ns, vec3 box, int periodic, int n, int hierarchical);
+void mixture_free( mixture *m);
+int mixture_set_pair( mixture *m, int a, int b, double eps);
+double u_mix( mixture *m, int a, int b, cyl c1, cyl c2);
+int mixture_place( mixture *m, int i, int species, cyl c);
+int mixture_random_initialize( mixture *m, const int *count, rng *g, int tries);
+int mixture_inside( mixture *m, cyl c);
+double mixture_u_i( mixture *m, int index, cyl c);
+double mixture_du( mixture *m, int i, cyl c_new);
+double mixture_energy( mixture *m);
+void mixture_accept( mixture *m, int i, cyl c_new);
+double mixture_energy_check( mixture *m, double *max_drift);
+int mixture_try( mixture *m, int i, cyl c_new, double beta, rng *g);
+int mixture_sweep( mixture *m, double beta, rng *g);
+
+#endif /* JW_MIXTURE */
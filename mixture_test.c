@@ -0,0 +1,218 @@
+/*!*******************************************************************
+ * mixture_test.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "mixture.c"
+
+/*!
+ * Check that every placed cylinder is on the list of the bucket on
+ * its level that contains its center, exactly once.
+ */
+int mix_lists_ok( mixture *m){
+	int L, mm, nb, count, placed, i;
+	cyl_ll *cur;
+	count = 0;
+	for( L=0; L<m->nlevels; L++){
+		nb = m->lv[L].nbx * m->lv[L].nby * m->lv[L].nbz;
+		for( mm=0; mm<nb; mm++){
+			for( cur = m->lv[L].heads[mm]; cur != NULL; cur = cur->next){
+				i = cur - m->a;
+				if( m->level[m->species[i]] != L || cur->bucket != mm ||
+					mix_bucket( m->lv + L, cyl_point( cur->c, 0.5)) != mm ){
+					return 0;
+				}
+				count++;
+			}
+		}
+	}
+	placed = 0;
+	for( i=0; i<m->n; i++){
+		placed += ( m->a[i].bucket >= 0 );
+	}
+	return( count == placed );
+}
+
+/*!
+ * Check that no two cylinders overlap, without using the buckets.
+ */
+int mix_no_overlaps( mixture *m){
+	int i, j;
+	vec3 ctr;
+	for( i=0; i<m->n; i++){
+		if( !mixture_inside( m, m->a[i].c) ){
+			return 0;
+		}
+		ctr = cyl_point( m->a[i].c, 0.5);
+		for( j=i+1; j<m->n; j++){
+			if( cyl_cyl_overlap( mix_image( m, m->a[j].c, ctr), m->a[i].c) ){
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+/*!
+ * Energy of cylinder `i` summed over every other cylinder, without
+ * using the buckets.
+ */
+double mix_u_brute( mixture *m, int i){
+	int j;
+	vec3 ctr = cyl_point( m->a[i].c, 0.5);
+	double u = 0.;
+	for( j=0; j<m->n; j++){
+		if( j != i ){
+			u += u_mix( m, m->species[i], m->species[j], mix_image( m, m->a[j].c, ctr), m->a[i].c);
+		}
+	}
+	return u;
+}
+
+void malloc_test(){
+	int result;
+	cyl_params sp[3] = {{0.1, 1.}, {0.1, 1.2}, {0.1, 8.}};
+	vec3 box = {20., 20., 20.};
+	mixture *m;
+
+	fprintf( stdout, "Testing mixture_malloc size classes: ");
+	m = mixture_malloc( sp, 3, box, 1, 10, 1);
+	result = ( m != NULL );
+	result = result && ( m->nlevels == 2 );
+	result = result && ( m->level[0] == 0 && m->level[1] == 0 && m->level[2] == 1 );
+	result = result && ( m->lv[0].bucket.x < 1.5 && m->lv[1].bucket.x > 8. );
+	/* the long rods look several fine buckets out, the short ones
+	 * only next door on the coarse level */
+	result = result && ( m->span[3*(2*2+0)] == 4 );
+	result = result && ( m->span[3*(0*2+1)] == 1 );
+	mixture_free( m);
+	m = mixture_malloc( sp, 3, box, 1, 10, 0);
+	result = result && ( m != NULL && m->nlevels == 1 );
+	result = result && ( m->lv[0].bucket.x > 8. );
+	mixture_free( m);
+	/* too small for the long rods */
+	box.x = 15.;
+	m = mixture_malloc( sp, 3, box, 1, 10, 1);
+	result = result && ( m == NULL );
+	m = mixture_malloc( sp, 3, box, 0, 10, 1);
+	result = result && ( m != NULL );
+	mixture_free( m);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+}
+
+void u_mix_test(){
+	int i, result;
+	double u;
+	cyl_params sp[1] = {{0.2, 1.}};
+	vec3 box = {10., 10., 10.};
+	cyl c1, c2;
+	rng g;
+	mixture *m;
+
+	fprintf( stdout, "Testing u_mix against u_cc: ");
+	rng_seed( &g, 5u);
+	m = mixture_malloc( sp, 1, box, 0, 2, 1);
+	result = ( m != NULL );
+	c1.p = (vec3) {0., 0., 0.};
+	c1.d = (vec3) {0., 0., 1.};
+	c1.r = 0.2;
+	c2.r = 0.2;
+	for( i=0; i<1000; i++){
+		c2.p = vec3_smul( rand_ball( &g), 1.5);
+		c2.d = rand_rot( c1.d, PI, &g);
+		u = u_cc( c1, c2);
+		result = result && ( fabs( u_mix( m, 0, 0, c1, c2) - u) <= 1.e-12*max( 1., fabs( u)) );
+	}
+	result = result && mixture_set_pair( m, 0, 0, 0.5);
+	result = result && ( fabs( u_mix( m, 0, 0, c1, c2) - 0.5*u_cc( c1, c2)) <= 1.e-12*max( 1., fabs( u)) );
+	result = result && !mixture_set_pair( m, 0, 1, 1.);
+	result = result && !mixture_set_pair( m, 0, 0, -1.);
+	mixture_free( m);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+}
+
+void energy_test( int periodic){
+	int i, result;
+	int count[3] = {1200, 100, 30};
+	double u, drift, max_drift, tol;
+	cyl_params sp[3] = {{0.1, 1.}, {0.15, 1.}, {0.1, 8.}};
+	vec3 box = {20., 20., 20.};
+	rng g;
+	mixture *m, *flat;
+
+	fprintf( stdout, "Testing mixture_random_initialize (%s): ", periodic?"periodic":"walls");
+	rng_seed( &g, 2024u);
+	m = mixture_malloc( sp, 3, box, periodic, 1330, 1);
+	flat = mixture_malloc( sp, 3, box, periodic, 1330, 0);
+	result = ( m != NULL && flat != NULL );
+	result = result && ( m->nlevels == 2 && flat->nlevels == 1 );
+	result = result && mixture_random_initialize( m, count, &g, 100);
+	result = result && mix_lists_ok( m) && mix_no_overlaps( m);
+	result = result && ( m->species[0] == 0 && m->species[1299] == 1 && m->species[1329] == 2 );
+	result = result && ( fabs( vec3_mag( m->a[1329].c.d) - 8.) < 1.e-5 );
+	count[0] = 1;
+	result = result && !mixture_random_initialize( flat, count, &g, 100);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing mixture_u_i against a brute force sum (%s): ", periodic?"periodic":"walls");
+	result = mixture_set_pair( m, 0, 2, 0.5) && mixture_set_pair( flat, 0, 2, 0.5);
+	result = result && mixture_set_pair( m, 1, 1, 2.) && mixture_set_pair( flat, 1, 1, 2.);
+	for( i=0; i<m->n; i++){
+		result = result && mixture_place( flat, i, m->species[i], m->a[i].c);
+	}
+	result = result && mix_lists_ok( flat);
+	tol = max( 1.e-10, 100.*COORD_EPSILON);
+	for( i=0; i<m->n; i++){
+		u = mix_u_brute( m, i);
+		result = result && ( fabs( mixture_u_i( m, i, m->a[i].c) - u) <= tol*max( 1., fabs( u)) );
+		result = result && ( fabs( mixture_u_i( flat, i, flat->a[i].c) - u) <= tol*max( 1., fabs( u)) );
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing mixture_sweep keeps the cache (%s): ", periodic?"periodic":"walls");
+	mixture_energy( m);
+	result = 1;
+	for( i=0; i<10; i++){
+		result = result && ( mixture_sweep( m, 1., &g) > 0 );
+	}
+	result = result && mix_lists_ok( m);
+	drift = mixture_energy_check( m, &max_drift);
+	tol = max( 1.e-8, 1.e4*COORD_EPSILON);
+	result = result && ( fabs( drift) < tol*m->n && max_drift < tol );
+	result = result && ( fabs( mixture_du( m, 7, m->a[7].c)) < tol );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	mixture_free( flat);
+	mixture_free( m);
+}
+
+int main(){
+	malloc_test();
+	u_mix_test();
+	energy_test( 1);
+	energy_test( 0);
+	return 0;
+}
@@ -7,80 +7,588 @@
  * 
  */
 
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
 #include "math_const.h"
 #include "vecs.h"
 #include "distributions.h"
 #include "lennardjones.h"
+#include "ljtable.h"
 #include "cylinders.h"
 #include "manybody.h"
+#include "cellstore.h"
+#include "cylbatch.h"
+#include "nlist.h"
+#include "montecarlo.h"
 
 /*!
  * Move a cylinder.
  *
  * Move a cylinder up to half it's length, and rotate it up to a Pi/6
- * rotation.
+ * rotation, using the random number generator `g`.
  */
-cyl move_cyl( cyl c_old){
+cyl move_cyl( cyl c_old, rng *g){
 	cyl c_new;
 
-	c_new.p = vec3_smul( rand_ball(), 0.5*vec3_mag(c_old.d));
+	c_new.p = vec3_smul( rand_ball( g), 0.5*vec3_mag(c_old.d));
 	c_new.p = vec3_add( c_old.p, c_new.p);
-	c_new.d = rand_rot( c_old.d, PI_6);
+	c_new.d = rand_rot( c_old.d, PI_6, g);
 	c_new.r = c_old.r;
 	return c_new;
 }
 
+/*!
+ * Broad phase for the repulsive part of `u_cc`.
+ *
+ * Most neighbor pairs are well out of range of the repulsive core, and
+ * for those the exact closest approach is not needed. Given the
+ * squared center separation `sep2` and the range `r_rep`, two cheap
+ * lower bounds on the closest approach are tried in turn:
+ * + the center separation minus the two half lengths
+ * + the distance between the bounding boxes of the two axes
+ * Returns 0 if one of them shows the pair is out of range, and 1 if the
+ * exact distance is needed.
+ *
+ * When compiled with `U_CC_COUNT` defined, every call is counted in
+ * `u_cc_count`, by the layer that settled it.
+ */
+#ifdef U_CC_COUNT
+#define U_CC_TICK(x) __atomic_fetch_add( &(u_cc_count.x), 1, __ATOMIC_RELAXED)
+#else
+#define U_CC_TICK(x)
+#endif
+
+u_cc_counters u_cc_count = { 0, 0, 0, 0};
+
+static inline int u_cc_near( cyl c1, cyl c2, double sep2, double r_rep){
+	double reach, gap, lo1, hi1, lo2, hi2, gap2;
+
+	U_CC_TICK( calls);
+	/* (|d1|+|d2|)/2 <= sqrt((|d1|^2+|d2|^2)/2), with equality for
+	 * equal lengths, which saves a square root */
+	reach = r_rep + sqrt( 0.5*(vec3_dot( c1.d, c1.d) + vec3_dot( c2.d, c2.d)));
+	if( sep2 >= reach*reach ){
+		U_CC_TICK( centre);
+		return 0;
+	}
+
+	gap2 = 0.;
+	lo1 = min( c1.p.x, c1.p.x + c1.d.x); hi1 = max( c1.p.x, c1.p.x + c1.d.x);
+	lo2 = min( c2.p.x, c2.p.x + c2.d.x); hi2 = max( c2.p.x, c2.p.x + c2.d.x);
+	gap = max( max( lo2 - hi1, lo1 - hi2), 0.);
+	gap2 += gap*gap;
+	lo1 = min( c1.p.y, c1.p.y + c1.d.y); hi1 = max( c1.p.y, c1.p.y + c1.d.y);
+	lo2 = min( c2.p.y, c2.p.y + c2.d.y); hi2 = max( c2.p.y, c2.p.y + c2.d.y);
+	gap = max( max( lo2 - hi1, lo1 - hi2), 0.);
+	gap2 += gap*gap;
+	lo1 = min( c1.p.z, c1.p.z + c1.d.z); hi1 = max( c1.p.z, c1.p.z + c1.d.z);
+	lo2 = min( c2.p.z, c2.p.z + c2.d.z); hi2 = max( c2.p.z, c2.p.z + c2.d.z);
+	gap = max( max( lo2 - hi1, lo1 - hi2), 0.);
+	gap2 += gap*gap;
+	if( gap2 >= r_rep*r_rep ){
+		U_CC_TICK( box);
+		return 0;
+	}
+
+	U_CC_TICK( exact);
+	return 1;
+}
+
+/*!
+ * Squared separation between the centers of two cylinders.
+ */
+static inline double u_cc_sep2( cyl c1, cyl c2){
+	vec3 dp = vec3_add( vec3_sub( c1.p, c2.p), vec3_smul( vec3_sub( c1.d, c2.d), 0.5));
+	return vec3_dot( dp, dp);
+}
+
+/*!
+ * Pair potentials
+ *
+ * The pair energies the energy loops are specialised for (see
+ * `mc_set_potential`). None of them reaches further than `u_cc`, so
+ * the buckets of the state cover all of them.
+ * + `pot_default` is `u_cc`
+ * + `pot_centre` only the attractive lj potential of `u_cc`, between
+ *   the centers
+ * + `pot_closest` only the repulsive lj potential of `u_cc`, between
+ *   the points of closest approach
+ * + `pot_kihara` the truncated lj potential of the closest approach,
+ *   with the minimum where the surfaces touch (a Kihara potential)
+ * + `pot_hard` infinite if the cylinders overlap, and 0 otherwise
+ */
+static inline double pot_default( cyl c1, cyl c2){
+	double u0, sep2;
+	lj_params p_attractive = { 1., 2.*c1.r};
+	lj_params p_repulsive = { 1., 2.*c1.r/TWO_1_6};
+	double r_att = LJ_RMAX*p_attractive.r0;
+
+	sep2 = u_cc_sep2( c1, c2);
+
+	u0 = 0.;
+	if( sep2 <= r_att*r_att ){
+		u0 = lj_truncated( sqrt( sep2), p_attractive);
+	}
+	if( u_cc_near( c1, c2, sep2, p_repulsive.r0) ){
+		u0 += lj_shifted( cyl_dist( c1, c2), p_repulsive);
+	}
+
+	return u0;
+}
+
+static inline double pot_centre( cyl c1, cyl c2){
+	lj_params p_attractive = { 1., 2.*c1.r};
+	double r_att = LJ_RMAX*p_attractive.r0;
+	double sep2 = u_cc_sep2( c1, c2);
+	if( sep2 > r_att*r_att ){
+		return 0.;
+	}
+	return lj_truncated( sqrt( sep2), p_attractive);
+}
+
+static inline double pot_closest( cyl c1, cyl c2){
+	lj_params p_repulsive = { 1., 2.*c1.r/TWO_1_6};
+	if( !u_cc_near( c1, c2, u_cc_sep2( c1, c2), p_repulsive.r0) ){
+		return 0.;
+	}
+	return lj_shifted( cyl_dist( c1, c2), p_repulsive);
+}
+
+static inline double pot_kihara( cyl c1, cyl c2){
+	lj_params p = { 1., 2.*c1.r};
+	if( !u_cc_near( c1, c2, u_cc_sep2( c1, c2), LJ_RMAX*p.r0) ){
+		return 0.;
+	}
+	return lj_truncated( cyl_dist( c1, c2), p);
+}
+
+static inline double pot_hard( cyl c1, cyl c2){
+	double r = c1.r + c2.r;
+	if( !u_cc_near( c1, c2, u_cc_sep2( c1, c2), r) ){
+		return 0.;
+	}
+	return( cyl_dist2( c1, c2) < r*r )?INFINITY:0.;
+}
+
 /*!
  * Energy between two cylinders
  *
  * This calculates a lj potential between two cylinders: it has an
  * attractive lj potential between the centers, and a repulsive lj
- * potential between the points of closest approach.
+ * potential between the points of closest approach. The closest
+ * approach is only worked out for pairs that pass the broad phase in
+ * `u_cc_near`, and a pair out of range of both returns 0 without a
+ * square root.
  */
 double u_cc( cyl c1, cyl c2){
-	double u0;
-	lj_params p_attractive = { 1., 2.*c1.r};
-	lj_params p_repulsive = { 1., 2.*c1.r/TWO_1_6};
+	return pot_default( c1, c2);
+}
 
-	double sep = vec3_dist( cyl_point( c1, 0.5), cyl_point( c2, 0.5));
+/*!
+ * Energy between two cylinders with the pair potential `potential`
+ * (one of the `POT_` values in montecarlo.h).
+ */
+double u_pair( int potential, cyl c1, cyl c2){
+	switch( potential ){
+	case POT_CENTRE:
+		return pot_centre( c1, c2);
+	case POT_CLOSEST:
+		return pot_closest( c1, c2);
+	case POT_KIHARA:
+		return pot_kihara( c1, c2);
+	case POT_HARD:
+		return pot_hard( c1, c2);
+	default:
+		return pot_default( c1, c2);
+	}
+}
 
-	u0 = lj_truncated( sep, p_attractive);
-	u0 += lj_shifted( cyl_dist( c1, c2), p_repulsive);
+/*!
+ * Constructor for the tabulated pair potentials.
+ *
+ * Tabulates the attractive and repulsive potentials used in `u_cc`
+ * for cylinders of radius `r` (see `pair_tables` in montecarlo.h).
+ * Each table has `n` intervals, and starts at 0.8 times the position
+ * of the minimum; closer pairs fall back to the analytic forms.
+ * Returns `NULL` if any allocation fails.
+ */
+pair_tables* pair_tables_malloc( double r, int n){
+	lj_params p_attractive = { 1., 2.*r};
+	lj_params p_repulsive = { 1., 2.*r/TWO_1_6};
+	pair_tables *pt = (pair_tables *) malloc( sizeof(pair_tables));
+	if( pt == NULL ){
+		return NULL;
+	}
+	pt->att = lj_table_malloc( lj_truncated, p_attractive,
+							   0.8*p_attractive.r0, LJ_RMAX*p_attractive.r0, n);
+	pt->rep = lj_table_malloc( lj_shifted, p_repulsive,
+							   0.8*p_repulsive.r0, p_repulsive.r0, n);
+	if( pt->att == NULL || pt->rep == NULL ){
+		if( pt->att != NULL ){
+			lj_table_free( pt->att);
+		}
+		if( pt->rep != NULL ){
+			lj_table_free( pt->rep);
+		}
+		free( pt);
+		return NULL;
+	}
+	return pt;
+}
 
-	return u0;
+/*!
+ * Destructor for the tabulated pair potentials.
+ */
+void pair_tables_free( pair_tables *pt){
+	lj_table_free( pt->att);
+	lj_table_free( pt->rep);
+	free( pt);
+}
+
+/*!
+ * Interaction energy between two cylinders, tabulated.
+ *
+ * Same as `u_cc`, but works with the squared distances and looks the
+ * energies up in the tables `pt`, so there is no `sqrt` or division
+ * apart from the one in the broad phase.
+ */
+double u_cc_tab( pair_tables *pt, cyl c1, cyl c2){
+	double sep2 = u_cc_sep2( c1, c2);
+	double u = lj_table_eval( pt->att, sep2);
+	if( u_cc_near( c1, c2, sep2, pt->rep->p.r0) ){
+		u += lj_table_eval( pt->rep, cyl_dist2( c1, c2));
+	}
+	return u;
+}
+
+/*!
+ * Early rejection
+ *
+ * In a Metropolis test the random number can be drawn before the
+ * energy is known. The move of cylinder `i` is accepted if the change
+ * in energy is below `-log(1-x)/beta` (with `x` uniform in [0,1)), so
+ * the new energy has a budget, and once it is sure to go over, the
+ * rest of the neighbors do not need to be looked at.
+ *
+ * No pair energy is below `U_CC_MIN` (the depth of the attractive
+ * well, `POT_MIN` for the other pair potentials), so once the partial
+ * sum plus `U_CC_MIN` for every pair left is at or above the budget,
+ * the move is rejected. The pairs are
+ * counted before the scan, which is a cheap walk over the lists. A
+ * move is rejected early mostly because of a big repulsive energy from
+ * a close neighbor, which comes early in the scan since the stencil
+ * of the state is sorted closest first (the own bucket, then the ones
+ * that share a face, an edge, and a corner).
+ */
+#define U_CC_MIN -1.
+
+/*!
+ * Energy cache
+ *
+ * The state keeps the energy of every cylinder with all of its
+ * neighbors in `u`, and the total energy in `u_tot`. They are set up
+ * from scratch with `state_energy`, and kept up to date by making
+ * every accepted move through `mc_accept`. Anything else that moves
+ * cylinders should set `u_valid` to 0.
+ *
+ * Several threads may accept moves at the same time (see `sweep.c`),
+ * and the neighbors of two moving cylinders can be the same, so the
+ * updates to the neighbors and the total are done atomically.
+ */
+static void atomic_add( double *x, double dx){
+	double old, new;
+	__atomic_load( x, &old, __ATOMIC_RELAXED);
+	do{
+		new = old + dx;
+	}while( !__atomic_compare_exchange( x, &old, &new, 1,
+										__ATOMIC_RELAXED, __ATOMIC_RELAXED) );
+}
+
+/*!
+ * Potential selection
+ *
+ * Every loop over the neighbors is compiled once for each pair
+ * potential with the pair energy inlined (see uloops.h), and the
+ * public energy functions below switch on the potential of the state
+ * once per call, never once per pair. Compiling with `MC_POTENTIAL`
+ * defined to one of the `POT_` values fixes the potential at build
+ * time (see `mc_potential` in montecarlo.h), and the switch folds away.
+ */
+#define POT_NAME default
+#define POT_PAIR pot_default
+#define POT_MIN U_CC_MIN
+#include "uloops.h"
+#undef POT_NAME
+#undef POT_PAIR
+#undef POT_MIN
+
+#define POT_NAME centre
+#define POT_PAIR pot_centre
+#define POT_MIN U_CC_MIN
+#include "uloops.h"
+#undef POT_NAME
+#undef POT_PAIR
+#undef POT_MIN
+
+#define POT_NAME closest
+#define POT_PAIR pot_closest
+#define POT_MIN 0.
+#include "uloops.h"
+#undef POT_NAME
+#undef POT_PAIR
+#undef POT_MIN
+
+#define POT_NAME kihara
+#define POT_PAIR pot_kihara
+#define POT_MIN U_CC_MIN
+#include "uloops.h"
+#undef POT_NAME
+#undef POT_PAIR
+#undef POT_MIN
+
+#define POT_NAME hard
+#define POT_PAIR pot_hard
+#define POT_MIN 0.
+#include "uloops.h"
+#undef POT_NAME
+#undef POT_PAIR
+#undef POT_MIN
+
+#define POT_DISPATCH( s, f, args) \
+	switch( mc_potential( s) ){ \
+	case POT_CENTRE: return f##_centre args; \
+	case POT_CLOSEST: return f##_closest args; \
+	case POT_KIHARA: return f##_kihara args; \
+	case POT_HARD: return f##_hard args; \
+	default: return f##_default args; \
+	}
+
+/*!
+ * Select the pair potential of the state.
+ *
+ * `potential` is one of the `POT_` values in montecarlo.h. The cached
+ * energies are marked out of date. Returns 0 (and changes nothing) if
+ * there is no such potential, or the build fixes a different one.
+ */
+int mc_set_potential( state *s, int potential){
+	if( potential < 0 || potential >= POT_COUNT ){
+		return 0;
+	}
+#ifdef MC_POTENTIAL
+	if( potential != MC_POTENTIAL ){
+		return 0;
+	}
+#endif
+	s->potential = potential;
+	s->u_valid = 0;
+	return 1;
 }
 
 /*!
  * Total energy involving indexed cylinder. 
+ *
+ * The buckets to scan are the stencil of the state (see
+ * `state_neighbors`).
+ * In a periodic box the neighbors are taken at their closest image.
  */
 double u_i( state *s, int index, cyl c){
-	int i, j, k, m;
+	POT_DISPATCH( s, u_i, ( s, index, c))
+}
+
+/*!
+ * The difference in energy.
+ *
+ * The difference in energy in moving cylidner index with the index i,
+ * to the new position c_new. If the cached energies in the state are
+ * up to date, the energy of the old position is taken from the cache.
+ */
+double du( state *s, int i, cyl c_new){
+	double u_old = s->u_valid?s->u[i]:u_i( s, i, s->a[i].c);
+	return( u_i( s, i, c_new) - u_old );
+}
+
+/*!
+ * Total energy involving indexed cylinder, with early exit.
+ *
+ * Same as `u_i`, but stops as soon as the sum is sure to end up at or
+ * above `budget`. Returns the full sum if it is below the budget, and
+ * otherwise some value at or above the budget.
+ */
+double u_i_budget( state *s, int index, cyl c, double budget){
+	POT_DISPATCH( s, u_i_budget, ( s, index, c, budget))
+}
+
+/*!
+ * Compute the cached energies from scratch, returns the total.
+ */
+double state_energy( state *s){
+	int i;
+	double u = 0.;
+	for( i=0; i<s->n; i++){
+		s->u[i] = u_i( s, i, s->a[i].c);
+		u += s->u[i];
+	}
+	s->u_tot = 0.5*u;
+	s->u_valid = 1;
+	return s->u_tot;
+}
+
+/*!
+ * Add `sign` times the pair energy with `c` to the cached energy of
+ * every neighbor of `c`, and return the sum of the pair energies.
+ */
+static double u_shift( state *s, int index, cyl c, double sign){
+	POT_DISPATCH( s, u_shift, ( s, index, c, sign))
+}
+
+/*!
+ * Accept a move.
+ *
+ * Move cylinder `i` to `c_new`, and update the cached energies of the
+ * cylinder, its old and new neighbors, and the total. The hook of the
+ * state (if any) is called first.
+ */
+void mc_accept( state *s, int i, cyl c_new){
+	double u_old, u_new;
+	c_new.p = state_wrap( s, c_new.p);
+	if( s->hook != NULL ){
+		s->hook( s->hook_ctx, s, i, c_new);
+	}
+	if( s->u_valid ){
+		u_old = u_shift( s, i, s->a[i].c, -1.);
+		u_new = u_shift( s, i, c_new, 1.);
+		s->u[i] = u_new;
+		atomic_add( &(s->u_tot), u_new - u_old);
+	}
+	cyl_list_move( s, i, c_new.p);
+	s->a[i].c.d = c_new.d;
+}
+
+/*!
+ * Check the cached energies.
+ *
+ * Recomputes all the energies from scratch and compares them with
+ * the cached ones. The largest difference for a single cylinder is
+ * stored in `max_drift` and the difference in the total energy is
+ * returned. Afterwards the cache holds the fresh values.
+ */
+double state_energy_check( state *s, double *max_drift){
+	int i;
+	double u, u_tot, drift;
+	*max_drift = 0.;
+	u_tot = 0.;
+	for( i=0; i<s->n; i++){
+		u = u_i( s, i, s->a[i].c);
+		drift = fabs( u - s->u[i]);
+		*max_drift = max( *max_drift, drift);
+		s->u[i] = u;
+		u_tot += u;
+	}
+	drift = 0.5*u_tot - s->u_tot;
+	s->u_tot = 0.5*u_tot;
+	s->u_valid = 1;
+	return drift;
+}
+
+/*!
+ * Total energy involving indexed cylinder, neighbor list.
+ *
+ * Same as `u_i`, but the neighbors are taken from the Verlet list
+ * `nl`. If the list is stale, or `c` is too far from where cylinder
+ * `index` was when the list was built, this falls back to `u_i`.
+ */
+double u_i_nlist( state *s, nlist *nl, int index, cyl c){
+	POT_DISPATCH( s, u_i_nlist, ( s, nl, index, c))
+}
+
+/*!
+ * The difference in energy, neighbor list.
+ */
+double du_nlist( state *s, nlist *nl, int i, cyl c_new){
+	double u_old = s->u_valid?s->u[i]:u_i_nlist( s, nl, i, s->a[i].c);
+	return( u_i_nlist( s, nl, i, c_new) - u_old );
+}
+
+/*!
+ * Total energy involving indexed cylinder, neighbor list, with early
+ * exit.
+ *
+ * Same as `u_i_nlist`, with the early exit of `u_i_budget`. The list
+ * is in the order the buckets were scanned when it was built.
+ */
+double u_i_nlist_budget( state *s, nlist *nl, int index, cyl c, double budget){
+	POT_DISPATCH( s, u_i_nlist_budget, ( s, nl, index, c, budget))
+}
+
+/*!
+ * Metropolis test with early rejection.
+ *
+ * Draws the random number for moving cylinder `i` to `c_new` at
+ * inverse temperature `beta` first, and then works out the new energy
+ * only as far as needed. The neighbor list `nl` is used if it is not
+ * `NULL`. Returns 1 if the move should be accepted.
+ */
+int mc_try( state *s, nlist *nl, int i, cyl c_new, double beta, rng *g){
+	double u_old, budget;
+	if( nl != NULL ){
+		u_old = s->u_valid?s->u[i]:u_i_nlist( s, nl, i, s->a[i].c);
+	}else{
+		u_old = s->u_valid?s->u[i]:u_i( s, i, s->a[i].c);
+	}
+	budget = -log( 1. - rng_uniform( g));
+	budget = u_old + ((beta > 0.)?budget/beta:INFINITY);
+	if( nl != NULL ){
+		return( u_i_nlist_budget( s, nl, i, c_new, budget) < budget );
+	}
+	return( u_i_budget( s, i, c_new, budget) < budget );
+}
+
+/*!
+ * Total energy involving indexed cylinder, cell sorted storage.
+ *
+ * Same as `u_i`, but the neighbors are read from the contiguous slot
+ * range of each bucket in a `cell_store`. The squared distances for a
+ * bucket are computed in blocks of `CS_BLOCK` with `cyl_dist2_batch`,
+ * and the energies looked up in the tables `pt` afterwards. The cell
+ * sorted storage only supports a box with hard walls, and the tables
+ * are for the default pair potential `u_cc`.
+ */
+#define CS_BLOCK 64
+double cs_u_i( cell_store *cs, pair_tables *pt, int index, cyl c){
+	int i, j, k, m, q, q_end, nq, t;
 	int i_min, i_max, j_min, j_max, k_min, k_max;
-	vec3 p;
-	cyl_ll *old, *cur;
+	double dist2[CS_BLOCK], sep2[CS_BLOCK];
+	cyl_batch b;
 	double u;
 
-	p = c.p;
-	i = (int) p.x/s->bucket.x;
+	i = (int) (c.p.x/cs->bucket.x);
 	i_min = (i==0)?i:i-1;
-	i_max = (i==s->nbx-1)?i:i+1;
-	j = (int) p.y/s->bucket.y;
+	i_max = (i==cs->nbx-1)?i:i+1;
+	j = (int) (c.p.y/cs->bucket.y);
 	j_min = (j==0)?j:j-1;
-	j_max = (j==s->nby-1)?j:j+1;
-	k = (int) p.z/s->bucket.z;
+	j_max = (j==cs->nby-1)?j:j+1;
+	k = (int) (c.p.z/cs->bucket.z);
 	k_min = (k==0)?k:k-1;
-	k_max = (k==s->nbz-1)?k:k+1;
-	m = (s->nbx)*( (s->nby)*k + j) + i;
+	k_max = (k==cs->nbz-1)?k:k+1;
 
-	old = &(s->a[index]);
 	u = 0.;
-	for( i=i_min; i<=i_max; i++){
+	for( k=k_min; k<=k_max; k++){
 		for( j=j_min; j<=j_max; j++){
-			for( k=k_min; k<=k_max; k++){
-				m = (s->nbx)*( (s->nby)*k + j) + i;
-				for( cur = s->heads[m]; cur != NULL; cur = cur->next){
-					if( cur != old ){
-						u += u_cc( cur->c, c);
+			for( i=i_min; i<=i_max; i++){
+				m = (cs->nbx)*( (cs->nby)*k + j) + i;
+				q_end = cs->start[m] + cs->count[m];
+				for( q=cs->start[m]; q<q_end; q+=CS_BLOCK){
+					nq = min( CS_BLOCK, q_end-q);
+					b.px = cs->px+q; b.py = cs->py+q; b.pz = cs->pz+q;
+					b.dx = cs->dx+q; b.dy = cs->dy+q; b.dz = cs->dz+q;
+					cyl_dist2_batch( c, b, nq, dist2, sep2);
+					for( t=0; t<nq; t++){
+						if( cs->id[q+t] != index ){
+							u += lj_table_eval( pt->att, sep2[t]);
+							u += lj_table_eval( pt->rep, dist2[t]);
+						}
 					}
 				}
 			}
@@ -91,13 +599,8 @@ double u_i( state *s, int index, cyl c){
 }
 
 /*!
- * The difference in energy.
- *
- * The difference in energy in moving cylidner index with the index i,
- * to the new position c_new.
+ * The difference in energy, cell sorted storage.
  */
-double du( state *s, int i, cyl c_new){
-	return( u_i( s, i, c_new) - u_i( s, i, s->a[i].c) );
+double cs_du( cell_store *cs, pair_tables *pt, int i, cyl c_new){
+	return( cs_u_i( cs, pt, i, c_new) - cs_u_i( cs, pt, i, cell_store_get( cs, cs->slot[i])) );
 }
-
-
@@ -0,0 +1,71 @@
+/*!*******************************************************************
+ * montecarlo.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#ifndef JW_MONTECARLO
+#define JW_MONTECARLO
+
+cyl move_cyl( cyl c_old, rng *g);
+
+/*!
+ * Broad phase counters
+ *
+ * How many calls to the broad phase of `u_cc` (and `u_cc_tab`) there
+ * were (`calls`), and how many were settled by the center separation
+ * (`centre`), by the bounding boxes (`box`), or needed the exact
+ * closest approach (`exact`). Only counted when montecarlo.c is
+ * compiled with `U_CC_COUNT` defined.
+ */
+typedef struct{ long calls, centre, box, exact;} u_cc_counters;
+extern u_cc_counters u_cc_count;
+double u_cc( cyl c1, cyl c2);
+
+/*!
+ * Pair potentials
+ *
+ * The pair potential used by `u_i` and the other energy functions of
+ * a state (see `mc_set_potential` and the pair potentials in
+ * montecarlo.c). `mc_potential` gives the one in use, which is fixed
+ * by the build if `MC_POTENTIAL` is defined.
+ */
+#define POT_DEFAULT 0
+#define POT_CENTRE 1
+#define POT_CLOSEST 2
+#define POT_KIHARA 3
+#define POT_HARD 4
+#define POT_COUNT 5
+#ifdef MC_POTENTIAL
+#define mc_potential(s) (MC_POTENTIAL)
+#else
+#define mc_potential(s) ((s)->potential)
+#endif
+double u_pair( int potential, cyl c1, cyl c2);
+int mc_set_potential( state *s, int potential);
+
+/*!
+ * Tabulated pair potentials
+ *
+ * The attractive (`att`) and repulsive (`rep`) potentials of `u_cc`,
+ * tabulated in the squared distance (see ljtable.h).
+ */
+typedef struct{ lj_table *att, *rep;} pair_tables;
+pair_tables* pair_tables_malloc( double r, int n);
+void pair_tables_free( pair_tables *pt);
+double u_cc_tab( pair_tables *pt, cyl c1, cyl c2);
+
+double u_i( state *s, int index, cyl c);
+double du( state *s, int i, cyl c_new);
+double u_i_budget( state *s, int index, cyl c, double budget);
+double state_energy( state *s);
+void mc_accept( state *s, int i, cyl c_new);
+double state_energy_check( state *s, double *max_drift);
+double u_i_nlist( state *s, nlist *nl, int index, cyl c);
+double du_nlist( state *s, nlist *nl, int i, cyl c_new);
+double u_i_nlist_budget( state *s, nlist *nl, int index, cyl c, double budget);
+int mc_try( state *s, nlist *nl, int i, cyl c_new, double beta, rng *g);
+double cs_u_i( cell_store *cs, pair_tables *pt, int index, cyl c);
+double cs_du( cell_store *cs, pair_tables *pt, int i, cyl c_new);
+
+#endif /* JW_MONTECARLO */
@@ -0,0 +1,138 @@
+/*!*******************************************************************
+ * movebatch.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * This file contains the batched generation of trial moves used by
+ * the sweeps in place of `move_cyl`. Each move has a translation and
+ * a new direction, and `move_cyl` draws them one at a time with
+ * `rand_ball` and `rand_rot`, which costs an `acos`, a `cos`, a `sin`
+ * and two axis angle rotations (each with its own trig and square
+ * root) per move.
+ *
+ * Here the random parts are made for a whole batch at once, and only
+ * depend on the random numbers, not on the cylinder. The translations
+ * are drawn uniformly in the unit ball by rejection. The directions
+ * are drawn over a spherical cap around the z axis with Marsaglia's
+ * method: for `(a, b)` uniform in a disk with `s = a^2 + b^2`, the
+ * point `(2a sqrt(1-s), 2b sqrt(1-s), 1-2s)` is uniform on the unit
+ * sphere, and limiting the disk to `s < (1 - cos(th_max))/2` limits the
+ * point to the cap of half-angle `th_max`. So there are no trig
+ * functions at all.
+ *
+ * A fill first draws the uniform random numbers in bulk, then keeps
+ * the candidates that fall inside the ball (or the disk) without
+ * branching, and finally maps the disk points onto the cap in a plain
+ * loop over the arrays that the compiler can vectorize.
+ * `move_batch_next` (in movebatch.h) then only has to scale the
+ * translation and turn the direction from the z axis to the axis of
+ * the cylinder.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "vecs.h"
+#include "rng.h"
+#include "cylinders.h"
+#include "movebatch.h"
+
+/*!
+ * Constructor for a batch of `size` trial moves, with the new
+ * directions within `th_max` of the old ones.
+ *
+ * The batch starts out empty, so the first move fills it. Returns
+ * `NULL` if an allocation fails.
+ */
+move_batch* move_batch_malloc( int size, double th_max){
+	move_batch *mb;
+	if( size < 1 ){
+		size = 1;
+	}
+	mb = (move_batch *) malloc( sizeof(move_batch));
+	if( mb == NULL ){
+		return NULL;
+	}
+	mb->size = size;
+	mb->next = size;
+	mb->cap = 0.5*(1. - cos( th_max));
+	mb->tx = (double *) malloc( 6*size*sizeof(double));
+	mb->buf = (double *) malloc( 3*size*sizeof(double));
+	if( mb->tx == NULL || mb->buf == NULL ){
+		free( mb->tx);
+		free( mb->buf);
+		free( mb);
+		return NULL;
+	}
+	mb->ty = mb->tx + size;
+	mb->tz = mb->tx + 2*size;
+	mb->wx = mb->tx + 3*size;
+	mb->wy = mb->tx + 4*size;
+	mb->wz = mb->tx + 5*size;
+	return mb;
+}
+
+/*!
+ * Destructor for a batch of trial moves.
+ */
+void move_batch_free( move_batch *mb){
+	free( mb->tx);
+	free( mb->buf);
+	free( mb);
+}
+
+/*!
+ * Fill the batch with new trial moves from the generator `g`.
+ *
+ * The points outside the ball (about 48%) or the disk (about 21%) are
+ * dropped by writing every candidate and only moving the write
+ * position past the ones inside.
+ */
+void move_batch_fill( move_batch *mb, rng *g){
+	int i, k, m, size = mb->size;
+	double x, y, z, s, rho, *buf = mb->buf;
+
+	k = 0;
+	while( k < size ){
+		m = size - k;
+		rng_fill_uniform( g, buf, 3*m);
+		for( i=0; i<m; i++){
+			x = 2.*buf[3*i] - 1.;
+			y = 2.*buf[3*i+1] - 1.;
+			z = 2.*buf[3*i+2] - 1.;
+			mb->tx[k] = x;
+			mb->ty[k] = y;
+			mb->tz[k] = z;
+			k += ( x*x + y*y + z*z <= 1. );
+			if( k == size ){
+				break;
+			}
+		}
+	}
+
+	rho = sqrt( mb->cap);
+	k = 0;
+	while( k < size ){
+		m = size - k;
+		rng_fill_uniform( g, buf, 2*m);
+		for( i=0; i<m; i++){
+			x = rho*(2.*buf[2*i] - 1.);
+			y = rho*(2.*buf[2*i+1] - 1.);
+			mb->wx[k] = x;
+			mb->wy[k] = y;
+			k += ( x*x + y*y < mb->cap );
+			if( k == size ){
+				break;
+			}
+		}
+	}
+	for( i=0; i<size; i++){
+		s = mb->wx[i]*mb->wx[i] + mb->wy[i]*mb->wy[i];
+		z = 2.*sqrt( 1. - s);
+		mb->wx[i] *= z;
+		mb->wy[i] *= z;
+		mb->wz[i] = 1. - 2.*s;
+	}
+	mb->next = 0;
+}
@@ -0,0 +1,83 @@
+/*!*******************************************************************
+ * movebatch.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#ifndef JW_MOVEBATCH
+#define JW_MOVEBATCH
+
+#include "vecs.h"
+#include "rng.h"
+#include "cylinders.h"
+
+/*!
+ * Batch of trial moves
+ * ----------------------------
+ * move_batch_next : the next trial move of a cylinder
+ *
+ * A batch holds `size` trial moves made ahead of time (see
+ * movebatch.c), as separate component arrays:
+ * + `tx`, `ty`, `tz` translations, uniform in the unit ball
+ * + `wx`, `wy`, `wz` new directions, uniform over the spherical cap
+ *   of half-angle `th_max` around the z axis
+ * + `next` the next move to hand out
+ * + `cap` `(1 - cos(th_max))/2`, the squared radius of the disk the
+ *   cap is drawn from
+ * + `buf` scratch space for the uniform random numbers
+ */
+typedef struct{
+	int size, next;
+	double cap;
+	double *tx, *ty, *tz;
+	double *wx, *wy, *wz;
+	double *buf;
+} move_batch;
+
+move_batch* move_batch_malloc( int size, double th_max);
+void move_batch_free( move_batch *mb);
+void move_batch_fill( move_batch *mb, rng *g);
+
+/*!
+ * The next trial move of cylinder `c`, refilling the batch from `g`
+ * when it runs out.
+ *
+ * Moves the end point by up to half the length (as `move_cyl` does),
+ * and turns the stored direction from around the z axis to around
+ * the axis of `c` with the rotation that takes z to the axis. There
+ * are no trig functions, just a square root for the length.
+ */
+static inline cyl move_batch_next( move_batch *mb, cyl c, rng *g){
+	double len, ux, uy, uz, k, wx, wy, wz;
+	int i;
+	if( mb->next == mb->size ){
+		move_batch_fill( mb, g);
+	}
+	i = mb->next++;
+	len = vec3_mag( c.d);
+	ux = c.d.x/len;
+	uy = c.d.y/len;
+	uz = c.d.z/len;
+	c.p.x += 0.5*len*mb->tx[i];
+	c.p.y += 0.5*len*mb->ty[i];
+	c.p.z += 0.5*len*mb->tz[i];
+	wx = mb->wx[i];
+	wy = mb->wy[i];
+	wz = mb->wz[i];
+	if( uz > -0.5 ){
+		k = 1./(1. + uz);
+		c.d.x = len*((1. - ux*ux*k)*wx - ux*uy*k*wy + ux*wz);
+		c.d.y = len*(-ux*uy*k*wx + (1. - uy*uy*k)*wy + uy*wz);
+		c.d.z = len*(-ux*wx - uy*wy + uz*wz);
+	}else{
+		/* close to -z, turn to the mirror image of the axis and then a
+		 * half turn about x, so `k` stays small */
+		k = 1./(1. - uz);
+		c.d.x = len*((1. - ux*ux*k)*wx + ux*uy*k*wy + ux*wz);
+		c.d.y = len*(-ux*uy*k*wx - (1. - uy*uy*k)*wy + uy*wz);
+		c.d.z = len*(ux*wx - uy*wy + uz*wz);
+	}
+	return c;
+}
+
+#endif /* JW_MOVEBATCH */
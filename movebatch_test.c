@@ -0,0 +1,103 @@
+/*!*******************************************************************
+ * movebatch_test.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "math_const.h"
+#include "distributions.h"
+#include "movebatch.c"
+
+#define NMOVE 200000
+
+void move_batch_fill_test(){
+	move_batch *mb;
+	rng g;
+	int i, result;
+
+	fprintf( stdout, "Testing move_batch_fill: ");
+	rng_seed( &g, 1);
+	mb = move_batch_malloc( 1000, PI_6);
+	result = (mb != NULL);
+	move_batch_fill( mb, &g);
+	result = result && (mb->next == 0);
+	for( i=0; i<mb->size; i++){
+		result = result && ( mb->tx[i]*mb->tx[i] + mb->ty[i]*mb->ty[i] + mb->tz[i]*mb->tz[i] <= 1. );
+		result = result && ( fabs( mb->wx[i]*mb->wx[i] + mb->wy[i]*mb->wy[i] +
+								   mb->wz[i]*mb->wz[i] - 1.) < 1.0e-12 );
+		result = result && ( mb->wz[i] >= cos( PI_6) - 1.0e-12 );
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	move_batch_free( mb);
+}
+
+/*!
+ * Check the moves of a cylinder along `d`: the length is kept, the
+ * end point moves by at most half the length, the new axis is within
+ * `th_max` of the old one, and the mean of the cosine of the angle
+ * and of the new axis match those of `rand_rot`.
+ */
+int move_batch_check( move_batch *mb, vec3 d, double th_max, rng *g){
+	cyl c, c_new;
+	vec3 u, mean, mean_rot;
+	double len, ct, ct_sum, ct_rot;
+	int i, result = 1;
+
+	c.p.x = 1.; c.p.y = 2.; c.p.z = 3.;
+	c.d = d;
+	c.r = 0.1;
+	len = vec3_mag( d);
+	u = vec3_smul( d, 1./len);
+	ct_sum = 0.;
+	ct_rot = 0.;
+	mean.x = 0.; mean.y = 0.; mean.z = 0.;
+	mean_rot = mean;
+	for( i=0; i<NMOVE; i++){
+		c_new = move_batch_next( mb, c, g);
+		result = result && ( fabs( vec3_mag( c_new.d) - len) < max( 1.0e-12, 100.*COORD_EPSILON)*len );
+		result = result && ( vec3_dist( c_new.p, c.p) <= 0.5*len*(1. + 1.0e-12) );
+		ct = vec3_dot( c_new.d, u)/len;
+		result = result && ( ct >= cos( th_max) - 1.0e-12 );
+		ct_sum += ct;
+		vec3_addto( &mean, vec3_smul( c_new.d, 1./NMOVE));
+		ct_rot += vec3_dot( rand_rot( d, th_max, g), u)/len;
+		vec3_addto( &mean_rot, vec3_smul( rand_rot( d, th_max, g), 1./NMOVE));
+	}
+	result = result && ( fabs( ct_sum - ct_rot)/NMOVE < 1.0e-3 );
+	result = result && ( vec3_dist( mean, mean_rot) < 5.0e-3*len );
+	return result;
+}
+
+void move_batch_next_test(){
+	vec3 axes[5] = {{0., 0., 1.}, {0., 0., -1.}, {0.3, -0.2, -2.}, {1., 2., -0.5}, {-0.5, 0., 0.1}};
+	move_batch *mb;
+	rng g;
+	int i, result;
+
+	fprintf( stdout, "Testing move_batch_next: ");
+	rng_seed( &g, 2);
+	mb = move_batch_malloc( 4096, PI_6);
+	result = (mb != NULL);
+	for( i=0; i<5 && result; i++){
+		result = move_batch_check( mb, axes[i], PI_6, &g);
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	move_batch_free( mb);
+}
+
+int main(){
+	move_batch_fill_test();
+	move_batch_next_test();
+	return 0;
+}
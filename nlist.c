@@ -0,0 +1,230 @@
+/*!*******************************************************************
+ * nlist.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * This file contains Verlet neighbor lists for the cylinders in a
+ * `state`. The list for each cylinder holds every other cylinder that
+ * is within the interaction range plus a `skin`. The lists are built
+ * from the bucket grid, and can be used in place of the bucket
+ * scan in `u_i` for as long as no cylinder has moved more than half
+ * the skin since the last build. Then no pair that was outside the
+ * range plus skin at the build can have come into range.
+ *
+ * The displacement of a cylinder is measured as the larger of the
+ * displacements of its two endpoints, which bounds the displacement
+ * of every point along the axis (including the center) for both
+ * translations and rotations. In a periodic box the displacements
+ * are minimum images, so wrapping around the box is not a move.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "vecs.h"
+#include "cylinders.h"
+#include "lennardjones.h"
+#include "manybody.h"
+#include "math_const.h"
+
+/*!
+ * Neighbor list
+ *
+ * + `skin` the extra distance added to the interaction range
+ * + `n` number of cylinders
+ * + `start` the neighbors of cylinder `i` are `list[start[i]]` up to
+ *   `list[start[i+1]]`
+ * + `list` the neighbor indices, `size` long
+ * + `p0`, `p1` the two endpoints of each cylinder at the last build
+ * + `stale` set once any cylinder has moved more than half the skin
+ * + `builds` number of times the list has been built
+ * + `periodic`, `box` the boundary conditions of the state
+ */
+typedef struct{
+	double skin;
+	int n;
+	int *start;
+	int *list;
+	int size;
+	vec3 *p0, *p1;
+	int stale;
+	long builds;
+	int periodic;
+	vec3 box;
+} nlist;
+
+/*!
+ * The largest skin the bucket grid of `s` leaves room for.
+ *
+ * The list is built from the bucket stencil, which holds every pair
+ * whose first endpoints are less than `reach` apart: the smallest
+ * bucket size times the subdivision, and no more than the range of
+ * the stencil `2*(LJ_RMAX*r+l)` for a subdivided grid. A pair on the
+ * list can have its first endpoints as far apart as the range plus
+ * the skin, with the range `max(2*LJ_RMAX*r+l, 2*l+2*r/TWO_1_6)` (the
+ * center range of the attractive potential plus a length, or the
+ * repulsive range plus two lengths). So the skin can be at most
+ * `reach` minus that range, which for long thin rods can be well
+ * under a length, or nothing at all.
+ */
+double nlist_max_skin( state *s){
+	double reach, range;
+	reach = s->sub*min( min( s->bucket.x, s->bucket.y), s->bucket.z);
+	if( s->sub > 1 ){
+		reach = min( reach, 2.*(LJ_RMAX*s->cp.r + s->cp.l));
+	}
+	range = max( 2.*LJ_RMAX*s->cp.r + s->cp.l, 2.*s->cp.l + 2.*s->cp.r/TWO_1_6);
+	return max( reach - range, 0.);
+}
+
+/*!
+ * Constructor for the neighbor list.
+ *
+ * The list is marked stale, so it has to be built before use. Returns
+ * `NULL` if `skin` is not positive or more than the bucket grid has
+ * room for (see `nlist_max_skin`), or if any allocation fails.
+ */
+nlist* nlist_malloc( state *s, double skin){
+	nlist *nl;
+	if( skin <= 0. || skin > nlist_max_skin( s) ){
+		return NULL;
+	}
+	nl = (nlist *) malloc( sizeof(nlist));
+	if( nl == NULL ){
+		return NULL;
+	}
+	nl->skin = skin;
+	nl->n = s->n;
+	nl->size = 32*s->n;
+	nl->start = (int *) malloc( (s->n+1)*sizeof(int));
+	nl->list = (int *) malloc( nl->size*sizeof(int));
+	nl->p0 = (vec3 *) malloc( 2*s->n*sizeof(vec3));
+	if( nl->start == NULL || nl->list == NULL || nl->p0 == NULL ){
+		free( nl->start);
+		free( nl->list);
+		free( nl->p0);
+		free( nl);
+		return NULL;
+	}
+	nl->p1 = nl->p0 + s->n;
+	nl->stale = 1;
+	nl->builds = 0;
+	nl->periodic = s->periodic;
+	nl->box = s->box;
+	return nl;
+}
+
+/*!
+ * Destructor for the neighbor list.
+ */
+void nlist_free( nlist *nl){
+	free( nl->start);
+	free( nl->list);
+	free( nl->p0);
+	free( nl);
+}
+
+/*!
+ * Build the neighbor list from the bucket grid.
+ *
+ * A pair is on the list if the centers are within the range of the
+ * attractive potential plus the skin, or the closest approach is
+ * within the range of the repulsive potential plus the skin. The
+ * closest approach is at least the center separation minus the two
+ * half lengths, so it is only worked out for pairs that bound (taken
+ * with the longest cylinder) leaves in range, and the centers are
+ * compared squared. Returns 0 if the list could not be grown.
+ */
+int nlist_build( nlist *nl, state *s){
+	int l, q, t, nn, nbr[NBR_MAX], *tmp;
+	double r_att2, r_rep, reach2, len2, sep2;
+	vec3 ctr, d;
+	cyl_ll *cur;
+	cyl c, cc;
+
+	len2 = 0.;
+	for( l=0; l<s->n; l++){
+		len2 = max( len2, vec3_dot( s->a[l].c.d, s->a[l].c.d));
+	}
+	q = 0;
+	for( l=0; l<s->n; l++){
+		c = s->a[l].c;
+		r_att2 = (LJ_RMAX*2.*c.r + nl->skin)*(LJ_RMAX*2.*c.r + nl->skin);
+		r_rep = 2.*c.r/TWO_1_6 + nl->skin;
+		reach2 = (r_rep + sqrt( len2))*(r_rep + sqrt( len2));
+		nl->p0[l] = c.p;
+		nl->p1[l] = vec3_add( c.p, c.d);
+		nl->start[l] = q;
+
+		ctr = cyl_point( c, 0.5);
+		nn = state_neighbors( s, s->a[l].bucket, nbr);
+		for( t=0; t<nn; t++){
+			for( cur = s->heads[nbr[t]]; cur != NULL; cur = cur->next){
+				if( cur == &(s->a[l]) ){
+					continue;
+				}
+				cc = state_image( s, cur->c, ctr);
+				d = vec3_sub( ctr, cyl_point( cc, 0.5));
+				sep2 = vec3_dot( d, d);
+				if( sep2 > r_att2 && ( sep2 > reach2 || cyl_dist( c, cc) > r_rep) ){
+					continue;
+				}
+				if( q == nl->size ){
+					tmp = (int *) realloc( nl->list, 2*nl->size*sizeof(int));
+					if( tmp == NULL ){
+						return 0;
+					}
+					nl->list = tmp;
+					nl->size *= 2;
+				}
+				nl->list[q++] = (int) (cur - s->a);
+			}
+		}
+	}
+	nl->start[s->n] = q;
+	nl->stale = 0;
+	nl->builds++;
+	return 1;
+}
+
+/*!
+ * Displacement of cylinder `c` from where cylinder `i` was at the
+ * last build.
+ */
+double nlist_disp( nlist *nl, int i, cyl c){
+	vec3 d0 = vec3_sub( c.p, nl->p0[i]);
+	vec3 d1 = vec3_sub( vec3_add( c.p, c.d), nl->p1[i]);
+	if( nl->periodic ){
+		d0 = min_image( d0, nl->box);
+		d1 = min_image( d1, nl->box);
+	}
+	return max( vec3_mag( d0), vec3_mag( d1));
+}
+
+/*!
+ * Check whether the list can be used for cylinder `i` at `c`.
+ */
+int nlist_valid( nlist *nl, int i, cyl c){
+	return( !nl->stale && nlist_disp( nl, i, c) <= 0.5*nl->skin );
+}
+
+/*!
+ * Record an accepted move of cylinder `i` to `c`.
+ *
+ * Marks the list stale if the cylinder is now more than half the
+ * skin away from where it was at the last build.
+ */
+void nlist_moved( nlist *nl, int i, cyl c){
+	if( nlist_disp( nl, i, c) > 0.5*nl->skin ){
+		nl->stale = 1;
+	}
+}
+
+/*!
+ * Mean number of neighbors per cylinder.
+ */
+double nlist_mean( nlist *nl){
+	return ((double) nl->start[nl->n])/nl->n;
+}
@@ -0,0 +1,32 @@
+/*!*******************************************************************
+ * nlist.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#ifndef JW_NLIST
+#define JW_NLIST
+
+typedef struct{
+	double skin;
+	int n;
+	int *start;
+	int *list;
+	int size;
+	vec3 *p0, *p1;
+	int stale;
+	long builds;
+	int periodic;
+	vec3 box;
+} nlist;
+
+double nlist_max_skin( state *s);
+nlist* nlist_malloc( state *s, double skin);
+void nlist_free( nlist *nl);
+int nlist_build( nlist *nl, state *s);
+double nlist_disp( nlist *nl, int i, cyl c);
+int nlist_valid( nlist *nl, int i, cyl c);
+void nlist_moved( nlist *nl, int i, cyl c);
+double nlist_mean( nlist *nl);
+
+#endif /* JW_NLIST */
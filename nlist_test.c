@@ -0,0 +1,184 @@
+/*!*******************************************************************
+ * nlist_test.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "nlist.c"
+#include "distributions.h"
+#include "cellstore.h"
+#include "ljtable.h"
+#include "montecarlo.h"
+#include "rsa.h"
+
+/*!
+ * Mean number of cylinders in the 27 buckets around each cylinder.
+ */
+double bucket_mean( state *s){
+	int i, j, k, l, m, q;
+	int i_min, i_max, j_min, j_max, k_min, k_max;
+	cyl_ll *cur;
+	vec3 p;
+
+	q = 0;
+	for( l=0; l<s->n; l++){
+		p = s->a[l].c.p;
+		i = (int) (p.x/s->bucket.x);
+		i_min = (i==0)?i:i-1;
+		i_max = (i==s->nbx-1)?i:i+1;
+		j = (int) (p.y/s->bucket.y);
+		j_min = (j==0)?j:j-1;
+		j_max = (j==s->nby-1)?j:j+1;
+		k = (int) (p.z/s->bucket.z);
+		k_min = (k==0)?k:k-1;
+		k_max = (k==s->nbz-1)?k:k+1;
+		for( i=i_min; i<=i_max; i++){
+			for( j=j_min; j<=j_max; j++){
+				for( k=k_min; k<=k_max; k++){
+					m = state_bucket( s, i, j, k);
+					for( cur = s->heads[m]; cur != NULL; cur = cur->next){
+						q++;
+					}
+				}
+			}
+		}
+		/* don't count the cylinder itself */
+		q--;
+	}
+	return ((double) q)/s->n;
+}
+
+void nlist_test(){
+	int i, l, result;
+	double a, b;
+	cyl c;
+	rng g;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {20., 20., 20.};
+	state *s = state_malloc( cp, box, 2000);
+	nlist *nl;
+
+	rng_seed( &g, 26);
+	state_uniform_initialize( s);
+
+	fprintf( stdout, "Testing nlist_build: ");
+	nl = nlist_malloc( s, 0.4);
+	result = (nl != NULL);
+	result = result && nlist_build( nl, s);
+	result = result && !nl->stale;
+	result = result && ( nlist_mean( nl) < bucket_mean( s) );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+		return;
+	}
+	fprintf( stdout, " %g neighbors on the list, %g in the buckets\n",
+		nlist_mean( nl), bucket_mean( s));
+
+	fprintf( stdout, "Testing u_i_nlist: ");
+	result = 1;
+	for( i=0; i<5000; i++){
+		/* small moves, so the list is used for a while between builds */
+		l = rng_below( &g, s->n);
+		c = s->a[l].c;
+		c.p = vec3_add( c.p, vec3_smul( rand_ball( &g), 0.05));
+		c.d = vec3_add( c.d, vec3_smul( rand_ball( &g), 0.05));
+		c.d = vec3_smul( vec3_unit( c.d), cp.l);
+		if( !cyl_box_overlap( c, box) ){
+			continue;
+		}
+		a = u_i_nlist( s, nl, l, c);
+		b = u_i( s, l, c);
+		result = result && ( fabs(a-b) < 1.0e-7*(1.+fabs(b)) );
+		cyl_list_move( s, l, c.p);
+		s->a[l].c.d = c.d;
+		nlist_moved( nl, l, c);
+		if( nl->stale ){
+			nlist_build( nl, s);
+		}
+	}
+	result = result && ( nl->builds > 1 );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	nlist_free( nl);
+	state_free( s);
+}
+
+/*!
+ * Check that every pair within the interaction range plus the skin
+ * is on the list, without using the buckets.
+ */
+int nlist_complete( nlist *nl, state *s){
+	int i, j, q, found;
+	double r_att, r_rep;
+	vec3 ctr;
+	cyl cc;
+	for( i=0; i<s->n; i++){
+		r_att = LJ_RMAX*2.*s->a[i].c.r + nl->skin;
+		r_rep = 2.*s->a[i].c.r/TWO_1_6 + nl->skin;
+		ctr = cyl_point( s->a[i].c, 0.5);
+		for( j=0; j<s->n; j++){
+			if( j == i ){
+				continue;
+			}
+			cc = state_image( s, s->a[j].c, ctr);
+			if( vec3_dist( ctr, cyl_point( cc, 0.5)) > r_att && cyl_dist( s->a[i].c, cc) > r_rep ){
+				continue;
+			}
+			found = 0;
+			for( q=nl->start[i]; q<nl->start[i+1]; q++){
+				found = found || ( nl->list[q] == j );
+			}
+			if( !found ){
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+void skin_test(){
+	int sub, result;
+	/* long thin rods, the buckets leave well under a length of room */
+	cyl_params cp = {0.05, 2.};
+	vec3 box = {16.9, 16.9, 16.9};
+	rsa_params rp = { 7u, 1, 0, 0, 0.};
+	state *s;
+	nlist *nl;
+
+	fprintf( stdout, "Testing nlist_malloc limits the skin to the stencil: ");
+	result = 1;
+	for( sub=1; sub<=2; sub++){
+		s = state_malloc( cp, box, 3000);
+		result = result && state_set_periodic( s, 1) && state_set_subdivision( s, sub);
+		result = result && ( rsa_initialize( s, rp) == 1 );
+		result = result && ( nlist_max_skin( s) > 0. && nlist_max_skin( s) < 0.2 );
+		result = result && ( nlist_malloc( s, 1.) == NULL );
+		nl = nlist_malloc( s, nlist_max_skin( s));
+		result = result && ( nl != NULL );
+		result = result && nlist_build( nl, s) && nlist_complete( nl, s);
+		if( nl != NULL ){
+			nlist_free( nl);
+		}
+		state_free( s);
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+}
+
+int main(){
+	nlist_test();
+	skin_test();
+	return 0;
+}
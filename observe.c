@@ -0,0 +1,448 @@
+/*!*******************************************************************
+ * observe.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * This file contains observables that are kept up to date move by
+ * move, so sampling them does not need a pass over the whole state.
+ *
+ * The observables install themselves as the move hook of the state
+ * (see `manybody.c`), which `mc_accept` calls for every accepted
+ * move, whether it comes from a sweep, an event chain or a domain.
+ * Each move then updates
+ * + the sum of `u u` (the outer product of the unit axis with itself)
+ *   over all cylinders, which gives the nematic order tensor
+ *   `Q = 3/2 <u u> - 1/2 I` and the order parameter `S`, its largest
+ *   eigenvalue. This costs O(1) per move.
+ * + the histogram of the center to center distances of all pairs
+ *   closer than `r_max`, which gives the pair distribution `g(r)`. The
+ *   pairs of the moving cylinder are found in the bucket grid, taken
+ *   out of the histogram at the old position and put back in at the
+ *   new one. This costs O(neighbors) per move.
+ * The energy is already kept up to date by `mc_accept` in the cached
+ * energies of the state, and is just read off.
+ *
+ * Accepted moves can come from several threads at once (see
+ * `sweep.c`), so the updates are done atomically. Moving cylinders in
+ * any other way (initializing, exchanging cylinders between domains,
+ * ...) is not seen by the hook, and `observables_check` has to be
+ * called afterwards. It is also called every `check_every` samples
+ * to recompute everything from scratch, and how far the running
+ * values had drifted is kept for `observables_print`.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "math_const.h"
+#include "vecs.h"
+#include "rng.h"
+#include "lennardjones.h"
+#include "ljtable.h"
+#include "cylinders.h"
+#include "manybody.h"
+#include "cellstore.h"
+#include "nlist.h"
+#include "montecarlo.h"
+
+/*!
+ * Observable parameters
+ *
+ * + `r_max` the range of the pair distribution, at most
+ *   `2*LJ_RMAX*r+l` so all the pairs are in the bucket stencil
+ * + `nbins` number of bins of the pair distribution
+ * + `check_every` recompute everything from scratch every this many
+ *   samples and keep the drift, or 0 to never check
+ */
+typedef struct{
+	double r_max;
+	int nbins;
+	int check_every;
+} observe_params;
+
+/*!
+ * Incrementally updated observables
+ *
+ * + `op` the parameters
+ * + `s` the state that is observed
+ * + `uu` sum of `u u` over the cylinders, in the order xx, yy, zz, xy,
+ *   xz, yz
+ * + `dr` the width of a bin
+ * + `hist` number of pairs in each bin of the pair distribution
+ * + `hist_sum` sum of `hist` over the samples
+ * + `samples` number of samples taken
+ * + `s_sum`, `s2_sum` sums of the order parameter and its square
+ * + `u_sum`, `u2_sum` sums of the energy and its square
+ * + `moves` number of moves seen by the hook
+ * + `drift` the largest deviation found by the last check
+ */
+typedef struct{
+	observe_params op;
+	state *s;
+	double uu[6];
+	double dr;
+	long *hist;
+	double *hist_sum;
+	long samples;
+	double s_sum, s2_sum;
+	double u_sum, u2_sum;
+	long moves;
+	double drift;
+} observables;
+
+/*!
+ * Add `dx` to `x` atomically.
+ */
+static void obs_atomic_add( double *x, double dx){
+	double old, new;
+	__atomic_load( x, &old, __ATOMIC_RELAXED);
+	do{
+		new = old + dx;
+	}while( !__atomic_compare_exchange( x, &old, &new, 1,
+										__ATOMIC_RELAXED, __ATOMIC_RELAXED) );
+}
+
+/*!
+ * Add `sign` times `u u` of cylinder `c` to `uu`.
+ */
+static void obs_uu( double *uu, cyl c, double sign, int atomic){
+	vec3 u;
+	double t[6];
+	int k;
+	u = vec3_smul( c.d, 1./vec3_mag( c.d));
+	t[0] = u.x*u.x;
+	t[1] = u.y*u.y;
+	t[2] = u.z*u.z;
+	t[3] = u.x*u.y;
+	t[4] = u.x*u.z;
+	t[5] = u.y*u.z;
+	for( k=0; k<6; k++){
+		if( atomic ){
+			obs_atomic_add( &(uu[k]), sign*t[k]);
+		}else{
+			uu[k] += sign*t[k];
+		}
+	}
+}
+
+/*!
+ * Add `sign` to the bins of `hist` for the pairs of cylinder `c`
+ * (taking the place of cylinder `index`) with every other cylinder.
+ */
+static void obs_pairs( observables *o, long *hist, int index, cyl c, long sign, int atomic){
+	state *s = o->s;
+	int t, nn, b, nbr[NBR_MAX];
+	vec3 ctr, d;
+	cyl_ll *self, *cur;
+	double r;
+
+	ctr = cyl_point( c, 0.5);
+	nn = state_neighbors( s, bucket_index( s, c.p), nbr);
+	self = &(s->a[index]);
+	for( t=0; t<nn; t++){
+		for( cur = s->heads[nbr[t]]; cur != NULL; cur = cur->next){
+			if( cur == self ){
+				continue;
+			}
+			d = vec3_sub( cyl_point( cur->c, 0.5), ctr);
+			if( s->periodic ){
+				d = min_image( d, s->box);
+			}
+			r = vec3_mag( d);
+			if( r < o->op.r_max ){
+				b = (int) (r/o->dr);
+				b = ( b < o->op.nbins )?b:o->op.nbins-1;
+				if( atomic ){
+					__sync_fetch_and_add( &(hist[b]), sign);
+				}else{
+					hist[b] += sign;
+				}
+			}
+		}
+	}
+}
+
+/*!
+ * The move hook, cylinder `i` is about to move to `c_new`.
+ */
+static void obs_hook( void *ctx, state *s, int i, cyl c_new){
+	observables *o = (observables *) ctx;
+	obs_uu( o->uu, s->a[i].c, -1., 1);
+	obs_uu( o->uu, c_new, 1., 1);
+	obs_pairs( o, o->hist, i, s->a[i].c, -1, 1);
+	obs_pairs( o, o->hist, i, c_new, 1, 1);
+	__sync_fetch_and_add( &(o->moves), 1);
+}
+
+/*!
+ * Compute `uu` and the histogram from scratch.
+ *
+ * Every pair is seen from both ends, so the histogram is halved.
+ */
+static void obs_compute( observables *o, double *uu, long *hist){
+	state *s = o->s;
+	int i, b;
+	for( i=0; i<6; i++){
+		uu[i] = 0.;
+	}
+	for( b=0; b<o->op.nbins; b++){
+		hist[b] = 0;
+	}
+	for( i=0; i<s->n; i++){
+		obs_uu( uu, s->a[i].c, 1., 0);
+		obs_pairs( o, hist, i, s->a[i].c, 1, 0);
+	}
+	for( b=0; b<o->op.nbins; b++){
+		hist[b] /= 2;
+	}
+}
+
+/*!
+ * Constructor for the observables.
+ *
+ * Computes the observables of the state `s` from scratch and installs
+ * the move hook, so every accepted move from then on updates them. A
+ * state has a single hook, so only one set of observables can be
+ * attached to it at a time. Returns `NULL` if an allocation fails.
+ */
+observables* observables_malloc( state *s, observe_params op){
+	observables *o;
+	double r_lim;
+	int b;
+
+	r_lim = 2.*LJ_RMAX*s->cp.r + s->cp.l;
+	if( op.r_max <= 0. || op.r_max > r_lim ){
+		op.r_max = r_lim;
+	}
+	if( op.nbins < 1 ){
+		op.nbins = 1;
+	}
+	o = (observables *) malloc( sizeof(observables));
+	if( o == NULL ){
+		return NULL;
+	}
+	o->hist = (long *) malloc( op.nbins*sizeof(long));
+	o->hist_sum = (double *) malloc( op.nbins*sizeof(double));
+	if( o->hist == NULL || o->hist_sum == NULL ){
+		free( o->hist);
+		free( o->hist_sum);
+		free( o);
+		return NULL;
+	}
+	o->op = op;
+	o->s = s;
+	o->dr = op.r_max/op.nbins;
+	o->samples = 0;
+	o->s_sum = 0.;
+	o->s2_sum = 0.;
+	o->u_sum = 0.;
+	o->u2_sum = 0.;
+	o->moves = 0;
+	o->drift = 0.;
+	for( b=0; b<op.nbins; b++){
+		o->hist_sum[b] = 0.;
+	}
+	obs_compute( o, o->uu, o->hist);
+	s->hook = obs_hook;
+	s->hook_ctx = o;
+	return o;
+}
+
+/*!
+ * Destructor for the observables, takes the hook off the state.
+ */
+void observables_free( observables *o){
+	if( o->s->hook_ctx == o ){
+		o->s->hook = NULL;
+		o->s->hook_ctx = NULL;
+	}
+	free( o->hist);
+	free( o->hist_sum);
+	free( o);
+}
+
+/*!
+ * The nematic order parameter.
+ *
+ * The largest eigenvalue of the order tensor `Q = 3/2 <u u> - 1/2 I`,
+ * 1 if all the cylinders are aligned and close to 0 if they point
+ * every which way. The eigenvalues of the symmetric 3x3 tensor are
+ * found from its characteristic polynomial.
+ */
+double observables_order( observables *o){
+	double q[6], tr, p1, p2, p, r, phi, b[6], det;
+	int k;
+
+	if( o->s->n == 0 ){
+		return 0.;
+	}
+	for( k=0; k<6; k++){
+		q[k] = 1.5*o->uu[k]/o->s->n;
+	}
+	q[0] -= 0.5;
+	q[1] -= 0.5;
+	q[2] -= 0.5;
+	p1 = q[3]*q[3] + q[4]*q[4] + q[5]*q[5];
+	if( p1 == 0. ){
+		return fmax( q[0], fmax( q[1], q[2]));
+	}
+	tr = (q[0] + q[1] + q[2])/3.;
+	p2 = (q[0]-tr)*(q[0]-tr) + (q[1]-tr)*(q[1]-tr) + (q[2]-tr)*(q[2]-tr) + 2.*p1;
+	p = sqrt( p2/6.);
+	for( k=0; k<6; k++){
+		b[k] = q[k]/p;
+	}
+	b[0] -= tr/p;
+	b[1] -= tr/p;
+	b[2] -= tr/p;
+	det = b[0]*(b[1]*b[2] - b[5]*b[5])
+		- b[3]*(b[3]*b[2] - b[5]*b[4])
+		+ b[4]*(b[3]*b[5] - b[1]*b[4]);
+	r = 0.5*det;
+	if( r <= -1. ){
+		phi = PI/3.;
+	}else if( r >= 1. ){
+		phi = 0.;
+	}else{
+		phi = acos( r)/3.;
+	}
+	return tr + 2.*p*cos( phi);
+}
+
+/*!
+ * Recompute the observables from scratch.
+ *
+ * Returns the largest deviation of the running values from the fresh
+ * ones: of the entries of `<u u>`, and of the bins of the histogram
+ * relative to the number of pairs in range. The running values are
+ * then replaced by the fresh ones. Returns -1 if an allocation fails.
+ */
+double observables_check( observables *o){
+	double uu[6], dev, d, npairs;
+	long *hist;
+	int k;
+
+	hist = (long *) malloc( o->op.nbins*sizeof(long));
+	if( hist == NULL ){
+		return -1.;
+	}
+	obs_compute( o, uu, hist);
+	dev = 0.;
+	for( k=0; k<6; k++){
+		d = fabs( uu[k] - o->uu[k])/( (o->s->n > 0)?o->s->n:1);
+		dev = ( d > dev )?d:dev;
+		o->uu[k] = uu[k];
+	}
+	npairs = 0.;
+	for( k=0; k<o->op.nbins; k++){
+		npairs += hist[k];
+	}
+	npairs = ( npairs > 0. )?npairs:1.;
+	for( k=0; k<o->op.nbins; k++){
+		d = labs( o->hist[k] - hist[k])/npairs;
+		dev = ( d > dev )?d:dev;
+		o->hist[k] = hist[k];
+	}
+	free( hist);
+	o->drift = dev;
+	return dev;
+}
+
+/*!
+ * Take a sample of the running observables.
+ *
+ * Adds the order parameter, the energy and the histogram to their
+ * sums, which costs O(`nbins`) and does not depend on the number of
+ * cylinders. The cached energies are computed first if they are not
+ * valid. Returns 0 if the check fails.
+ */
+int observables_sample( observables *o){
+	double S, u;
+	int b;
+
+	if( o->op.check_every > 0 && o->samples > 0 && o->samples%o->op.check_every == 0 ){
+		if( observables_check( o) < 0. ){
+			return 0;
+		}
+	}
+	if( !o->s->u_valid ){
+		state_energy( o->s);
+	}
+	S = observables_order( o);
+	u = o->s->u_tot;
+	o->s_sum += S;
+	o->s2_sum += S*S;
+	o->u_sum += u;
+	o->u2_sum += u*u;
+	for( b=0; b<o->op.nbins; b++){
+		o->hist_sum[b] += o->hist[b];
+	}
+	o->samples++;
+	return 1;
+}
+
+/*!
+ * The pair distribution averaged over the samples.
+ *
+ * Writes `g(r)` at the middle of each bin into `g`, normalized by the
+ * number of pairs a uniform fluid of the same density would have in
+ * the shell. In a box with walls the pairs near the walls are missing,
+ * so `g` falls below 1 at large `r`. Returns 0 if no samples were
+ * taken.
+ */
+int observables_gr( observables *o, double *g){
+	double vol, pairs, shell, r0, r1;
+	int b;
+
+	if( o->samples == 0 || o->s->n < 2 ){
+		return 0;
+	}
+	vol = o->s->box.x * o->s->box.y * o->s->box.z;
+	pairs = 0.5*o->s->n*(o->s->n - 1.);
+	for( b=0; b<o->op.nbins; b++){
+		r0 = b*o->dr;
+		r1 = r0 + o->dr;
+		shell = 4.*PI/3.*(r1*r1*r1 - r0*r0*r0);
+		g[b] = o->hist_sum[b]/o->samples*vol/(pairs*shell);
+	}
+	return 1;
+}
+
+/*!
+ * Print the averages of the observables: the order parameter, the
+ * energy per cylinder and `g(r)`, and the drift found by the last
+ * check if there was one.
+ *
+ * Returns 0 if the output fails.
+ */
+int observables_print( FILE *file, observables *o){
+	double ms, mu, ss, su, *g;
+	int b, ok;
+
+	if( o->samples == 0 ){
+		return( fprintf( file, "no samples\n") >= 0 );
+	}
+	ms = o->s_sum/o->samples;
+	mu = o->u_sum/o->samples;
+	ss = sqrt( fmax( o->s2_sum/o->samples - ms*ms, 0.));
+	su = sqrt( fmax( o->u2_sum/o->samples - mu*mu, 0.));
+	ok = ( fprintf( file, "%ld samples, %ld moves\n", o->samples, o->moves) >= 0 );
+	ok = ok && ( fprintf( file, "S %1.6e (sd %1.3e)\n", ms, ss) >= 0 );
+	ok = ok && ( fprintf( file, "U/n %1.6e (sd %1.3e)\n", mu/o->s->n, su/o->s->n) >= 0 );
+	if( o->op.check_every > 0 && o->samples > o->op.check_every ){
+		ok = ok && ( fprintf( file, "drift %1.3e at the last check\n", o->drift) >= 0 );
+	}
+	g = (double *) malloc( o->op.nbins*sizeof(double));
+	if( g == NULL ){
+		return 0;
+	}
+	if( observables_gr( o, g) ){
+		for( b=0; b<o->op.nbins; b++){
+			ok = ok && ( fprintf( file, "%1.6e %1.6e\n", (b+0.5)*o->dr, g[b]) >= 0 );
+		}
+	}
+	free( g);
+	return ok;
+}
@@ -0,0 +1,40 @@
+/*!*******************************************************************
+ * observe.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#ifndef JW_OBSERVE
+#define JW_OBSERVE
+
+#include <stdio.h>
+
+typedef struct{
+	double r_max;
+	int nbins;
+	int check_every;
+} observe_params;
+
+typedef struct{
+	observe_params op;
+	state *s;
+	double uu[6];
+	double dr;
+	long *hist;
+	double *hist_sum;
+	long samples;
+	double s_sum, s2_sum;
+	double u_sum, u2_sum;
+	long moves;
+	double drift;
+} observables;
+
+observables* observables_malloc( state *s, observe_params op);
+void observables_free( observables *o);
+double observables_order( observables *o);
+double observables_check( observables *o);
+int observables_sample( observables *o);
+int observables_gr( observables *o, double *g);
+int observables_print( FILE *file, observables *o);
+
+#endif /* JW_OBSERVE */
@@ -0,0 +1,206 @@
+/*!*******************************************************************
+ * observe_test.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "observe.c"
+#include "cylbatch.h"
+#include "sweep.h"
+
+/*!
+ * Histogram of the center distances of all pairs, without using the
+ * buckets.
+ */
+void hist_brute( observables *o, long *hist){
+	state *s = o->s;
+	int i, j, b;
+	vec3 d;
+	double r;
+	for( b=0; b<o->op.nbins; b++){
+		hist[b] = 0;
+	}
+	for( i=0; i<s->n; i++){
+		for( j=i+1; j<s->n; j++){
+			d = vec3_sub( cyl_point( s->a[j].c, 0.5), cyl_point( s->a[i].c, 0.5));
+			if( s->periodic ){
+				d = min_image( d, s->box);
+			}
+			r = vec3_mag( d);
+			if( r < o->op.r_max ){
+				b = (int) (r/o->dr);
+				hist[( b < o->op.nbins )?b:o->op.nbins-1]++;
+			}
+		}
+	}
+}
+
+/*!
+ * Sum of `u u` over the cylinders, without any bookkeeping.
+ */
+void uu_brute( state *s, double *uu){
+	int i, k;
+	for( k=0; k<6; k++){
+		uu[k] = 0.;
+	}
+	for( i=0; i<s->n; i++){
+		obs_uu( uu, s->a[i].c, 1., 0);
+	}
+}
+
+/*!
+ * Check the running observables against the brute force ones.
+ */
+int observables_agree( observables *o){
+	long hist[50];
+	double uu[6];
+	int k, result = 1;
+	hist_brute( o, hist);
+	uu_brute( o->s, uu);
+	for( k=0; k<o->op.nbins; k++){
+		result = result && ( o->hist[k] == hist[k] );
+	}
+	for( k=0; k<6; k++){
+		result = result && ( fabs( o->uu[k] - uu[k]) < max( 1.0e-9, 100.*COORD_EPSILON)*o->s->n );
+	}
+	return result;
+}
+
+void observables_test(){
+	int result;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {12., 12., 12.};
+	observe_params op = { 2., 40, 0};
+	observables *o;
+	state *s;
+
+	fprintf( stdout, "Testing observables_malloc: ");
+	s = state_malloc( cp, box, 300);
+	result = state_set_periodic( s, 1);
+	result = result && state_uniform_initialize( s);
+	o = observables_malloc( s, op);
+	result = result && (o != NULL) && (s->hook_ctx == o);
+	result = result && ( fabs( observables_order( o) - 1.) < max( 1.0e-12, 100.*COORD_EPSILON) );
+	result = result && observables_agree( o);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	observables_free( o);
+	result = (s->hook == NULL);
+	op.r_max = 100.;
+	o = observables_malloc( s, op);
+	fprintf( stdout, "Testing observables_malloc range limit: ");
+	result = result && (o != NULL);
+	result = result && ( o->op.r_max == 2.*LJ_RMAX*cp.r + cp.l );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	observables_free( o);
+	state_free( s);
+}
+
+void observables_sweep_test(){
+	int n, result;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {12., 12., 12.};
+	observe_params op = { 2., 50, 0};
+	sweep_params sp = { 1., 4, 100, 1020u, 0.5, 0, 5};
+	double S, q[6], *g;
+	sweeper *sw;
+	observables *o;
+	state *s;
+
+	fprintf( stdout, "Testing observables with threaded sweeps: ");
+	s = state_malloc( cp, box, 300);
+	result = state_set_periodic( s, 1);
+	result = result && state_set_subdivision( s, 2);
+	result = result && state_uniform_initialize( s);
+	o = observables_malloc( s, op);
+	sw = sweeper_malloc( s, sp);
+	result = result && (o != NULL) && (sw != NULL);
+	for( n=0; n<10 && result; n++){
+		result = sweeper_run( sw, 2);
+		result = result && observables_sample( o);
+	}
+	result = result && ( o->moves > 0 );
+	result = result && observables_agree( o);
+	result = result && ( observables_check( o) < max( 1.0e-9, 100.*COORD_EPSILON) );
+	/* the order parameter of the brute force tensor */
+	uu_brute( s, q);
+	S = observables_order( o);
+	result = result && ( S > 0. && S < 1. );
+	result = result && ( fabs( 1.5*(q[0]+q[1]+q[2])/s->n - 1.5) < max( 1.0e-9, 100.*COORD_EPSILON) );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing observables_gr: ");
+	g = (double *) malloc( op.nbins*sizeof(double));
+	result = (g != NULL) && observables_gr( o, g);
+	/* cylinders can not sit on top of each other */
+	result = result && ( g[0] < 0.1 );
+	result = result && ( o->samples == 10 );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	free( g);
+	sweeper_free( sw);
+	observables_free( o);
+	state_free( s);
+}
+
+void observables_order_test(){
+	int i, result;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {12., 12., 12.};
+	observe_params op = { 2., 10, 0};
+	vec3 axes[3] = {{1., 0., 0.}, {0., 1., 0.}, {0., 0., 1.}};
+	observables *o;
+	state *s;
+
+	fprintf( stdout, "Testing observables_order: ");
+	s = state_malloc( cp, box, 300);
+	result = state_uniform_initialize( s);
+	o = observables_malloc( s, op);
+	result = result && (o != NULL);
+	/* an isotropic mix of the three axes has no order */
+	for( i=0; i<s->n; i++){
+		mc_accept( s, i, (cyl){ s->a[i].c.p, axes[i%3], cp.r});
+	}
+	result = result && ( fabs( observables_order( o)) < max( 1.0e-9, 100.*COORD_EPSILON) );
+	/* a tilted nematic director */
+	for( i=0; i<s->n; i++){
+		mc_accept( s, i, (cyl){ s->a[i].c.p, vec3_smul( (vec3){1., 1., 0.}, M_SQRT1_2), cp.r});
+	}
+	result = result && ( fabs( observables_order( o) - 1.) < max( 1.0e-9, 100.*COORD_EPSILON) );
+	result = result && observables_agree( o);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	observables_free( o);
+	state_free( s);
+}
+
+int main(){
+	observables_test();
+	observables_sweep_test();
+	observables_order_test();
+	return 0;
+}
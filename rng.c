@@ -0,0 +1,106 @@
+/*!*******************************************************************
+ * rng.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * This file contains the setup and bulk functions for the random
+ * number generator in `rng.h`. Unlike `rand()` every generator is an
+ * explicit object, so threads and replicas never share hidden state,
+ * and a run can be checkpointed and restarted with the exact same
+ * random numbers.
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "rng.h"
+
+/*!
+ * Seed a generator.
+ *
+ * The 4 words of state are filled from the 64 bit `seed` with the
+ * splitmix64 generator, as recommended by the xoshiro authors, so
+ * that similar seeds still give unrelated states.
+ */
+void rng_seed( rng *g, uint64_t seed){
+	int i;
+	uint64_t z;
+	for( i=0; i<4; i++){
+		seed += 0x9e3779b97f4a7c15ULL;
+		z = seed;
+		z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+		g->s[i] = z ^ (z >> 31);
+	}
+}
+
+/*!
+ * Jump ahead 2^128 steps.
+ *
+ * This is the same as calling `rng_next` 2^128 times. It is used to
+ * make streams that are guaranteed not to overlap.
+ */
+void rng_jump( rng *g){
+	static const uint64_t jump[] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+									 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+	uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	int i, b;
+	for( i=0; i<4; i++){
+		for( b=0; b<64; b++){
+			if( jump[i] & (1ULL << b) ){
+				s0 ^= g->s[0];
+				s1 ^= g->s[1];
+				s2 ^= g->s[2];
+				s3 ^= g->s[3];
+			}
+			rng_next( g);
+		}
+	}
+	g->s[0] = s0;
+	g->s[1] = s1;
+	g->s[2] = s2;
+	g->s[3] = s3;
+}
+
+/*!
+ * Set up stream number `stream` for a given `seed`.
+ *
+ * Stream `k` starts `k` jumps (k*2^128 steps) after the seeded state,
+ * so the streams for different threads or replicas never overlap.
+ */
+void rng_stream( rng *g, uint64_t seed, int stream){
+	int i;
+	rng_seed( g, seed);
+	for( i=0; i<stream; i++){
+		rng_jump( g);
+	}
+}
+
+/*!
+ * Fill `buf` with `n` uniform doubles in [0,1).
+ */
+void rng_fill_uniform( rng *g, double *buf, int n){
+	int i;
+	rng h = *g;
+	for( i=0; i<n; i++){
+		buf[i] = rng_uniform( &h);
+	}
+	*g = h;
+}
+
+/*!
+ * Save the state of a generator as one line of text.
+ */
+int rng_save( FILE *file, rng *g){
+	return( fprintf( file, "%016" PRIx64 " %016" PRIx64 " %016" PRIx64 " %016" PRIx64 "\n",
+					 g->s[0], g->s[1], g->s[2], g->s[3]) >= 0 );
+}
+
+/*!
+ * Restore the state of a generator saved with `rng_save`.
+ */
+int rng_load( FILE *file, rng *g){
+	return( fscanf( file, "%" SCNx64 " %" SCNx64 " %" SCNx64 " %" SCNx64,
+					&(g->s[0]), &(g->s[1]), &(g->s[2]), &(g->s[3])) == 4 );
+}
@@ -0,0 +1,59 @@
+/*!*******************************************************************
+ * rng.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifndef JW_RNG
+#define JW_RNG
+
+/*!
+ * Random number generator
+ * ----------------------------
+ * rng_next : next 64 random bits
+ * rng_uniform : uniform double in [0,1)
+ * rng_below : uniform integer in [0,n)
+ *
+ * The generator is xoshiro256** by Blackman and Vigna. The whole
+ * state is the 4 words in the struct, so a generator can be copied,
+ * saved and restored freely. Each thread or replica should have its
+ * own generator, set up with `rng_stream` (see rng.c).
+ */
+typedef struct{ uint64_t s[4]; } rng;
+
+static inline uint64_t rng_rotl( uint64_t x, int k){
+	return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rng_next( rng *g){
+	uint64_t *s = g->s;
+	uint64_t out = rng_rotl( s[1]*5, 7)*9;
+	uint64_t t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rng_rotl( s[3], 45);
+	return out;
+}
+
+static inline double rng_uniform( rng *g){
+	return (rng_next( g) >> 11)*0x1.0p-53;
+}
+
+static inline int rng_below( rng *g, int n){
+	return (int) (((rng_next( g) >> 32)*((uint64_t) n)) >> 32);
+}
+
+void rng_seed( rng *g, uint64_t seed);
+void rng_jump( rng *g);
+void rng_stream( rng *g, uint64_t seed, int stream);
+void rng_fill_uniform( rng *g, double *buf, int n);
+int rng_save( FILE *file, rng *g);
+int rng_load( FILE *file, rng *g);
+
+#endif /* JW_RNG */
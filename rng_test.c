@@ -0,0 +1,99 @@
+/*!*******************************************************************
+ * rng_test.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+
+#include "rng.c"
+
+#define NR 100000
+
+void rng_test(){
+	FILE *file;
+	int i, result;
+	double a, buf[64];
+	rng g, h;
+
+	fprintf( stdout, "Testing rng_seed: ");
+	rng_seed( &g, 42);
+	rng_seed( &h, 42);
+	result = 1;
+	for( i=0; i<100; i++){
+		result = result && ( rng_next( &g) == rng_next( &h) );
+	}
+	rng_seed( &h, 43);
+	result = result && ( rng_next( &g) != rng_next( &h) );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing rng_uniform and rng_below: ");
+	a = 0.;
+	result = 1;
+	for( i=0; i<NR; i++){
+		double x = rng_uniform( &g);
+		int k = rng_below( &g, 7);
+		result = result && ( x >= 0. && x < 1. );
+		result = result && ( k >= 0 && k < 7 );
+		a += x;
+	}
+	result = result && ( a/NR - 0.5 < 1.0e-2 && 0.5 - a/NR < 1.0e-2 );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing rng_fill_uniform: ");
+	h = g;
+	rng_fill_uniform( &g, buf, 64);
+	result = 1;
+	for( i=0; i<64; i++){
+		result = result && ( buf[i] == rng_uniform( &h) );
+	}
+	result = result && ( rng_next( &g) == rng_next( &h) );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing rng_stream: ");
+	rng_stream( &g, 7, 0);
+	rng_stream( &h, 7, 1);
+	result = ( rng_next( &g) != rng_next( &h) );
+	rng_seed( &g, 7);
+	rng_jump( &g);
+	rng_stream( &h, 7, 1);
+	result = result && ( rng_next( &g) == rng_next( &h) );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing rng_save and rng_load: ");
+	file = fopen( "test_rng.dat", "w");
+	result = rng_save( file, &g);
+	fclose( file);
+	file = fopen( "test_rng.dat", "r");
+	result = result && rng_load( file, &h);
+	fclose( file);
+	for( i=0; i<100; i++){
+		result = result && ( rng_next( &g) == rng_next( &h) );
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+}
+
+int main(){
+	rng_test();
+	return 0;
+}
@@ -0,0 +1,574 @@
+/*!*******************************************************************
+ * rsa.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * This file contains a fast initializer for large states. The
+ * cylinders are placed by random sequential addition (RSA): a
+ * cylinder with a random position and a random orientation is tried,
+ * and kept if it does not overlap any cylinder already placed (and
+ * fits inside the box if it has walls). The state starts out
+ * isotropic, with no lattice for a long equilibration to melt away.
+ *
+ * Overlaps only reach as far as `l+2r` between the centers, which is
+ * a good deal less than the interaction range the buckets of the
+ * state are made for. So the placement uses its own grid of cells at
+ * least `l+2r` across, with the cylinders filed by their center, and
+ * each try only looks at the 27 cells around it. The cells are
+ * coloured by the parity of their index along each axis, so no cell
+ * is in the 27 cells around another cell of the same colour. So the
+ * threads can fill all the cells of one colour at the same time, each
+ * only adding cylinders to its own cell and only reading the cells
+ * around it, none of which is being written. The cylinders are put in
+ * the buckets of the state at the end.
+ *
+ * The cylinders are handed out in passes. Each pass gives every
+ * cell a quota, spreading the cylinders still to be placed evenly
+ * over the cells, and each cell tries `tries` times per cylinder
+ * of its quota. Every cell draws its random numbers from its own
+ * generator, seeded from the seed, the pass and the cell, so the
+ * positions do not depend on the number of threads. The indices of
+ * the cylinders are handed out as they are placed, so at the end the
+ * cylinders are sorted by bucket (`state_reorder`), which makes the
+ * final order deterministic as well.
+ *
+ * Random sequential addition jams well below the densest packing, so
+ * at high packing fractions (or if the passes stop making progress)
+ * the cylinders are put on an aligned lattice instead. The lattice
+ * spacing is worked out directly from the box and the packing
+ * fraction, rather than by searching over all the lattice sizes.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "math_const.h"
+#include "vecs.h"
+#include "rng.h"
+#include "distributions.h"
+#include "cylinders.h"
+#include "manybody.h"
+
+/*!
+ * Number of passes in a row without a single cylinder placed before
+ * random sequential addition gives up.
+ */
+#define RSA_STALL 4
+
+/*!
+ * Random sequential addition parameters
+ *
+ * + `seed` seed for the random numbers
+ * + `nthreads` number of threads
+ * + `tries` number of tries per cylinder and pass, 50 if 0
+ * + `max_passes` give up after this many passes, 1000 if 0
+ * + `phi_max` go straight to the lattice above this packing
+ *   fraction, or 0 to always try random sequential addition first
+ */
+typedef struct{
+	uint64_t seed;
+	int nthreads;
+	int tries;
+	int max_passes;
+	double phi_max;
+} rsa_params;
+
+/*!
+ * Random sequential addition driver
+ *
+ * + `s` the state being filled
+ * + `rp` the parameters
+ * + `nc` the number of cells along each axis, and `size` their size
+ * + `head`, `link` the cylinders whose center is in cell `m` are
+ *   `head[m]`, `link[head[m]]`, ... up to -1
+ * + `ncolours`, `colour`, `colour_start` the cells sorted by colour,
+ *   as in the sweeper
+ * + `next` for each colour the next cell to be handed out
+ * + `quota` the number of cylinders each cell should place this pass
+ * + `placed` number of cylinders placed so far
+ * + `pass`, `stall` the number of passes, and of passes in a row that
+ *   did not place anything
+ * + `placed_pass` number of cylinders placed before this pass
+ * + `done` set once the passes are over
+ * + `quit` set if the helper threads should leave without placing
+ * + `gate` held while the helper threads are started
+ * + `barrier` barrier used between colours
+ */
+typedef struct{
+	state *s;
+	rsa_params rp;
+	int nc[3];
+	vec3 size;
+	int *head, *link;
+	int ncolours;
+	int *colour, *colour_start, *next;
+	int *quota;
+	int placed, placed_pass;
+	int pass, stall;
+	int done;
+	int quit;
+	pthread_mutex_t gate;
+	pthread_barrier_t barrier;
+} rsa;
+
+/*!
+ * One thread of the driver.
+ */
+typedef struct{
+	rsa *r;
+	int id;
+} rsa_worker;
+
+/*!
+ * Number of cells along an axis of length `len`.
+ *
+ * The cells are at least `reach` across. In a periodic box there has
+ * to be an even number of them, or the two cells on either side of the
+ * boundary would have the same colour.
+ */
+static int rsa_cells( double len, double reach, int periodic){
+	int n = (int) (len/reach);
+	n = ( n < 1 )?1:n;
+	if( periodic && n > 1 && n%2 == 1 ){
+		n--;
+	}
+	return n;
+}
+
+/*!
+ * The cell `d` over from cell `i` along an axis of `n` cells, or -1
+ * past a wall. In a periodic box of length `len`, `shift` is set to
+ * what has to be added to the positions in that cell to get their
+ * image next to cell `i`.
+ */
+static int rsa_step( int i, int d, int n, int periodic, double len, coord *shift){
+	i += d;
+	*shift = 0.;
+	if( i < 0 ){
+		*shift = -len;
+		return periodic?(i+n)%n:-1;
+	}else if( i >= n ){
+		*shift = len;
+		return periodic?i%n:-1;
+	}
+	return i;
+}
+
+/*!
+ * Check if cylinder `c` (centered at `ctr`) overlaps any cylinder
+ * whose center is in cell `(i, j, k)` or the cells around it.
+ *
+ * Two cylinders whose centers are more than `l+2r` apart can not
+ * overlap, which settles most pairs before the exact distance. The
+ * images across a periodic boundary come from the cell offsets, so
+ * no minimum image is needed. The cell of the new cylinder is checked
+ * first.
+ */
+static int rsa_overlap( rsa *r, int i, int j, int k, vec3 ctr, cyl c){
+	state *s = r->s;
+	int di, dj, dk, a, b, e, t, l;
+	double reach2;
+	vec3 d, shift;
+	cyl im;
+	reach2 = (s->cp.l + 2.*s->cp.r)*(s->cp.l + 2.*s->cp.r);
+	for( t=0; t<27; t++){
+		/* 13 is the center, so start there */
+		di = (t+13)%27;
+		dk = di/9 - 1;
+		dj = (di/3)%3 - 1;
+		di = di%3 - 1;
+		a = rsa_step( i, di, r->nc[0], s->periodic, s->box.x, &(shift.x));
+		b = rsa_step( j, dj, r->nc[1], s->periodic, s->box.y, &(shift.y));
+		e = rsa_step( k, dk, r->nc[2], s->periodic, s->box.z, &(shift.z));
+		if( a < 0 || b < 0 || e < 0 ){
+			continue;
+		}
+		for( l = r->head[a + r->nc[0]*(b + r->nc[1]*e)]; l >= 0; l = r->link[l]){
+			im = s->a[l].c;
+			im.p = vec3_add( im.p, shift);
+			d = vec3_sub( cyl_point( im, 0.5), ctr);
+			if( vec3_dot( d, d) < reach2 && cyl_cyl_overlap( im, c) ){
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+/*!
+ * Place the quota of cell `m` for this pass.
+ */
+static void rsa_cell( rsa *r, int m){
+	state *s = r->s;
+	int i, j, k, q, t, l, tries;
+	vec3 corner, ctr, d;
+	cyl c;
+	rng g;
+
+	tries = (r->rp.tries > 0)?r->rp.tries:50;
+	rng_seed( &g, r->rp.seed + (((uint64_t) r->pass) << 32) + (uint64_t) m);
+	i = m%r->nc[0];
+	j = (m/r->nc[0])%r->nc[1];
+	k = m/(r->nc[0]*r->nc[1]);
+	corner.x = i*r->size.x;
+	corner.y = j*r->size.y;
+	corner.z = k*r->size.z;
+	c.r = s->cp.r;
+	for( q=0; q<r->quota[m]; q++){
+		for( t=0; t<tries; t++){
+			ctr.x = corner.x + rng_uniform( &g)*r->size.x;
+			ctr.y = corner.y + rng_uniform( &g)*r->size.y;
+			ctr.z = corner.z + rng_uniform( &g)*r->size.z;
+			do{
+				d = rand_ball( &g);
+			}while( vec3_dot( d, d) < 1.0e-6 );
+			c.d = vec3_smul( d, s->cp.l/vec3_mag( d));
+			c.p = vec3_sub( ctr, vec3_smul( c.d, 0.5));
+			if( !state_inside( s, c) || rsa_overlap( r, i, j, k, ctr, c) ){
+				continue;
+			}
+			/* not wrapped yet, so the center stays inside the cell */
+			l = __sync_fetch_and_add( &(r->placed), 1);
+			s->a[l].c = c;
+			r->link[l] = r->head[m];
+			r->head[m] = l;
+			break;
+		}
+	}
+}
+
+/*!
+ * Hand out the quotas for the next pass.
+ *
+ * The cylinders left are spread evenly over the cells, with the
+ * remainder going to cells that move along from pass to pass.
+ */
+static void rsa_quotas( rsa *r){
+	int m, nc, shift;
+	long long left, mm;
+	nc = r->nc[0]*r->nc[1]*r->nc[2];
+	left = r->s->n - r->placed;
+	shift = (int) ((r->pass*2654435761LL)%nc);
+	for( m=0; m<nc; m++){
+		mm = (m + shift)%nc;
+		r->quota[m] = (int) (left*(mm+1)/nc - left*mm/nc);
+	}
+}
+
+/*!
+ * Finish a pass, and decide whether there is another one.
+ */
+static void rsa_next_pass( rsa *r){
+	int c, max_passes;
+	max_passes = (r->rp.max_passes > 0)?r->rp.max_passes:1000;
+	r->stall = ( r->placed == r->placed_pass )?r->stall+1:0;
+	r->placed_pass = r->placed;
+	r->pass++;
+	if( r->placed == r->s->n || r->stall >= RSA_STALL || r->pass >= max_passes ){
+		r->done = 1;
+		return;
+	}
+	rsa_quotas( r);
+	for( c=0; c<r->ncolours; c++){
+		r->next[c] = 0;
+	}
+}
+
+/*!
+ * Main loop for each thread.
+ */
+static void *rsa_worker_run( void *arg){
+	rsa_worker *w = (rsa_worker *) arg;
+	rsa *r = w->r;
+	int c, b;
+
+	while( 1 ){
+		for( c=0; c<r->ncolours; c++){
+			while( 1 ){
+				b = __sync_fetch_and_add( &(r->next[c]), 1);
+				if( b >= r->colour_start[c+1] - r->colour_start[c] ){
+					break;
+				}
+				b = r->colour[r->colour_start[c]+b];
+				if( r->quota[b] > 0 ){
+					rsa_cell( r, b);
+				}
+			}
+			pthread_barrier_wait( &(r->barrier));
+		}
+		if( w->id == 0 ){
+			rsa_next_pass( r);
+		}
+		pthread_barrier_wait( &(r->barrier));
+		if( r->done ){
+			break;
+		}
+	}
+	return NULL;
+}
+
+/*!
+ * Entry point of the helper threads.
+ *
+ * Waits at the gate until every helper has been started, and then
+ * either places cylinders or, if not all of them could be started,
+ * leaves.
+ */
+static void *rsa_helper_run( void *arg){
+	rsa_worker *w = (rsa_worker *) arg;
+	pthread_mutex_lock( &(w->r->gate));
+	pthread_mutex_unlock( &(w->r->gate));
+	if( w->r->quit ){
+		return NULL;
+	}
+	return rsa_worker_run( w);
+}
+
+/*!
+ * Free the arrays of the driver.
+ */
+static void rsa_release( rsa *r){
+	free( r->head);
+	free( r->link);
+	free( r->colour);
+	free( r->colour_start);
+	free( r->next);
+	free( r->quota);
+}
+
+/*!
+ * Run the passes of random sequential addition.
+ *
+ * The cylinders are put in the buckets of the state at the end, cell
+ * by cell. Returns 1 if every cylinder was placed, 0 if the passes
+ * stopped making progress first, and -1 if the setup fails.
+ */
+static int rsa_fill( state *s, rsa_params rp){
+	rsa r;
+	rsa_worker *w;
+	pthread_t *threads;
+	double reach;
+	int i, j, k, c, m, t, l, nc;
+
+	if( rp.nthreads < 1 ){
+		rp.nthreads = 1;
+	}
+	reach = s->cp.l + 2.*s->cp.r;
+	r.s = s;
+	r.rp = rp;
+	r.nc[0] = rsa_cells( s->box.x, reach, s->periodic);
+	r.nc[1] = rsa_cells( s->box.y, reach, s->periodic);
+	r.nc[2] = rsa_cells( s->box.z, reach, s->periodic);
+	r.size.x = s->box.x/r.nc[0];
+	r.size.y = s->box.y/r.nc[1];
+	r.size.z = s->box.z/r.nc[2];
+	nc = r.nc[0]*r.nc[1]*r.nc[2];
+	r.ncolours = 8;
+	r.placed = 0;
+	r.placed_pass = 0;
+	r.pass = 0;
+	r.stall = 0;
+	r.done = 0;
+	r.quit = 0;
+	r.head = (int *) malloc( nc*sizeof(int));
+	r.link = (int *) malloc( s->n*sizeof(int));
+	r.colour = (int *) malloc( nc*sizeof(int));
+	r.colour_start = (int *) malloc( (r.ncolours+1)*sizeof(int));
+	r.next = (int *) malloc( r.ncolours*sizeof(int));
+	r.quota = (int *) malloc( nc*sizeof(int));
+	w = (rsa_worker *) malloc( rp.nthreads*sizeof(rsa_worker));
+	threads = (pthread_t *) malloc( rp.nthreads*sizeof(pthread_t));
+	if( r.head == NULL || r.link == NULL || r.colour == NULL || r.colour_start == NULL ||
+		r.next == NULL || r.quota == NULL || w == NULL || threads == NULL ||
+		pthread_mutex_init( &(r.gate), NULL) != 0 ){
+		rsa_release( &r);
+		free( w);
+		free( threads);
+		return -1;
+	}
+
+	m = 0;
+	for( c=0; c<r.ncolours; c++){
+		r.colour_start[c] = m;
+		r.next[c] = 0;
+		for( k=c/4; k<r.nc[2]; k+=2){
+			for( j=(c/2)%2; j<r.nc[1]; j+=2){
+				for( i=c%2; i<r.nc[0]; i+=2){
+					r.colour[m++] = i + r.nc[0]*(j + r.nc[1]*k);
+				}
+			}
+		}
+	}
+	r.colour_start[r.ncolours] = m;
+	for( m=0; m<nc; m++){
+		r.head[m] = -1;
+	}
+	rsa_quotas( &r);
+
+	for( t=0; t<rp.nthreads; t++){
+		w[t].r = &r;
+		w[t].id = t;
+	}
+	/* the barrier counts on every thread showing up, so it is only set
+	 * up once they have all started */
+	pthread_mutex_lock( &(r.gate));
+	for( t=1; t<rp.nthreads; t++){
+		if( pthread_create( &threads[t], NULL, rsa_helper_run, &(w[t])) != 0 ){
+			break;
+		}
+	}
+	if( t < rp.nthreads || pthread_barrier_init( &(r.barrier), NULL, rp.nthreads) != 0 ){
+		r.quit = 1;
+		pthread_mutex_unlock( &(r.gate));
+		while( --t > 0 ){
+			pthread_join( threads[t], NULL);
+		}
+		pthread_mutex_destroy( &(r.gate));
+		rsa_release( &r);
+		free( w);
+		free( threads);
+		return -1;
+	}
+	pthread_mutex_unlock( &(r.gate));
+	rsa_worker_run( &(w[0]));
+	for( t=1; t<rp.nthreads; t++){
+		pthread_join( threads[t], NULL);
+	}
+	pthread_barrier_destroy( &(r.barrier));
+	pthread_mutex_destroy( &(r.gate));
+
+	/* the indices depend on the threads, the cells do not */
+	state_empty_buckets( s);
+	for( m=0; m<nc; m++){
+		for( l = r.head[m]; l >= 0; l = r.link[l]){
+			cyl_list_add( s, l);
+		}
+	}
+	rsa_release( &r);
+	free( w);
+	free( threads);
+	return( r.placed == s->n );
+}
+
+/*!
+ * Put the cylinders on an aligned lattice.
+ *
+ * Every cylinder sits in a cell of `2r` by `2r` by `2r+l`, with its
+ * axis along the long side of the cell, and the long side is put
+ * along the axis of the box that fits the most cells. The numbers of
+ * cells along the axes start from cells of the same shape scaled to
+ * the volume per cylinder, and are then raised one at a time (along
+ * the axis with the most room) until there are enough cells. When
+ * there are more cells than cylinders the cylinders are spread evenly
+ * over the cells. Returns 0 if the cylinders do not fit.
+ */
+int state_lattice_initialize( state *s){
+	double ext[3], box[3], room, best, lam;
+	int nmax[3], nc[3], idx[3], a, b, axis, l;
+	long long fit, sites, site;
+	vec3 d;
+
+	if( s->n == 0 ){
+		state_empty_buckets( s);
+		return 1;
+	}
+	box[0] = s->box.x;
+	box[1] = s->box.y;
+	box[2] = s->box.z;
+	axis = -1;
+	fit = 0;
+	for( a=0; a<3; a++){
+		for( b=0; b<3; b++){
+			ext[b] = 2.*s->cp.r + ((a == b)?s->cp.l:0.);
+			/* a hair of space, so neighbors do not touch the walls or each other */
+			nmax[b] = (int) (box[b]/(ext[b]*(1. + 1.0e-9)));
+		}
+		if( (long long) nmax[0]*nmax[1]*nmax[2] > fit ){
+			fit = (long long) nmax[0]*nmax[1]*nmax[2];
+			axis = a;
+		}
+	}
+	if( fit < s->n ){
+		return 0;
+	}
+
+	for( b=0; b<3; b++){
+		ext[b] = 2.*s->cp.r + ((axis == b)?s->cp.l:0.);
+		nmax[b] = (int) (box[b]/(ext[b]*(1. + 1.0e-9)));
+	}
+	lam = cbrt( box[0]*box[1]*box[2]/(s->n*ext[0]*ext[1]*ext[2]));
+	for( b=0; b<3; b++){
+		nc[b] = (int) (box[b]/(lam*ext[b]));
+		nc[b] = ( nc[b] < 1 )?1:nc[b];
+		nc[b] = ( nc[b] > nmax[b] )?nmax[b]:nc[b];
+	}
+	while( (long long) nc[0]*nc[1]*nc[2] < s->n ){
+		best = 0.;
+		a = -1;
+		for( b=0; b<3; b++){
+			room = box[b]/(nc[b]*ext[b]);
+			if( nc[b] < nmax[b] && room > best ){
+				best = room;
+				a = b;
+			}
+		}
+		nc[a]++;
+	}
+
+	d.x = (axis == 0)?s->cp.l:0.;
+	d.y = (axis == 1)?s->cp.l:0.;
+	d.z = (axis == 2)?s->cp.l:0.;
+	sites = (long long) nc[0]*nc[1]*nc[2];
+	state_empty_buckets( s);
+	s->u_valid = 0;
+	for( l=0; l<s->n; l++){
+		site = (l*sites)/s->n;
+		idx[0] = (int) (site%nc[0]);
+		idx[1] = (int) ((site/nc[0])%nc[1]);
+		idx[2] = (int) (site/((long long) nc[0]*nc[1]));
+		s->a[l].c.p.x = (idx[0]+0.5)*s->box.x/nc[0] - 0.5*d.x;
+		s->a[l].c.p.y = (idx[1]+0.5)*s->box.y/nc[1] - 0.5*d.y;
+		s->a[l].c.p.z = (idx[2]+0.5)*s->box.z/nc[2] - 0.5*d.z;
+		s->a[l].c.d = d;
+		s->a[l].c.r = s->cp.r;
+		cyl_list_add( s, l);
+	}
+	return 1;
+}
+
+/*!
+ * Random sequential addition initialization.
+ *
+ * Fills the state with randomly placed and oriented cylinders that do
+ * not overlap, falling back on `state_lattice_initialize` above the
+ * packing fraction `phi_max` or when random sequential addition
+ * jams. The cylinders end up sorted by bucket, and the cached
+ * energies are marked out of date. Returns 1 if the cylinders were
+ * placed at random, 2 if they are on the lattice, and 0 if an
+ * allocation fails or the cylinders do not fit.
+ */
+int rsa_initialize( state *s, rsa_params rp){
+	double phi;
+	int ok;
+
+	s->u_valid = 0;
+	phi = s->n*PI*s->cp.r*s->cp.r*s->cp.l/(s->box.x*s->box.y*s->box.z);
+	ok = 0;
+	if( rp.phi_max <= 0. || phi <= rp.phi_max ){
+		ok = rsa_fill( s, rp);
+		if( ok < 0 ){
+			return 0;
+		}
+	}
+	if( !ok ){
+		if( !state_lattice_initialize( s) ){
+			return 0;
+		}
+		ok = 2;
+	}
+	state_reorder( s, NULL);
+	return ok;
+}
@@ -0,0 +1,23 @@
+/*!*******************************************************************
+ * rsa.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#ifndef JW_RSA
+#define JW_RSA
+
+#include <stdint.h>
+
+typedef struct{
+	uint64_t seed;
+	int nthreads;
+	int tries;
+	int max_passes;
+	double phi_max;
+} rsa_params;
+
+int state_lattice_initialize( state *s);
+int rsa_initialize( state *s, rsa_params rp);
+
+#endif /* JW_RSA */
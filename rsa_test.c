@@ -0,0 +1,212 @@
+/*!*******************************************************************
+ * rsa_test.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+
+/* the threads in rsa.c are started through here, so that the test can
+ * make the start of one fail */
+static int fail_thread = -1;
+static int test_pthread_create( pthread_t *thread, const pthread_attr_t *attr,
+								void *(*run)( void *), void *arg){
+	if( fail_thread == 0 ){
+		return EAGAIN;
+	}
+	if( fail_thread > 0 ){
+		fail_thread--;
+	}
+	return pthread_create( thread, attr, run, arg);
+}
+#define pthread_create test_pthread_create
+#include "rsa.c"
+#undef pthread_create
+
+/*!
+ * Check that no two cylinders overlap and that every cylinder is
+ * allowed in the box, without using the buckets.
+ */
+int no_overlaps( state *s){
+	int i, j;
+	for( i=0; i<s->n; i++){
+		if( !state_inside( s, s->a[i].c) ){
+			return 0;
+		}
+		for( j=i+1; j<s->n; j++){
+			if( cyl_cyl_overlap( state_image( s, s->a[j].c, cyl_point( s->a[i].c, 0.5)), s->a[i].c) ){
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+/*!
+ * Check that every cylinder is on the list of the bucket that
+ * contains it, exactly once.
+ */
+int lists_ok( state *s){
+	int m, nb, count;
+	cyl_ll *cur;
+	nb = s->nbx * s->nby * s->nbz;
+	count = 0;
+	for( m=0; m<nb; m++){
+		for( cur = s->heads[m]; cur != NULL; cur = cur->next){
+			if( bucket_index( s, cur->c.p) != m || cur->bucket != m ){
+				return 0;
+			}
+			count++;
+		}
+	}
+	return( count == s->n );
+}
+
+/*!
+ * Mean of `(u.z)^2` over the cylinders, 1/3 when isotropic.
+ */
+double mean_uz2( state *s){
+	int i;
+	double sum = 0.;
+	for( i=0; i<s->n; i++){
+		sum += s->a[i].c.d.z*s->a[i].c.d.z/vec3_dot( s->a[i].c.d, s->a[i].c.d);
+	}
+	return sum/s->n;
+}
+
+void rsa_test(){
+	int i, ret, result;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {15., 15., 15.};
+	rsa_params rp = { 2021u, 1, 0, 0, 0.};
+	state *s, *t;
+
+	fprintf( stdout, "Testing rsa_initialize in a periodic box: ");
+	s = state_malloc( cp, box, 3000);
+	result = state_set_periodic( s, 1);
+	ret = rsa_initialize( s, rp);
+	result = result && ( ret == 1 );
+	result = result && no_overlaps( s) && lists_ok( s);
+	result = result && ( fabs( mean_uz2( s) - 1./3.) < 0.05 );
+	result = result && !s->u_valid;
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing rsa_initialize does not depend on the threads: ");
+	t = state_malloc( cp, box, 3000);
+	result = state_set_periodic( t, 1);
+	rp.nthreads = 4;
+	result = result && ( rsa_initialize( t, rp) == 1 );
+	for( i=0; i<s->n; i++){
+		result = result && ( s->a[i].c.p.x == t->a[i].c.p.x );
+		result = result && ( s->a[i].c.p.y == t->a[i].c.p.y );
+		result = result && ( s->a[i].c.d.z == t->a[i].c.d.z );
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	state_free( t);
+	state_free( s);
+
+	fprintf( stdout, "Testing rsa_initialize in a box with walls: ");
+	s = state_malloc( cp, box, 3000);
+	result = state_set_subdivision( s, 2);
+	result = result && ( rsa_initialize( s, rp) == 1 );
+	result = result && no_overlaps( s) && lists_ok( s);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	state_free( s);
+}
+
+void lattice_test(){
+	int result;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {10., 10., 10.};
+	rsa_params rp = { 2022u, 2, 0, 0, 0.3};
+	state *s;
+
+	fprintf( stdout, "Testing rsa_initialize falls back on the lattice: ");
+	/* packing fraction 0.5 */
+	s = state_malloc( cp, box, 3978);
+	result = ( rsa_initialize( s, rp) == 2 );
+	result = result && no_overlaps( s) && lists_ok( s);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	state_free( s);
+
+	fprintf( stdout, "Testing rsa_initialize with a jammed box: ");
+	s = state_malloc( cp, box, 3978);
+	result = state_set_periodic( s, 1);
+	rp.phi_max = 0.;
+	rp.tries = 5;
+	result = result && ( rsa_initialize( s, rp) == 2 );
+	result = result && no_overlaps( s) && lists_ok( s);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	state_free( s);
+
+	fprintf( stdout, "Testing state_lattice_initialize: ");
+	/* 24x24x7 cells of 0.4x0.4x1.4 (and a hair) fit, one more does not */
+	s = state_malloc( cp, box, 4033);
+	result = !state_lattice_initialize( s);
+	state_free( s);
+	s = state_malloc( cp, box, 4032);
+	result = result && state_lattice_initialize( s);
+	result = result && no_overlaps( s) && lists_ok( s);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	state_free( s);
+}
+
+void thread_fail_test(){
+	int result;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {15., 15., 15.};
+	rsa_params rp = { 2023u, 3, 0, 0, 0.};
+	state *s;
+
+	fprintf( stdout, "Testing rsa_initialize when a thread cannot be started: ");
+	s = state_malloc( cp, box, 3000);
+	result = state_set_periodic( s, 1);
+	/* the second helper fails to start, the first has to be let go */
+	fail_thread = 1;
+	result = result && ( rsa_fill( s, rp) == -1 );
+	fail_thread = 1;
+	result = result && ( rsa_initialize( s, rp) == 0 );
+	fail_thread = -1;
+	result = result && ( rsa_initialize( s, rp) == 1 );
+	result = result && no_overlaps( s) && lists_ok( s);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	state_free( s);
+}
+
+int main(){
+	rsa_test();
+	lattice_test();
+	thread_fail_test();
+	return 0;
+}
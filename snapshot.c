@@ -0,0 +1,249 @@
+/*!*******************************************************************
+ * snapshot.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * This file contains a snapshot writer that writes trajectory frames
+ * (see `traj.c`) from a background thread. Taking a snapshot gathers
+ * the cylinders of the state into one of a fixed pool of `nbuf` frame
+ * buffers and puts it on a queue; the simulation can carry on right
+ * away while the writer thread empties the queue onto disk.
+ *
+ * The buffers are used as a ring. If all of them are waiting to be
+ * written, taking a snapshot blocks until the writer frees one, so
+ * the memory used is bounded even if the disk can not keep up. The
+ * time spent copying, the time blocked waiting for a buffer, and the
+ * time the writer thread spends writing are all recorded, so the cost
+ * of the I/O to the simulation can be read off directly.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "vecs.h"
+#include "cylinders.h"
+#include "manybody.h"
+#include "traj.h"
+
+/*!
+ * Snapshot writer
+ *
+ * + `w` the trajectory the frames are written to
+ * + `n` number of cylinders
+ * + `nbuf` number of frame buffers
+ * + `cols` the frame buffers, `7*n` doubles each
+ * + `steps` the step number of each buffer
+ * + `head` the next buffer to be written
+ * + `count` number of buffers waiting to be written
+ * + `done` set when the writer thread should finish
+ * + `error` set if a write failed
+ * + `lock`, `not_empty`, `not_full` guard the queue
+ * + `thread` the writer thread
+ * + `taken`, `written` snapshots taken and written
+ * + `t_copy` seconds spent copying the state into buffers
+ * + `t_blocked` seconds spent waiting for a free buffer
+ * + `t_write` seconds the writer thread spent writing
+ */
+typedef struct{
+	traj_writer *w;
+	int n, nbuf;
+	double *cols;
+	int64_t *steps;
+	int head, count, done, error;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty, not_full;
+	pthread_t thread;
+	long taken, written;
+	double t_copy, t_blocked, t_write;
+} snapshot_writer;
+
+/*!
+ * Wall clock time in seconds.
+ */
+static double snapshot_time(){
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1.0e-9*ts.tv_nsec;
+}
+
+/*!
+ * The writer thread.
+ *
+ * Writes the queued buffers in order until the queue is empty and
+ * `done` is set. The lock is not held during the write, so the
+ * simulation can fill other buffers at the same time.
+ */
+static void* snapshot_run( void *arg){
+	snapshot_writer *sw = (snapshot_writer *) arg;
+	double t0;
+	int q, ok;
+
+	pthread_mutex_lock( &(sw->lock));
+	for(;;){
+		while( sw->count == 0 && !sw->done ){
+			pthread_cond_wait( &(sw->not_empty), &(sw->lock));
+		}
+		if( sw->count == 0 ){
+			break;
+		}
+		q = sw->head;
+		pthread_mutex_unlock( &(sw->lock));
+
+		t0 = snapshot_time();
+		ok = traj_write_cols( sw->w, sw->cols + (size_t) 7*sw->n*q, sw->steps[q]);
+		t0 = snapshot_time() - t0;
+
+		pthread_mutex_lock( &(sw->lock));
+		sw->t_write += t0;
+		sw->error = sw->error || !ok;
+		sw->written++;
+		sw->head = (sw->head + 1)%sw->nbuf;
+		sw->count--;
+		pthread_cond_broadcast( &(sw->not_full));
+	}
+	pthread_mutex_unlock( &(sw->lock));
+	return NULL;
+}
+
+/*!
+ * Constructor for a snapshot writer.
+ *
+ * Opens the trajectory file `path` for the state `s` (see
+ * `traj_writer_malloc`), sets up `nbuf` frame buffers and starts the
+ * writer thread. Returns `NULL` if the file can not be opened, any
+ * allocation fails, or the thread can not be started.
+ */
+snapshot_writer* snapshot_writer_malloc( const char *path, state *s, int nbuf){
+	snapshot_writer *sw = (snapshot_writer *) malloc( sizeof(snapshot_writer));
+	if( sw == NULL ){
+		return NULL;
+	}
+	sw->n = s->n;
+	sw->nbuf = (nbuf < 1)?1:nbuf;
+	sw->cols = (double *) malloc( (size_t) 7*sw->n*sw->nbuf*sizeof(double));
+	sw->steps = (int64_t *) malloc( sw->nbuf*sizeof(int64_t));
+	sw->w = traj_writer_malloc( path, s);
+	if( sw->cols == NULL || sw->steps == NULL || sw->w == NULL ){
+		if( sw->w != NULL ){
+			traj_writer_free( sw->w);
+		}
+		free( sw->cols);
+		free( sw->steps);
+		free( sw);
+		return NULL;
+	}
+	sw->head = 0;
+	sw->count = 0;
+	sw->done = 0;
+	sw->error = 0;
+	sw->taken = 0;
+	sw->written = 0;
+	sw->t_copy = 0.;
+	sw->t_blocked = 0.;
+	sw->t_write = 0.;
+	pthread_mutex_init( &(sw->lock), NULL);
+	pthread_cond_init( &(sw->not_empty), NULL);
+	pthread_cond_init( &(sw->not_full), NULL);
+	if( pthread_create( &(sw->thread), NULL, snapshot_run, sw) != 0 ){
+		pthread_mutex_destroy( &(sw->lock));
+		pthread_cond_destroy( &(sw->not_empty));
+		pthread_cond_destroy( &(sw->not_full));
+		traj_writer_free( sw->w);
+		free( sw->cols);
+		free( sw->steps);
+		free( sw);
+		return NULL;
+	}
+	return sw;
+}
+
+/*!
+ * Destructor for a snapshot writer.
+ *
+ * Waits for every queued snapshot to be written, stops the writer
+ * thread and closes the file. Returns 0 if any write failed.
+ */
+int snapshot_writer_free( snapshot_writer *sw){
+	int ok;
+	pthread_mutex_lock( &(sw->lock));
+	sw->done = 1;
+	pthread_cond_signal( &(sw->not_empty));
+	pthread_mutex_unlock( &(sw->lock));
+	pthread_join( sw->thread, NULL);
+	ok = !sw->error;
+	pthread_mutex_destroy( &(sw->lock));
+	pthread_cond_destroy( &(sw->not_empty));
+	pthread_cond_destroy( &(sw->not_full));
+	traj_writer_free( sw->w);
+	free( sw->cols);
+	free( sw->steps);
+	free( sw);
+	return ok;
+}
+
+/*!
+ * Take a snapshot of the state `s`, labeled with `step`.
+ *
+ * Blocks only if every buffer is still waiting to be written. Returns
+ * 0 if the state does not match the trajectory or an earlier write
+ * failed.
+ */
+int snapshot_take( snapshot_writer *sw, state *s, int64_t step){
+	double t0, t1;
+	int q;
+	if( s->n != sw->n ){
+		return 0;
+	}
+	t0 = snapshot_time();
+	pthread_mutex_lock( &(sw->lock));
+	while( sw->count == sw->nbuf ){
+		pthread_cond_wait( &(sw->not_full), &(sw->lock));
+	}
+	q = (sw->head + sw->count)%sw->nbuf;
+	pthread_mutex_unlock( &(sw->lock));
+	t1 = snapshot_time();
+
+	/* only this thread fills buffers, so slot `q` is ours */
+	traj_gather( s, sw->cols + (size_t) 7*sw->n*q);
+	sw->steps[q] = step;
+
+	pthread_mutex_lock( &(sw->lock));
+	sw->count++;
+	sw->taken++;
+	sw->t_blocked += t1 - t0;
+	sw->t_copy += snapshot_time() - t1;
+	pthread_cond_signal( &(sw->not_empty));
+	q = !sw->error;
+	pthread_mutex_unlock( &(sw->lock));
+	return q;
+}
+
+/*!
+ * Wait until every snapshot taken so far has been written.
+ */
+void snapshot_flush( snapshot_writer *sw){
+	pthread_mutex_lock( &(sw->lock));
+	while( sw->count > 0 ){
+		pthread_cond_wait( &(sw->not_full), &(sw->lock));
+	}
+	pthread_mutex_unlock( &(sw->lock));
+}
+
+/*!
+ * Print the snapshot timings.
+ *
+ * One line with the number of snapshots taken and written, and the
+ * total seconds spent copying, blocked on I/O, and writing.
+ */
+int snapshot_print_stats( FILE *file, snapshot_writer *sw){
+	int m;
+	pthread_mutex_lock( &(sw->lock));
+	m = fprintf( file, "snapshots %ld taken %ld written: copy %1.3e s, blocked %1.3e s, write %1.3e s\n",
+				 sw->taken, sw->written, sw->t_copy, sw->t_blocked, sw->t_write);
+	pthread_mutex_unlock( &(sw->lock));
+	return( m >= 0 );
+}
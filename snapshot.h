@@ -0,0 +1,33 @@
+/*!*******************************************************************
+ * snapshot.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#ifndef JW_SNAPSHOT
+#define JW_SNAPSHOT
+
+typedef struct{
+	traj_writer *w;
+	int n, nbuf;
+	double *cols;
+	int64_t *steps;
+	int head, count, done, error;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty, not_full;
+	pthread_t thread;
+	long taken, written;
+	double t_copy, t_blocked, t_write;
+} snapshot_writer;
+
+snapshot_writer* snapshot_writer_malloc( const char *path, state *s, int nbuf);
+int snapshot_writer_free( snapshot_writer *sw);
+int snapshot_take( snapshot_writer *sw, state *s, int64_t step);
+void snapshot_flush( snapshot_writer *sw);
+int snapshot_print_stats( FILE *file, snapshot_writer *sw);
+
+#endif /* JW_SNAPSHOT */
@@ -0,0 +1,94 @@
+/*!*******************************************************************
+ * snapshot_test.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "snapshot.c"
+#include "rng.h"
+#include "distributions.h"
+#include "lennardjones.h"
+#include "ljtable.h"
+#include "cellstore.h"
+#include "nlist.h"
+#include "montecarlo.h"
+
+#define NF 20
+
+void snapshot_test(){
+	int i, k, result;
+	rng g;
+	cyl c;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {10., 10., 10.};
+	state *s = state_malloc( cp, box, 200);
+	cyl saved[NF][200];
+	snapshot_writer *sw;
+	traj_reader *t;
+	traj_frame f;
+
+	rng_seed( &g, 9);
+	state_uniform_initialize( s);
+
+	fprintf( stdout, "Testing snapshot_take: ");
+	/* only 2 buffers, so the queue fills up */
+	sw = snapshot_writer_malloc( "test_snapshot.bin", s, 2);
+	result = ( sw != NULL );
+	for( k=0; k<NF && result; k++){
+		for( i=0; i<s->n; i++){
+			c = move_cyl( s->a[i].c, &g);
+			if( cyl_box_overlap( c, box) ){
+				s->a[i].c.d = c.d;
+				cyl_list_move( s, i, c.p);
+			}
+			saved[k][i] = s->a[i].c;
+		}
+		result = result && snapshot_take( sw, s, k);
+	}
+	snapshot_flush( sw);
+	result = result && ( sw->written == NF ) && ( sw->count == 0 );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing snapshot_print_stats: ");
+	result = snapshot_print_stats( stdout, sw);
+	result = result && snapshot_writer_free( sw);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing snapshot frames: ");
+	t = traj_reader_malloc( "test_snapshot.bin");
+	result = ( t != NULL ) && ( t->frames == NF );
+	for( k=0; k<NF && result; k++){
+		f = traj_get_frame( t, k);
+		result = ( f.step == k );
+		for( i=0; i<s->n; i++){
+			c = traj_get_cyl( f, i);
+			result = result && ( memcmp( &c, &(saved[k][i]), sizeof(cyl)) == 0 );
+		}
+	}
+	if( t != NULL ){
+		traj_reader_free( t);
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	state_free( s);
+}
+
+int main(){
+	snapshot_test();
+	return 0;
+}
@@ -0,0 +1,561 @@
+/*!*******************************************************************
+ * sweep.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * This file contains a threaded Metropolis sweep over the bucket
+ * grid in `state`. The buckets are sized so that a cylinder only
+ * interacts with cylinders in the same or neighboring buckets. If we
+ * colour each bucket by the parity of its (i, j, k) index we get 8
+ * sub-lattices (a 2x2x2 checkerboard), and no two buckets of the same
+ * colour are neighbors. When the buckets are subdivided (see
+ * `state_set_subdivision`) a cylinder reaches `sub` buckets over, and
+ * the colour is the index modulo `sub+1` instead, for `(sub+1)^3`
+ * colours. So as long as every cylinder stays inside its
+ * own bucket, the trial moves in all the buckets of one colour are
+ * independent and can be run at the same time. The trial moves go
+ * through `mc_try`, which can reject a move part way through the
+ * neighbor scan. Accepted moves go through `mc_accept`, so the cached
+ * energies in the state are kept up to date and a rejected move costs
+ * at most a single neighbor scan.
+ *
+ * A sweep goes through the colours one after another. Within a
+ * colour the buckets are handed out to the threads from a shared
+ * counter, and each bucket gets as many trial moves as it holds
+ * cylinders. A move that would take a cylinder out of its bucket is
+ * rejected, which keeps the set of moves symmetric. Crossing between
+ * buckets is handled by a short serial pass of unconstrained moves at
+ * the end of every sweep, which goes through `cyl_list_move`.
+ *
+ * The trial moves themselves come from a per-thread batch (see
+ * `movebatch.c`), which makes them thousands at a time without any
+ * trig functions, so making a move costs next to nothing compared
+ * with deciding it.
+ *
+ * In a periodic box the colouring still works across the boundary,
+ * since the number of buckets along an axis is always a multiple of
+ * `sub+1` (or at most `sub+1`) when the state is periodic.
+ *
+ * With Verlet neighbor lists (`nlist.c`), a list that goes stale in
+ * the middle of a colour does not need to be rebuilt right away. A
+ * cylinder that has moved too far can only be a neighbor of buckets
+ * of other colours, which are not being moved. So the list is only
+ * rebuilt between colours. A build costs about as much as a bucket
+ * scan for every cylinder, so this only pays off if a list lasts for
+ * more than a sweep, which needs a skin that is wide compared with the
+ * trial moves (up to half a length), and the buckets rarely leave room
+ * for that. If `SWEEP_NLIST_TRIES` builds in a row go stale before a
+ * sweep's worth of colours, the list is dropped and the sweeper goes
+ * back to scanning the buckets, rather than rebuilding it serially
+ * every colour or two.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "math_const.h"
+#include "vecs.h"
+#include "rng.h"
+#include "cylinders.h"
+#include "manybody.h"
+#include "cellstore.h"
+#include "nlist.h"
+#include "lennardjones.h"
+#include "ljtable.h"
+#include "montecarlo.h"
+#include "movebatch.h"
+
+/*!
+ * Number of trial moves made at a time by each thread.
+ */
+#define SWEEP_MOVE_BATCH 2048
+
+/*!
+ * Number of builds in a row that have to go stale within a sweep
+ * before the neighbor list is dropped.
+ */
+#define SWEEP_NLIST_TRIES 3
+
+/*!
+ * Sweep parameters
+ *
+ * + `beta` the inverse temperature
+ * + `nthreads` the number of threads to use
+ * + `serial_moves` number of unconstrained moves at the end of each
+ *   sweep, these are the only moves that can change buckets
+ * + `seed` seed for the per-thread random number streams
+ * + `skin` skin for the Verlet neighbor lists, or 0 to scan the
+ *   buckets on every move. If the bucket grid has no room for the
+ *   skin (see `nlist_max_skin`) the buckets are scanned as well.
+ * + `check_every` recompute the cached energies from scratch every
+ *   this many sweeps and keep the drift in the sweeper, or 0 to never
+ *   check
+ * + `reorder_every` sort the cylinders by bucket (`state_reorder`)
+ *   every this many sweeps, or 0 to leave them in place. This changes
+ *   the indices of the cylinders.
+ */
+typedef struct{
+	double beta;
+	int nthreads;
+	int serial_moves;
+	uint64_t seed;
+	double skin;
+	int check_every;
+	int reorder_every;
+} sweep_params;
+
+/*!
+ * Sweep statistics
+ *
+ * + `tried` number of trial moves
+ * + `accepted` number of accepted moves
+ * + `confined` number of moves rejected because they would leave the
+ *   bucket (or the box)
+ */
+typedef struct{
+	long tried, accepted, confined;
+} sweep_stats;
+
+/*!
+ * Per-thread data
+ *
+ * Each thread carries its own random number generator `g` (stream
+ * `id` for the seed in the sweep parameters), the batch of trial
+ * moves `moves` it fills from `g`, its statistics, and a scratch
+ * array `members` used to hold the indices of the cylinders in the
+ * bucket it is currently working on.
+ */
+typedef struct{
+	struct sweeper_struct *sw;
+	int id;
+	rng g;
+	move_batch *moves;
+	sweep_stats stats;
+	int *members;
+	int members_max;
+} sweep_worker;
+
+/*!
+ * The sweep engine
+ *
+ * + `s` the state being sampled
+ * + `sp` the sweep parameters
+ * + `w` array of per-thread data
+ * + `nl` the neighbor list, `NULL` if not used (or dropped)
+ * + `nl_age` number of colours swept since the list was last built
+ * + `nl_misses` number of builds in a row that went stale within a
+ *   sweep
+ * + `ncolours` the number of colours
+ * + `colour` the bucket indices sorted by colour, with the buckets
+ *   of colour `c` in `colour[colour_start[c]]` up to
+ *   `colour[colour_start[c+1]]`
+ * + `next` for each colour the next bucket to be handed out
+ * + `nsweeps` number of sweeps in the current run
+ * + `sweeps` total number of sweeps done
+ * + `drift`, `max_drift` drift in the total energy and the largest
+ *   drift for one cylinder found at the last energy check
+ * + `ok` cleared if a bucket could not be swept or the neighbor list
+ *   could not be rebuilt during the current run
+ * + `quit` set if the helper threads should leave without sweeping
+ * + `gate` held while the helper threads are started
+ * + `barrier` barrier used between colours
+ */
+typedef struct sweeper_struct{
+	state *s;
+	sweep_params sp;
+	sweep_worker *w;
+	nlist *nl;
+	int nl_age, nl_misses;
+	int ncolours;
+	int *colour, *colour_start, *next;
+	int nsweeps;
+	long sweeps;
+	double drift, max_drift;
+	int ok;
+	int quit;
+	pthread_mutex_t gate;
+	pthread_barrier_t barrier;
+} sweeper;
+
+/*!
+ * Constructor for the sweep engine.
+ *
+ * Sorts the buckets of `s` by colour and sets up the per-thread
+ * random number streams. Returns `NULL` if any allocation fails.
+ */
+sweeper* sweeper_malloc( state *s, sweep_params sp){
+	int i, j, k, c, m, t, p = s->sub+1;
+	int nb = s->nbx * s->nby * s->nbz;
+
+	if( sp.nthreads < 1 ){
+		sp.nthreads = 1;
+	}
+	sweeper *sw = (sweeper *) malloc( sizeof(sweeper));
+	if( sw == NULL ){
+		return NULL;
+	}
+	sw->s = s;
+	sw->sp = sp;
+	sw->sweeps = 0;
+	sw->drift = 0.;
+	sw->max_drift = 0.;
+	sw->ok = 1;
+	sw->nl = NULL;
+	sw->nl_age = 0;
+	sw->nl_misses = 0;
+	if( sp.skin > 0. && sp.skin <= nlist_max_skin( s) ){
+		sw->nl = nlist_malloc( s, sp.skin);
+		if( sw->nl == NULL ){
+			free( sw);
+			return NULL;
+		}
+	}
+	sw->ncolours = p*p*p;
+	sw->colour = (int *) malloc( nb*sizeof(int));
+	sw->colour_start = (int *) malloc( (sw->ncolours+1)*sizeof(int));
+	sw->next = (int *) malloc( sw->ncolours*sizeof(int));
+	sw->w = (sweep_worker *) malloc( sp.nthreads*sizeof(sweep_worker));
+	if( sw->colour == NULL || sw->colour_start == NULL || sw->next == NULL || sw->w == NULL ){
+		free( sw->colour);
+		free( sw->colour_start);
+		free( sw->next);
+		free( sw->w);
+		if( sw->nl != NULL ){
+			nlist_free( sw->nl);
+		}
+		free( sw);
+		return NULL;
+	}
+
+	m = 0;
+	for( c=0; c<sw->ncolours; c++){
+		sw->colour_start[c] = m;
+		for( k=c/(p*p); k<s->nbz; k+=p){
+			for( j=(c/p)%p; j<s->nby; j+=p){
+				for( i=c%p; i<s->nbx; i+=p){
+					sw->colour[m++] = state_bucket( s, i, j, k);
+				}
+			}
+		}
+	}
+	sw->colour_start[sw->ncolours] = m;
+
+	for( t=0; t<sp.nthreads; t++){
+		sw->w[t].sw = sw;
+		sw->w[t].id = t;
+		rng_stream( &(sw->w[t].g), sp.seed, t);
+		sw->w[t].stats.tried = 0;
+		sw->w[t].stats.accepted = 0;
+		sw->w[t].stats.confined = 0;
+		sw->w[t].members = NULL;
+		sw->w[t].members_max = 0;
+		sw->w[t].moves = move_batch_malloc( SWEEP_MOVE_BATCH, PI_6);
+		if( sw->w[t].moves == NULL ){
+			while( t-- > 0 ){
+				move_batch_free( sw->w[t].moves);
+			}
+			free( sw->colour);
+			free( sw->colour_start);
+			free( sw->next);
+			free( sw->w);
+			if( sw->nl != NULL ){
+				nlist_free( sw->nl);
+			}
+			free( sw);
+			return NULL;
+		}
+	}
+	return sw;
+}
+
+/*!
+ * Destructor for the sweep engine.
+ */
+void sweeper_free( sweeper *sw){
+	int t;
+	for( t=0; t<sw->sp.nthreads; t++){
+		free( sw->w[t].members);
+		move_batch_free( sw->w[t].moves);
+	}
+	free( sw->w);
+	free( sw->colour);
+	free( sw->colour_start);
+	free( sw->next);
+	if( sw->nl != NULL ){
+		nlist_free( sw->nl);
+	}
+	free( sw);
+}
+
+/*!
+ * Apply an accepted move of cylinder `l` to `c_new`.
+ */
+static void sweep_apply( sweeper *sw, int l, cyl c_new){
+	mc_accept( sw->s, l, c_new);
+	if( sw->nl != NULL ){
+		nlist_moved( sw->nl, l, c_new);
+	}
+}
+
+/*!
+ * Trial moves for all the cylinders in bucket `m`.
+ *
+ * The members of the bucket are copied into the thread's scratch
+ * array first. Since no cylinder can leave or enter the bucket while
+ * its colour is being swept, the list is fixed for the duration.
+ * Returns 0 if the scratch array could not be grown.
+ */
+static int sweep_bucket( sweep_worker *w, int m){
+	state *s = w->sw->s;
+	double beta = w->sw->sp.beta;
+	cyl_ll *cur;
+	cyl c_new;
+	int n, t, l, *tmp;
+
+	n = 0;
+	for( cur = s->heads[m]; cur != NULL; cur = cur->next){
+		if( n == w->members_max ){
+			tmp = (int *) realloc( w->members, (2*n+16)*sizeof(int));
+			if( tmp == NULL ){
+				return 0;
+			}
+			w->members = tmp;
+			w->members_max = 2*n+16;
+		}
+		w->members[n++] = (int) (cur - s->a);
+	}
+
+	for( t=0; t<n; t++){
+		l = w->members[rng_below( &(w->g), n)];
+		c_new = move_batch_next( w->moves, s->a[l].c, &(w->g));
+		c_new.p = state_wrap( s, c_new.p);
+		w->stats.tried++;
+		if( !state_inside( s, c_new) ||
+			bucket_index( s, c_new.p) != m ){
+			w->stats.confined++;
+			continue;
+		}
+		if( mc_try( s, w->sw->nl, l, c_new, beta, &(w->g)) ){
+			sweep_apply( w->sw, l, c_new);
+			w->stats.accepted++;
+		}
+	}
+	return 1;
+}
+
+/*!
+ * Serial pass of unconstrained moves.
+ *
+ * These moves are only restricted to the box, and are allowed to
+ * carry a cylinder into a new bucket.
+ */
+static void sweep_serial( sweep_worker *w){
+	state *s = w->sw->s;
+	double beta = w->sw->sp.beta;
+	cyl c_new;
+	int t, l;
+
+	for( t=0; t<w->sw->sp.serial_moves; t++){
+		l = rng_below( &(w->g), s->n);
+		c_new = move_batch_next( w->moves, s->a[l].c, &(w->g));
+		c_new.p = state_wrap( s, c_new.p);
+		w->stats.tried++;
+		if( !state_inside( s, c_new) ){
+			w->stats.confined++;
+			continue;
+		}
+		if( mc_try( s, w->sw->nl, l, c_new, beta, &(w->g)) ){
+			sweep_apply( w->sw, l, c_new);
+			w->stats.accepted++;
+		}
+	}
+}
+
+/*!
+ * Build the neighbor list, and clear `ok` if it fails.
+ */
+static int sweep_nlist_build( sweeper *sw){
+	if( !nlist_build( sw->nl, sw->s) ){
+		__sync_fetch_and_and( &(sw->ok), 0);
+		return 0;
+	}
+	sw->nl_age = 0;
+	return 1;
+}
+
+/*!
+ * Rebuild the neighbor list if it has gone stale.
+ *
+ * If it went stale before lasting a sweep's worth of colours, and that
+ * has happened `SWEEP_NLIST_TRIES` times in a row, the skin can not
+ * keep up with the moves and the list is dropped instead.
+ */
+static void sweep_nlist_update( sweeper *sw){
+	if( !sw->nl->stale ){
+		return;
+	}
+	if( sw->nl_age >= sw->ncolours ){
+		sw->nl_misses = 0;
+	}else if( ++sw->nl_misses >= SWEEP_NLIST_TRIES ){
+		nlist_free( sw->nl);
+		sw->nl = NULL;
+		return;
+	}
+	sweep_nlist_build( sw);
+}
+
+/*!
+ * Main loop for each thread.
+ */
+static void *sweep_worker_run( void *arg){
+	sweep_worker *w = (sweep_worker *) arg;
+	sweeper *sw = w->sw;
+	int n, c, b, list;
+
+	for( n=0; n<sw->nsweeps; n++){
+		for( c=0; c<sw->ncolours; c++){
+			/* thread 0 can drop the list between the barriers, so every
+			 * thread decides on the second barrier before the first */
+			list = ( sw->nl != NULL );
+			while( 1 ){
+				b = __sync_fetch_and_add( &(sw->next[c]), 1);
+				if( b >= sw->colour_start[c+1] - sw->colour_start[c] ){
+					break;
+				}
+				if( !sweep_bucket( w, sw->colour[sw->colour_start[c]+b]) ){
+					__sync_fetch_and_and( &(sw->ok), 0);
+				}
+			}
+			pthread_barrier_wait( &(sw->barrier));
+			if( list ){
+				if( w->id == 0 ){
+					sw->nl_age++;
+					sweep_nlist_update( sw);
+				}
+				pthread_barrier_wait( &(sw->barrier));
+			}
+		}
+		if( w->id == 0 ){
+			sweep_serial( w);
+			sw->sweeps++;
+			if( sw->nl != NULL ){
+				sweep_nlist_update( sw);
+			}
+			if( sw->sp.reorder_every > 0 && sw->sweeps%sw->sp.reorder_every == 0 &&
+				state_reorder( sw->s, NULL) && sw->nl != NULL ){
+				/* the lists hold the old indices */
+				sw->nl->stale = 1;
+				sweep_nlist_build( sw);
+			}
+			if( sw->sp.check_every > 0 && sw->sweeps%sw->sp.check_every == 0 ){
+				sw->drift = state_energy_check( sw->s, &(sw->max_drift));
+			}
+			for( c=0; c<sw->ncolours; c++){
+				sw->next[c] = 0;
+			}
+		}
+		pthread_barrier_wait( &(sw->barrier));
+	}
+	return NULL;
+}
+
+/*!
+ * Entry point of the helper threads.
+ *
+ * Waits at the gate until every helper has been started, and then
+ * either sweeps or, if not all of them could be started, leaves.
+ */
+static void *sweep_helper_run( void *arg){
+	sweep_worker *w = (sweep_worker *) arg;
+	sweeper *sw = w->sw;
+
+	pthread_mutex_lock( &(sw->gate));
+	pthread_mutex_unlock( &(sw->gate));
+	if( sw->quit ){
+		return NULL;
+	}
+	return sweep_worker_run( w);
+}
+
+/*!
+ * Run `nsweeps` sweeps.
+ *
+ * The calling thread does the work of thread 0, and `nthreads-1`
+ * helper threads are started for the duration of the call. Returns 1
+ * on success and 0 if the setup fails (including when a helper thread
+ * can not be started, in which case no sweeps are done), or if a
+ * bucket could not be swept (its scratch array could not be grown, so
+ * its cylinders got no trial moves) or the neighbor list could not be
+ * rebuilt.
+ */
+int sweeper_run( sweeper *sw, int nsweeps){
+	pthread_t *threads;
+	int c, t, nt;
+
+	nt = sw->sp.nthreads;
+	threads = (pthread_t *) malloc( nt*sizeof(pthread_t));
+	if( threads == NULL ){
+		return 0;
+	}
+	if( pthread_mutex_init( &(sw->gate), NULL) != 0 ){
+		free( threads);
+		return 0;
+	}
+	if( !sw->s->u_valid ){
+		state_energy( sw->s);
+	}
+	sw->ok = 1;
+	if( sw->nl != NULL && sw->nl->stale && !sweep_nlist_build( sw) ){
+		pthread_mutex_destroy( &(sw->gate));
+		free( threads);
+		return 0;
+	}
+	sw->nsweeps = nsweeps;
+	sw->quit = 0;
+	for( c=0; c<sw->ncolours; c++){
+		sw->next[c] = 0;
+	}
+	/* the barrier counts on every thread showing up, so it is only set
+	 * up once they have all started */
+	pthread_mutex_lock( &(sw->gate));
+	for( t=1; t<nt; t++){
+		if( pthread_create( &threads[t], NULL, sweep_helper_run, &(sw->w[t])) != 0 ){
+			break;
+		}
+	}
+	if( t < nt || pthread_barrier_init( &(sw->barrier), NULL, nt) != 0 ){
+		sw->quit = 1;
+		pthread_mutex_unlock( &(sw->gate));
+		while( --t > 0 ){
+			pthread_join( threads[t], NULL);
+		}
+		pthread_mutex_destroy( &(sw->gate));
+		free( threads);
+		return 0;
+	}
+	pthread_mutex_unlock( &(sw->gate));
+	sweep_worker_run( &(sw->w[0]));
+	for( t=1; t<nt; t++){
+		pthread_join( threads[t], NULL);
+	}
+	pthread_barrier_destroy( &(sw->barrier));
+	pthread_mutex_destroy( &(sw->gate));
+	free( threads);
+	return sw->ok;
+}
+
+/*!
+ * Statistics summed over all threads.
+ */
+sweep_stats sweeper_stats( sweeper *sw){
+	sweep_stats st = { 0, 0, 0};
+	int t;
+	for( t=0; t<sw->sp.nthreads; t++){
+		st.tried += sw->w[t].stats.tried;
+		st.accepted += sw->w[t].stats.accepted;
+		st.confined += sw->w[t].stats.confined;
+	}
+	return st;
+}
@@ -0,0 +1,62 @@
+/*!*******************************************************************
+ * sweep.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#ifndef JW_SWEEP
+#define JW_SWEEP
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "rng.h"
+#include "movebatch.h"
+
+typedef struct{
+	double beta;
+	int nthreads;
+	int serial_moves;
+	uint64_t seed;
+	double skin;
+	int check_every;
+	int reorder_every;
+} sweep_params;
+
+typedef struct{
+	long tried, accepted, confined;
+} sweep_stats;
+
+typedef struct{
+	struct sweeper_struct *sw;
+	int id;
+	rng g;
+	move_batch *moves;
+	sweep_stats stats;
+	int *members;
+	int members_max;
+} sweep_worker;
+
+typedef struct sweeper_struct{
+	state *s;
+	sweep_params sp;
+	sweep_worker *w;
+	nlist *nl;
+	int nl_age, nl_misses;
+	int ncolours;
+	int *colour, *colour_start, *next;
+	int nsweeps;
+	long sweeps;
+	double drift, max_drift;
+	int ok;
+	int quit;
+	pthread_mutex_t gate;
+	pthread_barrier_t barrier;
+} sweeper;
+
+sweeper* sweeper_malloc( state *s, sweep_params sp);
+void sweeper_free( sweeper *sw);
+int sweeper_run( sweeper *sw, int nsweeps);
+sweep_stats sweeper_stats( sweeper *sw);
+
+#endif /* JW_SWEEP */
@@ -0,0 +1,286 @@
+/*!*******************************************************************
+ * sweep_test.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+
+/* the threads in sweep.c are started through here, so that the test
+ * can make the start of one fail */
+static int fail_thread = -1;
+static int test_pthread_create( pthread_t *thread, const pthread_attr_t *attr,
+								void *(*run)( void *), void *arg){
+	if( fail_thread == 0 ){
+		return EAGAIN;
+	}
+	if( fail_thread > 0 ){
+		fail_thread--;
+	}
+	return pthread_create( thread, attr, run, arg);
+}
+#define pthread_create test_pthread_create
+#include "sweep.c"
+#undef pthread_create
+
+/*!
+ * Check that every cylinder is on the list of the bucket that
+ * contains it, exactly once.
+ */
+int state_consistent( state *s){
+	int m, nb, count;
+	cyl_ll *cur;
+
+	nb = s->nbx * s->nby * s->nbz;
+	count = 0;
+	for( m=0; m<nb; m++){
+		for( cur = s->heads[m]; cur != NULL; cur = cur->next){
+			if( bucket_index( s, cur->c.p) != m ){
+				return 0;
+			}
+			count++;
+		}
+	}
+	return( count == s->n );
+}
+
+void sweep_test(){
+	int result;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {20., 20., 20.};
+	sweep_params sp = { 1., 4, 100, 12345u, 0., 0, 0};
+	sweep_stats st;
+	sweeper *sw;
+	state *s;
+
+	fprintf( stdout, "Testing sweeper_malloc: ");
+	s = state_malloc( cp, box, 500);
+	state_uniform_initialize( s);
+	sw = sweeper_malloc( s, sp);
+	result = (sw != NULL);
+	result = result && (sw->colour_start[8] == s->nbx*s->nby*s->nbz);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+		return;
+	}
+
+	fprintf( stdout, "Testing sweeper_run: ");
+	result = sweeper_run( sw, 10);
+	st = sweeper_stats( sw);
+	result = result && (st.tried == 10*(s->n + sp.serial_moves));
+	result = result && state_consistent( s);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	sweeper_free( sw);
+
+	fprintf( stdout, "Testing sweeper_run with neighbor lists: ");
+	sp.skin = 0.5;
+	sp.check_every = 5;
+	sw = sweeper_malloc( s, sp);
+	result = (sw != NULL) && (sw->nl != NULL);
+	result = result && sweeper_run( sw, 10);
+	/* in a dilute system the moves outrun the skin, so the list is
+	 * dropped for the bucket scan */
+	result = result && (sw->nl == NULL);
+	result = result && ( fabs( sw->drift) < max( 1.0e-7, 100.*COORD_EPSILON)*(1.+fabs( s->u_tot)) );
+	result = result && state_consistent( s);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	sweeper_free( sw);
+	state_free( s);
+}
+
+/*!
+ * Energy of cylinder `i` with all the others, at their closest
+ * images, without using the buckets.
+ */
+double u_brute( state *s, int i){
+	int j;
+	double u = 0.;
+	vec3 ctr = cyl_point( s->a[i].c, 0.5);
+	for( j=0; j<s->n; j++){
+		if( j != i ){
+			u += u_cc( state_image( s, s->a[j].c, ctr), s->a[i].c);
+		}
+	}
+	return u;
+}
+
+void periodic_sweep_test(){
+	int i, result;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {12., 12., 12.};
+	sweep_params sp = { 1., 4, 100, 777u, 0.5, 5, 0};
+	sweeper *sw;
+	state *s;
+
+	fprintf( stdout, "Testing sweeper_malloc with a skin the buckets have no room for: ");
+	sp.skin = 2.;
+	s = state_malloc( cp, box, 300);
+	result = state_set_periodic( s, 1) && state_uniform_initialize( s);
+	sw = sweeper_malloc( s, sp);
+	result = result && (sw != NULL) && (sw->nl == NULL);
+	result = result && sweeper_run( sw, 2);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	sweeper_free( sw);
+	state_free( s);
+	sp.skin = 0.5;
+
+	fprintf( stdout, "Testing sweeper_run in a periodic box: ");
+	s = state_malloc( cp, box, 300);
+	result = state_set_periodic( s, 1);
+	result = result && state_uniform_initialize( s);
+	sw = sweeper_malloc( s, sp);
+	result = result && (sw != NULL);
+	result = result && sweeper_run( sw, 20);
+	result = result && ( fabs( sw->drift) < max( 1.0e-7, 100.*COORD_EPSILON)*(1.+fabs( s->u_tot)) );
+	result = result && state_consistent( s);
+	for( i=0; i<s->n; i++){
+		result = result && ( s->a[i].c.p.x >= 0. && s->a[i].c.p.x < box.x );
+		result = result && ( s->a[i].c.p.y >= 0. && s->a[i].c.p.y < box.y );
+		result = result && ( s->a[i].c.p.z >= 0. && s->a[i].c.p.z < box.z );
+		result = result && ( fabs( u_i( s, i, s->a[i].c) - u_brute( s, i)) < max( 1.0e-9, 100.*COORD_EPSILON) );
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	sweeper_free( sw);
+	state_free( s);
+}
+
+void subdivided_sweep_test(){
+	int i, result;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {12., 12., 12.};
+	sweep_params sp = { 1., 4, 100, 778u, 0., 5, 0};
+	sweeper *sw;
+	state *s;
+
+	fprintf( stdout, "Testing sweeper_run with subdivided buckets: ");
+	s = state_malloc( cp, box, 300);
+	result = state_set_periodic( s, 1);
+	result = result && state_set_subdivision( s, 2);
+	result = result && state_uniform_initialize( s);
+	sw = sweeper_malloc( s, sp);
+	result = result && (sw != NULL);
+	result = result && ( sw->ncolours == 27 );
+	result = result && sweeper_run( sw, 20);
+	result = result && ( fabs( sw->drift) < max( 1.0e-7, 100.*COORD_EPSILON)*(1.+fabs( s->u_tot)) );
+	result = result && state_consistent( s);
+	for( i=0; i<s->n; i++){
+		result = result && ( fabs( u_i( s, i, s->a[i].c) - u_brute( s, i)) < max( 1.0e-9, 100.*COORD_EPSILON) );
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	sweeper_free( sw);
+	state_free( s);
+}
+
+void reorder_sweep_test(){
+	int i, result;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {12., 12., 12.};
+	sweep_params sp = { 1., 4, 100, 779u, 0.5, 5, 5};
+	sweeper *sw;
+	state *s;
+
+	fprintf( stdout, "Testing sweeper_run with Morton buckets and reordering: ");
+	s = state_malloc( cp, box, 300);
+	result = state_set_periodic( s, 1);
+	result = result && state_set_morton( s, 1);
+	result = result && state_uniform_initialize( s);
+	sw = sweeper_malloc( s, sp);
+	result = result && (sw != NULL);
+	result = result && sweeper_run( sw, 20);
+	result = result && ( fabs( sw->drift) < max( 1.0e-7, 100.*COORD_EPSILON)*(1.+fabs( s->u_tot)) );
+	result = result && state_consistent( s);
+	for( i=0; i<s->n; i++){
+		result = result && ( fabs( u_i( s, i, s->a[i].c) - u_brute( s, i)) < max( 1.0e-9, 100.*COORD_EPSILON) );
+		result = result && ( sw->nl == NULL ||
+							 fabs( u_i_nlist( s, sw->nl, i, s->a[i].c) - u_brute( s, i)) < max( 1.0e-9, 100.*COORD_EPSILON) );
+		/* reordered after the last sweep */
+		result = result && ( i == 0 || bucket_index( s, s->a[i-1].c.p) <= bucket_index( s, s->a[i].c.p) );
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	sweeper_free( sw);
+	state_free( s);
+}
+
+void thread_fail_test(){
+	int i, result;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {12., 12., 12.};
+	sweep_params sp = { 1., 4, 100, 780u, 0., 0, 0};
+	sweep_stats st;
+	sweeper *sw;
+	state *s;
+	cyl *c;
+
+	fprintf( stdout, "Testing sweeper_run when a thread cannot be started: ");
+	s = state_malloc( cp, box, 300);
+	c = (cyl *) malloc( s->n*sizeof(cyl));
+	result = ( c != NULL ) && state_uniform_initialize( s);
+	sw = sweeper_malloc( s, sp);
+	result = result && (sw != NULL);
+	for( i=0; result && i<s->n; i++){
+		c[i] = s->a[i].c;
+	}
+	/* the second helper fails to start, the first has to be let go */
+	fail_thread = 1;
+	result = result && !sweeper_run( sw, 5);
+	fail_thread = -1;
+	st = sweeper_stats( sw);
+	result = result && ( st.tried == 0 );
+	for( i=0; result && i<s->n; i++){
+		result = ( vec3_dist( c[i].p, s->a[i].c.p) == 0. );
+	}
+	result = result && sweeper_run( sw, 5);
+	result = result && state_consistent( s);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	free( c);
+	sweeper_free( sw);
+	state_free( s);
+}
+
+int main(){
+	sweep_test();
+	periodic_sweep_test();
+	subdivided_sweep_test();
+	reorder_sweep_test();
+	thread_fail_test();
+	return 0;
+}
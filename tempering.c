@@ -0,0 +1,381 @@
+/*!*******************************************************************
+ * tempering.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * This file contains a parallel tempering (replica exchange) driver.
+ * It holds `nrep` replicas of the system, each a `state` with its own
+ * Metropolis `sweeper`, at a ladder of inverse temperatures
+ * `beta[0] < beta[1] < ...`, so temperature 0 is the hottest.
+ *
+ * A round runs `sweeps_per_swap` sweeps on every replica, and then
+ * tries to swap the neighboring temperatures `k` and `k+1`. The swap is
+ * accepted with probability `min(1, exp((beta[k+1]-beta[k])(E[k+1]-E[k])))`.
+ * Rounds alternate between the even pairs (0-1, 2-3, ...) and the odd
+ * pairs (1-2, 3-4, ...). An accepted swap does not copy any cylinders,
+ * the two replicas just trade their inverse temperatures.
+ *
+ * The replicas are run by a pool of threads that lives as long as the
+ * driver. Within a round the replicas are handed out from a shared
+ * counter, each replica being swept by a single thread, and the only
+ * synchronisation is a barrier at the start and at the end of the
+ * sweeps. The swaps are cheap and are done by the calling thread.
+ *
+ * Every replica has its own random number stream (stream `r+1` of the
+ * seed in the sweep parameters), and the swaps use stream 0.
+ *
+ * To help tune the ladder the driver counts the swaps tried and
+ * accepted between each pair of temperatures, and follows each
+ * replica on its walk through the ladder. A round trip is a walk from
+ * the hottest temperature to the coldest and back, and its length is
+ * counted in rounds.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "vecs.h"
+#include "rng.h"
+#include "lennardjones.h"
+#include "ljtable.h"
+#include "cylinders.h"
+#include "manybody.h"
+#include "cellstore.h"
+#include "nlist.h"
+#include "montecarlo.h"
+#include "sweep.h"
+
+/*!
+ * Parallel tempering parameters
+ *
+ * + `nthreads` the number of threads in the pool
+ * + `sweeps_per_swap` number of sweeps between swap attempts
+ * + `sp` the sweep parameters for every replica, `beta` and
+ *   `nthreads` are ignored
+ */
+typedef struct{
+	int nthreads;
+	int sweeps_per_swap;
+	sweep_params sp;
+} tempering_params;
+
+/*!
+ * One replica
+ *
+ * + `sw` the sweeper, which holds the state and the current `beta`
+ * + `temp` index of the current temperature
+ * + `dir` +1 if the last end of the ladder visited was the hottest, -1
+ *   if it was the coldest, 0 if neither has been visited yet
+ * + `trip_start` round when the current round trip started
+ * + `trips` number of round trips finished
+ * + `trip_rounds` total length of the finished round trips
+ */
+typedef struct{
+	sweeper *sw;
+	int temp;
+	int dir;
+	long trip_start;
+	long trips, trip_rounds;
+} replica;
+
+/*!
+ * The parallel tempering driver
+ *
+ * + `tp` the parameters
+ * + `nrep` the number of replicas (and temperatures)
+ * + `beta` the ladder of inverse temperatures
+ * + `r` the replicas
+ * + `at` index of the replica at each temperature
+ * + `tried`, `accepted` swaps between temperatures `k` and `k+1`
+ * + `g` random number generator for the swaps
+ * + `rounds` number of rounds done
+ * + `threads`, `barrier` the thread pool
+ * + `gate` held while the pool is started
+ * + `next` the next replica to be handed out
+ * + `quit` set to shut the pool down
+ * + `ok` cleared if a sweep fails
+ */
+typedef struct{
+	tempering_params tp;
+	int nrep;
+	double *beta;
+	replica *r;
+	int *at;
+	long *tried, *accepted;
+	rng g;
+	long rounds;
+	pthread_t *threads;
+	pthread_mutex_t gate;
+	pthread_barrier_t barrier;
+	int next;
+	int quit;
+	int ok;
+} tempering;
+
+/*!
+ * Sweep replicas until there are none left this round.
+ */
+static void tempering_work( tempering *t){
+	int k;
+	while( 1 ){
+		k = __sync_fetch_and_add( &(t->next), 1);
+		if( k >= t->nrep ){
+			break;
+		}
+		if( !sweeper_run( t->r[k].sw, t->tp.sweeps_per_swap) ){
+			__sync_fetch_and_and( &(t->ok), 0);
+		}
+	}
+}
+
+/*!
+ * Main loop for the threads in the pool.
+ *
+ * Waits at the gate until the whole pool has been started, and leaves
+ * straight away if it could not be.
+ */
+static void *tempering_worker( void *arg){
+	tempering *t = (tempering *) arg;
+	pthread_mutex_lock( &(t->gate));
+	pthread_mutex_unlock( &(t->gate));
+	if( t->quit ){
+		return NULL;
+	}
+	while( 1 ){
+		pthread_barrier_wait( &(t->barrier));
+		if( t->quit ){
+			break;
+		}
+		tempering_work( t);
+		pthread_barrier_wait( &(t->barrier));
+	}
+	return NULL;
+}
+
+/*!
+ * Free the first `nrep` sweepers and the arrays of the driver.
+ */
+static void tempering_release( tempering *t, int nrep){
+	int k;
+	for( k=0; k<nrep; k++){
+		sweeper_free( t->r[k].sw);
+	}
+	free( t->beta);
+	free( t->r);
+	free( t->at);
+	free( t->tried);
+	free( t->accepted);
+	free( t->threads);
+	free( t);
+}
+
+/*!
+ * Constructor for the parallel tempering driver.
+ *
+ * Replica `k` samples `s[k]` and starts at inverse temperature
+ * `beta[k]`. The states stay owned by the caller. Starts the pool of
+ * `nthreads-1` helper threads (the calling thread is the last one).
+ * Returns `NULL` if an allocation fails or a thread can not be
+ * started.
+ */
+tempering* tempering_malloc( state **s, double *beta, int nrep, tempering_params tp){
+	tempering *t;
+	int k, nt;
+
+	if( tp.nthreads < 1 ){
+		tp.nthreads = 1;
+	}
+	t = (tempering *) malloc( sizeof(tempering));
+	if( t == NULL ){
+		return NULL;
+	}
+	t->tp = tp;
+	t->nrep = nrep;
+	t->rounds = 0;
+	t->next = 0;
+	t->quit = 0;
+	t->ok = 1;
+	rng_stream( &(t->g), tp.sp.seed, 0);
+	t->beta = (double *) malloc( nrep*sizeof(double));
+	t->r = (replica *) malloc( nrep*sizeof(replica));
+	t->at = (int *) malloc( nrep*sizeof(int));
+	t->tried = (long *) malloc( nrep*sizeof(long));
+	t->accepted = (long *) malloc( nrep*sizeof(long));
+	t->threads = (pthread_t *) malloc( tp.nthreads*sizeof(pthread_t));
+	if( t->beta == NULL || t->r == NULL || t->at == NULL || t->tried == NULL ||
+		t->accepted == NULL || t->threads == NULL ){
+		free( t->beta);
+		free( t->r);
+		free( t->at);
+		free( t->tried);
+		free( t->accepted);
+		free( t->threads);
+		free( t);
+		return NULL;
+	}
+
+	tp.sp.nthreads = 1;
+	for( k=0; k<nrep; k++){
+		t->beta[k] = beta[k];
+		t->at[k] = k;
+		t->tried[k] = 0;
+		t->accepted[k] = 0;
+		tp.sp.beta = beta[k];
+		t->r[k].sw = sweeper_malloc( s[k], tp.sp);
+		t->r[k].temp = k;
+		t->r[k].dir = 0;
+		t->r[k].trip_start = 0;
+		t->r[k].trips = 0;
+		t->r[k].trip_rounds = 0;
+		if( t->r[k].sw == NULL ){
+			break;
+		}
+		rng_stream( &(t->r[k].sw->w[0].g), tp.sp.seed, k+1);
+	}
+	if( k < nrep || pthread_mutex_init( &(t->gate), NULL) != 0 ){
+		tempering_release( t, k);
+		return NULL;
+	}
+
+	/* the barrier counts on every thread showing up, so it is only set
+	 * up once they have all started */
+	pthread_mutex_lock( &(t->gate));
+	for( nt=1; nt<tp.nthreads; nt++){
+		if( pthread_create( &(t->threads[nt]), NULL, tempering_worker, t) != 0 ){
+			break;
+		}
+	}
+	if( nt < tp.nthreads || pthread_barrier_init( &(t->barrier), NULL, tp.nthreads) != 0 ){
+		t->quit = 1;
+		pthread_mutex_unlock( &(t->gate));
+		while( --nt > 0 ){
+			pthread_join( t->threads[nt], NULL);
+		}
+		pthread_mutex_destroy( &(t->gate));
+		tempering_release( t, nrep);
+		return NULL;
+	}
+	pthread_mutex_unlock( &(t->gate));
+	return t;
+}
+
+/*!
+ * Destructor for the parallel tempering driver.
+ *
+ * Shuts the thread pool down. The states are left alone.
+ */
+void tempering_free( tempering *t){
+	int k;
+	t->quit = 1;
+	pthread_barrier_wait( &(t->barrier));
+	for( k=1; k<t->tp.nthreads; k++){
+		pthread_join( t->threads[k], NULL);
+	}
+	pthread_barrier_destroy( &(t->barrier));
+	pthread_mutex_destroy( &(t->gate));
+	tempering_release( t, t->nrep);
+}
+
+/*!
+ * Update the round trip bookkeeping of replica `k`.
+ */
+static void tempering_walk( tempering *t, int k){
+	replica *r = &(t->r[k]);
+	if( r->temp == 0 ){
+		if( r->dir == -1 ){
+			r->trips++;
+			r->trip_rounds += t->rounds - r->trip_start;
+		}
+		if( r->dir != 1 ){
+			r->trip_start = t->rounds;
+		}
+		r->dir = 1;
+	}else if( r->temp == t->nrep-1 && r->dir == 1 ){
+		r->dir = -1;
+	}
+}
+
+/*!
+ * Try to swap the replicas at temperatures `k` and `k+1`.
+ */
+static void tempering_swap( tempering *t, int k){
+	int a = t->at[k], b = t->at[k+1];
+	double x;
+	x = (t->beta[k+1] - t->beta[k])*(t->r[b].sw->s->u_tot - t->r[a].sw->s->u_tot);
+	t->tried[k]++;
+	if( x >= 0. || rng_uniform( &(t->g)) < exp( x) ){
+		t->accepted[k]++;
+		t->at[k] = b;
+		t->at[k+1] = a;
+		t->r[a].temp = k+1;
+		t->r[b].temp = k;
+		t->r[a].sw->sp.beta = t->beta[k+1];
+		t->r[b].sw->sp.beta = t->beta[k];
+	}
+}
+
+/*!
+ * Run `nrounds` rounds of sweeps and swaps.
+ *
+ * Returns 1 on success and 0 if a sweep fails.
+ */
+int tempering_run( tempering *t, int nrounds){
+	int n, k;
+	for( n=0; n<nrounds && t->ok; n++){
+		t->next = 0;
+		pthread_barrier_wait( &(t->barrier));
+		tempering_work( t);
+		pthread_barrier_wait( &(t->barrier));
+		for( k=(int) (t->rounds%2); k+1<t->nrep; k+=2){
+			tempering_swap( t, k);
+		}
+		t->rounds++;
+		for( k=0; k<t->nrep; k++){
+			tempering_walk( t, k);
+		}
+	}
+	return t->ok;
+}
+
+/*!
+ * The state currently at temperature `k`.
+ */
+state* tempering_state( tempering *t, int k){
+	return t->r[t->at[k]].sw->s;
+}
+
+/*!
+ * Print the swap acceptance between neighboring temperatures, and
+ * the move acceptance and round trips of every replica.
+ *
+ * Returns 0 if the output fails.
+ */
+int tempering_print_stats( FILE *file, tempering *t){
+	sweep_stats st;
+	replica *r;
+	int k, ok;
+	ok = ( fprintf( file, "%ld rounds of %d sweeps\n", t->rounds, t->tp.sweeps_per_swap) >= 0 );
+	for( k=0; k<t->nrep; k++){
+		if( k+1 < t->nrep ){
+			ok = ok && ( fprintf( file, "beta %1.4e: swap to %1.4e accepted %1.3f (%ld of %ld)\n",
+								  t->beta[k], t->beta[k+1],
+								  t->tried[k]?((double) t->accepted[k])/t->tried[k]:0.,
+								  t->accepted[k], t->tried[k]) >= 0 );
+		}else{
+			ok = ok && ( fprintf( file, "beta %1.4e\n", t->beta[k]) >= 0 );
+		}
+	}
+	for( k=0; k<t->nrep; k++){
+		r = &(t->r[k]);
+		st = sweeper_stats( r->sw);
+		ok = ok && ( fprintf( file, "replica %d: at beta %1.4e, moves accepted %1.3f, "
+							  "%ld round trips, mean %1.1f rounds\n",
+							  k, t->beta[r->temp], st.tried?((double) st.accepted)/st.tried:0.,
+							  r->trips, r->trips?((double) r->trip_rounds)/r->trips:0.) >= 0 );
+	}
+	return ok;
+}
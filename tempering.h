@@ -0,0 +1,49 @@
+/*!*******************************************************************
+ * tempering.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#ifndef JW_TEMPERING
+#define JW_TEMPERING
+
+typedef struct{
+	int nthreads;
+	int sweeps_per_swap;
+	sweep_params sp;
+} tempering_params;
+
+typedef struct{
+	sweeper *sw;
+	int temp;
+	int dir;
+	long trip_start;
+	long trips, trip_rounds;
+} replica;
+
+typedef struct{
+	tempering_params tp;
+	int nrep;
+	double *beta;
+	replica *r;
+	int *at;
+	long *tried, *accepted;
+	rng g;
+	long rounds;
+	pthread_t *threads;
+	pthread_barrier_t barrier;
+	int next;
+	int quit;
+	int ok;
+} tempering;
+
+tempering* tempering_malloc( state **s, double *beta, int nrep, tempering_params tp);
+void tempering_free( tempering *t);
+int tempering_run( tempering *t, int nrounds);
+state* tempering_state( tempering *t, int k);
+int tempering_print_stats( FILE *file, tempering *t);
+
+#endif /* JW_TEMPERING */
@@ -0,0 +1,168 @@
+/*!*******************************************************************
+ * tempering_test.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "math_const.h"
+
+/* the threads in tempering.c are started through here, so that the
+ * test can make the start of one fail */
+static int fail_thread = -1;
+static int test_pthread_create( pthread_t *thread, const pthread_attr_t *attr,
+								void *(*run)( void *), void *arg){
+	if( fail_thread == 0 ){
+		return EAGAIN;
+	}
+	if( fail_thread > 0 ){
+		fail_thread--;
+	}
+	return pthread_create( thread, attr, run, arg);
+}
+#define pthread_create test_pthread_create
+#include "tempering.c"
+#undef pthread_create
+
+#define NREP 4
+
+/*!
+ * Check that every temperature holds exactly one replica, and that
+ * each replica is swept at the inverse temperature it holds.
+ */
+int tempering_consistent( tempering *t){
+	int k, seen[NREP] = { 0, 0, 0, 0};
+	for( k=0; k<t->nrep; k++){
+		if( t->r[t->at[k]].temp != k || t->r[t->at[k]].sw->sp.beta != t->beta[k] ){
+			return 0;
+		}
+		seen[t->at[k]]++;
+	}
+	for( k=0; k<t->nrep; k++){
+		if( seen[k] != 1 ){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void tempering_test(){
+	int k, result;
+	long tried;
+	double drift, max_drift;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {10., 10., 10.};
+	tempering_params tp = { 2, 2, { 1., 1, 10, 777u, 0., 0, 0}};
+	double beta[NREP] = { 0.5, 1., 2., 4.};
+	double flat[NREP] = { 1., 1., 1., 1.};
+	state *s[NREP];
+	tempering *t;
+
+	for( k=0; k<NREP; k++){
+		s[k] = state_malloc( cp, box, 100);
+		state_uniform_initialize( s[k]);
+	}
+
+	fprintf( stdout, "Testing tempering_malloc: ");
+	t = tempering_malloc( s, beta, NREP, tp);
+	result = ( t != NULL ) && tempering_consistent( t);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+		return;
+	}
+
+	fprintf( stdout, "Testing tempering_run: ");
+	result = tempering_run( t, 20);
+	result = result && tempering_consistent( t);
+	/* 10 rounds with 2 even pairs and 10 with 1 odd pair */
+	tried = 0;
+	for( k=0; k<NREP; k++){
+		tried += t->tried[k];
+		result = result && ( t->accepted[k] <= t->tried[k] );
+	}
+	result = result && ( tried == 30 );
+	for( k=0; k<NREP; k++){
+		drift = state_energy_check( s[k], &max_drift);
+		result = result && ( fabs( drift) < max( 1.0e-7, 100.*COORD_EPSILON)*(1.+fabs( s[k]->u_tot)) );
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	tempering_free( t);
+
+	fprintf( stdout, "Testing tempering round trips: ");
+	/* with a flat ladder every swap is accepted */
+	t = tempering_malloc( s, flat, NREP, tp);
+	result = tempering_run( t, 40);
+	result = result && tempering_consistent( t);
+	for( k=0; k<NREP; k++){
+		result = result && ( t->accepted[k] == t->tried[k] );
+		result = result && ( t->r[k].trips > 0 );
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing tempering_print_stats: ");
+	result = tempering_print_stats( stdout, t);
+	if( !result ){
+		fprintf( stdout, "failed!\n");
+	}
+	tempering_free( t);
+
+	for( k=0; k<NREP; k++){
+		state_free( s[k]);
+	}
+}
+
+void thread_fail_test(){
+	int k, result;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {10., 10., 10.};
+	tempering_params tp = { 3, 2, { 1., 1, 10, 778u, 0., 0, 0}};
+	double beta[NREP] = { 0.5, 1., 2., 4.};
+	state *s[NREP];
+	tempering *t;
+
+	fprintf( stdout, "Testing tempering_malloc when a thread cannot be started: ");
+	result = 1;
+	for( k=0; k<NREP; k++){
+		s[k] = state_malloc( cp, box, 100);
+		result = result && state_uniform_initialize( s[k]);
+	}
+	/* the second helper fails to start, the first has to be let go */
+	fail_thread = 1;
+	t = tempering_malloc( s, beta, NREP, tp);
+	fail_thread = -1;
+	result = result && ( t == NULL );
+	t = tempering_malloc( s, beta, NREP, tp);
+	result = result && ( t != NULL ) && tempering_run( t, 4);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	if( t != NULL ){
+		tempering_free( t);
+	}
+	for( k=0; k<NREP; k++){
+		state_free( s[k]);
+	}
+}
+
+int main(){
+	tempering_test();
+	thread_fail_test();
+	return 0;
+}
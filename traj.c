@@ -0,0 +1,327 @@
+/*!*******************************************************************
+ * traj.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * This file contains a binary trajectory format for the manybody
+ * state in `manybody.c`. A trajectory file is a fixed size header
+ * followed by any number of frames. Every frame has the same size, so
+ * frame `k` starts at `sizeof(traj_header) + k*frame_bytes`, and can
+ * be found without reading any of the frames before it.
+ *
+ * A frame is the step number (a 64 bit integer) followed by the
+ * cylinder data stored by column: all `n` of the `p.x`, then all the
+ * `p.y`, and so on through `p.z`, `d.x`, `d.y`, `d.z` and `r`. The
+ * numbers are written as raw doubles, so nothing is lost, and an
+ * analysis code can read a single column of a single frame.
+ *
+ * The reader maps the whole file into memory, and hands out pointers
+ * straight into the mapping. The number of frames is worked out from
+ * the size of the file, so a trajectory that is still being written
+ * (or whose writer crashed) can be read up to the last whole frame.
+ * The data is in the byte order of the machine that wrote it; the
+ * header holds a check value so that a file from a machine with the
+ * other byte order is rejected rather than misread.
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vecs.h"
+#include "cylinders.h"
+#include "manybody.h"
+
+#define TRAJ_MAGIC "CYLTRAJ"
+#define TRAJ_VERSION 1
+#define TRAJ_ENDIAN 0x01020304
+
+/*!
+ * Trajectory file header
+ *
+ * + `magic` the string "CYLTRAJ"
+ * + `version` the format version
+ * + `endian` the check value 0x01020304 in the byte order of the writer
+ * + `n` number of cylinders
+ * + `box` the box size
+ * + `r`, `l` the cylinder parameters
+ * + `frame_bytes` the size of one frame
+ * The header is padded to 128 bytes, which leaves room for more
+ * fields in later versions. The frames are only 8 byte aligned, since
+ * a frame is 8 bytes of step number plus `56n` bytes of columns.
+ */
+typedef struct{
+	char magic[8];
+	uint32_t version;
+	uint32_t endian;
+	int64_t n;
+	double box[3];
+	double r, l;
+	int64_t frame_bytes;
+	char pad[56];
+} traj_header;
+
+/*!
+ * Trajectory writer
+ *
+ * + `file` the open trajectory file
+ * + `h` the header written at the start of the file
+ * + `buf` space for the 7 columns of one frame
+ * + `frames` number of frames written
+ */
+typedef struct{
+	FILE *file;
+	traj_header h;
+	double *buf;
+	long frames;
+} traj_writer;
+
+/*!
+ * A single frame, pointing into the mapped file
+ *
+ * + `step` the step number given when the frame was written
+ * + `px`, `py`, `pz`, `dx`, `dy`, `dz`, `r` the columns, each `n` long
+ */
+typedef struct{
+	int64_t step;
+	const double *px, *py, *pz;
+	const double *dx, *dy, *dz;
+	const double *r;
+} traj_frame;
+
+/*!
+ * Trajectory reader
+ *
+ * + `h` the header of the file
+ * + `frames` number of whole frames in the file
+ * + `size` the size of the mapping
+ * + `map` the mapped file
+ */
+typedef struct{
+	traj_header h;
+	long frames;
+	size_t size;
+	const char *map;
+} traj_reader;
+
+/*!
+ * Constructor for a trajectory writer.
+ *
+ * Creates (or truncates) the file `path` and writes the header using
+ * the box, cylinder parameters and number of cylinders from `s`.
+ * Returns `NULL` if the file can not be written or any allocation
+ * fails.
+ */
+traj_writer* traj_writer_malloc( const char *path, state *s){
+	traj_writer *w = (traj_writer *) malloc( sizeof(traj_writer));
+	if( w == NULL ){
+		return NULL;
+	}
+	w->buf = (double *) malloc( 7*s->n*sizeof(double));
+	w->file = fopen( path, "wb");
+	if( w->buf == NULL || w->file == NULL ){
+		if( w->file != NULL ){
+			fclose( w->file);
+		}
+		free( w->buf);
+		free( w);
+		return NULL;
+	}
+	memset( &(w->h), 0, sizeof(traj_header));
+	memcpy( w->h.magic, TRAJ_MAGIC, sizeof(TRAJ_MAGIC));
+	w->h.version = TRAJ_VERSION;
+	w->h.endian = TRAJ_ENDIAN;
+	w->h.n = s->n;
+	w->h.box[0] = s->box.x;
+	w->h.box[1] = s->box.y;
+	w->h.box[2] = s->box.z;
+	w->h.r = s->cp.r;
+	w->h.l = s->cp.l;
+	w->h.frame_bytes = sizeof(int64_t) + 7*s->n*sizeof(double);
+	w->frames = 0;
+	if( fwrite( &(w->h), sizeof(traj_header), 1, w->file) != 1 ){
+		fclose( w->file);
+		free( w->buf);
+		free( w);
+		return NULL;
+	}
+	return w;
+}
+
+/*!
+ * Destructor for a trajectory writer, closes the file.
+ */
+void traj_writer_free( traj_writer *w){
+	fclose( w->file);
+	free( w->buf);
+	free( w);
+}
+
+/*!
+ * Gather the cylinders of `s` into the 7 columns of a frame.
+ *
+ * `b` must have room for `7*s->n` doubles.
+ */
+void traj_gather( state *s, double *b){
+	int i, n = s->n;
+	cyl c;
+	for( i=0; i<n; i++){
+		c = s->a[i].c;
+		b[i] = c.p.x;
+		b[n+i] = c.p.y;
+		b[2*n+i] = c.p.z;
+		b[3*n+i] = c.d.x;
+		b[4*n+i] = c.d.y;
+		b[5*n+i] = c.d.z;
+		b[6*n+i] = c.r;
+	}
+}
+
+/*!
+ * Append a frame already gathered into columns (see `traj_gather`).
+ *
+ * Returns 0 if the write fails.
+ */
+int traj_write_cols( traj_writer *w, const double *b, int64_t step){
+	size_t m = 7*w->h.n;
+	if( fwrite( &step, sizeof(int64_t), 1, w->file) != 1 ||
+		fwrite( b, sizeof(double), m, w->file) != m ||
+		fflush( w->file) != 0 ){
+		return 0;
+	}
+	w->frames++;
+	return 1;
+}
+
+/*!
+ * Append the state `s` as a new frame, labeled with `step`.
+ *
+ * The cylinders are gathered into columns and written with a single
+ * call. Returns 0 if the state does not match the header or the write
+ * fails.
+ */
+int traj_append( traj_writer *w, state *s, int64_t step){
+	if( s->n != w->h.n ){
+		return 0;
+	}
+	traj_gather( s, w->buf);
+	return traj_write_cols( w, w->buf, step);
+}
+
+/*!
+ * Constructor for a trajectory reader.
+ *
+ * Maps the file `path` read only. Returns `NULL` if the file can not
+ * be opened or mapped, or the header does not match this format.
+ */
+traj_reader* traj_reader_malloc( const char *path){
+	struct stat st;
+	void *map;
+	int fd;
+	traj_reader *t;
+
+	fd = open( path, O_RDONLY);
+	if( fd < 0 ){
+		return NULL;
+	}
+	if( fstat( fd, &st) != 0 || st.st_size < (off_t) sizeof(traj_header) ){
+		close( fd);
+		return NULL;
+	}
+	map = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close( fd);
+	if( map == MAP_FAILED ){
+		return NULL;
+	}
+	t = (traj_reader *) malloc( sizeof(traj_reader));
+	if( t == NULL ){
+		munmap( map, st.st_size);
+		return NULL;
+	}
+	t->map = (const char *) map;
+	t->size = st.st_size;
+	memcpy( &(t->h), map, sizeof(traj_header));
+	if( memcmp( t->h.magic, TRAJ_MAGIC, sizeof(TRAJ_MAGIC)) != 0 ||
+		t->h.version != TRAJ_VERSION || t->h.endian != TRAJ_ENDIAN ||
+		t->h.frame_bytes != (int64_t) (sizeof(int64_t) + 7*t->h.n*sizeof(double)) ){
+		munmap( map, st.st_size);
+		free( t);
+		return NULL;
+	}
+	t->frames = (t->size - sizeof(traj_header))/t->h.frame_bytes;
+	madvise( map, st.st_size, MADV_RANDOM);
+	return t;
+}
+
+/*!
+ * Destructor for a trajectory reader, unmaps the file.
+ */
+void traj_reader_free( traj_reader *t){
+	munmap( (void *) t->map, t->size);
+	free( t);
+}
+
+/*!
+ * Get frame `k`.
+ *
+ * The columns point into the mapped file, and are only valid until
+ * the reader is freed. `k` must be less than `t->frames`.
+ */
+traj_frame traj_get_frame( traj_reader *t, long k){
+	traj_frame f;
+	int64_t n = t->h.n;
+	const char *base = t->map + sizeof(traj_header) + k*t->h.frame_bytes;
+	const double *col = (const double *) (base + sizeof(int64_t));
+	memcpy( &(f.step), base, sizeof(int64_t));
+	f.px = col;
+	f.py = col + n;
+	f.pz = col + 2*n;
+	f.dx = col + 3*n;
+	f.dy = col + 4*n;
+	f.dz = col + 5*n;
+	f.r = col + 6*n;
+	return f;
+}
+
+/*!
+ * Get cylinder `i` from a frame.
+ */
+cyl traj_get_cyl( traj_frame f, int i){
+	cyl c;
+	c.p.x = f.px[i]; c.p.y = f.py[i]; c.p.z = f.pz[i];
+	c.d.x = f.dx[i]; c.d.y = f.dy[i]; c.d.z = f.dz[i];
+	c.r = f.r[i];
+	return c;
+}
+
+/*!
+ * Load frame `k` into a state.
+ *
+ * The state must have the same number of cylinders and box as the
+ * trajectory. The buckets are rebuilt and the cached energies are
+ * marked out of date. Returns 0 if the state does not match.
+ */
+int traj_load( traj_reader *t, long k, state *s){
+	int i;
+	traj_frame f;
+	if( k < 0 || k >= t->frames || s->n != t->h.n ||
+		s->box.x != t->h.box[0] || s->box.y != t->h.box[1] || s->box.z != t->h.box[2] ){
+		return 0;
+	}
+	f = traj_get_frame( t, k);
+	state_empty_buckets( s);
+	for( i=0; i<s->n; i++){
+		s->a[i].c = traj_get_cyl( f, i);
+		cyl_list_add( s, i);
+	}
+	s->u_valid = 0;
+	return 1;
+}
@@ -0,0 +1,56 @@
+/*!*******************************************************************
+ * traj.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifndef JW_TRAJ
+#define JW_TRAJ
+
+typedef struct{
+	char magic[8];
+	uint32_t version;
+	uint32_t endian;
+	int64_t n;
+	double box[3];
+	double r, l;
+	int64_t frame_bytes;
+	char pad[56];
+} traj_header;
+
+typedef struct{
+	FILE *file;
+	traj_header h;
+	double *buf;
+	long frames;
+} traj_writer;
+
+typedef struct{
+	int64_t step;
+	const double *px, *py, *pz;
+	const double *dx, *dy, *dz;
+	const double *r;
+} traj_frame;
+
+typedef struct{
+	traj_header h;
+	long frames;
+	size_t size;
+	const char *map;
+} traj_reader;
+
+traj_writer* traj_writer_malloc( const char *path, state *s);
+void traj_writer_free( traj_writer *w);
+void traj_gather( state *s, double *b);
+int traj_write_cols( traj_writer *w, const double *b, int64_t step);
+int traj_append( traj_writer *w, state *s, int64_t step);
+traj_reader* traj_reader_malloc( const char *path);
+void traj_reader_free( traj_reader *t);
+traj_frame traj_get_frame( traj_reader *t, long k);
+cyl traj_get_cyl( traj_frame f, int i);
+int traj_load( traj_reader *t, long k, state *s);
+
+#endif /* JW_TRAJ */
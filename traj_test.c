@@ -0,0 +1,109 @@
+/*!*******************************************************************
+ * traj_test.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+
+#include "traj.c"
+#include "rng.h"
+#include "distributions.h"
+#include "lennardjones.h"
+#include "ljtable.h"
+#include "cellstore.h"
+#include "nlist.h"
+#include "montecarlo.h"
+
+#define NF 5
+
+void traj_test(){
+	int i, k, result;
+	rng g;
+	cyl c;
+	cyl_params cp = {0.2, 1.};
+	vec3 box = {10., 10., 10.};
+	state *s = state_malloc( cp, box, 200);
+	state *ss = state_malloc( cp, box, 200);
+	cyl saved[NF][200];
+	traj_writer *w;
+	traj_reader *t;
+	traj_frame f;
+
+	rng_seed( &g, 8);
+	state_uniform_initialize( s);
+
+	fprintf( stdout, "Testing traj_append: ");
+	w = traj_writer_malloc( "test_traj.bin", s);
+	result = ( w != NULL );
+	for( k=0; k<NF && result; k++){
+		for( i=0; i<s->n; i++){
+			c = move_cyl( s->a[i].c, &g);
+			if( cyl_box_overlap( c, box) ){
+				s->a[i].c.d = c.d;
+				cyl_list_move( s, i, c.p);
+			}
+			saved[k][i] = s->a[i].c;
+		}
+		result = result && traj_append( w, s, 100*k);
+	}
+	result = result && ( w->frames == NF );
+	traj_writer_free( w);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing traj_get_frame: ");
+	t = traj_reader_malloc( "test_traj.bin");
+	result = ( t != NULL ) && ( t->frames == NF ) && ( t->h.n == s->n );
+	result = result && ( t->h.box[1] == box.y && t->h.l == cp.l );
+	/* read the frames backwards to check the random access */
+	for( k=NF-1; k>=0 && result; k--){
+		f = traj_get_frame( t, k);
+		result = ( f.step == 100*k );
+		for( i=0; i<s->n; i++){
+			c = traj_get_cyl( f, i);
+			result = result && ( memcmp( &c, &(saved[k][i]), sizeof(cyl)) == 0 );
+		}
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing traj_load: ");
+	result = traj_load( t, 2, ss);
+	for( i=0; i<ss->n; i++){
+		result = result && ( ss->a[i].c.p.x == saved[2][i].p.x );
+		result = result && ( ss->a[i].c.d.z == saved[2][i].d.z );
+	}
+	result = result && !traj_load( t, NF, ss);
+	/* the last frame is the current state */
+	result = result && traj_load( t, NF-1, ss);
+	result = result && ( fabs( state_energy( ss) - state_energy( s)) < 1.0e-9 );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	traj_reader_free( t);
+
+	fprintf( stdout, "Testing traj_reader_malloc: ");
+	result = ( traj_reader_malloc( "test_traj_missing.bin") == NULL );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	state_free( ss);
+	state_free( s);
+}
+
+int main(){
+	traj_test();
+	return 0;
+}
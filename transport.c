@@ -0,0 +1,311 @@
+/*!*******************************************************************
+ * transport.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * This file contains the message transport used by the domain
+ * decomposition in `domain.c`. A transport connects `size` processes,
+ * each with its own `rank`, and all the communication goes through a
+ * single operation, `transport_exchange`, which sends one message to
+ * a rank and receives one message from a rank at the same time (like
+ * `MPI_Sendrecv`). Doing both at once means a ring of processes that
+ * all send to the right and receive from the left can never deadlock.
+ *
+ * The transport is an interface: a struct holding the rank, the size,
+ * a context pointer and the functions that do the work. Another
+ * implementation (MPI, shared memory rings, ...) only has to fill in
+ * the same struct.
+ *
+ * The implementation here uses local (unix domain) sockets, so it
+ * runs on a single Linux box. `transport_local_malloc` opens a socket
+ * pair between every two ranks, and is meant to be called before
+ * forking the processes. Each process then calls
+ * `transport_local_attach` with its rank, which closes the ends it
+ * does not use. A message is its length (8 bytes) followed by the
+ * data. Sending to and receiving from the own rank copies the data.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+/*!
+ * Message transport
+ *
+ * + `rank`, `size` the rank of this process and the number of
+ *   processes
+ * + `ctx` data for the implementation
+ * + `exchange` send `slen` bytes from `sbuf` to rank `to`, and receive
+ *   a message from rank `from`. The received message is left in a
+ *   buffer owned by the transport, which stays valid until the next
+ *   exchange, and its address and length are stored in `rbuf` and
+ *   `rlen`. Returns 0 on failure.
+ * + `close` release the resources of the implementation
+ */
+typedef struct transport_struct{
+	int rank, size;
+	void *ctx;
+	int (*exchange)( struct transport_struct *t, int to, const void *sbuf, size_t slen,
+					 int from, void **rbuf, size_t *rlen);
+	void (*close)( struct transport_struct *t);
+} transport;
+
+/*!
+ * Data for the local socket transport
+ *
+ * + `fd` the socket from rank `i` to rank `j` is `fd[i*size+j]`, or
+ *   -1 if it is not open in this process
+ * + `buf` the receive buffer of `buf_max` bytes
+ */
+typedef struct{
+	int *fd;
+	char *buf;
+	size_t buf_max;
+} transport_local;
+
+/*!
+ * Make sure the receive buffer holds `len` bytes.
+ */
+static int transport_local_reserve( transport_local *tl, size_t len){
+	char *tmp;
+	if( len <= tl->buf_max ){
+		return 1;
+	}
+	tmp = (char *) realloc( tl->buf, len);
+	if( tmp == NULL ){
+		return 0;
+	}
+	tl->buf = tmp;
+	tl->buf_max = len;
+	return 1;
+}
+
+/*!
+ * Exchange for the local socket transport.
+ *
+ * The sockets are non-blocking, and `poll` is used to keep sending
+ * and receiving until both messages are through. The sends use
+ * `MSG_NOSIGNAL`, so a rank whose peer has gone away gets `EPIPE` (and
+ * returns 0) rather than being killed by `SIGPIPE`. A hang up is
+ * handled on the descriptor that reported it: on the socket being
+ * sent to it makes the send fail, on the one being received from it
+ * makes the read see the end of the stream.
+ */
+static int transport_local_exchange( transport *t, int to, const void *sbuf, size_t slen,
+									 int from, void **rbuf, size_t *rlen){
+	transport_local *tl = (transport_local *) t->ctx;
+	uint64_t shead, rhead;
+	size_t sdone, rdone, rtot;
+	struct pollfd pfd[2];
+	int fs, fr, np, ks, kr, k;
+	ssize_t m;
+
+	if( to == t->rank || from == t->rank ){
+		/* only a message to ourselves can be received from ourselves */
+		if( to != from ){
+			return 0;
+		}
+		if( !transport_local_reserve( tl, slen) ){
+			return 0;
+		}
+		memcpy( tl->buf, sbuf, slen);
+		*rbuf = tl->buf;
+		*rlen = slen;
+		return 1;
+	}
+
+	fs = tl->fd[t->rank*t->size + to];
+	fr = tl->fd[t->rank*t->size + from];
+	shead = slen;
+	sdone = 0;
+	rdone = 0;
+	rtot = sizeof(uint64_t);
+	while( sdone < sizeof(uint64_t) + slen || rdone < rtot ){
+		/* `ks` and `kr` are the entries for sending and receiving, or -1 */
+		np = 0;
+		ks = -1;
+		kr = -1;
+		if( sdone < sizeof(uint64_t) + slen ){
+			ks = np;
+			pfd[np].fd = fs;
+			pfd[np].events = POLLOUT;
+			np++;
+		}
+		if( rdone < rtot ){
+			if( ks >= 0 && fs == fr ){
+				kr = ks;
+				pfd[kr].events |= POLLIN;
+			}else{
+				kr = np;
+				pfd[np].fd = fr;
+				pfd[np].events = POLLIN;
+				np++;
+			}
+		}
+		if( poll( pfd, np, -1) < 0 ){
+			if( errno == EINTR ){
+				continue;
+			}
+			return 0;
+		}
+		for( k=0; k<np; k++){
+			if( pfd[k].revents & (POLLERR | POLLNVAL) ){
+				return 0;
+			}
+		}
+		if( ks >= 0 && (pfd[ks].revents & (POLLOUT | POLLHUP)) ){
+			if( sdone < sizeof(uint64_t) ){
+				m = send( fs, ((char *) &shead) + sdone, sizeof(uint64_t) - sdone,
+						  MSG_NOSIGNAL);
+			}else{
+				m = send( fs, ((const char *) sbuf) + (sdone - sizeof(uint64_t)),
+						  slen - (sdone - sizeof(uint64_t)), MSG_NOSIGNAL);
+			}
+			if( m < 0 && errno != EAGAIN && errno != EINTR ){
+				return 0;
+			}
+			sdone += (m > 0)?m:0;
+		}
+		if( kr >= 0 && (pfd[kr].revents & (POLLIN | POLLHUP)) ){
+			if( rdone < sizeof(uint64_t) ){
+				m = read( fr, ((char *) &rhead) + rdone, sizeof(uint64_t) - rdone);
+			}else{
+				m = read( fr, tl->buf + (rdone - sizeof(uint64_t)),
+						  rtot - rdone);
+			}
+			if( m == 0 || (m < 0 && errno != EAGAIN && errno != EINTR) ){
+				return 0;
+			}
+			rdone += (m > 0)?m:0;
+			if( rdone == sizeof(uint64_t) && rtot == sizeof(uint64_t) ){
+				if( !transport_local_reserve( tl, rhead) ){
+					return 0;
+				}
+				rtot += rhead;
+			}
+		}
+	}
+	*rbuf = tl->buf;
+	*rlen = rtot - sizeof(uint64_t);
+	return 1;
+}
+
+/*!
+ * Close the sockets of this process and free the context.
+ */
+static void transport_local_close( transport *t){
+	transport_local *tl = (transport_local *) t->ctx;
+	int k;
+	for( k=0; k<t->size*t->size; k++){
+		if( tl->fd[k] >= 0 ){
+			close( tl->fd[k]);
+		}
+	}
+	free( tl->fd);
+	free( tl->buf);
+	free( tl);
+}
+
+/*!
+ * Constructor for the local socket transport.
+ *
+ * Opens a socket pair between every two of the `size` ranks. This
+ * should be called before forking, and every process should then
+ * call `transport_local_attach`. Returns `NULL` if an allocation or a
+ * socket fails.
+ */
+transport* transport_local_malloc( int size){
+	transport *t;
+	transport_local *tl;
+	int i, j, sv[2];
+
+	t = (transport *) malloc( sizeof(transport));
+	tl = (transport_local *) malloc( sizeof(transport_local));
+	if( t == NULL || tl == NULL ){
+		free( t);
+		free( tl);
+		return NULL;
+	}
+	tl->fd = (int *) malloc( size*size*sizeof(int));
+	if( tl->fd == NULL ){
+		free( t);
+		free( tl);
+		return NULL;
+	}
+	tl->buf = NULL;
+	tl->buf_max = 0;
+	t->rank = -1;
+	t->size = size;
+	t->ctx = tl;
+	t->exchange = transport_local_exchange;
+	t->close = transport_local_close;
+	for( i=0; i<size*size; i++){
+		tl->fd[i] = -1;
+	}
+	for( i=0; i<size; i++){
+		for( j=i+1; j<size; j++){
+			if( socketpair( AF_UNIX, SOCK_STREAM, 0, sv) != 0 ){
+				transport_local_close( t);
+				free( t);
+				return NULL;
+			}
+			tl->fd[i*size+j] = sv[0];
+			tl->fd[j*size+i] = sv[1];
+		}
+	}
+	return t;
+}
+
+/*!
+ * Take the place of rank `rank` in a local socket transport.
+ *
+ * Closes the sockets that belong to the other ranks, and makes the
+ * remaining ones non-blocking. Returns 0 on failure.
+ */
+int transport_local_attach( transport *t, int rank){
+	transport_local *tl = (transport_local *) t->ctx;
+	int i, j, flags;
+	t->rank = rank;
+	for( i=0; i<t->size; i++){
+		for( j=0; j<t->size; j++){
+			if( tl->fd[i*t->size+j] < 0 ){
+				continue;
+			}
+			if( i != rank ){
+				close( tl->fd[i*t->size+j]);
+				tl->fd[i*t->size+j] = -1;
+			}else{
+				flags = fcntl( tl->fd[i*t->size+j], F_GETFL, 0);
+				if( flags < 0 || fcntl( tl->fd[i*t->size+j], F_SETFL, flags | O_NONBLOCK) < 0 ){
+					return 0;
+				}
+			}
+		}
+	}
+	return 1;
+}
+
+/*!
+ * Destructor for any transport.
+ */
+void transport_free( transport *t){
+	t->close( t);
+	free( t);
+}
+
+/*!
+ * Send a message to rank `to` and receive one from rank `from`.
+ *
+ * See the `exchange` member of the transport.
+ */
+int transport_exchange( transport *t, int to, const void *sbuf, size_t slen,
+						int from, void **rbuf, size_t *rlen){
+	return t->exchange( t, to, sbuf, slen, from, rbuf, rlen);
+}
@@ -0,0 +1,26 @@
+/*!*******************************************************************
+ * transport.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stddef.h>
+
+#ifndef JW_TRANSPORT
+#define JW_TRANSPORT
+
+typedef struct transport_struct{
+	int rank, size;
+	void *ctx;
+	int (*exchange)( struct transport_struct *t, int to, const void *sbuf, size_t slen,
+					 int from, void **rbuf, size_t *rlen);
+	void (*close)( struct transport_struct *t);
+} transport;
+
+transport* transport_local_malloc( int size);
+int transport_local_attach( transport *t, int rank);
+void transport_free( transport *t);
+int transport_exchange( transport *t, int to, const void *sbuf, size_t slen,
+						int from, void **rbuf, size_t *rlen);
+
+#endif /* JW_TRANSPORT */
@@ -0,0 +1,132 @@
+/*!*******************************************************************
+ * transport_test.c
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "transport.c"
+
+#define NPROC 3
+#define NBIG 100000
+
+/*!
+ * Pass a message around the ring, every rank sends to the right and
+ * receives from the left at the same time. The big message is well
+ * over the socket buffer size. Returns 1 if every message arrived
+ * intact.
+ */
+int transport_ring( transport *t){
+	static int big[NBIG];
+	int right = (t->rank+1)%t->size, left = (t->rank+t->size-1)%t->size;
+	int k, ok, *in;
+	void *rbuf;
+	size_t rlen;
+
+	ok = transport_exchange( t, right, &(t->rank), sizeof(int), left, &rbuf, &rlen);
+	ok = ok && ( rlen == sizeof(int) ) && ( *((int *) rbuf) == left );
+	for( k=0; k<NBIG; k++){
+		big[k] = k*t->size + t->rank;
+	}
+	ok = ok && transport_exchange( t, right, big, sizeof(big), left, &rbuf, &rlen);
+	ok = ok && ( rlen == sizeof(big) );
+	in = (int *) rbuf;
+	for( k=0; ok && k<NBIG; k++){
+		ok = ( in[k] == k*t->size + left );
+	}
+	/* empty messages both ways */
+	ok = ok && transport_exchange( t, left, NULL, 0, right, &rbuf, &rlen) && ( rlen == 0 );
+	return ok;
+}
+
+void transport_test(){
+	int k, result, status;
+	pid_t pid[NPROC];
+	transport *t;
+	void *rbuf;
+	size_t rlen;
+
+	fprintf( stdout, "Testing transport_local_malloc: ");
+	t = transport_local_malloc( NPROC);
+	result = ( t != NULL );
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+		return;
+	}
+
+	fprintf( stdout, "Testing transport_exchange: ");
+	fflush( stdout);
+	for( k=1; k<NPROC; k++){
+		pid[k] = fork();
+		if( pid[k] == 0 ){
+			result = transport_local_attach( t, k) && transport_ring( t);
+			transport_free( t);
+			_exit( result?0:1);
+		}
+	}
+	result = transport_local_attach( t, 0) && transport_ring( t);
+	transport_free( t);
+	for( k=1; k<NPROC; k++){
+		result = ( waitpid( pid[k], &status, 0) == pid[k] ) && result;
+		result = result && WIFEXITED( status) && ( WEXITSTATUS( status) == 0 );
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	/* rank 1 leaves at once, rank 0 sends to it and listens to rank 2,
+	 * which waits for a message from rank 0 that never comes */
+	fprintf( stdout, "Testing transport_exchange with a rank that has exited: ");
+	fflush( stdout);
+	t = transport_local_malloc( NPROC);
+	result = ( t != NULL );
+	for( k=1; result && k<NPROC; k++){
+		pid[k] = fork();
+		if( pid[k] == 0 ){
+			result = transport_local_attach( t, k);
+			if( k == 2 ){
+				result = result && !transport_exchange( t, 0, &k, sizeof(int), 0, &rbuf, &rlen);
+			}
+			transport_free( t);
+			_exit( result?0:1);
+		}
+	}
+	if( result ){
+		result = ( waitpid( pid[1], &status, 0) == pid[1] );
+		result = result && transport_local_attach( t, 0);
+		result = result && !transport_exchange( t, 1, &k, sizeof(int), 2, &rbuf, &rlen);
+		transport_free( t);
+		result = result && WIFEXITED( status) && ( WEXITSTATUS( status) == 0 );
+		result = ( waitpid( pid[2], &status, 0) == pid[2] ) && result;
+		result = result && WIFEXITED( status) && ( WEXITSTATUS( status) == 0 );
+	}
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+
+	fprintf( stdout, "Testing transport_exchange with one rank: ");
+	t = transport_local_malloc( 1);
+	result = ( t != NULL ) && transport_local_attach( t, 0) && transport_ring( t);
+	if( result ){
+		fprintf( stdout, "passed!\n");
+	}else{
+		fprintf( stdout, "failed!\n");
+	}
+	if( t != NULL ){
+		transport_free( t);
+	}
+}
+
+int main(){
+	transport_test();
+	return 0;
+}
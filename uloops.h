@@ -0,0 +1,142 @@
+/*!*******************************************************************
+ * uloops.h
+ * jefwagner@gmail.com
+ *********************************************************************
+ */
+/*!
+ * Energy loops for one pair potential
+ *
+ * This file has no include guard. montecarlo.c includes it once for
+ * every pair potential, after defining
+ * + `POT_NAME` the name of the potential
+ * + `POT_PAIR` the pair energy `POT_PAIR( c1, c2)`, a `static inline`
+ *   function so it is inlined into every loop
+ * + `POT_MIN` a lower bound on the pair energy, for the early exits
+ * and each time it defines `u_i_NAME`, `u_i_budget_NAME`,
+ * `u_shift_NAME`, `u_i_nlist_NAME` and `u_i_nlist_budget_NAME`. These
+ * are the loops behind `u_i`, `u_i_budget`, `u_shift`, `u_i_nlist`
+ * and `u_i_nlist_budget` (see montecarlo.c for what they do), with
+ * nothing in the loop but the pair energy itself.
+ */
+
+#define POT_CAT2(f, name) f##_##name
+#define POT_CAT(f, name) POT_CAT2(f, name)
+#define POT_FN(f) POT_CAT(f, POT_NAME)
+
+static double POT_FN(u_i)( state *s, int index, cyl c){
+	int t, nn, nbr[NBR_MAX];
+	vec3 ctr;
+	cyl_ll *old, *cur;
+	double u;
+
+	c.p = state_wrap( s, c.p);
+	ctr = cyl_point( c, 0.5);
+	nn = state_neighbors( s, bucket_index( s, c.p), nbr);
+
+	old = &(s->a[index]);
+	u = 0.;
+	for( t=0; t<nn; t++){
+		for( cur = s->heads[nbr[t]]; cur != NULL; cur = cur->next){
+			if( cur != old ){
+				u += POT_PAIR( state_image( s, cur->c, ctr), c);
+			}
+		}
+	}
+
+	return u;
+}
+
+static double POT_FN(u_i_budget)( state *s, int index, cyl c, double budget){
+	int t, nn, left, nbr[NBR_MAX];
+	vec3 ctr;
+	cyl_ll *old, *cur;
+	double u;
+
+	c.p = state_wrap( s, c.p);
+	ctr = cyl_point( c, 0.5);
+	nn = state_neighbors( s, bucket_index( s, c.p), nbr);
+
+	left = 0;
+	for( t=0; t<nn; t++){
+		for( cur = s->heads[nbr[t]]; cur != NULL; cur = cur->next){
+			left++;
+		}
+	}
+	old = &(s->a[index]);
+	u = 0.;
+	for( t=0; t<nn; t++){
+		for( cur = s->heads[nbr[t]]; cur != NULL; cur = cur->next){
+			if( cur != old ){
+				u += POT_PAIR( state_image( s, cur->c, ctr), c);
+			}
+			left--;
+			if( u + POT_MIN*left >= budget ){
+				return u + POT_MIN*left;
+			}
+		}
+	}
+	return u;
+}
+
+static double POT_FN(u_shift)( state *s, int index, cyl c, double sign){
+	int t, nn, nbr[NBR_MAX];
+	vec3 ctr;
+	cyl_ll *old, *cur;
+	double u, e;
+
+	ctr = cyl_point( c, 0.5);
+	nn = state_neighbors( s, bucket_index( s, c.p), nbr);
+
+	old = &(s->a[index]);
+	u = 0.;
+	for( t=0; t<nn; t++){
+		for( cur = s->heads[nbr[t]]; cur != NULL; cur = cur->next){
+			if( cur != old ){
+				e = POT_PAIR( state_image( s, cur->c, ctr), c);
+				atomic_add( &(s->u[cur - s->a]), sign*e);
+				u += e;
+			}
+		}
+	}
+	return u;
+}
+
+static double POT_FN(u_i_nlist)( state *s, nlist *nl, int index, cyl c){
+	int q;
+	vec3 ctr;
+	double u;
+
+	if( !nlist_valid( nl, index, c) ){
+		return POT_FN(u_i)( s, index, c);
+	}
+	ctr = cyl_point( c, 0.5);
+	u = 0.;
+	for( q=nl->start[index]; q<nl->start[index+1]; q++){
+		u += POT_PAIR( state_image( s, s->a[nl->list[q]].c, ctr), c);
+	}
+	return u;
+}
+
+static double POT_FN(u_i_nlist_budget)( state *s, nlist *nl, int index, cyl c, double budget){
+	int q, q_end;
+	vec3 ctr;
+	double u;
+
+	if( !nlist_valid( nl, index, c) ){
+		return POT_FN(u_i_budget)( s, index, c, budget);
+	}
+	ctr = cyl_point( c, 0.5);
+	u = 0.;
+	q_end = nl->start[index+1];
+	for( q=nl->start[index]; q<q_end; q++){
+		u += POT_PAIR( state_image( s, s->a[nl->list[q]].c, ctr), c);
+		if( u + POT_MIN*(q_end-q-1) >= budget ){
+			return u + POT_MIN*(q_end-q-1);
+		}
+	}
+	return u;
+}
+
+#undef POT_FN
+#undef POT_CAT
+#undef POT_CAT2
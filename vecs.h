@@ -5,6 +5,28 @@
  */
 
 #include <math.h>
+#include <float.h>
+
+#ifndef JW_COORD
+#define JW_COORD
+/*!
+ * Coordinate precision
+ *
+ * The components of `vec2` and `vec3`, and with them the positions,
+ * orientations and radii of stored cylinders, are `double` by
+ * default. Compiling every file with `CYL_FLOAT` defined stores them
+ * as `float` instead, which halves the size of a cylinder. Energies
+ * and other sums are kept in `double` either way. `COORD_EPSILON` is
+ * the machine epsilon of the stored coordinates.
+ */
+#ifdef CYL_FLOAT
+typedef float coord;
+#define COORD_EPSILON FLT_EPSILON
+#else
+typedef double coord;
+#define COORD_EPSILON DBL_EPSILON
+#endif
+#endif
 
 #ifndef JW_VEC2
 #define JW_VEC2
@@ -28,7 +50,7 @@
  * vec2_rotto : in place rotation
  * vec2_dist : distance between two 2-vectors
  */
-typedef struct{ double x, y; } vec2;
+typedef struct{ coord x, y; } vec2;
 
 static inline vec2 vec2_add( vec2 p0, vec2 p1){
 	vec2 pout;
@@ -148,7 +170,7 @@ static inline double vec2_dist( vec2 p0, vec2 p1){
  * vec3_rotAAto : in place axis angle rotation
  * vec3_dist : distance between two 3-vectors
  */
-typedef struct{ double x, y, z; } vec3;
+typedef struct{ coord x, y, z; } vec3;
 
 static inline vec3 vec3_add( vec3 p0, vec3 p1){
 	vec3 pout;
@@ -259,21 +281,7 @@ static inline vec3 vec3_rotAA( vec3 v, vec3 u, double th ){
 }
 
 static inline void vec3_rotAAto( vec3 *v, vec3 u, double th ){
-	double x, y;
-	double c = cos(th);
-	double s = sin(th);
-	vec3_unitto( &u);
-	x = (c + u.x*u.x*(1.-c))*v->x;
-	x += (u.x*u.y*(1.-c)-u.z*s)*v->y;
-	x += (u.x*u.z*(1.-c)+u.y*s)*v->z;
-	y = (u.y*u.x*(1.-c)+u.z*s)*v->x;
-	y += (c + u.y*u.y*(1.-c))*v->y;
-	y += (u.y*u.z*(1.-c)-u.x*s)*v->z;
-	v->z = (u.z*u.x*(1-c)-u.y*s)*v->x;
-	v->z += (u.z*u.y*(1-c)+u.x*s)*v->y;
-	v->z += (c + u.z*u.z*(1-c))*v->z;
-	v->x = x;
-	v->y = y;
+	*v = vec3_rotAA( *v, u, th);
 }
 
 static inline double vec3_dist( vec3 p0, vec3 p1){